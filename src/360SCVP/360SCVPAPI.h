@@ -27,6 +27,7 @@
 #define _360SCVP_API_H_
 #include "stdint.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,8 +42,11 @@ extern "C" {
 #define ID_SCVP_PARAM_SEI_VIEWPORT         1006
 #define ID_SCVP_BITSTREAMS_HEADER          1007
 #define ID_SCVP_RWPK_INFO                  1008
+#define ID_SCVP_PARAM_MAPPING_THREADS      1009 //int32_t, the number of threads to map the viewport to the source
+#define ID_SCVP_PARAM_MERGE_THREADS        1010 //int32_t, the number of threads to merge the selected tiles
 
 #define DEFAULT_REGION_NUM                 1000
+#define MAX_MID_TIER_NUM                   4    //the most tiers between the high and the low resolution streams
 
 typedef enum SliceType {
     E_SLICE_B   = 0,
@@ -59,6 +63,19 @@ typedef enum EGeometryType
     E_SVIDEO_TYPE_NUM,
 }EGeometryType;
 
+typedef enum EViewportMappingMode
+{
+    E_VIEWPORT_MAPPING_FULL = 0,     //map every pixel of the viewport to the source
+    E_VIEWPORT_MAPPING_BOUNDARY,     //map the perimeter of the viewport only, with pole and seam checks
+}EViewportMappingMode;
+
+typedef enum EViewportPrecision
+{
+    E_VIEWPORT_PRECISION_DOUBLE = 0, //the mapping is done in double precision
+    E_VIEWPORT_PRECISION_FAST,       //the full scan maps to the erp source in single precision with approximate atan2/acos
+    E_VIEWPORT_PRECISION_VALIDATE,   //both precisions are run, the double one is output and the tile set differences are counted
+}EViewportPrecision;
+
 /*!
 *
 *  currently the library can support three types
@@ -115,6 +132,12 @@ typedef struct CC_DEF
     uint32_t elevationRange;
 }CCDef;
 
+typedef struct VIEWPORT_POSE
+{
+    float yaw;
+    float pitch;
+}ViewportPose;
+
 typedef struct Nalu
 {
     uint8_t  *data;  //pointer to nalu
@@ -301,6 +324,8 @@ typedef struct PARAM_VIEWPORT_OUTPUT
 //! \param    faceHeight,         input,    the height of the face
 //! \param    tileNumRow,         input,    the number of tile rows
 //! \param    tileNumCol,         input,    the number of tile columns
+//! \param    mappingMode,        input,    the way to map the viewport to the source, refer to EViewportMappingMode
+//! \param    precision,          input,    the precision of the mapping, refer to EViewportPrecision
 typedef struct PARAM_VIEWPORT
 {
     int32_t                viewportWidth;
@@ -315,6 +340,8 @@ typedef struct PARAM_VIEWPORT
     uint32_t               faceHeight;
     uint32_t               tileNumRow;
     uint32_t               tileNumCol;
+    EViewportMappingMode   mappingMode;
+    EViewportPrecision     precision;
 }Param_ViewPortInfo;
 
 //!
@@ -338,6 +365,19 @@ typedef struct INPUT_ONESTREAM_IFO
     uint32_t outputBufferLen;
 }param_oneStream_info;
 
+//!
+//! \brief  This structure is one segment of the output bitstream, the whole bitstream is
+//!         the segments one after the other. The layout is the one of struct iovec, so
+//!         the segments can be given to writev as they are
+//!
+//! \param    pData,                 output,   the data of the segment
+//! \param    dataLen,               output,   the length of the data
+typedef struct BITSTREAM_SEGMENT
+{
+    uint8_t* pData;
+    size_t   dataLen;
+}BitstreamSegment;
+
 //!
 //! \brief  This structure is for the whole frame parameters
 //!
@@ -354,6 +394,28 @@ typedef struct PARAM_STREAMSTITCHINFO
     uint32_t               pts;
 }param_streamStitchInfo;
 
+//!
+//! \brief  This structure is for one tier merged between the high and the low resolution streams,
+//!         the tiles of the tier in a window around the center of the viewport are merged, at the right
+//!         of the ones of the tier before. The tile number of the window has to be a multiple of the
+//!         tiles in one column of the merged frame.
+//!
+//! \param    pInputBitstream,    input,    the buffer for the input frame of the tier
+//! \param    inputBitstreamLen,  input,    the length of the input bistream of the tier
+//! \param    frameWidth,         input,    the width of the frame of the tier
+//! \param    frameHeight,        input,    the height of the frame of the tier
+//! \param    tileWidthNumSel,    input,    the number of the tile columns of the window
+//! \param    tileHeightNumSel,   input,    the number of the tile rows of the window
+typedef struct PARAM_MIDTIER
+{
+    uint8_t               *pInputBitstream;
+    uint32_t               inputBitstreamLen;
+    uint32_t               frameWidth;
+    uint32_t               frameHeight;
+    int32_t                tileWidthNumSel;
+    int32_t                tileHeightNumSel;
+}param_midTier;
+
 //!
 //! \brief  This structure is for the stitch parameters
 //!
@@ -376,6 +438,10 @@ typedef struct PARAM_STREAMSTITCHINFO
 //! \param    inputLowBistreamLen,input,    the length of the low resolution input bistream, just used in the usedType=E_MERGE_AND_VIEWPORT
 //! \param    pOutputSEI,         output,   the buffer for the output SEI bistream, mainly RWPK, just used in the usedType=E_MERGE_AND_VIEWPORT
 //! \param    outputSEILen,       output,   the length of the output SEI bistream, just used in the usedType=E_MERGE_AND_VIEWPORT
+//! \param    midTierNum,         input,    the number of the tiers in pMidTiers, up to MAX_MID_TIER_NUM, 0 to only merge the
+//!                                         high and the low resolution streams, just used in the usedType=E_MERGE_AND_VIEWPORT
+//! \param    pMidTiers,          input,    the tiers between the high and the low resolution streams, from high to low quality,
+//!                                         just used in the usedType=E_MERGE_AND_VIEWPORT
 //!
 typedef struct PARAM_360SCVP
 {
@@ -397,8 +463,19 @@ typedef struct PARAM_360SCVP
     unsigned int           inputLowBistreamLen;
     unsigned char         *pOutputSEI;
     unsigned int           outputSEILen;
+    int32_t                midTierNum;
+    param_midTier         *pMidTiers;
 }param_360SCVP;
 
+//!
+//! \brief  The function called by the pipeline when a frame given to I360SCVP_processAsync is done
+//!
+//! \param    pUserData,          input,    the user data given to I360SCVP_PipelineInit
+//! \param    pParam360SCVP,      input,    the parameters the frame is given with, with the output of the frame
+//! \param    ret,                input,    0 if the frame is processed, not 0 if it fails
+//!
+typedef void (*I360SCVP_FrameDoneCallback)(void* pUserData, param_360SCVP* pParam360SCVP, int32_t ret);
+
 //!
 //! \brief      This function mainly do the initialization, pass the input paramters to the stitch stream library, malloc the needed memory
 //!             and return the handle of the  stitch stream library
@@ -431,6 +508,161 @@ void * I360SCVP_New(void* p360SCVPHandle);
 //!
 int32_t I360SCVP_process(param_360SCVP* pParam360SCVP, void * p360SCVPHandle);
 
+//!
+//! \brief    This function completes the stitch like I360SCVP_process, but the output bitstream is given as segments
+//!           instead of being copied into pOutputBitstream: the rewritten headers are in a buffer of the handle and
+//!           the slice data segments point into the input bitstreams, so the tile data is not copied.
+//!           the segments are valid until the next process call with the handle, and as long as the input bitstreams are
+//!
+//! \param    param_360SCVP*      pParam360SCVP,    input/output, just used in the usedType E_STREAM_STITCH_ONLY and
+//!                                                                E_MERGE_AND_VIEWPORT, pOutputBitstream is not used and
+//!                                                                outputBitstreamLen is the length of all the segments
+//! \param    void*               p360SCVPHandle,   input,        which is created by the I360SVCP_Init function
+//! \param    BitstreamSegment**  ppSegments,       output,       the segments of the output bitstream in order
+//! \param    int32_t*            pSegmentNum,      output,       the number of the segments
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_processSegments(param_360SCVP* pParam360SCVP, void* p360SCVPHandle, BitstreamSegment** ppSegments, int32_t* pSegmentNum);
+
+//!
+//! \brief    This function creates a shared frame, which parses the high and low resolution bitstreams once for all
+//!           the handles merging viewports of the same streams, so that each handle only selects its tiles, rewrites
+//!           the headers and joins the tiles in I360SCVP_processShared.
+//!           the first frame of the streams is parsed by this function
+//!
+//! \param    param_360SCVP*   pParam360SCVP,     input,  the parameters the handles are initialized with, the usedType
+//!                                                        must be E_MERGE_AND_VIEWPORT
+//!
+//! \return   void *, the shared frame handle
+//!           not null, if the creation is ok
+//!           null, if the creation fails
+//!
+void* I360SCVP_SharedFrameInit(param_360SCVP* pParam360SCVP);
+
+//!
+//! \brief    This function parses the next frame of the streams into the shared frame, it must not be called while
+//!           I360SCVP_processShared is running with the shared frame; the handles can read it concurrently until the
+//!           next call
+//!
+//! \param    param_360SCVP*   pParam360SCVP,     input,  pInputBitstream and pInputLowBitstream are the frames to parse,
+//!                                                        they are kept by the caller until the handles are done with them
+//! \param    void*            pSharedFrame,      input,  which is created by the I360SCVP_SharedFrameInit function
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_SharedFrameParse(param_360SCVP* pParam360SCVP, void* pSharedFrame);
+
+//!
+//! \brief    This function frees the shared frame
+//!
+//! \param    void*            pSharedFrame,      input,  which is created by the I360SCVP_SharedFrameInit function
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_SharedFrameUnInit(void* pSharedFrame);
+
+//!
+//! \brief    This function merges the viewport of the handle like I360SCVP_process does, but the tiles are taken from
+//!           the frame parsed by the shared frame, so the input bitstreams are not parsed again by the handle.
+//!           the handles of different viewports can run it concurrently on the same shared frame
+//!
+//! \param    param_360SCVP*      pParam360SCVP,    input/output, the output bitstream and the sei of the handle, the input
+//!                                                               bitstreams are not used
+//! \param    void*               p360SCVPHandle,   input,        which is created by the I360SVCP_Init function with the
+//!                                                               usedType E_MERGE_AND_VIEWPORT
+//! \param    void*               pSharedFrame,     input,        which is created by the I360SCVP_SharedFrameInit function
+//! \param    BitstreamSegment**  ppSegments,       output,       the segments of the output bitstream like in
+//!                                                               I360SCVP_processSegments, or NULL to copy the output
+//!                                                               bitstream into pOutputBitstream
+//! \param    int32_t*            pSegmentNum,      output,       the number of the segments, NULL if ppSegments is NULL
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_processShared(param_360SCVP* pParam360SCVP, void* p360SCVPHandle, void* pSharedFrame, BitstreamSegment** ppSegments, int32_t* pSegmentNum);
+
+//!
+//! \brief    This function creates a pipeline, which processes the frames given by I360SCVP_processAsync like
+//!           I360SCVP_process does, but the next frame is parsed on one thread while the frame before is merged by
+//!           the handle on another. the frames are done in order, and the callback is called on the merging thread
+//!           for each of them. the handle must not be used by the caller until the pipeline is freed.
+//!           the first frame of the streams is parsed by this function like by I360SCVP_SharedFrameInit
+//!
+//! \param    void*                       p360SCVPHandle,  input,  which is created by the I360SVCP_Init function with
+//!                                                                 the usedType E_MERGE_AND_VIEWPORT
+//! \param    param_360SCVP*              pParam360SCVP,   input,  the parameters the handle is initialized with
+//! \param    int32_t                     queueDepth,      input,  the most frames in flight, 2 or more to parse a frame
+//!                                                                 while the one before is merged
+//! \param    I360SCVP_FrameDoneCallback  pCallback,       input,  called when a frame is done
+//! \param    void*                       pUserData,       input,  given to the callback
+//!
+//! \return   void *, the pipeline handle
+//!           not null, if the creation is ok
+//!           null, if the creation fails
+//!
+void* I360SCVP_PipelineInit(void* p360SCVPHandle, param_360SCVP* pParam360SCVP, int32_t queueDepth, I360SCVP_FrameDoneCallback pCallback, void* pUserData);
+
+//!
+//! \brief    This function queues a frame into the pipeline, it waits while queueDepth frames are in flight.
+//!           the input bitstreams, the output bitstream and the output sei of pParam360SCVP are kept by the caller
+//!           until the callback of the frame is called, then pParam360SCVP has the output like after I360SCVP_process.
+//!           the frame is not in flight any more when its callback is called, so the callback can queue the next one
+//!
+//! \param    void*            pPipeline,         input,  which is created by the I360SCVP_PipelineInit function
+//! \param    param_360SCVP*   pParam360SCVP,     input/output, the frame to process, one for each frame in flight
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_processAsync(void* pPipeline, param_360SCVP* pParam360SCVP);
+
+//!
+//! \brief    This function sets the viewport of the handle of the pipeline, the frames in flight which are not merged
+//!           yet are merged with it, from the next one merged
+//!
+//! \param    void*   pPipeline,   input, which is created by the I360SCVP_PipelineInit function
+//! \param    float   yaw,         input, the angle rotated aroud y
+//! \param    float   pitch,       input, the angle rotated aroud z
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_PipelineSetViewPort(void* pPipeline, float yaw, float pitch);
+
+//!
+//! \brief    This function waits until all the frames in flight are done. it fails if it is called by the callback,
+//!           which is called before its frame is done
+//!
+//! \param    void*   pPipeline,   input, which is created by the I360SCVP_PipelineInit function
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_PipelineFlush(void* pPipeline);
+
+//!
+//! \brief    This function waits until all the frames in flight are done, then frees the pipeline, the handle is not
+//!           freed and can be used again. it fails and frees nothing if it is called by the callback
+//!
+//! \param    void*   pPipeline,   input, which is created by the I360SCVP_PipelineInit function
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t I360SCVP_PipelineUnInit(void* pPipeline);
+
 //!
 //! \brief      This function sets the parameter of the viewPort.
 //!
@@ -468,6 +700,35 @@ int32_t   I360SCVP_unInit(void * p360SCVPHandle);
 //!
 int32_t I360SCVP_getFixedNumTiles(TileDef* pOutTile, Param_ViewportOutput* pParamViewPortOutput, void* p360SCVPHandle);
 
+//!
+//! \brief    This function selects the tiles inside the viewport for a batch of poses, the geometries are set up once
+//!           for all the poses, and the viewport set by I360SCVP_setViewPort is not changed.
+//!           For hundreds of poses per frame, E_VIEWPORT_MAPPING_BOUNDARY or a pose-to-tile lookup table is recommended.
+//!
+//! \param    void*          p360SCVPHandle,   input,  which is created by the I360SVCP_Init function
+//! \param    ViewportPose*  pPoses,           input,  the poses, the yaw and pitch are the same as I360SCVP_setViewPort
+//! \param    int32_t        poseNum,          input,  the number of the poses
+//! \param    uint64_t*      pTileMasks,       output, the tile masks, the mask of pose k starts at pTileMasks[k * words],
+//!                                                    and bit i of it is set if the tile with idx i is inside the viewport.
+//!                                                    if it is NULL and poseNum is 0, only the words is returned
+//!
+//! \return   int32_t, the number of 64-bit words of each mask if succeed, negative if fail,
+//!                    it fails if pPoses or pTileMasks is NULL while poseNum is greater than 0
+//!
+int32_t I360SCVP_getTilesForPoses(void* p360SCVPHandle, ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks);
+
+//!
+//! \brief    This function outputs, for each tile, the fraction of the current viewport that the tile covers, so that the
+//!           tiles can be ranked and the ones which barely contribute can be dropped.
+//!
+//! \param    void*    p360SCVPHandle,   input,  which is created by the I360SVCP_Init function
+//! \param    float*   pCoverage,        output, the fractions indexed by the tile idx, faceId * tileNumRow * tileNumCol
+//!                                              + row * tileNumCol + col. if it is NULL, only the number of tiles is returned
+//!
+//! \return   int32_t, the number of the tiles if succeed, negative if fail
+//!
+int32_t I360SCVP_getTileCoverage(void* p360SCVPHandle, float* pCoverage);
+
 //!
 //! \brief    This function provides the parsing NAL function, can give the slice type, tileCols number, tileRows number and nal information
 //!           if it is the Slice, must provide the slice header length; if SEI, provide the SEI payload type
@@ -480,6 +741,24 @@ int32_t I360SCVP_getFixedNumTiles(TileDef* pOutTile, Param_ViewportOutput* pPara
 //!
 int32_t I360SCVP_ParseNAL(Nalu* pNALU, void* p360SCVPHandle);
 
+//!
+//! \brief    This function scans an access unit once and outputs the information of all its nal units, the same as
+//!           I360SCVP_ParseNAL gives for one nal unit, so that the tiles can be located without parsing nal by nal.
+//!           the parameter sets found in the access unit are kept for the slices of the following calls
+//!
+//! \param    void*      p360SCVPHandle,   input,  which is created by the I360SVCP_Init function
+//! \param    uint8_t*   pBitstream,       input,  the access unit, the bytes before the first start code are skipped
+//! \param    int32_t    bitstreamLen,     input,  the length of the access unit
+//! \param    Nalu*      pNalus,           output, the nal units in the bitstream order, the data points into pBitstream
+//!                                                 and the dataSize includes the start codes. if it is NULL, the nal units
+//!                                                 are only counted
+//! \param    int32_t    maxNaluNum,       input,  the number of the elements of pNalus, the nal units after them are
+//!                                                 only counted
+//!
+//! \return   int32_t, the number of the nal units in the access unit if succeed, negative if fail
+//!
+int32_t I360SCVP_ParseAccessUnit(void* p360SCVPHandle, uint8_t* pBitstream, int32_t bitstreamLen, Nalu* pNalus, int32_t maxNaluNum);
+
 //!
 //! \brief    geneate the new SPS bitstream, input include start code, output without startcode
 //!
@@ -34,6 +34,7 @@
 #include "360SCVPCommonDef.h"
 #include "360SCVPHevcEncHdr.h"
 #include "360SCVPImpl.h"
+#include "360SCVPPipeline.h"
 
 void* I360SCVP_Init(param_360SCVP* pParam360SCVP)
 {
@@ -69,18 +70,19 @@ int32_t   I360SCVP_process(param_360SCVP* pParam360SCVP, void* p360SCVPHandle)
     int32_t ret = 0;
     if (pParam360SCVP->usedType == E_STREAM_STITCH_ONLY)
     {
-        ret = pStitch->doStreamStitch(pParam360SCVP);
+        ret = pStitch->doStreamStitch(pParam360SCVP, NULL, NULL);
     }
     else if (pParam360SCVP->usedType == E_MERGE_AND_VIEWPORT)
     {
         //according to the FOV information, get the tiles in the viewport area
         pStitch->parseNals(pParam360SCVP, E_MERGE_AND_VIEWPORT, NULL, 0);
+        pStitch->parseMidTiers(pParam360SCVP);
         pStitch->parseNals(pParam360SCVP, E_MERGE_AND_VIEWPORT, NULL, 1);
         // feed the parameters to the stitch lib
         ret = pStitch->feedParamToGenStream(pParam360SCVP);
 
         //do the stitch process
-        ret = pStitch->doMerge(pParam360SCVP);
+        ret = pStitch->doMerge(pParam360SCVP, NULL, NULL);
     }
     else if (pParam360SCVP->usedType == E_PARSER_ONENAL)
     {
@@ -92,6 +94,136 @@ int32_t   I360SCVP_process(param_360SCVP* pParam360SCVP, void* p360SCVPHandle)
     return ret;
 }
 
+int32_t I360SCVP_processSegments(param_360SCVP* pParam360SCVP, void* p360SCVPHandle, BitstreamSegment** ppSegments, int32_t* pSegmentNum)
+{
+    TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
+    if (!pStitch || !pParam360SCVP || !ppSegments || !pSegmentNum)
+        return -1;
+    int32_t ret = 0;
+    *ppSegments = NULL;
+    *pSegmentNum = 0;
+    if (pParam360SCVP->usedType == E_STREAM_STITCH_ONLY)
+    {
+        ret = pStitch->doStreamStitch(pParam360SCVP, ppSegments, pSegmentNum);
+    }
+    else if (pParam360SCVP->usedType == E_MERGE_AND_VIEWPORT)
+    {
+        pStitch->parseNals(pParam360SCVP, E_MERGE_AND_VIEWPORT, NULL, 0);
+        pStitch->parseMidTiers(pParam360SCVP);
+        pStitch->parseNals(pParam360SCVP, E_MERGE_AND_VIEWPORT, NULL, 1);
+        ret = pStitch->feedParamToGenStream(pParam360SCVP);
+
+        ret = pStitch->doMerge(pParam360SCVP, ppSegments, pSegmentNum);
+    }
+    else
+    {
+        ret = -1;
+    }
+    return ret;
+}
+
+void* I360SCVP_SharedFrameInit(param_360SCVP* pParam360SCVP)
+{
+    if (pParam360SCVP == NULL)
+        return NULL;
+    TstitchStream*  pSharedFrame = new TstitchStream;
+
+    if(pSharedFrame->initSharedFrame(pParam360SCVP) < 0)
+    {
+        delete(pSharedFrame);
+        return NULL;
+    }
+    return (void*)pSharedFrame;
+}
+
+int32_t I360SCVP_SharedFrameParse(param_360SCVP* pParam360SCVP, void* pSharedFrame)
+{
+    TstitchStream* pShared = (TstitchStream*)(pSharedFrame);
+    if (!pShared || !pParam360SCVP)
+        return -1;
+    return pShared->parseSharedFrame(pParam360SCVP);
+}
+
+int32_t I360SCVP_SharedFrameUnInit(void* pSharedFrame)
+{
+    TstitchStream* pShared = (TstitchStream*)(pSharedFrame);
+    if (!pShared)
+        return -1;
+    int32_t ret = pShared->uninit();
+    delete pShared;
+    return ret;
+}
+
+int32_t I360SCVP_processShared(param_360SCVP* pParam360SCVP, void* p360SCVPHandle, void* pSharedFrame, BitstreamSegment** ppSegments, int32_t* pSegmentNum)
+{
+    TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
+    TstitchStream* pShared = (TstitchStream*)(pSharedFrame);
+    if (!pStitch || !pShared || !pParam360SCVP || pParam360SCVP->usedType != E_MERGE_AND_VIEWPORT)
+        return -1;
+    if (ppSegments && !pSegmentNum)
+        return -1;
+    if (ppSegments)
+    {
+        *ppSegments = NULL;
+        *pSegmentNum = 0;
+    }
+    // only the tiles of the viewport are taken from the shared parsing, then merged like in I360SCVP_process
+    if (pStitch->feedSharedToGenStream(pShared) < 0)
+        return -1;
+    return pStitch->doMerge(pParam360SCVP, ppSegments, pSegmentNum);
+}
+
+void* I360SCVP_PipelineInit(void* p360SCVPHandle, param_360SCVP* pParam360SCVP, int32_t queueDepth, I360SCVP_FrameDoneCallback pCallback, void* pUserData)
+{
+    TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
+    if (!pStitch || !pParam360SCVP)
+        return NULL;
+    TstitchPipeline* pPipeline = new TstitchPipeline;
+
+    if (pPipeline->init(pStitch, pParam360SCVP, queueDepth, pCallback, pUserData) < 0)
+    {
+        delete(pPipeline);
+        return NULL;
+    }
+    return (void*)pPipeline;
+}
+
+int32_t I360SCVP_processAsync(void* pPipeline, param_360SCVP* pParam360SCVP)
+{
+    TstitchPipeline* pPipe = (TstitchPipeline*)(pPipeline);
+    if (!pPipe || !pParam360SCVP || pParam360SCVP->usedType != E_MERGE_AND_VIEWPORT)
+        return -1;
+    return pPipe->submit(pParam360SCVP);
+}
+
+int32_t I360SCVP_PipelineSetViewPort(void* pPipeline, float yaw, float pitch)
+{
+    TstitchPipeline* pPipe = (TstitchPipeline*)(pPipeline);
+    if (!pPipe)
+        return -1;
+    return pPipe->setViewPort(yaw, pitch);
+}
+
+int32_t I360SCVP_PipelineFlush(void* pPipeline)
+{
+    TstitchPipeline* pPipe = (TstitchPipeline*)(pPipeline);
+    if (!pPipe)
+        return -1;
+    return pPipe->flush();
+}
+
+int32_t I360SCVP_PipelineUnInit(void* pPipeline)
+{
+    TstitchPipeline* pPipe = (TstitchPipeline*)(pPipeline);
+    if (!pPipe)
+        return -1;
+    int32_t ret = pPipe->uninit();
+    if (ret)
+        return ret;
+    delete pPipe;
+    return 0;
+}
+
 int32_t I360SCVP_setViewPort(void* p360SCVPHandle, float yaw, float pitch)
 {
     int32_t ret = 0;
@@ -131,6 +263,22 @@ int32_t I360SCVP_getFixedNumTiles(TileDef* pOutTile, Param_ViewportOutput* pPara
     return ret;
 }
 
+int32_t I360SCVP_getTilesForPoses(void* p360SCVPHandle, ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks)
+{
+    TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
+    if (!pStitch || poseNum < 0 || (poseNum > 0 && (!pPoses || !pTileMasks)))
+        return -1;
+    return pStitch->getTilesForPoses(pPoses, poseNum, pTileMasks);
+}
+
+int32_t I360SCVP_getTileCoverage(void* p360SCVPHandle, float* pCoverage)
+{
+    TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
+    if (!pStitch)
+        return -1;
+    return pStitch->getTileCoverage(pCoverage);
+}
+
 int32_t I360SCVP_ParseNAL(Nalu* pNALU, void* p360SCVPHandle)
 {
     TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
@@ -150,6 +298,14 @@ int32_t I360SCVP_ParseNAL(Nalu* pNALU, void* p360SCVPHandle)
     return 0;
 }
 
+int32_t I360SCVP_ParseAccessUnit(void* p360SCVPHandle, uint8_t* pBitstream, int32_t bitstreamLen, Nalu* pNalus, int32_t maxNaluNum)
+{
+    TstitchStream* pStitch = (TstitchStream*)(p360SCVPHandle);
+    if (!pStitch)
+        return -1;
+    return pStitch->parseAccessUnit(pBitstream, bitstreamLen, pNalus, maxNaluNum);
+}
+
 int32_t I360SCVP_GenerateSPS(param_360SCVP* pParam360SCVP, void* p360SCVPHandle)
 {
     int32_t ret = 0;
@@ -284,6 +440,12 @@ int32_t I360SCVP_SetParameter(void* p360SCVPHandle, int32_t paramID, void* pValu
         pSeiViewport = (OMNIViewPort*)pValue;
         ret = pStitch->setViewportSEI(pSeiViewport);
         break;
+    case ID_SCVP_PARAM_MAPPING_THREADS:
+        ret = pStitch->setMappingThreads(*((int32_t*)pValue));
+        break;
+    case ID_SCVP_PARAM_MERGE_THREADS:
+        ret = pStitch->setMergeThreads(*((int32_t*)pValue));
+        break;
     default:
         break;
     }
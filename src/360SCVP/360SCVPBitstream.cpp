@@ -25,6 +25,10 @@
  */
 #include "360SCVPBitstream.h"
 #include "assert.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 void* gts_malloc(size_t size)
 {
@@ -58,6 +62,19 @@ uint64_t gts_fseek(FILE *fp, int64_t offset, int32_t whence)
     return (uint64_t)fseek(fp, (long)offset, whence);
 }
 
+GTS_Err gts_bs_init(GTS_BitStream *bs, const int8_t *buffer, uint64_t size, uint32_t mode)
+{
+    if (!bs || !buffer || !size) return GTS_BAD_PARAM;
+    if ((mode != GTS_BITSTREAM_READ) && (mode != GTS_BITSTREAM_WRITE)) return GTS_BAD_PARAM;
+    memset(bs, 0, sizeof(GTS_BitStream));
+
+    bs->original = (int8_t*)buffer;
+    bs->size = size;
+    bs->bsmode = mode;
+    bs->nbBits = (mode == GTS_BITSTREAM_READ) ? 8 : 0;
+    return GTS_OK;
+}
+
 GTS_BitStream *gts_bs_new(const int8_t *buffer, uint64_t BufferSize, uint32_t mode)
 {
     GTS_BitStream *tmp;
@@ -65,6 +82,7 @@ GTS_BitStream *gts_bs_new(const int8_t *buffer, uint64_t BufferSize, uint32_t mo
 
     tmp = (GTS_BitStream *)gts_malloc(sizeof(GTS_BitStream));
     if (!tmp) return NULL;
+    if (buffer && (gts_bs_init(tmp, buffer, BufferSize, mode) == GTS_OK)) return tmp;
     memset(tmp, 0, sizeof(GTS_BitStream));
 
     tmp->original = (int8_t*)buffer;
@@ -152,9 +170,36 @@ static void bs_flush_cache(GTS_BitStream *bs)
     }
 }
 
+GTS_BitStream *gts_bs_from_file_mapped(const char *fileName, bool sequential)
+{
+    if (!fileName) return NULL;
+    int32_t fd = open(fileName, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) || (fileStat.st_size <= 0)) {
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    /*the mapping stays valid once the file is closed*/
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    if (sequential)
+        madvise(data, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+
+    GTS_BitStream *bs = gts_bs_new((const int8_t *)data, (uint64_t)fileStat.st_size, GTS_BITSTREAM_READ);
+    if (!bs) {
+        munmap(data, (size_t)fileStat.st_size);
+        return NULL;
+    }
+    bs->mapped = true;
+    return bs;
+}
+
 void gts_bs_del(GTS_BitStream *bs)
 {
     if (!bs) return;
+    if (bs->mapped && bs->original) munmap(bs->original, (size_t)bs->size);
     /*if we are in dynamic mode (alloc done by the bitstream), free the buffer if still present*/
     if ((bs->bsmode == GTS_BITSTREAM_WRITE_DYN) && bs->original) gts_free(bs->original);
     if (bs->buffer_io)
@@ -181,6 +226,7 @@ static uint8_t BS_ReadByte(GTS_BitStream *bs)
     if (bs->bsmode == GTS_BITSTREAM_READ) {
         uint8_t res;
         if (bs->position >= bs->size) {
+            bs->overRead = 1;
             if (bs->EndOfStream) bs->EndOfStream(bs->par);
             return 0;
         }
@@ -224,9 +270,63 @@ uint8_t gf_bs_read_bit(GTS_BitStream *bs)
 }
 
 
+/*loads the 8 bytes from byteOffset of a memory read stream as a big endian word,
+the bytes beyond the end of the buffer are read as 0*/
+static inline uint64_t BS_LoadWord(GTS_BitStream *bs, uint64_t byteOffset)
+{
+    const uint8_t *src = (const uint8_t *) bs->original + byteOffset;
+    uint64_t word = 0;
+    if (byteOffset + 8 <= bs->size) {
+        memcpy(&word, src, 8);
+        return __builtin_bswap64(word);
+    }
+    for (uint32_t i = 0; i < 8; i++) {
+        word <<= 8;
+        if (byteOffset + i < bs->size) word |= src[i];
+    }
+    return word;
+}
+
+/*the bit offset of a memory read stream, the current byte holds 8 - nbBits unread bits*/
+static inline uint64_t BS_GetReadOffset(GTS_BitStream *bs)
+{
+    return bs->position * 8 - (8 - bs->nbBits);
+}
+
+/*moves a memory read stream to the bit offset, the state is the same as the one left by gf_bs_read_bit*/
+static inline void BS_SetReadOffset(GTS_BitStream *bs, uint64_t bitOffset)
+{
+    uint64_t byteOffset = bitOffset >> 3;
+    uint32_t bits = (uint32_t) (bitOffset & 7);
+    if (bits) {
+        bs->position = byteOffset + 1;
+        bs->nbBits = bits;
+        bs->current = ((uint32_t) (uint8_t) bs->original[byteOffset]) << bits;
+    } else {
+        bs->position = byteOffset;
+        bs->nbBits = 8;
+        bs->current = byteOffset ? ((uint32_t) (uint8_t) bs->original[byteOffset - 1]) << 8 : 0;
+    }
+}
+
+/*the read of memory streams is done on a 64-bit word loaded from the buffer when all
+the bits are inside the buffer, so the end of stream handling stays in gf_bs_read_bit*/
+static inline bool BS_CanReadFast(GTS_BitStream *bs, uint64_t endOffset)
+{
+    return (bs->bsmode == GTS_BITSTREAM_READ) && !bs->overRead && (endOffset <= bs->size * 8);
+}
+
 uint32_t gts_bs_read_int(GTS_BitStream *bs, uint32_t nBits)
 {
     uint32_t ret = 0;
+    if (nBits <= 32 && BS_CanReadFast(bs, BS_GetReadOffset(bs) + nBits)) {
+        uint64_t offset;
+        if (!nBits) return 0;
+        offset = BS_GetReadOffset(bs);
+        ret = (uint32_t) ((BS_LoadWord(bs, offset >> 3) << (offset & 7)) >> (64 - nBits));
+        BS_SetReadOffset(bs, offset + nBits);
+        return ret;
+    }
     while (nBits-- > 0) {
         ret <<= 1;
         ret |= gf_bs_read_bit(bs);
@@ -252,6 +352,10 @@ uint32_t gts_bs_read_U32(GTS_BitStream *bs)
 uint64_t gts_bs_read_long_int(GTS_BitStream *bs, uint32_t nBits)
 {
     uint64_t ret = 0;
+    if (nBits > 32 && nBits <= 64) {
+        ret = (uint64_t) gts_bs_read_int(bs, nBits - 32) << 32;
+        return ret | gts_bs_read_int(bs, 32);
+    }
     if (nBits>64) {
         gts_bs_read_long_int(bs, nBits-64);
         ret = gts_bs_read_long_int(bs, 64);
@@ -265,6 +369,50 @@ uint64_t gts_bs_read_long_int(GTS_BitStream *bs, uint32_t nBits)
 }
 
 
+/*the exp-golomb code when the leading zeros are counted byte by byte, it is used
+when the code is longer than 32 bits or runs over the end of the buffer*/
+static uint32_t BS_ReadUESlow(GTS_BitStream *bs)
+{
+    uint32_t data = 0, peek = 0, zeros = 0;
+    while (1) {
+        peek = gts_bs_peek_bits(bs, 8, 0);
+        if (peek) break;
+        //check whether we still have data once the peek is done since we may have less than 8 data available
+        if (!gts_bs_available(bs)) {
+            return 0;
+        }
+        gts_bs_read_int(bs, 8);
+        data += 8;
+    }
+    zeros = __builtin_clz(peek) - 24;
+    gts_bs_read_int(bs, zeros);
+    data += zeros;
+    return gts_bs_read_int(bs, data + 1) - 1;
+}
+
+uint32_t gts_bs_read_ue(GTS_BitStream *bs)
+{
+    uint64_t offset = BS_GetReadOffset(bs);
+    if (BS_CanReadFast(bs, offset + 1)) {
+        uint64_t word = BS_LoadWord(bs, offset >> 3) << (offset & 7);
+        if (word) {
+            uint32_t codeLen = 2 * __builtin_clzll(word) + 1;
+            if (codeLen <= 32 && BS_CanReadFast(bs, offset + codeLen)) {
+                BS_SetReadOffset(bs, offset + codeLen);
+                return (uint32_t) (word >> (64 - codeLen)) - 1;
+            }
+        }
+    }
+    return BS_ReadUESlow(bs);
+}
+
+int32_t gts_bs_read_se(GTS_BitStream *bs)
+{
+    uint32_t v = gts_bs_read_ue(bs);
+    if ((v & 0x1) == 0) return (int32_t)(0 - (v >> 1));
+    return (v + 1) >> 1;
+}
+
 uint32_t gts_bs_read_data(GTS_BitStream *bs, int8_t *data, uint32_t nbBytes)
 {
     uint64_t orig = 0;
@@ -350,43 +498,51 @@ static void BS_WriteByte(GTS_BitStream *bs, uint8_t val)
     bs->position += 1;
 }
 
-static void BS_WriteBit(GTS_BitStream *bs, uint32_t bit)
+/*writes a whole byte of the bits, with an emulation prevention byte before it when
+it follows two zero bytes and is lower than 4*/
+static inline void BS_WriteEscapedByte(GTS_BitStream *bs, uint8_t val)
 {
     const uint8_t emulation_prevention_three_byte = 0x03;
 
-    bs->current <<= 1;
-    bs->current |= bit;
-    if (++ bs->nbBits == 8) {
-        bs->nbBits = 0;
-
-        if((bs->zeroCount == 2) && ((uint8_t) bs->current < 4))
-        {
-            BS_WriteByte(bs, emulation_prevention_three_byte);
+    if ((bs->bsmode == GTS_BITSTREAM_WRITE) && bs->original && (bs->position + 2 <= bs->size)) {
+        if ((bs->zeroCount == 2) && (val < 4)) {
+            bs->original[bs->position++] = emulation_prevention_three_byte;
             bs->zeroCount = 0;
         }
-        bs->zeroCount = ((uint8_t) bs->current) == 0 ? bs->zeroCount+1 : 0;
+        bs->zeroCount = val ? 0 : bs->zeroCount + 1;
+        bs->original[bs->position++] = val;
+        return;
+    }
 
-        BS_WriteByte(bs, (uint8_t) bs->current);
-        bs->current = 0;
+    if ((bs->zeroCount == 2) && (val < 4))
+    {
+        BS_WriteByte(bs, emulation_prevention_three_byte);
+        bs->zeroCount = 0;
     }
+    bs->zeroCount = val ? 0 : bs->zeroCount + 1;
+    BS_WriteByte(bs, val);
 }
 
-
 void gts_bs_write_int(GTS_BitStream *bs, int32_t _value, int32_t nBits)
 {
     if (!bs) return;
-    uint32_t value, nb_shift;
-    if (!nBits) return;
-    value = (uint32_t) _value;
-    nb_shift = sizeof (int32_t) * 8 - nBits;
-    if (nb_shift)
-        value <<= nb_shift;
+    if (nBits <= 0) return;
+    /*the bits above the 32 bits of the value are zero*/
+    if (nBits > 32) {
+        gts_bs_write_int(bs, 0, nBits - 32);
+        nBits = 32;
+    }
 
-    while (--nBits >= 0) {
-        //but check value as signed
-        BS_WriteBit (bs, ((int32_t)value) < 0);
-        value <<= 1;
+    /*the pending bits of the current byte and the new ones are gathered in a 64-bit
+    accumulator, and all the whole bytes are flushed at once*/
+    uint32_t total = bs->nbBits + nBits;
+    uint64_t acc = ((uint64_t)bs->current << nBits) | ((uint64_t)(uint32_t)_value & ((1ULL << nBits) - 1));
+    while (total >= 8) {
+        total -= 8;
+        BS_WriteEscapedByte(bs, (uint8_t)(acc >> total));
     }
+    bs->current = (uint32_t)acc & ((1 << total) - 1);
+    bs->nbBits = total;
 }
 
 
@@ -597,6 +753,7 @@ static GTS_Err BS_SeekIntern(GTS_BitStream *bs, uint64_t offset)
                 }
                 bs->position = bs->size;
                 bs->nbBits = (bs->bsmode == GTS_BITSTREAM_READ) ? 8 : 0;
+                bs->overRead = 0;
                 return GTS_OK;
             }
             /*in DYN, gf_realloc ...*/
@@ -610,6 +767,7 @@ static GTS_Err BS_SeekIntern(GTS_BitStream *bs, uint64_t offset)
         }
         bs->current = bs->original[offset];
         bs->position = offset;
+        bs->overRead = 0;
         bs->nbBits = (bs->bsmode == GTS_BITSTREAM_READ) ? 8 : 0;
         return GTS_OK;
     }
@@ -638,6 +796,7 @@ uint32_t gts_bs_peek_bits(GTS_BitStream *bs, uint32_t numBits, uint64_t byte_off
 {
     uint64_t curPos;
     uint32_t curBits, ret, current;
+    uint8_t overRead;
  
     if (!bs) return 0;
 
@@ -648,6 +807,7 @@ uint32_t gts_bs_peek_bits(GTS_BitStream *bs, uint32_t numBits, uint64_t byte_off
     curPos = bs->position;
     curBits = bs->nbBits;
     current = bs->current;
+    overRead = bs->overRead;
 
     if (byte_offset) gts_bs_seek(bs, bs->position + byte_offset);
     ret = gts_bs_read_int(bs, numBits);
@@ -655,5 +815,6 @@ uint32_t gts_bs_peek_bits(GTS_BitStream *bs, uint32_t numBits, uint64_t byte_off
     gts_bs_seek(bs, curPos);
     bs->nbBits = curBits;
     bs->current = current;
+    bs->overRead = overRead;
     return ret;
 }
@@ -111,10 +111,14 @@ struct __tag_bitstream
     uint32_t bsmode;
 
     uint8_t zeroCount;
+    //set when a memory read went over the end of the buffer, cleared by seeking
+    uint8_t overRead;
 
     int8_t *buffer_io;
     uint32_t buffer_io_size;
     uint32_t buffer_written;
+    //set when the buffer is a file mapped by the bitstream
+    bool mapped;
 };
 
 typedef struct __tag_bitstream GTS_BitStream;
@@ -133,6 +137,33 @@ typedef struct __tag_bitstream GTS_BitStream;
  */
 GTS_BitStream *gts_bs_new(const int8_t *buffer, uint64_t size, uint32_t mode);
 
+/*!
+ *    \brief Initializes a bitstream object of the caller on a buffer, so the object can live on the stack or be
+ *           reused for several buffers without allocation
+ *
+ *    \param GTS_BitStream *bs      input the bitstream object to initialize
+ *    \param const int8_t * buffer  input buffer to read or write, it can't be NULL
+ *    \param uint64_t       size    input size of the buffer given
+ *    \param uint32_t       mode    operation mode for this bitstream: GTS_BITSTREAM_READ or GTS_BITSTREAM_WRITE
+ *
+ *    \return GTS_Err GTS_OK if success, GTS_BAD_PARAM otherwise
+ *
+ *    \note the object holds no resource, so it is not deleted by gts_bs_del
+ */
+GTS_Err gts_bs_init(GTS_BitStream *bs, const int8_t *buffer, uint64_t size, uint32_t mode);
+
+/*!
+ *    \brief Constructs a read bitstream from a file mapped in memory, so it is read as a memory buffer
+ *
+ *    \param const char *   fileName    input the name of the file to read
+ *    \param bool           sequential  input hints the system that the file is read from the start to the end
+ *
+ *    \return GTS_BitStream * new bitstream object, NULL if the file can't be mapped or is empty
+ *
+ *    \note the file is unmapped by gts_bs_del, the data is at bs->original for bs->size bytes
+ */
+GTS_BitStream *gts_bs_from_file_mapped(const char *fileName, bool sequential);
+
 /*!
  *    \brief Deletes the bitstream object, bitstream destructor from file handle
  *    \param GTS_BitStream *bs  input which is created by gts_bs_new
@@ -187,6 +218,24 @@ uint32_t gts_bs_read_int(GTS_BitStream *bs, uint32_t nBits);
  */
 uint64_t gts_bs_read_long_int(GTS_BitStream *bs, uint32_t nBits);
 
+/*!
+ *    \brief Reads an unsigned integer coded with exp-golomb code, ue(v).
+ *
+ *    \param GTS_BitStream *bs   input  the target bitstream
+ *
+ *    \return uint32_t the integer value read, 0 if there is not enough data.
+ */
+uint32_t gts_bs_read_ue(GTS_BitStream *bs);
+
+/*!
+ *    \brief Reads a signed integer coded with exp-golomb code, se(v).
+ *
+ *    \param GTS_BitStream *bs   input  the target bitstream
+ *
+ *    \return int32_t the integer value read.
+ */
+int32_t gts_bs_read_se(GTS_BitStream *bs);
+
 /*!
  *    \brief Reads a data buffer
  *
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <math.h>
 #include "360SCVPCubeMap.h"
+#include "360SCVPGeometryBatch.h"
 
 /*************************************
 Cubemap geometry related functions;
@@ -151,3 +152,8 @@ void CubeMap::map3DTo2D(SPos *pSPosIn, SPos *pSPosOut)
     pSPosOut->x = (POSType)((pu+1.0)*(m_sVideoInfo.iFaceWidth>>1) + (-0.5));
     pSPosOut->y = (POSType)((pv+1.0)*(m_sVideoInfo.iFaceHeight>>1)+ (-0.5));
 }
+
+void CubeMap::map3DTo2DBatch(SPosArray *pSPosIn, SPosArray *pSPosOut, int32_t num)
+{
+    geoBatchCubeMapMap3DTo2D(pSPosIn, pSPosOut, num, m_sVideoInfo.iFaceWidth, m_sVideoInfo.iFaceHeight);
+}
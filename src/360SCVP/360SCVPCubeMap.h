@@ -43,6 +43,7 @@ public:
 
     virtual void map2DTo3D(SPos& IPosIn, SPos *pSPosOut);
     virtual void map3DTo2D(SPos *pSPosIn, SPos *pSPosOut);
+    virtual void map3DTo2DBatch(SPosArray *pSPosIn, SPosArray *pSPosOut, int32_t num);
 };
 
 #endif
@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <math.h>
 #include "360SCVPEquiRect.h"
+#include "360SCVPGeometryBatch.h"
 
 /********************************************
 Equirectangular geometry related functions;
@@ -100,3 +101,11 @@ void EquiRect::map3DTo2D(SPos *pSPosIn, SPos *pSPosOut)
     pSPosOut->y = (POSType)((len < S_EPS? 0.5 : sacos(y/len)/S_PI)*m_sVideoInfo.iFaceHeight);
     pSPosOut->y -= 0.5;
 }
+
+void EquiRect::map3DTo2DBatch(SPosArray *pSPosIn, SPosArray *pSPosOut, int32_t num)
+{
+    if (m_bSinglePrecision)
+        geoBatchEquiRectMap3DTo2DFast(pSPosIn, pSPosOut, num, m_sVideoInfo.iFaceWidth, m_sVideoInfo.iFaceHeight);
+    else
+        geoBatchEquiRectMap3DTo2D(pSPosIn, pSPosOut, num, m_sVideoInfo.iFaceWidth, m_sVideoInfo.iFaceHeight);
+}
@@ -31,10 +31,114 @@
 #include <assert.h>
 #include <math.h>
 #include <string.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <new>
 #include "360SCVPGeometry.h"
 #include "360SCVPEquiRect.h"
 #include "360SCVPCubeMap.h"
 #include "360SCVPViewPort.h"
+#include "360SCVPGeometryBatch.h"
+
+//rows [jStart, jEnd) of one face mapped by one thread, with its own extents
+struct SMapRowsTask
+{
+    Geometry *pGeoSrc;
+    int32_t fIdx;
+    int32_t jStart;
+    int32_t jEnd;
+    int32_t iStart;     //the first column, it is the seam column in the second pass
+    bool    bSeamArea;  //the second pass of the erp seam, all the samples go to box 1
+    int32_t nNextAreaX; //the seam column found in the last row, -1 if none
+    int32_t *pFaceBuf;  //row scratch, 2 x row length
+    POSType *pPosBuf;   //row scratch, 5 x row length
+    SPos    upLeft[FACE_NUMBER];
+    SPos    downRight[FACE_NUMBER];
+};
+
+//the worker i runs the task i of each dispatch, the same as the merge workers
+struct SMapWorkers
+{
+    std::mutex               mutex;
+    std::condition_variable  startCond;    //a dispatch starts, or the workers stop
+    std::condition_variable  doneCond;     //the last worker is done with the dispatch
+    std::vector<std::thread> threads;
+    int32_t                  threadNum;    //the requested threads, the calling thread included
+    Geometry                *pGeo;
+    SMapRowsTask            *tasks;
+    int32_t                  taskNum;
+    uint64_t                 dispatchCount;
+    int32_t                  pending;      //the workers not done with the current dispatch
+    bool                     bStop;
+};
+
+SMapWorkers* mapWorkersCreate(int32_t threadNum)
+{
+    SMapWorkers *pWorkers = new (std::nothrow) SMapWorkers;
+    if (!pWorkers)
+        return NULL;
+    pWorkers->threadNum = threadNum;
+    pWorkers->pGeo = NULL;
+    pWorkers->tasks = NULL;
+    pWorkers->taskNum = 0;
+    pWorkers->dispatchCount = 0;
+    pWorkers->pending = 0;
+    pWorkers->bStop = false;
+    try
+    {
+        pWorkers->threads.reserve(threadNum > 1 ? threadNum - 1 : 0);
+        for (int32_t t = 1; t < threadNum; t++)
+            pWorkers->threads.push_back(std::thread(Geometry::mapWorkerRun, pWorkers, t));
+    }
+    catch (...)
+    {
+        // the workers started so far are kept, the other tasks run on the calling thread
+    }
+    return pWorkers;
+}
+
+void mapWorkersDestroy(SMapWorkers* pWorkers)
+{
+    if (!pWorkers)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(pWorkers->mutex);
+        pWorkers->bStop = true;
+    }
+    pWorkers->startCond.notify_all();
+    for (size_t t = 0; t < pWorkers->threads.size(); t++)
+        pWorkers->threads[t].join();
+    delete pWorkers;
+}
+
+int32_t mapWorkersThreadNum(SMapWorkers* pWorkers)
+{
+    return pWorkers ? pWorkers->threadNum : 1;
+}
+
+void Geometry::mapWorkerRun(SMapWorkers *pWorkers, int32_t idx)
+{
+    uint64_t dispatchCount = 0;
+    std::unique_lock<std::mutex> lock(pWorkers->mutex);
+    while (1)
+    {
+        while (!pWorkers->bStop && pWorkers->dispatchCount == dispatchCount)
+            pWorkers->startCond.wait(lock);
+        if (pWorkers->bStop)
+            break;
+        dispatchCount = pWorkers->dispatchCount;
+        lock.unlock();
+
+        if (idx < pWorkers->taskNum)
+            pWorkers->pGeo->mapRows(pWorkers->tasks[idx]);
+
+        lock.lock();
+        if (--pWorkers->pending == 0)
+            pWorkers->doneCond.notify_one();
+    }
+}
 
 Geometry::Geometry()
 {
@@ -44,46 +148,64 @@ Geometry::Geometry()
     m_bPadded = false;
     m_bGeometryMapping = false;
     m_bConvOutputPaddingNeeded = false;
+    m_bBoundarySampling = false;
+    m_iMappingThreads = 1;
+    m_bSinglePrecision = false;
     m_numFaces = 0;
     m_upLeft = nullptr;
     m_downRight = nullptr;
+    m_pMapTasks = nullptr;
+    m_mapTaskNum = 0;
+    m_pMapWorkers = nullptr;
 }
 
 void Geometry::geoInit(SVideoInfo& sVideoInfo)
 {
     if(sVideoInfo.geoType==SVIDEO_VIEWPORT)
     {
-        m_numFaces = 0;
         m_upLeft = new SPos[FACE_NUMBER];//
         m_downRight = new SPos[FACE_NUMBER];//
-        SPos* pUpleftTmp = m_upLeft;
-        SPos* pDownRightTmp = m_downRight;
-        for (int32_t i = 0; i < FACE_NUMBER; i++)
-        {
-            pUpleftTmp->faceIdx = -1;
-            pUpleftTmp->x = 7680;// sVideoInfo.iFaceWidth; //7680
-            pUpleftTmp->y = 3840;// sVideoInfo.iFaceHeight; //3840
-            pDownRightTmp->faceIdx = -1;
-            pDownRightTmp->x = 0;
-            pDownRightTmp->y = 0;
-            pUpleftTmp++;
-            pDownRightTmp++;
-        }
     }
     m_sVideoInfo = sVideoInfo;
     m_bPadded = false;
     m_iMarginX = m_iMarginY = S_PAD_MAX;
+    resetMapping();
+}
+
+void Geometry::resetMapping()
+{
+    m_bGeometryMapping = false;
+    if (!m_upLeft || !m_downRight)
+        return;
+    m_numFaces = 0;
+    SPos* pUpleftTmp = m_upLeft;
+    SPos* pDownRightTmp = m_downRight;
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
+    {
+        pUpleftTmp->faceIdx = -1;
+        pUpleftTmp->x = 7680;// sVideoInfo.iFaceWidth; //7680
+        pUpleftTmp->y = 3840;// sVideoInfo.iFaceHeight; //3840
+        pDownRightTmp->faceIdx = -1;
+        pDownRightTmp->x = 0;
+        pDownRightTmp->y = 0;
+        pUpleftTmp++;
+        pDownRightTmp++;
+    }
 }
 
 void Geometry::geoUnInit()
 {
     delete[] m_upLeft;
     delete[] m_downRight;
+    m_upLeft = nullptr;
+    m_downRight = nullptr;
 
 }
 
 Geometry::~Geometry()
 {
+    delete[] m_pMapTasks;
+    m_pMapTasks = nullptr;
 }
 
 Geometry* Geometry::create(SVideoInfo& sVideoInfo)
@@ -101,109 +223,34 @@ Geometry* Geometry::create(SVideoInfo& sVideoInfo)
 void Geometry::geometryMapping(Geometry *pGeoSrc)
 {
     assert(!m_bGeometryMapping);
-    int32_t *pRot = m_sVideoInfo.sVideoRotation.degree;
 
     //For ViewPort, Set Rotation Matrix and K matrix
     if (m_sVideoInfo.geoType==SVIDEO_VIEWPORT)
     {
       ((ViewPort*)this)->setRotMat();
       ((ViewPort*)this)->setInvK();
+
+      //only the perimeter is needed to get the extents of each face
+      if (m_bBoundarySampling)
+      {
+          boundaryMapping(pGeoSrc);
+          m_bGeometryMapping = true;
+          return;
+      }
     }
-    //generate the map;
+    //generate the map, the rows are split to the mapping threads;
     for(int32_t fIdx=0; fIdx<m_sVideoInfo.iNumFaces; fIdx++)
     {
       for(int32_t ch=0; ch<1; ch++)//iNumMaps
       {
           int32_t iWidth = m_sVideoInfo.iFaceWidth;
-          int32_t iHeight = m_sVideoInfo.iFaceHeight;
           int32_t nMarginX = m_iMarginX;
-          int32_t nMarginY = m_iMarginY;
           int32_t nNextAreaX = iWidth + nMarginX;
-          for (int32_t j = -nMarginY; j < iHeight + nMarginY; j++)
-          {
-              for (int32_t i = -nMarginX; i < iWidth + nMarginX; i++)
-              {
-                  if (!m_bConvOutputPaddingNeeded && !insideFace((i), (j)))
-                      continue;
-
-                  int32_t xOrg = (i + nMarginX);
-                  int32_t ic = i;
-                  int32_t jc = j;
-                  {
-                      POSType x = (ic);
-                      POSType y = (jc);
-                      SPos in(fIdx, x, y, 0), pos3D;
-                      map2DTo3D(in, &pos3D);
-
-                      rotate3D(pos3D, pRot[0], pRot[1], pRot[2]);
-                      pGeoSrc->map3DTo2D(&pos3D, &pos3D);
-                      if (m_sVideoInfo.geoType == SVIDEO_VIEWPORT)
-                      {
-                          SPos *pUpLeftTmp = m_upLeft + pos3D.faceIdx;
-                          SPos *pDownRightTmp = m_downRight + pos3D.faceIdx;
-                          int32_t yTmp = (int32_t)pos3D.y;//(int32_t)(pos / stride);
-                          int32_t xTmp = (int32_t)pos3D.x;//(int32_t)(pos % stride);
-                                                          //if the input is the erp, should consider the boundary case
-                          if (xTmp == 0 && xOrg != 16 && pGeoSrc->getType() == SVIDEO_EQUIRECT)
-                          {
-                              nNextAreaX = i;
-                              break;
-                          }
-                          if (pUpLeftTmp->x > xTmp)
-                              pUpLeftTmp->x = xTmp;
-                          if (pUpLeftTmp->y > yTmp)
-                              pUpLeftTmp->y = yTmp;
-                          if (pDownRightTmp->x < xTmp)
-                              pDownRightTmp->x = xTmp;
-                          if (pDownRightTmp->y < yTmp)
-                              pDownRightTmp->y = yTmp;
-                          pUpLeftTmp->faceIdx = pos3D.faceIdx;
-                          pDownRightTmp->faceIdx = pos3D.faceIdx;
-                      }
-                  }
-              }
-          }
+          runMapRowsTasks(pGeoSrc, fIdx, -nMarginX, false, &nNextAreaX);
 
           // judge if exiting boundary when the source is erp format
           if (nNextAreaX != (iWidth + nMarginX) && (pGeoSrc->getType() == SVIDEO_EQUIRECT))
-          {
-              for (int32_t j = -nMarginY; j < iHeight + nMarginY; j++)
-              {
-                  for (int32_t i = nNextAreaX; i < iWidth + nMarginX; i++)
-                  {
-                      if (!m_bConvOutputPaddingNeeded && !insideFace((i), (j)))
-                          continue;
-                      int32_t ic = i;
-                      int32_t jc = j;
-                      {
-                          POSType x = (ic);
-                          POSType y = (jc);
-                          SPos in(fIdx, x, y, 0), pos3D;
-
-                          map2DTo3D(in, &pos3D);
-                          rotate3D(pos3D, pRot[0], pRot[1], pRot[2]);
-                          pGeoSrc->map3DTo2D(&pos3D, &pos3D);
-                          if (m_sVideoInfo.geoType == SVIDEO_VIEWPORT)
-                          {
-                              SPos *pUpLeftTmp = m_upLeft + 1;
-                              SPos *pDownRightTmp = m_downRight + 1;
-                              int32_t yTmp = (int32_t)pos3D.y;//(int32_t)(pos / stride);
-                              int32_t xTmp = (int32_t)pos3D.x;//(int32_t)(pos % stride);
-                              if (pUpLeftTmp->x > xTmp)
-                                  pUpLeftTmp->x = xTmp;
-                              if (pUpLeftTmp->y > yTmp)
-                                  pUpLeftTmp->y = yTmp;
-                              if (pDownRightTmp->x < xTmp)
-                                  pDownRightTmp->x = xTmp;
-                              if (pDownRightTmp->y < yTmp)
-                                  pDownRightTmp->y = yTmp;
-                              pUpLeftTmp->faceIdx = pos3D.faceIdx;
-                              pDownRightTmp->faceIdx = pos3D.faceIdx;
-                          }
-                      }
-                  }
-              }
-          }
+              runMapRowsTasks(pGeoSrc, fIdx, nNextAreaX, true, NULL);
       }
     }
 
@@ -220,6 +267,202 @@ void Geometry::geometryMapping(Geometry *pGeoSrc)
     m_bGeometryMapping = true;
 }
 
+void Geometry::mapRows(SMapRowsTask& task)
+{
+    Geometry *pGeoSrc = task.pGeoSrc;
+    int32_t iWidth = m_sVideoInfo.iFaceWidth;
+    int32_t nMarginX = m_iMarginX;
+    int32_t rowLen = iWidth + 2 * nMarginX;
+    int32_t *faceBuf = task.pFaceBuf;
+    POSType *posBuf = task.pPosBuf;
+    SPosArray in = { &faceBuf[0], &posBuf[0], &posBuf[rowLen], NULL };
+    SPosArray pos = { &faceBuf[rowLen], &posBuf[2 * rowLen], &posBuf[3 * rowLen], &posBuf[4 * rowLen] };
+
+    for (int32_t j = task.jStart; j < task.jEnd; j++)
+    {
+        int32_t num = mapRow(pGeoSrc, task.fIdx, j, task.iStart, iWidth + nMarginX, in, pos);
+        if (m_sVideoInfo.geoType != SVIDEO_VIEWPORT)
+            continue;
+        for (int32_t k = 0; k < num; k++)
+        {
+            int32_t i = (int32_t)in.x[k];
+            int32_t xOrg = (i + nMarginX);
+            int32_t boxIdx = task.bSeamArea ? 1 : pos.faceIdx[k];
+            SPos *pUpLeftTmp = task.upLeft + boxIdx;
+            SPos *pDownRightTmp = task.downRight + boxIdx;
+            int32_t yTmp = (int32_t)pos.y[k];//(int32_t)(pos / stride);
+            int32_t xTmp = (int32_t)pos.x[k];//(int32_t)(pos % stride);
+                                            //if the input is the erp, should consider the boundary case
+            if (!task.bSeamArea && xTmp == 0 && xOrg != 16 && pGeoSrc->getType() == SVIDEO_EQUIRECT)
+            {
+                task.nNextAreaX = i;
+                break;
+            }
+            if (pUpLeftTmp->x > xTmp)
+                pUpLeftTmp->x = xTmp;
+            if (pUpLeftTmp->y > yTmp)
+                pUpLeftTmp->y = yTmp;
+            if (pDownRightTmp->x < xTmp)
+                pDownRightTmp->x = xTmp;
+            if (pDownRightTmp->y < yTmp)
+                pDownRightTmp->y = yTmp;
+            pUpLeftTmp->faceIdx = pos.faceIdx[k];
+            pDownRightTmp->faceIdx = pos.faceIdx[k];
+        }
+    }
+}
+
+//each row only depends on itself, so the extents of the tasks are reduced
+//with min/max and the seam column is taken from the last row which has one,
+//the same as the single thread scan
+void Geometry::runMapRowsTasks(Geometry *pGeoSrc, int32_t fIdx, int32_t iStart, bool bSeamArea, int32_t *pNextAreaX)
+{
+    bool bViewport = (m_sVideoInfo.geoType == SVIDEO_VIEWPORT);
+    int32_t jBegin = -m_iMarginY;
+    int32_t rows = m_sVideoInfo.iFaceHeight + 2 * m_iMarginY;
+    int32_t threadNum = m_iMappingThreads < rows ? m_iMappingThreads : rows;
+    if (threadNum < 1)
+        threadNum = 1;
+
+    //the buffers only grow, so mapping the same geometry again does not allocate
+    int32_t rowLen = m_sVideoInfo.iFaceWidth + 2 * m_iMarginX;
+    if (m_mapTaskNum < threadNum)
+    {
+        delete[] m_pMapTasks;
+        m_pMapTasks = new SMapRowsTask[threadNum];
+        m_mapTaskNum = threadNum;
+    }
+    if (m_mapFaceBuf.size() < (size_t)threadNum * 2 * rowLen)
+        m_mapFaceBuf.resize((size_t)threadNum * 2 * rowLen);
+    if (m_mapPosBuf.size() < (size_t)threadNum * 5 * rowLen)
+        m_mapPosBuf.resize((size_t)threadNum * 5 * rowLen);
+    SMapRowsTask *tasks = m_pMapTasks;
+    for (int32_t t = 0; t < threadNum; t++)
+    {
+        SMapRowsTask& task = tasks[t];
+        task.pFaceBuf = &m_mapFaceBuf[(size_t)t * 2 * rowLen];
+        task.pPosBuf = &m_mapPosBuf[(size_t)t * 5 * rowLen];
+        task.pGeoSrc = pGeoSrc;
+        task.fIdx = fIdx;
+        task.jStart = jBegin + (int32_t)((int64_t)rows * t / threadNum);
+        task.jEnd = jBegin + (int32_t)((int64_t)rows * (t + 1) / threadNum);
+        task.iStart = iStart;
+        task.bSeamArea = bSeamArea;
+        task.nNextAreaX = -1;
+        for (int32_t i = 0; i < FACE_NUMBER && bViewport; i++)
+        {
+            task.upLeft[i] = m_upLeft[i];
+            task.downRight[i] = m_downRight[i];
+        }
+    }
+
+    SMapWorkers *pWorkers = m_pMapWorkers;
+    int32_t workerNum = pWorkers ? (int32_t)pWorkers->threads.size() : 0;
+    if (workerNum)
+    {
+        std::lock_guard<std::mutex> lock(pWorkers->mutex);
+        pWorkers->pGeo = this;
+        pWorkers->tasks = tasks;
+        pWorkers->taskNum = threadNum;
+        pWorkers->pending = workerNum;
+        pWorkers->dispatchCount++;
+    }
+    if (workerNum)
+        pWorkers->startCond.notify_all();
+
+    mapRows(tasks[0]);
+    for (int32_t t = workerNum + 1; t < threadNum; t++)
+        mapRows(tasks[t]);
+
+    if (workerNum)
+    {
+        std::unique_lock<std::mutex> lock(pWorkers->mutex);
+        while (pWorkers->pending)
+            pWorkers->doneCond.wait(lock);
+    }
+
+    for (int32_t t = 0; t < threadNum; t++)
+    {
+        SMapRowsTask& task = tasks[t];
+        if (pNextAreaX && task.nNextAreaX >= 0)
+            *pNextAreaX = task.nNextAreaX;
+        for (int32_t i = 0; i < FACE_NUMBER && bViewport; i++)
+        {
+            if (task.upLeft[i].faceIdx < 0)
+                continue;
+            if (m_upLeft[i].x > task.upLeft[i].x)
+                m_upLeft[i].x = task.upLeft[i].x;
+            if (m_upLeft[i].y > task.upLeft[i].y)
+                m_upLeft[i].y = task.upLeft[i].y;
+            if (m_downRight[i].x < task.downRight[i].x)
+                m_downRight[i].x = task.downRight[i].x;
+            if (m_downRight[i].y < task.downRight[i].y)
+                m_downRight[i].y = task.downRight[i].y;
+            m_upLeft[i].faceIdx = task.upLeft[i].faceIdx;
+            m_downRight[i].faceIdx = task.downRight[i].faceIdx;
+        }
+    }
+}
+
+//map the samples [iStart, iEnd) of row j to the source geometry, the samples
+//outside the face are skipped, in.x keeps the column of each mapped sample
+int32_t Geometry::mapRow(Geometry *pGeoSrc, int32_t fIdx, int32_t j, int32_t iStart, int32_t iEnd, SPosArray& in, SPosArray& pos)
+{
+    int32_t num = 0;
+    for (int32_t i = iStart; i < iEnd; i++)
+    {
+        if (!m_bConvOutputPaddingNeeded && !insideFace((i), (j)))
+            continue;
+        in.faceIdx[num] = fIdx;
+        in.x[num] = (POSType)i;
+        in.y[num] = (POSType)j;
+        num++;
+    }
+    if (!num)
+        return 0;
+    mapToSourceBatch(pGeoSrc, in, pos, num);
+    return num;
+}
+
+void Geometry::mapToSourceBatch(Geometry *pGeoSrc, SPosArray& in, SPosArray& pos, int32_t num)
+{
+    int32_t *pRot = m_sVideoInfo.sVideoRotation.degree;
+    map2DTo3DBatch(in, &pos, num);
+    rotate3DBatch(pos, num, pRot[0], pRot[1], pRot[2]);
+    pGeoSrc->map3DTo2DBatch(&pos, &pos, num);
+}
+
+void Geometry::map2DTo3DBatch(SPosArray& sPosIn, SPosArray *pSPosOut, int32_t num)
+{
+    for (int32_t i = 0; i < num; i++)
+    {
+        SPos in(sPosIn.faceIdx[i], sPosIn.x[i], sPosIn.y[i], 0), out;
+        map2DTo3D(in, &out);
+        pSPosOut->faceIdx[i] = out.faceIdx;
+        pSPosOut->x[i] = out.x;
+        pSPosOut->y[i] = out.y;
+        pSPosOut->z[i] = out.z;
+    }
+}
+
+void Geometry::map3DTo2DBatch(SPosArray *pSPosIn, SPosArray *pSPosOut, int32_t num)
+{
+    for (int32_t i = 0; i < num; i++)
+    {
+        SPos in(pSPosIn->faceIdx[i], pSPosIn->x[i], pSPosIn->y[i], pSPosIn->z[i]), out;
+        map3DTo2D(&in, &out);
+        pSPosOut->faceIdx[i] = out.faceIdx;
+        pSPosOut->x[i] = out.x;
+        pSPosOut->y[i] = out.y;
+        pSPosOut->z[i] = out.z;
+    }
+}
+
+void Geometry::rotate3DBatch(SPosArray& sPos, int32_t num, int32_t rx, int32_t ry, int32_t rz)
+{
+    geoBatchRotate3D(&sPos, num, rx, ry, rz);
+}
+
 /***************************************************
 //convert source geometry to destination geometry;
 ****************************************************/
@@ -266,3 +509,218 @@ void Geometry::rotate3D(SPos& sPos, int32_t rx, int32_t ry, int32_t rz)
     sPos.y = y;
     sPos.z = z;
 }
+
+void Geometry::mapToSource(Geometry *pGeoSrc, POSType x, POSType y, SPos *pSPosOut)
+{
+    int32_t *pRot = m_sVideoInfo.sVideoRotation.degree;
+    SPos in(0, x, y, 0);
+    map2DTo3D(in, pSPosOut);
+    rotate3D(*pSPosOut, pRot[0], pRot[1], pRot[2]);
+    pGeoSrc->map3DTo2D(pSPosOut, pSPosOut);
+}
+
+/***************************************************
+//the extents of the viewport in each face only depend on the perimeter of the viewport,
+//because the mapping has no extremum inside except at the poles of erp and the corners of cubemap,
+//these points are checked explicitly, and the erp seam is split into two areas as geometryMapping does
+****************************************************/
+void Geometry::boundaryMapping(Geometry *pGeoSrc)
+{
+    int32_t *pRot = m_sVideoInfo.sVideoRotation.degree;
+    int32_t iWidth = m_sVideoInfo.iFaceWidth;
+    int32_t iHeight = m_sVideoInfo.iFaceHeight;
+    bool bERP = (pGeoSrc->getType() == SVIDEO_EQUIRECT);
+    int32_t iSrcWidth = pGeoSrc->m_sVideoInfo.iFaceWidth;
+    int32_t iSrcHeight = pGeoSrc->m_sVideoInfo.iFaceHeight;
+    if (iWidth < 2 || iHeight < 2)
+        return;
+
+    // for erp, [0] holds the area right of the seam, [1] the area left of the seam, [2] the whole area
+    SPos erpUpLeft[3], erpDownRight[3];
+    for (int32_t i = 0; i < 3; i++)
+    {
+        erpUpLeft[i] = SPos(-1, iSrcWidth, iSrcHeight, 0);
+        erpDownRight[i] = SPos(-1, 0, 0, 0);
+    }
+    int32_t seamCnt = 0;
+
+    // walk along the perimeter: top, right, bottom, left, and back to the start point
+    int32_t perimeter = 2 * (iWidth - 1) + 2 * (iHeight - 1);
+    POSType xPrev = 0, yPrev = 0;
+    SPos posPrev;
+    for (int32_t k = 0; k <= perimeter; k++)
+    {
+        int32_t n = k % perimeter;
+        POSType x, y;
+        if (n < iWidth - 1)
+        {
+            x = n;
+            y = 0;
+        }
+        else if (n < iWidth - 1 + iHeight - 1)
+        {
+            x = iWidth - 1;
+            y = n - (iWidth - 1);
+        }
+        else if (n < 2 * (iWidth - 1) + iHeight - 1)
+        {
+            x = (iWidth - 1) - (n - (iWidth - 1 + iHeight - 1));
+            y = iHeight - 1;
+        }
+        else
+        {
+            x = 0;
+            y = (iHeight - 1) - (n - (2 * (iWidth - 1) + iHeight - 1));
+        }
+
+        SPos pos;
+        mapToSource(pGeoSrc, x, y, &pos);
+
+        int32_t nPoints = 1;
+        SPos points[3];
+        points[0] = pos;
+        bool bSeam = bERP && k > 0 && sfabs(pos.x - posPrev.x) > (iSrcWidth >> 1);
+        bool bFaceChange = !bERP && k > 0 && pos.faceIdx != posPrev.faceIdx;
+        if (bSeam || bFaceChange)
+        {
+            // locate the crossing between the two samples, and add the points on both sides
+            POSType tLow = 0, tHigh = 1;
+            SPos posLow = posPrev, posHigh = pos;
+            for (int32_t iter = 0; iter < 24; iter++)
+            {
+                POSType t = (tLow + tHigh) / 2;
+                SPos posMid;
+                mapToSource(pGeoSrc, xPrev + (x - xPrev) * t, yPrev + (y - yPrev) * t, &posMid);
+                bool bSameSide = bERP ? (sfabs(posMid.x - posPrev.x) <= (iSrcWidth >> 1)) : (posMid.faceIdx == posPrev.faceIdx);
+                if (bSameSide)
+                {
+                    tLow = t;
+                    posLow = posMid;
+                }
+                else
+                {
+                    tHigh = t;
+                    posHigh = posMid;
+                }
+            }
+            points[nPoints++] = posLow;
+            points[nPoints++] = posHigh;
+            if (bSeam)
+                seamCnt++;
+        }
+
+        for (int32_t p = 0; p < nPoints; p++)
+        {
+            int32_t xTmp = (int32_t)points[p].x;
+            int32_t yTmp = (int32_t)points[p].y;
+            int32_t idx[2] = { points[p].faceIdx, -1 };
+            SPos *pUpLeft = m_upLeft;
+            SPos *pDownRight = m_downRight;
+            if (bERP)
+            {
+                pUpLeft = erpUpLeft;
+                pDownRight = erpDownRight;
+                idx[0] = (points[p].x >= (iSrcWidth >> 1)) ? 0 : 1;
+                idx[1] = 2;
+            }
+            for (int32_t b = 0; b < 2 && idx[b] >= 0; b++)
+            {
+                SPos *pUpLeftTmp = pUpLeft + idx[b];
+                SPos *pDownRightTmp = pDownRight + idx[b];
+                if (pUpLeftTmp->x > xTmp)
+                    pUpLeftTmp->x = xTmp;
+                if (pUpLeftTmp->y > yTmp)
+                    pUpLeftTmp->y = yTmp;
+                if (pDownRightTmp->x < xTmp)
+                    pDownRightTmp->x = xTmp;
+                if (pDownRightTmp->y < yTmp)
+                    pDownRightTmp->y = yTmp;
+                pUpLeftTmp->faceIdx = points[p].faceIdx;
+                pDownRightTmp->faceIdx = points[p].faceIdx;
+            }
+        }
+        xPrev = x;
+        yPrev = y;
+        posPrev = pos;
+    }
+
+    if (bERP)
+    {
+        // a pole inside the viewport reaches the top or bottom row, and covers all the longitudes
+        bool bPole = false;
+        for (int32_t i = 0; i < 2; i++)
+        {
+            SPos pole(0, 0, (i == 0) ? 1 : -1, 0), posView;
+            rotate3D(pole, 0, 0, -pRot[2]);
+            rotate3D(pole, 0, -pRot[1], 0);
+            rotate3D(pole, -pRot[0], 0, 0);
+            map3DTo2D(&pole, &posView);
+            if (posView.faceIdx < 0 || posView.x < 0 || posView.x > iWidth - 1 || posView.y < 0 || posView.y > iHeight - 1)
+                continue;
+            bPole = true;
+            erpUpLeft[2].x = 0;
+            erpDownRight[2].x = iSrcWidth - 1;
+            if (i == 0)
+                erpUpLeft[2].y = 0;
+            else
+                erpDownRight[2].y = iSrcHeight - 1;
+        }
+
+        if (!bPole && seamCnt > 0 && erpUpLeft[0].faceIdx >= 0 && erpUpLeft[1].faceIdx >= 0)
+        {
+            m_upLeft[0] = erpUpLeft[0];
+            m_downRight[0] = erpDownRight[0];
+            m_upLeft[1] = erpUpLeft[1];
+            m_downRight[1] = erpDownRight[1];
+        }
+        else
+        {
+            m_upLeft[0] = erpUpLeft[2];
+            m_downRight[0] = erpDownRight[2];
+        }
+    }
+    else
+    {
+        // a corner of the cube inside the viewport is a corner of its three faces
+        for (int32_t v = 0; v < 8; v++)
+        {
+            SPos corner(0, (v & 1) ? 1 : -1, (v & 2) ? 1 : -1, (v & 4) ? 1 : -1), posView;
+            SPos cornerView = corner;
+            rotate3D(cornerView, 0, 0, -pRot[2]);
+            rotate3D(cornerView, 0, -pRot[1], 0);
+            rotate3D(cornerView, -pRot[0], 0, 0);
+            map3DTo2D(&cornerView, &posView);
+            if (posView.faceIdx < 0 || posView.x < 0 || posView.x > iWidth - 1 || posView.y < 0 || posView.y > iHeight - 1)
+                continue;
+            for (int32_t axis = 0; axis < 3; axis++)
+            {
+                SPos pos = corner;
+                POSType *pAxis = (axis == 0) ? &pos.x : ((axis == 1) ? &pos.y : &pos.z);
+                *pAxis *= (1 + S_EPS);
+                pGeoSrc->map3DTo2D(&pos, &pos);
+                int32_t xTmp = (int32_t)pos.x;
+                int32_t yTmp = (int32_t)pos.y;
+                SPos *pUpLeftTmp = m_upLeft + pos.faceIdx;
+                SPos *pDownRightTmp = m_downRight + pos.faceIdx;
+                if (pUpLeftTmp->x > xTmp)
+                    pUpLeftTmp->x = xTmp;
+                if (pUpLeftTmp->y > yTmp)
+                    pUpLeftTmp->y = yTmp;
+                if (pDownRightTmp->x < xTmp)
+                    pDownRightTmp->x = xTmp;
+                if (pDownRightTmp->y < yTmp)
+                    pDownRightTmp->y = yTmp;
+                pUpLeftTmp->faceIdx = pos.faceIdx;
+                pDownRightTmp->faceIdx = pos.faceIdx;
+            }
+        }
+    }
+
+    SPos *pUpLeftTmp = m_upLeft;
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
+    {
+        if (pUpLeftTmp->faceIdx >= 0)
+            m_numFaces++;
+        pUpLeftTmp++;
+    }
+}
@@ -32,6 +32,7 @@
 #define __360SCVP_GEOMETRY__
 #include <math.h>
 #include <stdint.h>
+#include <vector>
 #include "360SCVPCommonDef.h"
 // ====================================================================================================================
 // Class definition
@@ -66,6 +67,15 @@ struct SPos
     SPos(int32_t f, POSType xIn, POSType yIn, POSType zIn ) : faceIdx(f), x(xIn), y(yIn), z(zIn) {};
 };
 
+//structure of arrays of positions, used by the batch mapping
+struct SPosArray
+{
+    int32_t *faceIdx;
+    POSType *x;
+    POSType *y;
+    POSType *z;
+};
+
 struct GeometryRotation
 {
     int32_t degree[3];  //[x/y/z];
@@ -90,6 +100,15 @@ struct SVideoInfo
     ViewPortSettings viewPort;
 };
 
+struct SMapRowsTask;
+struct SMapWorkers;
+
+//the worker threads of the mapping, they are started once and run the row tasks of each runMapRowsTasks,
+//the threads without a worker run on the calling thread
+SMapWorkers* mapWorkersCreate(int32_t threadNum);
+void mapWorkersDestroy(SMapWorkers* pWorkers);
+int32_t mapWorkersThreadNum(SMapWorkers* pWorkers);
+
 class Geometry
 {
 protected:
@@ -99,8 +118,25 @@ protected:
     bool m_bPadded;
     bool m_bGeometryMapping;
     bool m_bConvOutputPaddingNeeded;
+    bool m_bBoundarySampling;
+    int32_t m_iMappingThreads;
+    bool m_bSinglePrecision;
+    //the tasks and row buffers of the mapping, kept to map again without allocation
+    SMapRowsTask* m_pMapTasks;
+    int32_t m_mapTaskNum;
+    SMapWorkers* m_pMapWorkers; //not owned, the rows run on the calling thread when it is NULL
+    std::vector<int32_t> m_mapFaceBuf;
+    std::vector<POSType> m_mapPosBuf;
     inline int32_t round(POSType t) { return (int32_t)(t+ (t>=0? 0.5 :-0.5)); }; 
     void rotate3D(SPos& sPos, int32_t rx, int32_t ry, int32_t rz);
+    void rotate3DBatch(SPosArray& sPos, int32_t num, int32_t rx, int32_t ry, int32_t rz);
+    int32_t mapRow(Geometry *pGeoSrc, int32_t fIdx, int32_t j, int32_t iStart, int32_t iEnd, SPosArray& in, SPosArray& pos);
+    void mapRows(SMapRowsTask& task);
+    void runMapRowsTasks(Geometry *pGeoSrc, int32_t fIdx, int32_t iStart, bool bSeamArea, int32_t *pNextAreaX);
+    static void mapWorkerRun(SMapWorkers *pWorkers, int32_t idx);
+    friend SMapWorkers* mapWorkersCreate(int32_t threadNum);
+    void mapToSource(Geometry *pGeoSrc, POSType x, POSType y, SPos *pSPosOut);
+    void boundaryMapping(Geometry *pGeoSrc);
 public:
     int32_t m_numFaces;
     SPos* m_upLeft;
@@ -109,13 +145,24 @@ public:
     virtual ~Geometry();
     void geoInit(SVideoInfo& sVideoInfo);
     void geoUnInit(); // just use in the viewport
+    void resetMapping(); // clear the extents so that the geometry can be mapped again
     GeometryType getType() { return (GeometryType)m_sVideoInfo.geoType; };
+    const SVideoInfo* getVideoInfo() { return &m_sVideoInfo; };
     void setPaddingFlag(bool bFlag) { m_bPadded = bFlag; }
+    void setBoundarySampling(bool bFlag) { m_bBoundarySampling = bFlag; }
+    void setMappingThreads(int32_t threadNum) { m_iMappingThreads = threadNum > 0 ? threadNum : 1; }
+    void setMappingWorkers(SMapWorkers* pWorkers) { m_pMapWorkers = pWorkers; }
+    void setSinglePrecision(bool bFlag) { m_bSinglePrecision = bFlag; } // fast approximate batch mapping to this geometry
     virtual void map2DTo3D(SPos& IPosIn, SPos *pSPosOut) = 0;
     virtual void map3DTo2D(SPos *pSPosIn, SPos *pSPosOut) = 0;
+    //batch versions over num positions, the default ones call the per position functions
+    virtual void map2DTo3DBatch(SPosArray& sPosIn, SPosArray *pSPosOut, int32_t num);
+    virtual void map3DTo2DBatch(SPosArray *pSPosIn, SPosArray *pSPosOut, int32_t num);
     virtual void geoConvert(Geometry *pGeoDst);
     virtual bool insideFace(int32_t x, int32_t y) { return ( x>=0 && x<(m_sVideoInfo.iFaceWidth) && y>=0 && y<(m_sVideoInfo.iFaceHeight) ); }
     virtual void geometryMapping(Geometry *pGeoSrc);
+    //map num positions of this geometry to the source geometry, the viewport matrices must be set
+    void mapToSourceBatch(Geometry *pGeoSrc, SPosArray& in, SPosArray& pos, int32_t num);
     static Geometry* create(SVideoInfo& sVideoInfo);
  };
 
@@ -0,0 +1,729 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file     360SCVPGeometryBatch.cpp
+    \brief    batch kernels for the geometry coordinate mapping
+*/
+
+// The kernels evaluate exactly the same operations in the same order as the
+// per point functions of EquiRect, CubeMap, ViewPort and Geometry::rotate3D,
+// and no fused multiply-add is used, so the results are bit identical to them.
+// The only exception is the fast erp kernel, which trades precision for speed.
+
+#include <atomic>
+#include "360SCVPGeometryBatch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEO_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+static std::atomic<int32_t> s_kernelLevelLimit(GEO_KERNEL_NUM);
+
+static int32_t geoKernelDetect()
+{
+#ifdef GEO_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return GEO_KERNEL_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return GEO_KERNEL_SSE4;
+#endif
+    return GEO_KERNEL_SCALAR;
+}
+
+int32_t geoKernelGetLevel()
+{
+    static const int32_t detected = geoKernelDetect();
+    int32_t limit = s_kernelLevelLimit;
+    return detected < limit ? detected : limit;
+}
+
+int32_t geoKernelSetLevel(int32_t level)
+{
+    if (level < GEO_KERNEL_SCALAR)
+        level = GEO_KERNEL_SCALAR;
+    s_kernelLevelLimit = level;
+    return geoKernelGetLevel();
+}
+
+/***************************************************
+// scalar kernels, also used for the tail points
+****************************************************/
+static void viewportMap2DTo3DScalar(POSType matInvK[3][3], POSType matRot[3][3], SPosArray *pIn, SPosArray *pOut, int32_t start, int32_t num)
+{
+    for (int32_t i = start; i < num; i++)
+    {
+        POSType u = pIn->x[i] + (POSType)(0.5);
+        POSType v = pIn->y[i] + (POSType)(0.5);
+        POSType x2 = matInvK[0][0]*u + matInvK[0][1]*v + matInvK[0][2];
+        POSType y2 = matInvK[1][0]*u + matInvK[1][1]*v + matInvK[1][2];
+
+        POSType z1 = 1/ssqrt(x2*x2+y2*y2+1);
+        POSType x1 = z1*x2;
+        POSType y1 = z1*y2;
+
+        pOut->x[i] = matRot[0][0]*x1 + matRot[0][1]*y1 + matRot[0][2]*z1;
+        pOut->y[i] = matRot[1][0]*x1 + matRot[1][1]*y1 + matRot[1][2]*z1;
+        pOut->z[i] = matRot[2][0]*x1 + matRot[2][1]*y1 + matRot[2][2]*z1;
+    }
+}
+
+static void rotatePlaneScalar(POSType *pA, POSType *pB, int32_t start, int32_t num, POSType c00, POSType c01, POSType c10, POSType c11)
+{
+    for (int32_t i = start; i < num; i++)
+    {
+        POSType t1 = c00*pA[i] + c01*pB[i];
+        POSType t2 = c10*pA[i] + c11*pB[i];
+        pA[i] = t1;
+        pB[i] = t2;
+    }
+}
+
+static void equiRectMap3DTo2DScalar(SPosArray *pIn, SPosArray *pOut, int32_t start, int32_t num, int32_t width, int32_t height)
+{
+    for (int32_t i = start; i < num; i++)
+    {
+        POSType x = pIn->x[i];
+        POSType y = pIn->y[i];
+        POSType z = pIn->z[i];
+        pOut->faceIdx[i] = 0;
+        pOut->z[i] = 0;
+        pOut->x[i] = (POSType)((S_PI-satan2(z, x))*width/(2*S_PI)) - 0.5;
+        POSType len = ssqrt(x*x + y*y + z*z);
+        pOut->y[i] = (POSType)((len < S_EPS? 0.5 : sacos(y/len)/S_PI)*height) - 0.5;
+    }
+}
+
+// the fast erp kernels evaluate the angles in single precision with a minimax
+// polynomial of atan, and the pitch as atan2(sqrt(x*x+z*z), y) which keeps the
+// precision near the poles, the error is about 2e-6 radian. The vector kernels
+// do the same operations as geoFastAtan2, so all the levels give the same result
+#define GEO_FAST_PI     3.14159274f
+#define GEO_FAST_PI_2   1.57079637f
+#define GEO_FAST_ATAN_C0  0.99997726f
+#define GEO_FAST_ATAN_C1 -0.33262347f
+#define GEO_FAST_ATAN_C2  0.19354346f
+#define GEO_FAST_ATAN_C3 -0.11643287f
+#define GEO_FAST_ATAN_C4  0.05265332f
+#define GEO_FAST_ATAN_C5 -0.01172120f
+
+static inline float geoFastAtan2(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float mx = ax > ay ? ax : ay;
+    float mn = ax > ay ? ay : ax;
+    float a = mx > 0 ? mn / mx : 0;
+    float s = a * a;
+    float r = s * GEO_FAST_ATAN_C5 + GEO_FAST_ATAN_C4;
+    r = r * s + GEO_FAST_ATAN_C3;
+    r = r * s + GEO_FAST_ATAN_C2;
+    r = r * s + GEO_FAST_ATAN_C1;
+    r = r * s + GEO_FAST_ATAN_C0;
+    r = r * a;
+    if (ay > ax)
+        r = GEO_FAST_PI_2 - r;
+    if (x < 0)
+        r = GEO_FAST_PI - r;
+    if (signbit(y))
+        r = -r;
+    return r;
+}
+
+static void equiRectMap3DTo2DFastScalar(SPosArray *pIn, SPosArray *pOut, int32_t start, int32_t num, int32_t width, int32_t height)
+{
+    for (int32_t i = start; i < num; i++)
+    {
+        float x = (float)pIn->x[i];
+        float y = (float)pIn->y[i];
+        float z = (float)pIn->z[i];
+        float xz = x*x + z*z;
+        float len = sqrtf(xz + y*y);
+        POSType yaw = (POSType)geoFastAtan2(z, x);
+        POSType pitch = (POSType)geoFastAtan2(sqrtf(xz), y);
+        pOut->faceIdx[i] = 0;
+        pOut->z[i] = 0;
+        pOut->x[i] = (S_PI - yaw)*width/(2*S_PI) - 0.5;
+        pOut->y[i] = (len < (float)S_EPS ? 0.5 : pitch/S_PI)*height - 0.5;
+    }
+}
+
+static void cubeMapMap3DTo2DScalar(SPosArray *pIn, SPosArray *pOut, int32_t start, int32_t num, int32_t width, int32_t height)
+{
+    for (int32_t i = start; i < num; i++)
+    {
+        POSType x = pIn->x[i];
+        POSType y = pIn->y[i];
+        POSType z = pIn->z[i];
+        POSType aX = sfabs(x);
+        POSType aY = sfabs(y);
+        POSType aZ = sfabs(z);
+        POSType pu, pv;
+        int32_t faceIdx;
+        if (aX >= aY && aX >= aZ)
+        {
+            faceIdx = x > 0 ? 0 : 1;
+            pu = (x > 0 ? -z : z)/aX;
+            pv = -y/aX;
+        }
+        else if (aY >= aX && aY >= aZ)
+        {
+            faceIdx = y > 0 ? 2 : 3;
+            pu = x/aY;
+            pv = (y > 0 ? z : -z)/aY;
+        }
+        else
+        {
+            faceIdx = z > 0 ? 4 : 5;
+            pu = (z > 0 ? x : -x)/aZ;
+            pv = -y/aZ;
+        }
+        pOut->faceIdx[i] = faceIdx;
+        pOut->z[i] = 0;
+        pOut->x[i] = (POSType)((pu+1.0)*(width>>1) + (-0.5));
+        pOut->y[i] = (POSType)((pv+1.0)*(height>>1)+ (-0.5));
+    }
+}
+
+#ifdef GEO_KERNEL_X86
+/***************************************************
+// AVX2 kernels, 4 points per iteration
+****************************************************/
+__attribute__((target("avx2")))
+static int32_t viewportMap2DTo3DAVX2(POSType matInvK[3][3], POSType matRot[3][3], SPosArray *pIn, SPosArray *pOut, int32_t num)
+{
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d k00 = _mm256_set1_pd(matInvK[0][0]), k01 = _mm256_set1_pd(matInvK[0][1]), k02 = _mm256_set1_pd(matInvK[0][2]);
+    __m256d k10 = _mm256_set1_pd(matInvK[1][0]), k11 = _mm256_set1_pd(matInvK[1][1]), k12 = _mm256_set1_pd(matInvK[1][2]);
+    __m256d r[3][3];
+    for (int32_t m = 0; m < 3; m++)
+        for (int32_t n = 0; n < 3; n++)
+            r[m][n] = _mm256_set1_pd(matRot[m][n]);
+
+    int32_t i = 0;
+    for (; i + 4 <= num; i += 4)
+    {
+        __m256d u = _mm256_add_pd(_mm256_loadu_pd(pIn->x + i), half);
+        __m256d v = _mm256_add_pd(_mm256_loadu_pd(pIn->y + i), half);
+        __m256d x2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(k00, u), _mm256_mul_pd(k01, v)), k02);
+        __m256d y2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(k10, u), _mm256_mul_pd(k11, v)), k12);
+        __m256d z1 = _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x2, x2), _mm256_mul_pd(y2, y2)), one)));
+        __m256d x1 = _mm256_mul_pd(z1, x2);
+        __m256d y1 = _mm256_mul_pd(z1, y2);
+        POSType *pDst[3] = { pOut->x + i, pOut->y + i, pOut->z + i };
+        for (int32_t m = 0; m < 3; m++)
+        {
+            __m256d t = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(r[m][0], x1), _mm256_mul_pd(r[m][1], y1)), _mm256_mul_pd(r[m][2], z1));
+            _mm256_storeu_pd(pDst[m], t);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int32_t rotatePlaneAVX2(POSType *pA, POSType *pB, int32_t num, POSType c00, POSType c01, POSType c10, POSType c11)
+{
+    __m256d v00 = _mm256_set1_pd(c00), v01 = _mm256_set1_pd(c01);
+    __m256d v10 = _mm256_set1_pd(c10), v11 = _mm256_set1_pd(c11);
+    int32_t i = 0;
+    for (; i + 4 <= num; i += 4)
+    {
+        __m256d a = _mm256_loadu_pd(pA + i);
+        __m256d b = _mm256_loadu_pd(pB + i);
+        _mm256_storeu_pd(pA + i, _mm256_add_pd(_mm256_mul_pd(v00, a), _mm256_mul_pd(v01, b)));
+        _mm256_storeu_pd(pB + i, _mm256_add_pd(_mm256_mul_pd(v10, a), _mm256_mul_pd(v11, b)));
+    }
+    return i;
+}
+
+// atan2 and acos have no vector equivalent with the precision of libm, they
+// are evaluated per lane and everything around them is vectorized
+__attribute__((target("avx2")))
+static int32_t equiRectMap3DTo2DAVX2(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    __m256d pi = _mm256_set1_pd(S_PI);
+    __m256d twoPi = _mm256_set1_pd(2*S_PI);
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d eps = _mm256_set1_pd(S_EPS);
+    __m256d w = _mm256_set1_pd((POSType)width);
+    __m256d h = _mm256_set1_pd((POSType)height);
+    __m256d zero = _mm256_setzero_pd();
+    POSType xs[4], zs[4], rs[4], as[4], cs[4];
+
+    int32_t i = 0;
+    for (; i + 4 <= num; i += 4)
+    {
+        __m256d x = _mm256_loadu_pd(pIn->x + i);
+        __m256d y = _mm256_loadu_pd(pIn->y + i);
+        __m256d z = _mm256_loadu_pd(pIn->z + i);
+        __m256d len = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x), _mm256_mul_pd(y, y)), _mm256_mul_pd(z, z)));
+        _mm256_storeu_pd(xs, x);
+        _mm256_storeu_pd(zs, z);
+        _mm256_storeu_pd(rs, _mm256_div_pd(y, len));
+        for (int32_t k = 0; k < 4; k++)
+        {
+            as[k] = satan2(zs[k], xs[k]);
+            cs[k] = sacos(rs[k]);
+        }
+        __m256d ox = _mm256_sub_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(pi, _mm256_loadu_pd(as)), w), twoPi), half);
+        __m256d t = _mm256_div_pd(_mm256_loadu_pd(cs), pi);
+        t = _mm256_blendv_pd(t, half, _mm256_cmp_pd(len, eps, _CMP_LT_OQ));
+        __m256d oy = _mm256_sub_pd(_mm256_mul_pd(t, h), half);
+        _mm256_storeu_pd(pOut->x + i, ox);
+        _mm256_storeu_pd(pOut->y + i, oy);
+        _mm256_storeu_pd(pOut->z + i, zero);
+        _mm_storeu_si128((__m128i*)(pOut->faceIdx + i), _mm_setzero_si128());
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static inline __m256 geoFastAtan2AVX2(__m256 y, __m256 x)
+{
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 ax = _mm256_andnot_ps(sign, x);
+    __m256 ay = _mm256_andnot_ps(sign, y);
+    __m256 mx = _mm256_max_ps(ax, ay);
+    __m256 mn = _mm256_min_ps(ax, ay);
+    __m256 a = _mm256_blendv_ps(zero, _mm256_div_ps(mn, mx), _mm256_cmp_ps(mx, zero, _CMP_GT_OQ));
+    __m256 s = _mm256_mul_ps(a, a);
+    __m256 r = _mm256_add_ps(_mm256_mul_ps(s, _mm256_set1_ps(GEO_FAST_ATAN_C5)), _mm256_set1_ps(GEO_FAST_ATAN_C4));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(GEO_FAST_ATAN_C3));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(GEO_FAST_ATAN_C2));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(GEO_FAST_ATAN_C1));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(GEO_FAST_ATAN_C0));
+    r = _mm256_mul_ps(r, a);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(GEO_FAST_PI_2), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(GEO_FAST_PI), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+    return _mm256_xor_ps(r, _mm256_and_ps(sign, y));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 geoLoad8PS(const POSType *p)
+{
+    __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd(p));
+    __m128 hi = _mm256_cvtpd_ps(_mm256_loadu_pd(p + 4));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+__attribute__((target("avx2")))
+static int32_t equiRectMap3DTo2DFastAVX2(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    __m256d pi = _mm256_set1_pd(S_PI);
+    __m256d twoPi = _mm256_set1_pd(2*S_PI);
+    __m256d half = _mm256_set1_pd(0.5);
+    __m256d w = _mm256_set1_pd((POSType)width);
+    __m256d h = _mm256_set1_pd((POSType)height);
+    __m256d zero = _mm256_setzero_pd();
+    __m256 eps = _mm256_set1_ps((float)S_EPS);
+
+    int32_t i = 0;
+    for (; i + 8 <= num; i += 8)
+    {
+        __m256 x = geoLoad8PS(pIn->x + i);
+        __m256 y = geoLoad8PS(pIn->y + i);
+        __m256 z = geoLoad8PS(pIn->z + i);
+        __m256 xz = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(z, z));
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(xz, _mm256_mul_ps(y, y)));
+        __m256 yaw = geoFastAtan2AVX2(z, x);
+        __m256 pitch = geoFastAtan2AVX2(_mm256_sqrt_ps(xz), y);
+        __m256 pole = _mm256_cmp_ps(len, eps, _CMP_LT_OQ);
+        for (int32_t k = 0; k < 2; k++)
+        {
+            __m256d a = _mm256_cvtps_pd(k ? _mm256_extractf128_ps(yaw, 1) : _mm256_castps256_ps128(yaw));
+            __m256d c = _mm256_cvtps_pd(k ? _mm256_extractf128_ps(pitch, 1) : _mm256_castps256_ps128(pitch));
+            __m256d m = _mm256_cvtps_pd(k ? _mm256_extractf128_ps(pole, 1) : _mm256_castps256_ps128(pole));
+            __m256d ox = _mm256_sub_pd(_mm256_div_pd(_mm256_mul_pd(_mm256_sub_pd(pi, a), w), twoPi), half);
+            __m256d t = _mm256_blendv_pd(_mm256_div_pd(c, pi), half, m);
+            __m256d oy = _mm256_sub_pd(_mm256_mul_pd(t, h), half);
+            _mm256_storeu_pd(pOut->x + i + 4 * k, ox);
+            _mm256_storeu_pd(pOut->y + i + 4 * k, oy);
+            _mm256_storeu_pd(pOut->z + i + 4 * k, zero);
+        }
+        _mm256_storeu_si256((__m256i*)(pOut->faceIdx + i), _mm256_setzero_si256());
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int32_t cubeMapMap3DTo2DAVX2(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d zero = _mm256_setzero_pd();
+    __m256d one = _mm256_set1_pd(1.0);
+    __m256d mhalf = _mm256_set1_pd(-0.5);
+    __m256d wh = _mm256_set1_pd((POSType)(width>>1));
+    __m256d hh = _mm256_set1_pd((POSType)(height>>1));
+    __m256d face[6];
+    for (int32_t f = 0; f < 6; f++)
+        face[f] = _mm256_set1_pd((POSType)f);
+
+    int32_t i = 0;
+    for (; i + 4 <= num; i += 4)
+    {
+        __m256d x = _mm256_loadu_pd(pIn->x + i);
+        __m256d y = _mm256_loadu_pd(pIn->y + i);
+        __m256d z = _mm256_loadu_pd(pIn->z + i);
+        __m256d nx = _mm256_xor_pd(x, sign);
+        __m256d ny = _mm256_xor_pd(y, sign);
+        __m256d nz = _mm256_xor_pd(z, sign);
+        __m256d aX = _mm256_andnot_pd(sign, x);
+        __m256d aY = _mm256_andnot_pd(sign, y);
+        __m256d aZ = _mm256_andnot_pd(sign, z);
+        __m256d mX = _mm256_and_pd(_mm256_cmp_pd(aX, aY, _CMP_GE_OQ), _mm256_cmp_pd(aX, aZ, _CMP_GE_OQ));
+        __m256d mY = _mm256_andnot_pd(mX, _mm256_and_pd(_mm256_cmp_pd(aY, aX, _CMP_GE_OQ), _mm256_cmp_pd(aY, aZ, _CMP_GE_OQ)));
+        __m256d pX = _mm256_cmp_pd(x, zero, _CMP_GT_OQ);
+        __m256d pY = _mm256_cmp_pd(y, zero, _CMP_GT_OQ);
+        __m256d pZ = _mm256_cmp_pd(z, zero, _CMP_GT_OQ);
+
+        // z faces, then overwritten by the y and x faces
+        __m256d nu = _mm256_blendv_pd(nx, x, pZ);
+        __m256d nv = ny;
+        __m256d d = aZ;
+        __m256d f = _mm256_blendv_pd(face[5], face[4], pZ);
+
+        nu = _mm256_blendv_pd(nu, x, mY);
+        nv = _mm256_blendv_pd(nv, _mm256_blendv_pd(nz, z, pY), mY);
+        d = _mm256_blendv_pd(d, aY, mY);
+        f = _mm256_blendv_pd(f, _mm256_blendv_pd(face[3], face[2], pY), mY);
+
+        nu = _mm256_blendv_pd(nu, _mm256_blendv_pd(z, nz, pX), mX);
+        nv = _mm256_blendv_pd(nv, ny, mX);
+        d = _mm256_blendv_pd(d, aX, mX);
+        f = _mm256_blendv_pd(f, _mm256_blendv_pd(face[1], face[0], pX), mX);
+
+        __m256d pu = _mm256_div_pd(nu, d);
+        __m256d pv = _mm256_div_pd(nv, d);
+        _mm256_storeu_pd(pOut->x + i, _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(pu, one), wh), mhalf));
+        _mm256_storeu_pd(pOut->y + i, _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(pv, one), hh), mhalf));
+        _mm256_storeu_pd(pOut->z + i, zero);
+        _mm_storeu_si128((__m128i*)(pOut->faceIdx + i), _mm256_cvttpd_epi32(f));
+    }
+    return i;
+}
+
+/***************************************************
+// SSE4.1 kernels, 2 points per iteration
+****************************************************/
+__attribute__((target("sse4.1")))
+static int32_t viewportMap2DTo3DSSE4(POSType matInvK[3][3], POSType matRot[3][3], SPosArray *pIn, SPosArray *pOut, int32_t num)
+{
+    __m128d half = _mm_set1_pd(0.5);
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d k00 = _mm_set1_pd(matInvK[0][0]), k01 = _mm_set1_pd(matInvK[0][1]), k02 = _mm_set1_pd(matInvK[0][2]);
+    __m128d k10 = _mm_set1_pd(matInvK[1][0]), k11 = _mm_set1_pd(matInvK[1][1]), k12 = _mm_set1_pd(matInvK[1][2]);
+    __m128d r[3][3];
+    for (int32_t m = 0; m < 3; m++)
+        for (int32_t n = 0; n < 3; n++)
+            r[m][n] = _mm_set1_pd(matRot[m][n]);
+
+    int32_t i = 0;
+    for (; i + 2 <= num; i += 2)
+    {
+        __m128d u = _mm_add_pd(_mm_loadu_pd(pIn->x + i), half);
+        __m128d v = _mm_add_pd(_mm_loadu_pd(pIn->y + i), half);
+        __m128d x2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(k00, u), _mm_mul_pd(k01, v)), k02);
+        __m128d y2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(k10, u), _mm_mul_pd(k11, v)), k12);
+        __m128d z1 = _mm_div_pd(one, _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x2, x2), _mm_mul_pd(y2, y2)), one)));
+        __m128d x1 = _mm_mul_pd(z1, x2);
+        __m128d y1 = _mm_mul_pd(z1, y2);
+        POSType *pDst[3] = { pOut->x + i, pOut->y + i, pOut->z + i };
+        for (int32_t m = 0; m < 3; m++)
+        {
+            __m128d t = _mm_add_pd(_mm_add_pd(_mm_mul_pd(r[m][0], x1), _mm_mul_pd(r[m][1], y1)), _mm_mul_pd(r[m][2], z1));
+            _mm_storeu_pd(pDst[m], t);
+        }
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static int32_t rotatePlaneSSE4(POSType *pA, POSType *pB, int32_t num, POSType c00, POSType c01, POSType c10, POSType c11)
+{
+    __m128d v00 = _mm_set1_pd(c00), v01 = _mm_set1_pd(c01);
+    __m128d v10 = _mm_set1_pd(c10), v11 = _mm_set1_pd(c11);
+    int32_t i = 0;
+    for (; i + 2 <= num; i += 2)
+    {
+        __m128d a = _mm_loadu_pd(pA + i);
+        __m128d b = _mm_loadu_pd(pB + i);
+        _mm_storeu_pd(pA + i, _mm_add_pd(_mm_mul_pd(v00, a), _mm_mul_pd(v01, b)));
+        _mm_storeu_pd(pB + i, _mm_add_pd(_mm_mul_pd(v10, a), _mm_mul_pd(v11, b)));
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static int32_t equiRectMap3DTo2DSSE4(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    __m128d pi = _mm_set1_pd(S_PI);
+    __m128d twoPi = _mm_set1_pd(2*S_PI);
+    __m128d half = _mm_set1_pd(0.5);
+    __m128d eps = _mm_set1_pd(S_EPS);
+    __m128d w = _mm_set1_pd((POSType)width);
+    __m128d h = _mm_set1_pd((POSType)height);
+    __m128d zero = _mm_setzero_pd();
+    POSType xs[2], zs[2], rs[2], as[2], cs[2];
+
+    int32_t i = 0;
+    for (; i + 2 <= num; i += 2)
+    {
+        __m128d x = _mm_loadu_pd(pIn->x + i);
+        __m128d y = _mm_loadu_pd(pIn->y + i);
+        __m128d z = _mm_loadu_pd(pIn->z + i);
+        __m128d len = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)), _mm_mul_pd(z, z)));
+        _mm_storeu_pd(xs, x);
+        _mm_storeu_pd(zs, z);
+        _mm_storeu_pd(rs, _mm_div_pd(y, len));
+        for (int32_t k = 0; k < 2; k++)
+        {
+            as[k] = satan2(zs[k], xs[k]);
+            cs[k] = sacos(rs[k]);
+        }
+        __m128d ox = _mm_sub_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(pi, _mm_loadu_pd(as)), w), twoPi), half);
+        __m128d t = _mm_div_pd(_mm_loadu_pd(cs), pi);
+        t = _mm_blendv_pd(t, half, _mm_cmplt_pd(len, eps));
+        __m128d oy = _mm_sub_pd(_mm_mul_pd(t, h), half);
+        _mm_storeu_pd(pOut->x + i, ox);
+        _mm_storeu_pd(pOut->y + i, oy);
+        _mm_storeu_pd(pOut->z + i, zero);
+        _mm_storel_epi64((__m128i*)(pOut->faceIdx + i), _mm_setzero_si128());
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 geoFastAtan2SSE4(__m128 y, __m128 x)
+{
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 zero = _mm_setzero_ps();
+    __m128 ax = _mm_andnot_ps(sign, x);
+    __m128 ay = _mm_andnot_ps(sign, y);
+    __m128 mx = _mm_max_ps(ax, ay);
+    __m128 mn = _mm_min_ps(ax, ay);
+    __m128 a = _mm_blendv_ps(zero, _mm_div_ps(mn, mx), _mm_cmpgt_ps(mx, zero));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(GEO_FAST_ATAN_C5)), _mm_set1_ps(GEO_FAST_ATAN_C4));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(GEO_FAST_ATAN_C3));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(GEO_FAST_ATAN_C2));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(GEO_FAST_ATAN_C1));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(GEO_FAST_ATAN_C0));
+    r = _mm_mul_ps(r, a);
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(GEO_FAST_PI_2), r), _mm_cmpgt_ps(ay, ax));
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(GEO_FAST_PI), r), _mm_cmplt_ps(x, zero));
+    return _mm_xor_ps(r, _mm_and_ps(sign, y));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 geoLoad4PS(const POSType *p)
+{
+    return _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(p)), _mm_cvtpd_ps(_mm_loadu_pd(p + 2)));
+}
+
+__attribute__((target("sse4.1")))
+static int32_t equiRectMap3DTo2DFastSSE4(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    __m128d pi = _mm_set1_pd(S_PI);
+    __m128d twoPi = _mm_set1_pd(2*S_PI);
+    __m128d half = _mm_set1_pd(0.5);
+    __m128d w = _mm_set1_pd((POSType)width);
+    __m128d h = _mm_set1_pd((POSType)height);
+    __m128d zero = _mm_setzero_pd();
+    __m128 eps = _mm_set1_ps((float)S_EPS);
+
+    int32_t i = 0;
+    for (; i + 4 <= num; i += 4)
+    {
+        __m128 x = geoLoad4PS(pIn->x + i);
+        __m128 y = geoLoad4PS(pIn->y + i);
+        __m128 z = geoLoad4PS(pIn->z + i);
+        __m128 xz = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z));
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(xz, _mm_mul_ps(y, y)));
+        __m128 yaw = geoFastAtan2SSE4(z, x);
+        __m128 pitch = geoFastAtan2SSE4(_mm_sqrt_ps(xz), y);
+        __m128 pole = _mm_cmplt_ps(len, eps);
+        for (int32_t k = 0; k < 2; k++)
+        {
+            __m128d a = _mm_cvtps_pd(k ? _mm_movehl_ps(yaw, yaw) : yaw);
+            __m128d c = _mm_cvtps_pd(k ? _mm_movehl_ps(pitch, pitch) : pitch);
+            __m128d m = _mm_cvtps_pd(k ? _mm_movehl_ps(pole, pole) : pole);
+            __m128d ox = _mm_sub_pd(_mm_div_pd(_mm_mul_pd(_mm_sub_pd(pi, a), w), twoPi), half);
+            __m128d t = _mm_blendv_pd(_mm_div_pd(c, pi), half, m);
+            __m128d oy = _mm_sub_pd(_mm_mul_pd(t, h), half);
+            _mm_storeu_pd(pOut->x + i + 2 * k, ox);
+            _mm_storeu_pd(pOut->y + i + 2 * k, oy);
+            _mm_storeu_pd(pOut->z + i + 2 * k, zero);
+        }
+        _mm_storeu_si128((__m128i*)(pOut->faceIdx + i), _mm_setzero_si128());
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1")))
+static int32_t cubeMapMap3DTo2DSSE4(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    __m128d sign = _mm_set1_pd(-0.0);
+    __m128d zero = _mm_setzero_pd();
+    __m128d one = _mm_set1_pd(1.0);
+    __m128d mhalf = _mm_set1_pd(-0.5);
+    __m128d wh = _mm_set1_pd((POSType)(width>>1));
+    __m128d hh = _mm_set1_pd((POSType)(height>>1));
+    __m128d face[6];
+    for (int32_t f = 0; f < 6; f++)
+        face[f] = _mm_set1_pd((POSType)f);
+
+    int32_t i = 0;
+    for (; i + 2 <= num; i += 2)
+    {
+        __m128d x = _mm_loadu_pd(pIn->x + i);
+        __m128d y = _mm_loadu_pd(pIn->y + i);
+        __m128d z = _mm_loadu_pd(pIn->z + i);
+        __m128d nx = _mm_xor_pd(x, sign);
+        __m128d ny = _mm_xor_pd(y, sign);
+        __m128d nz = _mm_xor_pd(z, sign);
+        __m128d aX = _mm_andnot_pd(sign, x);
+        __m128d aY = _mm_andnot_pd(sign, y);
+        __m128d aZ = _mm_andnot_pd(sign, z);
+        __m128d mX = _mm_and_pd(_mm_cmpge_pd(aX, aY), _mm_cmpge_pd(aX, aZ));
+        __m128d mY = _mm_andnot_pd(mX, _mm_and_pd(_mm_cmpge_pd(aY, aX), _mm_cmpge_pd(aY, aZ)));
+        __m128d pX = _mm_cmpgt_pd(x, zero);
+        __m128d pY = _mm_cmpgt_pd(y, zero);
+        __m128d pZ = _mm_cmpgt_pd(z, zero);
+
+        // z faces, then overwritten by the y and x faces
+        __m128d nu = _mm_blendv_pd(nx, x, pZ);
+        __m128d nv = ny;
+        __m128d d = aZ;
+        __m128d f = _mm_blendv_pd(face[5], face[4], pZ);
+
+        nu = _mm_blendv_pd(nu, x, mY);
+        nv = _mm_blendv_pd(nv, _mm_blendv_pd(nz, z, pY), mY);
+        d = _mm_blendv_pd(d, aY, mY);
+        f = _mm_blendv_pd(f, _mm_blendv_pd(face[3], face[2], pY), mY);
+
+        nu = _mm_blendv_pd(nu, _mm_blendv_pd(z, nz, pX), mX);
+        nv = _mm_blendv_pd(nv, ny, mX);
+        d = _mm_blendv_pd(d, aX, mX);
+        f = _mm_blendv_pd(f, _mm_blendv_pd(face[1], face[0], pX), mX);
+
+        __m128d pu = _mm_div_pd(nu, d);
+        __m128d pv = _mm_div_pd(nv, d);
+        _mm_storeu_pd(pOut->x + i, _mm_add_pd(_mm_mul_pd(_mm_add_pd(pu, one), wh), mhalf));
+        _mm_storeu_pd(pOut->y + i, _mm_add_pd(_mm_mul_pd(_mm_add_pd(pv, one), hh), mhalf));
+        _mm_storeu_pd(pOut->z + i, zero);
+        _mm_storel_epi64((__m128i*)(pOut->faceIdx + i), _mm_cvttpd_epi32(f));
+    }
+    return i;
+}
+#endif
+
+/***************************************************
+// dispatch, the vector kernel handles the multiple of its width
+// and the scalar kernel the remaining points
+****************************************************/
+void geoBatchViewportMap2DTo3D(POSType matInvK[3][3], POSType matRot[3][3], SPosArray *pIn, SPosArray *pOut, int32_t num)
+{
+    int32_t done = 0;
+#ifdef GEO_KERNEL_X86
+    int32_t level = geoKernelGetLevel();
+    if (level == GEO_KERNEL_AVX2)
+        done = viewportMap2DTo3DAVX2(matInvK, matRot, pIn, pOut, num);
+    else if (level == GEO_KERNEL_SSE4)
+        done = viewportMap2DTo3DSSE4(matInvK, matRot, pIn, pOut, num);
+#endif
+    viewportMap2DTo3DScalar(matInvK, matRot, pIn, pOut, done, num);
+}
+
+static void rotatePlane(POSType *pA, POSType *pB, int32_t num, int32_t degree, bool bNegFirst)
+{
+    POSType rcos = scos((POSType)(degree*S_PI/180.0));
+    POSType rsin = ssin((POSType)(degree*S_PI/180.0));
+    // bNegFirst: t1 = rcos*a + rsin*b, t2 = -rsin*a + rcos*b
+    // otherwise: t1 = rcos*a - rsin*b, t2 = rsin*a + rcos*b
+    POSType c01 = bNegFirst ? rsin : -rsin;
+    POSType c10 = bNegFirst ? -rsin : rsin;
+    int32_t done = 0;
+#ifdef GEO_KERNEL_X86
+    int32_t level = geoKernelGetLevel();
+    if (level == GEO_KERNEL_AVX2)
+        done = rotatePlaneAVX2(pA, pB, num, rcos, c01, c10, rcos);
+    else if (level == GEO_KERNEL_SSE4)
+        done = rotatePlaneSSE4(pA, pB, num, rcos, c01, c10, rcos);
+#endif
+    rotatePlaneScalar(pA, pB, done, num, rcos, c01, c10, rcos);
+}
+
+void geoBatchRotate3D(SPosArray *pPos, int32_t num, int32_t rx, int32_t ry, int32_t rz)
+{
+    if (rx)
+        rotatePlane(pPos->y, pPos->z, num, rx, false);
+    if (ry)
+        rotatePlane(pPos->x, pPos->z, num, ry, true);
+    if (rz)
+        rotatePlane(pPos->x, pPos->y, num, rz, false);
+}
+
+void geoBatchEquiRectMap3DTo2D(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    int32_t done = 0;
+#ifdef GEO_KERNEL_X86
+    int32_t level = geoKernelGetLevel();
+    if (level == GEO_KERNEL_AVX2)
+        done = equiRectMap3DTo2DAVX2(pIn, pOut, num, width, height);
+    else if (level == GEO_KERNEL_SSE4)
+        done = equiRectMap3DTo2DSSE4(pIn, pOut, num, width, height);
+#endif
+    equiRectMap3DTo2DScalar(pIn, pOut, done, num, width, height);
+}
+
+void geoBatchEquiRectMap3DTo2DFast(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    int32_t done = 0;
+#ifdef GEO_KERNEL_X86
+    int32_t level = geoKernelGetLevel();
+    if (level == GEO_KERNEL_AVX2)
+        done = equiRectMap3DTo2DFastAVX2(pIn, pOut, num, width, height);
+    else if (level == GEO_KERNEL_SSE4)
+        done = equiRectMap3DTo2DFastSSE4(pIn, pOut, num, width, height);
+#endif
+    equiRectMap3DTo2DFastScalar(pIn, pOut, done, num, width, height);
+}
+
+void geoBatchCubeMapMap3DTo2D(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height)
+{
+    int32_t done = 0;
+#ifdef GEO_KERNEL_X86
+    int32_t level = geoKernelGetLevel();
+    if (level == GEO_KERNEL_AVX2)
+        done = cubeMapMap3DTo2DAVX2(pIn, pOut, num, width, height);
+    else if (level == GEO_KERNEL_SSE4)
+        done = cubeMapMap3DTo2DSSE4(pIn, pOut, num, width, height);
+#endif
+    cubeMapMap3DTo2DScalar(pIn, pOut, done, num, width, height);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file     360SCVPGeometryBatch.h
+    \brief    batch kernels for the geometry coordinate mapping (header)
+*/
+
+#ifndef __360SCVP_GEOMETRYBATCH__
+#define __360SCVP_GEOMETRYBATCH__
+#include "360SCVPGeometry.h"
+
+//! the instruction set used by the batch kernels
+typedef enum GEO_KERNEL_LEVEL
+{
+    GEO_KERNEL_SCALAR = 0,
+    GEO_KERNEL_SSE4,
+    GEO_KERNEL_AVX2,
+    GEO_KERNEL_NUM
+}GeoKernelLevel;
+
+//!
+//! \brief  get the kernel level used by the batch functions, it is the best level
+//!         supported by the cpu, limited by geoKernelSetLevel
+//!
+int32_t geoKernelGetLevel();
+
+//!
+//! \brief  limit the kernel level used by the batch functions, mainly for
+//!         validation and benchmark
+//!
+//! \param  level, input, the highest level allowed, GEO_KERNEL_NUM removes the limit
+//!
+//! \return int32_t, the level in use after the setting
+//!
+int32_t geoKernelSetLevel(int32_t level);
+
+//!
+//! \brief  batch version of ViewPort::map2DTo3D
+//!
+//! \param  matInvK, input, the inverse K matrix of the viewport
+//! \param  matRot, input, the rotation matrix of the viewport
+//! \param  pIn, input, the x and y of the viewport sampling points
+//! \param  pOut, output, the x, y and z of the points on the sphere, faceIdx is not touched
+//! \param  num, input, the number of the points
+//!
+void geoBatchViewportMap2DTo3D(POSType matInvK[3][3], POSType matRot[3][3], SPosArray *pIn, SPosArray *pOut, int32_t num);
+
+//!
+//! \brief  batch version of Geometry::rotate3D, it works in place
+//!
+void geoBatchRotate3D(SPosArray *pPos, int32_t num, int32_t rx, int32_t ry, int32_t rz);
+
+//!
+//! \brief  batch version of EquiRect::map3DTo2D, pIn and pOut may be the same arrays
+//!
+void geoBatchEquiRectMap3DTo2D(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height);
+
+//!
+//! \brief  single precision version of geoBatchEquiRectMap3DTo2D, atan2 and acos are
+//!         replaced by a polynomial approximation, the angle error is about 2e-6 radian
+//!
+void geoBatchEquiRectMap3DTo2DFast(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height);
+
+//!
+//! \brief  batch version of CubeMap::map3DTo2D, pIn and pOut may be the same arrays
+//!
+void geoBatchCubeMapMap3DTo2D(SPosArray *pIn, SPosArray *pOut, int32_t num, int32_t width, int32_t height);
+
+#endif // __360SCVP_GEOMETRYBATCH__
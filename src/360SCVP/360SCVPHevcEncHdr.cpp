@@ -479,6 +479,39 @@ void hevc_write_parameter_sets(GTS_BitStream *stream,    HEVCState * const state
 }
 
 
+void hevc_write_parameter_sets_cached(GTS_BitStream *stream, HEVCState * const state, uint64_t key,
+    const uint8_t *parsed, uint32_t parsedSize, const uint8_t *layout, uint32_t layoutSize)
+{
+    HEVCParamSetCache *cache = state->param_set_cache;
+    // a fingerprint collision must not output the sets of other inputs, so the inputs are compared too
+    if (cache && cache->written_size && cache->written_key == key
+        && cache->written_parsed_size == parsedSize && !memcmp(cache->written_parsed, parsed, parsedSize)
+        && cache->written_layout_size == layoutSize && !memcmp(cache->written_layout, layout, layoutSize)
+        && gts_bs_is_align(stream))
+    {
+        // the nal units end byte aligned with a non zero byte, so no emulation
+        // prevention byte depends on the bytes written before
+        gts_bs_write_data(stream, (const int8_t *)cache->written, cache->written_size);
+        return;
+    }
+
+    uint64_t start = gts_bs_get_position(stream);
+    hevc_write_parameter_sets(stream, state);
+    uint64_t size = gts_bs_get_position(stream) - start;
+    if (cache && gts_bs_is_align(stream) && size <= HEVC_WRITTEN_PARAM_SETS_SIZE
+        && parsedSize <= HEVC_WRITTEN_PARAM_SETS_SIZE && layoutSize <= HEVC_WRITTEN_LAYOUT_SIZE
+        && (stream->bsmode == GTS_BITSTREAM_WRITE || stream->bsmode == GTS_BITSTREAM_WRITE_DYN))
+    {
+        memcpy(cache->written, stream->original + start, (size_t)size);
+        cache->written_size = (uint32_t)size;
+        cache->written_key = key;
+        memcpy(cache->written_parsed, parsed, parsedSize);
+        cache->written_parsed_size = parsedSize;
+        memcpy(cache->written_layout, layout, layoutSize);
+        cache->written_layout_size = layoutSize;
+    }
+}
+
 void hevc_write_sps(GTS_BitStream *stream, HEVCState * const state)
 {
     // Sequence Parameter Set (SPS)
@@ -549,7 +582,7 @@ static void hevc_write_bitstream_slice_header_independent(GTS_BitStream * stream
     }
 }
 
-void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state)
+static void hevc_write_bitstream_slice_header_address(GTS_BitStream * stream, HEVCState * state)
 {
     bool first_slice_segment_in_pic = state->s_info.first_slice_segment_in_pic_flag;
 
@@ -567,7 +600,10 @@ void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state
         int32_t num_bits = math_ceil_log2(lcu_cnt);
         gts_bs_write_int(stream, state->s_info.slice_segment_address, num_bits); //, "slice_segment_address"
     }
+}
 
+static void hevc_write_bitstream_slice_header_suffix(GTS_BitStream * stream, HEVCState * state)
+{
     hevc_write_bitstream_slice_header_independent(stream, state);
 
         if (state->pps[state->last_parsed_pps_id].tiles_enabled_flag) {
@@ -579,6 +615,12 @@ void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state
         }
 }
 
+void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state)
+{
+    hevc_write_bitstream_slice_header_address(stream, state);
+    hevc_write_bitstream_slice_header_suffix(stream, state);
+}
+
  void hevc_write_slice_header(GTS_BitStream * stream, HEVCState * state)
 {
     state->first_nal = true;
@@ -589,6 +631,118 @@ void hevc_write_bitstream_slice_header(GTS_BitStream * stream, HEVCState * state
     hevc_bitstream_add_rbsp_trailing_bits(stream);
 }
 
+/**
+* \brief Gather the values the bits after the slice_segment_address are written from,
+* returns 0 when they can't be gathered
+*/
+static uint32_t hevc_slice_header_suffix_fields(HEVCState * state, int32_t *fields)
+{
+    HEVC_SPS      *sps = &state->sps[state->last_parsed_sps_id];
+    HEVC_PPS      *pps = &state->pps[state->last_parsed_pps_id];
+    HEVCSliceInfo *si  = &state->s_info;
+    uint32_t num = 0;
+
+    if (si->rps[0].num_negative_pics > 16)
+        return 0;
+
+    fields[num++] = si->nal_unit_type;
+    fields[num++] = si->slice_type;
+    fields[num++] = si->poc_lsb;
+    fields[num++] = si->short_term_ref_pic_set_sps_flag;
+    fields[num++] = si->rps[0].num_negative_pics;
+    fields[num++] = si->rps[0].num_positive_pics;
+    fields[num++] = sps->temporal_mvp_enable_flag;
+    fields[num++] = si->slice_temporal_mvp_enabled_flag;
+    fields[num++] = sps->sample_adaptive_offset_enabled_flag;
+    fields[num++] = sps->chroma_format_idc;
+    fields[num++] = si->slice_sao_luma_flag;
+    fields[num++] = si->slice_sao_chroma_flag;
+    fields[num++] = si->num_ref_idx_active_override_flag;
+    fields[num++] = si->slice_qp_delta;
+    fields[num++] = pps->slice_chroma_qp_offsets_present_flag;
+    fields[num++] = si->slice_cb_qp_offset;
+    fields[num++] = si->slice_cr_qp_offset;
+    fields[num++] = pps->tiles_enabled_flag;
+    for (uint32_t j = 0; j < si->rps[0].num_negative_pics; j++) {
+        fields[num++] = si->rps[0].delta_poc[j];
+        fields[num++] = si->used_by_curr_pic_s0_flag[j];
+    }
+    return num;
+}
+
+/**
+* \brief Write the bits after the slice_segment_address on their own, and keep them without the
+* emulation prevention bytes, the template stays empty when they can't be kept
+*/
+static void hevc_slice_header_record_suffix(HEVCState * state, HEVCSliceHeaderTemplate *tmpl)
+{
+    int8_t escaped[2 * HEVC_SLICE_HEADER_SUFFIX_SIZE] = { 0 };
+    int8_t check[2 * HEVC_SLICE_HEADER_SUFFIX_SIZE];
+
+    GTS_BitStream bs;
+    GTS_BitStream checkBs;
+
+    tmpl->field_num = 0;
+    if (gts_bs_init(&bs, escaped, sizeof(escaped), GTS_BITSTREAM_WRITE) != GTS_OK)
+        return;
+    hevc_write_bitstream_slice_header_suffix(&bs, state);
+    uint32_t escapedSize = (uint32_t)gts_bs_get_position(&bs);
+    uint32_t pendingBits = bs.nbBits;
+    uint8_t pending = (uint8_t)(bs.current << (8 - pendingBits));
+    if (escapedSize + 1 >= sizeof(escaped))
+        return;
+
+    // the bits are kept only when the writer escapes them back to the same bytes
+    uint32_t size = gts_media_nalu_remove_emulation_bytes(escaped, (int8_t*)tmpl->suffix, escapedSize);
+    if ((size + 1 > HEVC_SLICE_HEADER_SUFFIX_SIZE)
+        || (gts_bs_init(&checkBs, check, sizeof(check), GTS_BITSTREAM_WRITE) != GTS_OK))
+        return;
+    for (uint32_t i = 0; i < size; i++)
+        gts_bs_write_int(&checkBs, (uint8_t)tmpl->suffix[i], 8);
+    if (((uint32_t)gts_bs_get_position(&checkBs) != escapedSize) || memcmp(check, escaped, escapedSize))
+        return;
+
+    tmpl->suffix[size] = pending;
+    tmpl->suffix_bits = size * 8 + pendingBits;
+    tmpl->field_num = hevc_slice_header_suffix_fields(state, tmpl->fields);
+}
+
+void hevc_write_slice_header_spliced(GTS_BitStream * stream, HEVCState * state, HEVCSliceHeaderTemplate *tmpl)
+{
+    int32_t fields[HEVC_SLICE_HEADER_FIELDS_NUM];
+    uint32_t field_num = tmpl ? hevc_slice_header_suffix_fields(state, fields) : 0;
+    if (!field_num)
+    {
+        hevc_write_slice_header(stream, state);
+        return;
+    }
+    if ((field_num != tmpl->field_num) || memcmp(fields, tmpl->fields, field_num * sizeof(int32_t)))
+        hevc_slice_header_record_suffix(state, tmpl);
+    if (!tmpl->field_num)
+    {
+        hevc_write_slice_header(stream, state);
+        return;
+    }
+
+    state->first_nal = true;
+    nal_write(stream, state->s_info.nal_unit_type, 0, state->first_nal);
+    state->first_nal = false;
+
+    hevc_write_bitstream_slice_header_address(stream, state);
+
+    // the recorded bits are shifted to the current bit position by the writer
+    uint32_t bits = tmpl->suffix_bits;
+    const uint8_t *suffix = tmpl->suffix;
+    for (; bits >= 32; bits -= 32, suffix += 4)
+        gts_bs_write_int(stream, (int32_t)(((uint32_t)suffix[0] << 24) | (suffix[1] << 16) | (suffix[2] << 8) | suffix[3]), 32);
+    for (; bits >= 8; bits -= 8, suffix++)
+        gts_bs_write_int(stream, suffix[0], 8);
+    if (bits)
+        gts_bs_write_int(stream, suffix[0] >> (8 - bits), bits);
+
+    hevc_bitstream_add_rbsp_trailing_bits(stream);
+}
+
  void writeSEINalHeader(GTS_BitStream *bs, H265SEIType payloadType, unsigned int payloadSize, int temporalIdPlus1)
  {
      // add NAL header
@@ -32,7 +32,27 @@
 
 void hevc_write_bitstream_aud(GTS_BitStream *stream,    HEVCState * const state);
 void hevc_write_parameter_sets(GTS_BitStream *stream, HEVCState * const state);
+//copies the parameter sets written last when the key, the parsed parameter sets and the layout they are
+//modified with are the same, the key is the fingerprint of both, the sets are written otherwise
+void hevc_write_parameter_sets_cached(GTS_BitStream *stream, HEVCState * const state, uint64_t key,
+    const uint8_t *parsed, uint32_t parsedSize, const uint8_t *layout, uint32_t layoutSize);
 void hevc_write_slice_header(GTS_BitStream * stream, HEVCState * state);
+
+#define HEVC_SLICE_HEADER_FIELDS_NUM 52
+#define HEVC_SLICE_HEADER_SUFFIX_SIZE 64
+
+//the bits of a written slice header after the slice_segment_address, with the values they are written from
+typedef struct HEVC_SLICE_HEADER_TEMPLATE
+{
+    int32_t  fields[HEVC_SLICE_HEADER_FIELDS_NUM];
+    uint32_t field_num;
+    uint32_t suffix_bits;
+    uint8_t  suffix[HEVC_SLICE_HEADER_SUFFIX_SIZE];
+}HEVCSliceHeaderTemplate;
+
+//writes the same slice header as hevc_write_slice_header, the bits after the slice_segment_address are
+//spliced from the template when they are written from the same values, the template is recorded otherwise
+void hevc_write_slice_header_spliced(GTS_BitStream * stream, HEVCState * state, HEVCSliceHeaderTemplate *tmpl);
 uint32_t hevc_write_RwpkSEI(GTS_BitStream * stream, const RegionWisePacking* pRegion, int32_t temporalIdPlus1);
 uint32_t hevc_write_ProjectionSEI(GTS_BitStream * stream, int32_t projType, int32_t temporalIdPlus1);
 uint32_t hevc_write_SphereRotSEI(GTS_BitStream * stream, const SphereRotation* pSphereRot, int32_t temporalIdPlus1);
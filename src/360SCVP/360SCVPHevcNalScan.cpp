@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file     360SCVPHevcNalScan.cpp
+    \brief    byte scanning kernels of the nal units
+*/
+
+// The vector kernels look for 00 00 xx in blocks of 64 bytes and return at the
+// first block with a match, the blocks without xx bytes are skipped after one
+// test, and only the other blocks look for the 00 bytes. The start codes are
+// 00 00 01, the emulation prevention bytes are the 03 of 00 00 03, and the
+// bytes to escape on output are the xx of 00 00 00 to 00 00 03. The scalar kernel finishes the bytes after the last whole block.
+
+#include <atomic>
+#include <string.h>
+#include "360SCVPHevcNalScan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NAL_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static std::atomic<int32_t> s_scanLevelLimit(NAL_SCAN_NUM);
+
+static int32_t nalScanDetect()
+{
+#ifdef NAL_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return NAL_SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return NAL_SCAN_SSE2;
+#endif
+    return NAL_SCAN_SCALAR;
+}
+
+int32_t nalScanGetLevel()
+{
+    static const int32_t detected = nalScanDetect();
+    int32_t limit = s_scanLevelLimit;
+    return detected < limit ? detected : limit;
+}
+
+int32_t nalScanSetLevel(int32_t level)
+{
+    if (level < NAL_SCAN_SCALAR)
+        level = NAL_SCAN_SCALAR;
+    s_scanLevelLimit = level;
+    return nalScanGetLevel();
+}
+
+/***************************************************
+// 00 00 xx pattern, the xx bytes are located by memchr when
+// the range is one value, the two bytes before them are checked
+****************************************************/
+static uint32_t findPatternScalar(const uint8_t *pData, uint32_t begin, uint32_t size, uint8_t minLast, uint8_t maxLast)
+{
+    uint32_t pos = begin + 2;
+    if (minLast == maxLast)
+    {
+        while (pos < size)
+        {
+            const uint8_t *pLast = (const uint8_t*)memchr(pData + pos, minLast, size - pos);
+            if (!pLast)
+                break;
+            pos = (uint32_t)(pLast - pData);
+            if (!pData[pos - 1] && !pData[pos - 2])
+                return pos - 2;
+            pos++;
+        }
+        return size;
+    }
+    while (pos < size)
+    {
+        // a nonzero byte before pos can not be in a pattern ending at pos or pos + 1
+        if (pData[pos - 1])
+        {
+            pos += 2;
+            continue;
+        }
+        if (!pData[pos - 2] && (uint8_t)(pData[pos] - minLast) <= (uint8_t)(maxLast - minLast))
+            return pos - 2;
+        pos++;
+    }
+    return size;
+}
+
+#ifdef NAL_SCAN_X86
+// the bits of the xx bytes and the 00 bytes of a 64 byte block give the ends
+// of the patterns, the two bytes before the block are checked for the ends at
+// the block start. The returned offset is where the scalar kernel goes on.
+static inline bool matchPattern(const uint8_t *pData, uint32_t i, uint64_t zeros, uint64_t lasts, uint32_t *pFound)
+{
+    uint64_t prevZeros = 0;
+    if (i)
+        prevZeros = ((uint64_t)!pData[i - 1] << 63) | ((uint64_t)!pData[i - 2] << 62);
+    uint64_t match = lasts & ((zeros << 1) | (prevZeros >> 63)) & ((zeros << 2) | (prevZeros >> 62));
+    if (!match)
+        return false;
+    *pFound = i + __builtin_ctzll(match) - 2;
+    return true;
+}
+
+// the bytes in [minLast, maxLast] are the ones unchanged by the unsigned saturation to the range
+__attribute__((target("avx2")))
+static inline __m256i inRangeAVX2(__m256i b, __m256i minLast, __m256i maxLast)
+{
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_max_epu8(b, minLast), maxLast), b);
+}
+
+__attribute__((target("avx2")))
+static uint32_t findPatternAVX2(const uint8_t *pData, uint32_t size, uint8_t minLast, uint8_t maxLast, uint32_t *pFound)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vMin = _mm256_set1_epi8((char)minLast);
+    const __m256i vMax = _mm256_set1_epi8((char)maxLast);
+    uint32_t i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(pData + i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(pData + i + 32));
+        __m256i l0 = inRangeAVX2(b0, vMin, vMax);
+        __m256i l1 = inRangeAVX2(b1, vMin, vMax);
+        __m256i l = _mm256_or_si256(l0, l1);
+        if (_mm256_testz_si256(l, l))
+            continue;
+        uint64_t lasts = (uint32_t)_mm256_movemask_epi8(l0) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(l1) << 32);
+        uint64_t zeros = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b0, zero))
+            | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b1, zero)) << 32);
+        if (matchPattern(pData, i, zeros, lasts, pFound))
+            return i;
+    }
+    return i >= 2 ? i - 2 : i;
+}
+
+__attribute__((target("sse2")))
+static inline __m128i inRangeSSE2(__m128i b, __m128i minLast, __m128i maxLast)
+{
+    return _mm_cmpeq_epi8(_mm_min_epu8(_mm_max_epu8(b, minLast), maxLast), b);
+}
+
+__attribute__((target("sse2")))
+static uint32_t findPatternSSE2(const uint8_t *pData, uint32_t size, uint8_t minLast, uint8_t maxLast, uint32_t *pFound)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vMin = _mm_set1_epi8((char)minLast);
+    const __m128i vMax = _mm_set1_epi8((char)maxLast);
+    uint32_t i = 0;
+    for (; i + 64 <= size; i += 64)
+    {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(pData + i));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(pData + i + 16));
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(pData + i + 32));
+        __m128i b3 = _mm_loadu_si128((const __m128i*)(pData + i + 48));
+        __m128i l0 = inRangeSSE2(b0, vMin, vMax);
+        __m128i l1 = inRangeSSE2(b1, vMin, vMax);
+        __m128i l2 = inRangeSSE2(b2, vMin, vMax);
+        __m128i l3 = inRangeSSE2(b3, vMin, vMax);
+        if (!_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(l0, l1), _mm_or_si128(l2, l3))))
+            continue;
+        uint64_t lasts = (uint64_t)(uint32_t)_mm_movemask_epi8(l0)
+            | ((uint64_t)(uint32_t)_mm_movemask_epi8(l1) << 16)
+            | ((uint64_t)(uint32_t)_mm_movemask_epi8(l2) << 32)
+            | ((uint64_t)(uint32_t)_mm_movemask_epi8(l3) << 48);
+        uint64_t zeros = (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b0, zero))
+            | ((uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b1, zero)) << 16)
+            | ((uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b2, zero)) << 32)
+            | ((uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b3, zero)) << 48);
+        if (matchPattern(pData, i, zeros, lasts, pFound))
+            return i;
+    }
+    return i >= 2 ? i - 2 : i;
+}
+#endif
+
+/***************************************************
+// dispatch, the vector kernel scans the whole blocks
+// and the scalar kernel the remaining bytes
+****************************************************/
+uint32_t nalScanFindPattern(const uint8_t *pData, uint32_t size, uint8_t minLast, uint8_t maxLast)
+{
+    uint32_t done = 0;
+    if (!pData || size < 3 || minLast > maxLast)
+        return size;
+#ifdef NAL_SCAN_X86
+    uint32_t found = size;
+    int32_t level = nalScanGetLevel();
+    if (level == NAL_SCAN_AVX2)
+        done = findPatternAVX2(pData, size, minLast, maxLast, &found);
+    else if (level == NAL_SCAN_SSE2)
+        done = findPatternSSE2(pData, size, minLast, maxLast, &found);
+    if (found < size)
+        return found;
+#endif
+    return findPatternScalar(pData, done, size, minLast, maxLast);
+}
+
+uint32_t nalScanFindStartCode(const uint8_t *pData, uint32_t size)
+{
+    return nalScanFindPattern(pData, size, 0x01, 0x01);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \file     360SCVPHevcNalScan.h
+    \brief    byte scanning kernels of the nal units (header)
+*/
+
+#ifndef _360SCVP_HEVC_NALSCAN_H_
+#define _360SCVP_HEVC_NALSCAN_H_
+#include "stdint.h"
+
+//! the instruction set used by the scanning kernels
+typedef enum NAL_SCAN_LEVEL
+{
+    NAL_SCAN_SCALAR = 0,
+    NAL_SCAN_SSE2,
+    NAL_SCAN_AVX2,
+    NAL_SCAN_NUM
+}NalScanLevel;
+
+//!
+//! \brief  get the kernel level used by the scanning functions, it is the best level
+//!         supported by the cpu, limited by nalScanSetLevel
+//!
+int32_t nalScanGetLevel();
+
+//!
+//! \brief  limit the kernel level used by the scanning functions, mainly for
+//!         validation and benchmark
+//!
+//! \param  level, input, the highest level allowed, NAL_SCAN_NUM removes the limit
+//!
+//! \return int32_t, the level in use after the setting
+//!
+int32_t nalScanSetLevel(int32_t level);
+
+//!
+//! \brief  find the first 00 00 xx pattern in the buffer with xx in [minLast, maxLast],
+//!         the buffer is scanned in place
+//!
+//! \param  pData, input, the buffer
+//! \param  size, input, the size of the buffer
+//! \param  minLast, input, the smallest value of the last byte
+//! \param  maxLast, input, the largest value of the last byte
+//!
+//! \return uint32_t, the offset of the first 00 of the pattern, size if there is none
+//!
+uint32_t nalScanFindPattern(const uint8_t *pData, uint32_t size, uint8_t minLast, uint8_t maxLast);
+
+//!
+//! \brief  find the first 00 00 01 start code prefix in the buffer, the buffer is
+//!         scanned in place
+//!
+//! \param  pData, input, the buffer
+//! \param  size, input, the size of the buffer
+//!
+//! \return uint32_t, the offset of the first 00 of the prefix, size if there is none
+//!
+uint32_t nalScanFindStartCode(const uint8_t *pData, uint32_t size);
+
+#endif // _360SCVP_HEVC_NALSCAN_H_
@@ -26,6 +26,7 @@
 #include "assert.h"
 #include "360SCVPHevcParser.h"
 #include "360SCVPHevcTilestream.h"
+#include "360SCVPHevcNalScan.h"
 
 uint32_t gts_get_bit_size(uint32_t MaxVal)
 {
@@ -34,115 +35,80 @@ uint32_t gts_get_bit_size(uint32_t MaxVal)
     return k;
 }
 
+/*the 03 at pos is an emulation prevention byte when it follows a run of 00 bytes of
+2 (modulo 256 as the run is counted on 8 bits) and is followed by a byte below 04,
+which is signed as the bytes are read as int8_t*/
+static inline bool hevc_is_emulation_byte(const uint8_t *buffer, uint32_t pos, uint32_t size_nal)
+{
+    uint32_t zeros = 2;
+    if ((pos + 1 >= size_nal) || ((int8_t)buffer[pos + 1] >= 0x04)) return false;
+    if ((pos < 3) || buffer[pos - 3]) return true;
+    while ((zeros < pos) && !buffer[pos - zeros - 1]) zeros++;
+    return (zeros & 0xFF) == 2;
+}
+
 uint32_t gts_media_nalu_emulation_bytes_remove_count(const int8_t *buffer, uint32_t size_nal)
 {
-    uint32_t n = 0, emulation_bytes_count = 0;
-    uint8_t zero_counter = 0;
+    const uint8_t *src = (const uint8_t *)buffer;
+    uint32_t pos = 0, emulation_bytes_count = 0;
 
-    while (n < size_nal)
+    while (pos < size_nal)
     {
-        if (zero_counter == 2 && buffer[n] == 0x03 && n + 1 < size_nal && buffer[n + 1] < 0x04)
-        {
-            zero_counter = 0;
-            emulation_bytes_count++;
-            n++;
-        }
-        if (!buffer[n])
-            zero_counter++;
-        else
-            zero_counter = 0;
-        n++;
+        uint32_t found = pos + nalScanFindPattern(src + pos, size_nal - pos, 0x03, 0x03);
+        if (found >= size_nal) break;
+        if (hevc_is_emulation_byte(src, found + 2, size_nal)) emulation_bytes_count++;
+        pos = found + 3;
     }
 
     return emulation_bytes_count;
 }
 
-uint32_t gts_media_nalu_remove_emulation_bytes(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal)
+/*the blocks between the emulation prevention bytes are copied until dst_max bytes are written*/
+static uint32_t hevc_copy_without_emulation_bytes(const int8_t *src_buffer, uint32_t size_nal, int8_t *dst_buffer, uint32_t dst_max)
 {
-    uint32_t n = 0, emulation_bytes_count = 0;
-    uint8_t zero_counter = 0;
-    while (n < size_nal)
-    {
-        if (zero_counter == 2 && src_buffer[n] == 0x03 && n + 1 < size_nal && src_buffer[n + 1] < 0x04)
-        {
-            zero_counter = 0;
-            emulation_bytes_count++;
-            n++;
-        }
-        dst_buffer[n - emulation_bytes_count] = src_buffer[n];
-        if (!src_buffer[n])
-            zero_counter++;
-        else
-            zero_counter = 0;
+    const uint8_t *src = (const uint8_t *)src_buffer;
+    uint32_t pos = 0, copied = 0, dst_size = 0;
 
-        n++;
-    }
-
-    return size_nal - emulation_bytes_count;
+    while ((pos < size_nal) && (dst_size < dst_max))
+    {
+        uint32_t found = pos + nalScanFindPattern(src + pos, size_nal - pos, 0x03, 0x03);
+        if (found >= size_nal) break;
+        if (hevc_is_emulation_byte(src, found + 2, size_nal)) {
+            uint32_t block = found + 2 - copied;
+            if (block > dst_max - dst_size) block = dst_max - dst_size;
+            memcpy(dst_buffer + dst_size, src_buffer + copied, block);
+            dst_size += block;
+            copied = found + 3;
+        }
+        pos = found + 3;
+    }
+    if ((dst_size < dst_max) && (copied < size_nal)) {
+        uint32_t block = size_nal - copied;
+        if (block > dst_max - dst_size) block = dst_max - dst_size;
+        memcpy(dst_buffer + dst_size, src_buffer + copied, block);
+        dst_size += block;
+    }
+    return dst_size;
 }
 
+uint32_t gts_media_nalu_remove_emulation_bytes(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal)
+{
+    return hevc_copy_without_emulation_bytes(src_buffer, size_nal, dst_buffer, size_nal);
+}
 
-static uint8_t digits_of_agm[256] = {
-    8, 7, 6, 6, 5, 5, 5, 5,
-    4, 4, 4, 4, 4, 4, 4, 4,
-    3, 3, 3, 3, 3, 3, 3, 3,
-    3, 3, 3, 3, 3, 3, 3, 3,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    1, 1, 1, 1, 1, 1, 1, 1,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0,
-    0, 0, 0, 0, 0, 0, 0, 0
-};
+uint32_t gts_media_nalu_remove_emulation_bytes_prefix(const int8_t *src_buffer, uint32_t size_nal, int8_t *dst_buffer, uint32_t prefix_size)
+{
+    return hevc_copy_without_emulation_bytes(src_buffer, size_nal, dst_buffer, prefix_size);
+}
 
 static uint32_t bs_get_ue(GTS_BitStream *gts_bitstream)
 {
-    uint8_t flag_c;
-    uint32_t data = 0, flag_r = 0;
-    while (1) {
-        flag_r = gts_bs_peek_bits(gts_bitstream, 8, 0);
-        if (flag_r) break;
-        //check whether we still have data once the peek is done since we may have less than 8 data available
-        if (!gts_bs_available(gts_bitstream)) {
-            //GF_LOG(GF_LOG_ERROR, GF_LOG_CODING, ("[AVC/HEVC] Not enough data in bitstream !!\n"));
-            return 0;
-        }
-        gts_bs_read_int(gts_bitstream, 8);
-        data += 8;
-    }
-    flag_c = digits_of_agm[flag_r];
-    gts_bs_read_int(gts_bitstream, flag_c);
-    data += flag_c;
-    return gts_bs_read_int(gts_bitstream, data + 1) - 1;
+    return gts_bs_read_ue(gts_bitstream);
 }
 
 static int32_t bs_get_se(GTS_BitStream *bs)
 {
-    uint32_t v = bs_get_ue(bs);
-    if ((v & 0x1) == 0) return (int32_t)(0 - (v >> 1));
-    return (v + 1) >> 1;
+    return gts_bs_read_se(bs);
 }
 
 uint32_t gts_media_nalu_is_start_code(GTS_BitStream *bs)
@@ -624,9 +590,33 @@ static void hevc_compute_poc(HEVCSliceInfo *slice_info)
 }
 
 
+/*the size of the unescaped slice prefix the slice header is parsed from*/
+#define HEVC_SLICE_HEADER_PREFIX_SIZE    256
+
 /*read that amount of data at each IO access rather than fetching byte by byte...*/
 #define AVC_CACHE_SIZE    4096
 
+/*memory streams are scanned in place, the position of the bitstream is not changed*/
+static uint32_t gts_media_nalu_locate_start_code_mem(GTS_BitStream *bs, uint64_t start, bool locate_trailing)
+{
+    const uint8_t *data = (const uint8_t *)bs->original;
+    uint64_t size = gts_bs_get_size(bs);
+    uint64_t end, nb_cons_zeros = 0;
+    if (start >= size) return (uint32_t)(size - start);
+
+    end = start + nalScanFindStartCode(data + start, (uint32_t)(size - start));
+    if (end < size) {
+        if ((end > start) && !data[end - 1]) end--;
+        return (uint32_t)(end - start);
+    }
+    if (locate_trailing) {
+        while ((nb_cons_zeros < end - start) && !data[end - nb_cons_zeros - 1]) nb_cons_zeros++;
+        if (nb_cons_zeros >= 3)
+            return (uint32_t)(end - start - nb_cons_zeros);
+    }
+    return (uint32_t)(end - start);
+}
+
 static uint32_t gts_media_nalu_locate_start_code_bs(GTS_BitStream *bs, bool locate_trailing)
 {
     uint32_t v, bpos, nb_cons_zeros = 0;
@@ -634,6 +624,8 @@ static uint32_t gts_media_nalu_locate_start_code_bs(GTS_BitStream *bs, bool loca
     uint64_t end, cache_start, load_size;
     uint64_t start = gts_bs_get_position(bs);
     if (start<3) return 0;
+    if ((bs->bsmode == GTS_BITSTREAM_READ) && gts_bs_is_align(bs))
+        return gts_media_nalu_locate_start_code_mem(bs, start, locate_trailing);
 
     load_size = 0;
     bpos = 0;
@@ -1670,11 +1662,113 @@ static int32_t gts_media_hevc_read_pps_bs(GTS_BitStream *gts_bitstream, HEVCStat
     return index_hevc_pps;
 }
 
+uint64_t gts_media_hevc_fingerprint(const uint8_t *data, uint32_t size, uint64_t seed)
+{
+    /*64-bit FNV-1a*/
+    uint64_t hash = seed ? seed : 0xcbf29ce484222325ULL;
+    for (uint32_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+HEVCParamSetCache* gts_media_hevc_param_set_cache_new()
+{
+    HEVCParamSetCache *cache = (HEVCParamSetCache*)gts_malloc(sizeof(HEVCParamSetCache));
+    if (cache) memset(cache, 0, sizeof(HEVCParamSetCache));
+    return cache;
+}
+
+void gts_media_hevc_param_set_cache_del(HEVCParamSetCache *cache)
+{
+    if (cache) gts_free(cache);
+}
+
+/*the cache entry of the parameter set, NULL if it is not a parameter set or it is not cached*/
+static HEVCParamSetEntry* hevc_param_set_entries(HEVCParamSetCache *cache, uint8_t nal_unit_type, int32_t *entry_num)
+{
+    switch (nal_unit_type) {
+    case GTS_HEVC_NALU_VID_PARAM:
+        *entry_num = 16;
+        return cache->vps_entry;
+    case GTS_HEVC_NALU_SEQ_PARAM:
+        *entry_num = 16;
+        return cache->sps_entry;
+    case GTS_HEVC_NALU_PIC_PARAM:
+        *entry_num = 64;
+        return cache->pps_entry;
+    default:
+        *entry_num = 0;
+        return NULL;
+    }
+}
+
+/*copies the parameter set parsed from the same bytes, returns the ID or -1 if it is not in the cache*/
+static int32_t hevc_param_set_restore(HEVCState *hevc, uint8_t nal_unit_type, const int8_t *data, uint32_t size, uint64_t fingerprint)
+{
+    HEVCParamSetCache *cache = hevc->param_set_cache;
+    int32_t entry_num, id;
+    HEVCParamSetEntry *entries = hevc_param_set_entries(cache, nal_unit_type, &entry_num);
+    for (id = 0; id < entry_num; id++) {
+        if ((entries[id].size == size) && (entries[id].fingerprint == fingerprint) && !memcmp(entries[id].data, data, size))
+            break;
+    }
+    if (id >= entry_num) return -1;
+
+    switch (nal_unit_type) {
+    case GTS_HEVC_NALU_VID_PARAM:
+        hevc->vps[id] = cache->vps[id];
+        hevc->last_parsed_vps_id = id;
+        break;
+    case GTS_HEVC_NALU_SEQ_PARAM:
+        hevc->sps[id] = cache->sps[id];
+        hevc->last_parsed_sps_id = id;
+        break;
+    case GTS_HEVC_NALU_PIC_PARAM:
+        /*the state set by gts_media_hevc_read_pps_bs besides the pps*/
+        hevc->pps[id] = cache->pps[id];
+        hevc->last_parsed_pps_id = id;
+        hevc->sps_active_idx = hevc->pps[id].sps_id;
+        hevc->tile_slice_count = hevc->pps[id].tiles_enabled_flag ? hevc->pps[id].num_tile_columns * hevc->pps[id].num_tile_rows : 1;
+        break;
+    }
+    return id;
+}
+
+static void hevc_param_set_store(HEVCState *hevc, uint8_t nal_unit_type, int32_t id, const int8_t *data, uint32_t size, uint64_t fingerprint)
+{
+    HEVCParamSetCache *cache = hevc->param_set_cache;
+    int32_t entry_num;
+    HEVCParamSetEntry *entries = hevc_param_set_entries(cache, nal_unit_type, &entry_num);
+    if ((id < 0) || (id >= entry_num)) return;
+
+    entries[id].fingerprint = fingerprint;
+    entries[id].size = size;
+    memcpy(entries[id].data, data, size);
+    switch (nal_unit_type) {
+    case GTS_HEVC_NALU_VID_PARAM:
+        cache->vps[id] = hevc->vps[id];
+        break;
+    case GTS_HEVC_NALU_SEQ_PARAM:
+        cache->sps[id] = hevc->sps[id];
+        break;
+    case GTS_HEVC_NALU_PIC_PARAM:
+        cache->pps[id] = hevc->pps[id];
+        break;
+    }
+}
+
 int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc)
 {
+    /*the bitstream and the small unescaped nal units are on the stack, so most nal units are parsed without allocation*/
+    GTS_BitStream bs_storage;
     GTS_BitStream *bs=NULL;
+    int8_t unescaped_storage[HEVC_UNESCAPED_STORAGE_SIZE];
     int8_t *data_without_emulation_bytes = NULL;
     uint32_t data_without_emulation_bytes_size = 0;
+    int8_t header_prefix[HEVC_SLICE_HEADER_PREFIX_SIZE];
+    uint32_t prefix_size = 0;
     bool is_slice = false;
     int32_t ret = -1;
     HEVCSliceInfo n_state;
@@ -1683,23 +1777,58 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
     uint8_t *layer_id = &pSpecialInfo->layer_id;
     uint16_t* slicehdrlen = &pSpecialInfo->sliceHeaderLen;
     uint16_t* payloadType = &pSpecialInfo->seiPayloadType;
+    bool is_cached = false;
+    uint64_t fingerprint = 0;
 
     memcpy(&n_state, &hevc->s_info, sizeof(HEVCSliceInfo));
+    int32_t entry_point_start_bits = n_state.entry_point_start_bits;
+    int32_t payload_start_offset = n_state.payload_start_offset;
 
     //hevc->last_parsed_vps_id = hevc->last_parsed_sps_id = hevc->last_parsed_pps_id = -1;
     hevc->s_info.entry_point_start_bits = -1;
     hevc->s_info.payload_start_offset = -1;
 
-    data_without_emulation_bytes_size = gts_media_nalu_emulation_bytes_remove_count(data, size);
-    if (!data_without_emulation_bytes_size) {
-        bs = gts_bs_new(data, size, GTS_BITSTREAM_READ);
-    } else {
-        /*still contains emulation bytes*/
-        data_without_emulation_bytes = (int8_t*) gts_malloc(size*sizeof(int8_t));
-        if(data_without_emulation_bytes){
-            data_without_emulation_bytes_size = gts_media_nalu_remove_emulation_bytes(data, data_without_emulation_bytes, size);
+    /*the parameter sets of the base layer are copied from the cache when the same bytes were parsed before,
+    the sps of the other layers depend on the vps so they are always parsed*/
+    if (hevc->param_set_cache && (size >= 2) && (size <= HEVC_PARAM_SET_CACHED_SIZE)
+        && !(data[0] & 0x80) && !(data[0] & 1) && !(((uint8_t)data[1]) >> 3) && (data[1] & 7)) {
+        uint8_t type = ((uint8_t)data[0]) >> 1;
+        if ((type == GTS_HEVC_NALU_VID_PARAM) || (type == GTS_HEVC_NALU_SEQ_PARAM) || (type == GTS_HEVC_NALU_PIC_PARAM)) {
+            is_cached = true;
+            fingerprint = gts_media_hevc_fingerprint((const uint8_t *)data, size, 0);
+            if (hevc_param_set_restore(hevc, type, data, size, fingerprint) >= 0) {
+                *nal_unit_type = type;
+                *layer_id = 0;
+                *temporal_id = (data[1] & 7) - 1;
+                n_state.nal_unit_type = type;
+                ret = 0;
+                goto save_state;
+            }
+        }
+    }
+
+    /*only the header of a slice is parsed, so the slice is unescaped up to the prefix size and
+    the whole slice is unescaped only when the header goes over the prefix*/
+    if ((size > HEVC_SLICE_HEADER_PREFIX_SIZE) && ((((uint8_t)data[0]) >> 1) < GTS_HEVC_NALU_VID_PARAM)) {
+        prefix_size = gts_media_nalu_remove_emulation_bytes_prefix(data, size, header_prefix, HEVC_SLICE_HEADER_PREFIX_SIZE);
+        bs = (gts_bs_init(&bs_storage, header_prefix, prefix_size, GTS_BITSTREAM_READ) == GTS_OK) ? &bs_storage : NULL;
+    }
+
+parse_whole_nalu:
+    if (!prefix_size) {
+        data_without_emulation_bytes_size = gts_media_nalu_emulation_bytes_remove_count(data, size);
+        if (!data_without_emulation_bytes_size) {
+            bs = (gts_bs_init(&bs_storage, data, size, GTS_BITSTREAM_READ) == GTS_OK) ? &bs_storage : NULL;
+        } else {
+            /*still contains emulation bytes*/
+            int8_t *unescaped = unescaped_storage;
+            if (size > HEVC_UNESCAPED_STORAGE_SIZE)
+                unescaped = data_without_emulation_bytes = (int8_t*) gts_malloc(size*sizeof(int8_t));
+            if(unescaped){
+                data_without_emulation_bytes_size = gts_media_nalu_remove_emulation_bytes(data, unescaped, size);
+                bs = (gts_bs_init(&bs_storage, unescaped, data_without_emulation_bytes_size, GTS_BITSTREAM_READ) == GTS_OK) ? &bs_storage : NULL;
+            }
         }
-        bs = gts_bs_new(data_without_emulation_bytes, data_without_emulation_bytes_size, GTS_BITSTREAM_READ);
     }
     if (!bs) goto exit;
 
@@ -1733,6 +1862,15 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
         is_slice = true;
         /* slice - read the info and compare.*/
         ret = hevc_parse_slice_segment(bs, hevc, &n_state);
+        if (prefix_size && ((ret < 0) || (gts_bs_get_position(bs) >= prefix_size))) {
+            /*the header may go over the prefix, the state is only read by the slice parsing*/
+            bs = NULL;
+            prefix_size = 0;
+            memcpy(&n_state, &hevc->s_info, sizeof(HEVCSliceInfo));
+            n_state.entry_point_start_bits = entry_point_start_bits;
+            n_state.payload_start_offset = payload_start_offset;
+            goto parse_whole_nalu;
+        }
         if (ret<0) goto exit;
 
         *slicehdrlen = n_state.payload_start_offset;
@@ -1753,14 +1891,20 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
         break;
     case GTS_HEVC_NALU_SEQ_PARAM:
         hevc->last_parsed_sps_id = gts_media_hevc_read_sps_bs(bs, hevc, *layer_id, NULL);
+        if (is_cached) hevc_param_set_store(hevc, n_state.nal_unit_type, hevc->last_parsed_sps_id, data, size, fingerprint);
+        hevc->param_set_parse_count++;
         ret = 0;
         break;
     case GTS_HEVC_NALU_PIC_PARAM:
         hevc->last_parsed_pps_id = gts_media_hevc_read_pps_bs(bs, hevc);
+        if (is_cached) hevc_param_set_store(hevc, n_state.nal_unit_type, hevc->last_parsed_pps_id, data, size, fingerprint);
+        hevc->param_set_parse_count++;
         ret = 0;
         break;
     case GTS_HEVC_NALU_VID_PARAM:
         hevc->last_parsed_vps_id = gts_media_hevc_read_vps_bs(bs, hevc, false);
+        if (is_cached) hevc_param_set_store(hevc, n_state.nal_unit_type, hevc->last_parsed_vps_id, data, size, fingerprint);
+        hevc->param_set_parse_count++;
         ret = 0;
         break;
     default:
@@ -1768,6 +1912,7 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
         break;
     }
 
+save_state:
     /* save _prev values */
     if (ret && hevc->s_info.sps) {
         n_state.frame_num_offset_prev = hevc->s_info.frame_num_offset;
@@ -1781,7 +1926,6 @@ int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data,
     memcpy(&hevc->s_info, &n_state, sizeof(HEVCSliceInfo));
 
 exit:
-    if (bs) gts_bs_del(bs);
     if (data_without_emulation_bytes) gts_free(data_without_emulation_bytes);
     return ret;
 }
@@ -414,10 +414,49 @@ typedef struct
     HEVC_ReferencePictureSets rps[64];
 } HEVCSliceInfo;
 
+/*the nal units up to this size are unescaped on the stack when parsed*/
+#define HEVC_UNESCAPED_STORAGE_SIZE    1024
+/*the parameter sets up to this size are kept in the cache*/
+#define HEVC_PARAM_SET_CACHED_SIZE     256
+/*the size of the parameter sets written for a merged layout*/
+#define HEVC_WRITTEN_PARAM_SETS_SIZE   1024
+/*the size of the stitch inputs the written parameter sets are modified with*/
+#define HEVC_WRITTEN_LAYOUT_SIZE       256
+
+typedef struct _hevc_param_set_entry
+{
+    uint64_t fingerprint;
+    uint32_t size; /*0 if the entry is empty*/
+    uint8_t  data[HEVC_PARAM_SET_CACHED_SIZE];
+} HEVCParamSetEntry;
+
+/*the parameter sets parsed from the same bytes are copied from the cache instead of being parsed
+again, the entries are indexed by the vps/sps/pps ID, one cache is used for the states of one stream*/
+typedef struct _hevc_param_set_cache
+{
+    HEVCParamSetEntry vps_entry[16];
+    HEVCParamSetEntry sps_entry[16];
+    HEVCParamSetEntry pps_entry[64];
+    HEVC_VPS vps[16];
+    HEVC_SPS sps[16];
+    HEVC_PPS pps[64];
+
+    /*the parameter sets written last, for the fingerprint of the parsed ones and the layout,
+    the parsed bytes and the layout are kept to be compared when the fingerprint is the same*/
+    uint64_t written_key;
+    uint32_t written_size; /*0 if nothing is written yet*/
+    uint8_t  written[HEVC_WRITTEN_PARAM_SETS_SIZE];
+    uint32_t written_parsed_size;
+    uint8_t  written_parsed[HEVC_WRITTEN_PARAM_SETS_SIZE];
+    uint32_t written_layout_size;
+    uint8_t  written_layout[HEVC_WRITTEN_LAYOUT_SIZE];
+} HEVCParamSetCache;
+
 typedef struct _hevc_state
 {
     //set by user
     bool full_slice_header_parse;
+    HEVCParamSetCache *param_set_cache; /*NULL if the parameter sets are always parsed*/
 
     //all other vars set by parser
 
@@ -438,6 +477,9 @@ typedef struct _hevc_state
 
     bool first_nal;
     int32_t  tile_slice_count;
+
+    //incremented for each parameter set parsed from its bytes, the ones copied from the cache are not counted
+    uint32_t param_set_parse_count;
 } HEVCState;
 
 enum
@@ -448,6 +490,12 @@ enum
 };
 
 int32_t gts_media_hevc_parse_nalu(hevc_specialInfo* pSpecialInfo, int8_t *data, uint32_t size, HEVCState *hevc);
+
+//the fingerprint of the bytes of a nal unit, seed is 0 or the fingerprint the bytes are appended to
+uint64_t gts_media_hevc_fingerprint(const uint8_t *data, uint32_t size, uint64_t seed);
+//the cache is allocated empty, it is used by the states its pointer is set to
+HEVCParamSetCache* gts_media_hevc_param_set_cache_new();
+void gts_media_hevc_param_set_cache_del(HEVCParamSetCache *cache);
 bool gts_media_hevc_slice_is_intra(HEVCState *hevc);
 bool gts_media_hevc_slice_is_IDR(HEVCState *hevc);
 
@@ -456,6 +504,12 @@ int32_t gts_media_hevc_stitch_pps(HEVCState *hevc, void *gentiledstream);
 int32_t gts_media_hevc_stitch_slice_segment(HEVCState *hevc, void* slice, uint32_t frameWidth, uint32_t sub_tile_index);
 
 uint32_t gts_media_nalu_next_start_code_bs(GTS_BitStream *bs);
+
+//the emulation prevention bytes, the buffers are scanned by the vector kernels of 360SCVPHevcNalScan
+uint32_t gts_media_nalu_emulation_bytes_remove_count(const int8_t *buffer, uint32_t size_nal);
+uint32_t gts_media_nalu_remove_emulation_bytes(const int8_t *src_buffer, int8_t *dst_buffer, uint32_t size_nal);
+//unescapes the nal unit until prefix_size bytes are written, the bytes are the first ones of the whole nal unit unescaped
+uint32_t gts_media_nalu_remove_emulation_bytes_prefix(const int8_t *src_buffer, uint32_t size_nal, int8_t *dst_buffer, uint32_t prefix_size);
 int32_t hevc_read_RwpkSEI(int8_t *pRWPKBits, uint32_t RWPKBitsSize, RegionWisePacking* pRWPK);
 #define MAX_TILE_ROWS 64
 #define MAX_TILE_COLS 64
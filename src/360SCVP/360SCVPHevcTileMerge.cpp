@@ -27,6 +27,10 @@
 #include"stdlib.h"
 #include "math.h"
 #include "vector"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <new>
 #include "360SCVPHevcTileMerge.h"
 #include "360SCVPBitstream.h"
 #include "360SCVPHevcEncHdr.h"
@@ -142,9 +146,55 @@ int32_t modify_slice_header(HEVCState *hevc, hevc_mergeStream *mergeStream, uint
     return 0;
 }
 
-int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitstream, bool isHR, hevc_mergeStream *mergeStream, HEVCState *orgHevc)
+one_res *merge_get_tier(hevc_mergeStream *mergeStream, int32_t tier)
 {
-    if (!bs || !pSlice || !pBitstream || !mergeStream)
+    if (tier == 0)
+        return &mergeStream->highRes;
+    if (tier <= mergeStream->midResNum)
+        return &mergeStream->pMidRes[tier - 1];
+    return &mergeStream->lowRes;
+}
+
+// The parameters of the tier of index tier, in the same order as merge_get_tier
+static one_res_param *merge_get_tier_param(param_mergeStream *mergeStreamParams, int32_t tier)
+{
+    if (tier == 0)
+        return &mergeStreamParams->highRes;
+    if (tier <= mergeStreamParams->midResNum)
+        return &mergeStreamParams->pMidRes[tier - 1];
+    return &mergeStreamParams->lowRes;
+}
+
+static int32_t merge_tier_num(hevc_mergeStream *mergeStream)
+{
+    return mergeStream->midResNum + 2;
+}
+
+// The parameter sets are written from the last tier with selected tiles, -1 if there is none
+static int32_t merge_header_tier(hevc_mergeStream *mergeStream)
+{
+    for (int32_t tier = merge_tier_num(mergeStream) - 1; tier >= 0; tier--)
+    {
+        if (merge_get_tier(mergeStream, tier)->selectedTilesCount)
+            return tier;
+    }
+    return -1;
+}
+
+// The number of the selected tiles of all the tiers
+static int32_t merge_tile_num(hevc_mergeStream *mergeStream)
+{
+    int32_t tileNum = 0;
+    for (int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
+        tileNum += merge_get_tier(mergeStream, tier)->selectedTilesCount;
+    return tileNum;
+}
+
+int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitstream, int32_t tier, hevc_mergeStream *mergeStream, HEVCState *orgHevc, merge_segments *pSegments, HEVCSliceHeaderTemplate *pTemplate)
+{
+    if (!pSlice || !mergeStream)
+        return -1;
+    if (!pSegments && (!bs || !pBitstream))
         return -1;
     uint32_t nalsize[NALU_NUM];
     uint32_t specialLen = 0;
@@ -153,7 +203,7 @@ int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitst
     uint8_t *pBufferSliceCur = pSlice->pTiledBitstreamBuffer;
     int32_t lenSlice = pSlice->inputBufferLen;
 
-    uint8_t *pBitstreamCur = *pBitstream;
+    uint8_t *pBitstreamCur = pBitstream ? *pBitstream : NULL;
 
     HEVCState *hevc = pSlice->hevcSlice;
 
@@ -162,14 +212,23 @@ int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitst
     specialInfo.ptr = pBufferSliceCur;
     specialInfo.ptr_size = lenSlice;
     memset(nalsize, 0, sizeof(nalsize));
-    uint64_t bs_position = bs->position;
     int32_t spsCnt;
     parse_hevc_specialinfo(&specialInfo, hevc, nalsize, &specialLen, &spsCnt, 0);
+    uint32_t paramSetsLen = specialLen;
 
     specialLen += nalsize[SLICE_HEADER];
     framesize = specialLen + nalsize[SLICE_DATA];
     lenSlice -= framesize;
 
+    if (pSegments)
+    {
+        // the headers are rewritten into the arena
+        if (merge_segments_reserve(pSegments, 2 * specialLen + MERGE_SEGMENTS_ARENA_MARGIN))
+            return -1;
+        bs = &pSegments->writer;
+    }
+    uint64_t bs_position = bs->position;
+
     if (nalsize[SEQ_PARAM_SET])
     {
         if (orgHevc)
@@ -177,19 +236,49 @@ int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitst
             memcpy(orgHevc, hevc, sizeof(HEVCState));
         }
 
-        // Choose LR header if HR and LR exist
+        // Choose the header of the lowest tier with tiles
         // or return directly after parsing if this frame doesn't need headers
-        if ((isHR && mergeStream->highRes.selectedTilesCount && mergeStream->lowRes.selectedTilesCount)
-            || (!mergeStream->bWroteHeader))
+        if (tier != merge_header_tier(mergeStream) || (!mergeStream->bWroteHeader))
             return 0;
 
         modify_parameter_sets(hevc, mergeStream);
-        hevc_write_parameter_sets(bs, hevc);
+
+        //the written parameter sets only depend on the parsed ones and on the merged layout, which is the one of pLayout,
+        //so each cached layout keeps its own parameter sets, and they are not written again when the layouts alternate
+        merge_layout *pLayout = mergeStream->pLayout;
+        uint64_t key = gts_media_hevc_fingerprint(pBufferSliceCur, paramSetsLen, 0);
+        if (pLayout && pLayout->paramSetsSize && pLayout->paramSetsKey == key && pLayout->parsedParamSetsSize == paramSetsLen
+            && !memcmp(pLayout->parsedParamSets, pBufferSliceCur, paramSetsLen) && gts_bs_is_align(bs))
+        {
+            gts_bs_write_data(bs, (const int8_t *)pLayout->paramSets, pLayout->paramSetsSize);
+        }
+        else
+        {
+            uint64_t start = gts_bs_get_position(bs);
+            hevc_write_parameter_sets(bs, hevc);
+            uint64_t size = gts_bs_get_position(bs) - start;
+            if (pLayout && gts_bs_is_align(bs) && size <= HEVC_WRITTEN_PARAM_SETS_SIZE && paramSetsLen <= HEVC_WRITTEN_PARAM_SETS_SIZE)
+            {
+                memcpy(pLayout->paramSets, bs->original + start, (size_t)size);
+                pLayout->paramSetsSize = (uint32_t)size;
+                pLayout->paramSetsKey = key;
+                memcpy(pLayout->parsedParamSets, pBufferSliceCur, paramSetsLen);
+                pLayout->parsedParamSetsSize = paramSetsLen;
+            }
+        }
     }
     else
     {
         modify_slice_header(hevc, mergeStream, pSlice->currentTileIdx);
-        hevc_write_slice_header(bs, hevc);
+        if (!pTemplate)
+            pTemplate = &merge_get_tier(mergeStream, tier)->sliceHeaderTemplate;
+        hevc_write_slice_header_spliced(bs, hevc, pTemplate);
+    }
+
+    if (pSegments)
+    {
+        // the slice data stays in the input
+        return merge_segments_add(pSegments, pBufferSliceCur + specialLen, nalsize[SLICE_DATA]);
     }
 
     //move to current address
@@ -198,6 +287,8 @@ int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitst
     bs_position = bs->position;
 
     //copy slice data
+    if (bs->position + nalsize[SLICE_DATA] > bs->size)
+        return -1;
     memcpy(pBitstreamCur, pBufferSliceCur + specialLen, nalsize[SLICE_DATA]);
     pBitstreamCur += nalsize[SLICE_DATA];
     bs->position += nalsize[SLICE_DATA];
@@ -223,194 +314,617 @@ int32_t copy_tile_params(one_res *dst, one_res_param *src)
     return 0;
 }
 
-// Put all LR tiles at the right of HR tiles
+// Put the tiles of each lower tier at the right of the tiles of the tier before
 int32_t get_merge_solution(hevc_mergeStream *mergeStream)
 {
     if (!mergeStream)
         return -1;
-    int32_t HR_ntile = mergeStream->highRes.selectedTilesCount;
-    int32_t LR_ntile = mergeStream->lowRes.selectedTilesCount;
-    int32_t HR_tile_h = mergeStream->highRes.tile_height;
-    int32_t HR_tile_w = mergeStream->highRes.tile_width;
-    int32_t LR_tile_h = mergeStream->lowRes.tile_height;
-    int32_t LR_tile_w = mergeStream->lowRes.tile_width;
-    int32_t num_tile_rows = mergeStream->highRes.num_tile_rows;
 
 #define LCU_SIZE 64
 
     HEVC_PPS *pps = &(mergeStream->pps);
+    int32_t tierNum = merge_tier_num(mergeStream);
 
-    if(0 != HR_ntile && 0 != LR_ntile)
+    // the first tier with tiles decides the height of the merged picture
+    int32_t leadTier = -1;
+    int32_t mergedTierNum = 0;
+    for (int32_t tier = tierNum - 1; tier >= 0; tier--)
     {
-        int32_t height = 0;
-        int32_t HR_hc = 0;
-        if(!mergeStream->highRes.bOrdered)
-        {
-        // Suppose all tiles of one stream have same resolution
-            height = lcm(HR_tile_h, LR_tile_h);
-            int sqrtH = (int)(ceil((double)sqrt(HR_ntile)));
-            //find the max height of the stitched YUV, maybe we can try every possible value later.
-            while(sqrtH && HR_ntile%sqrtH){sqrtH--;}
-
-            HR_hc = height / HR_tile_h;
-            HR_hc = lcm(HR_hc, sqrtH);
-            height = HR_hc * HR_tile_h;
-        }
-        else
-        {
-            HR_hc = num_tile_rows;
-            height = HR_tile_h * num_tile_rows;
-        }
-
-        // Check if the input tile number is legitimate
-        if(height == 0 || HR_hc == 0 || height % LR_tile_h || HR_ntile % HR_hc || LR_ntile % (height / LR_tile_h))
+        if (merge_get_tier(mergeStream, tier)->selectedTilesCount)
         {
-            printf("The input tile number is not legitimate!\n");
-            return -1;
+            leadTier = tier;
+            mergedTierNum++;
         }
+    }
+    if (leadTier < 0)
+        return -1;
 
-        int32_t LR_hc = height / LR_tile_h;
-        uint32_t HR_wc = HR_ntile / HR_hc;
-        int32_t LR_wc = LR_ntile / LR_hc;
+    one_res *pLead = merge_get_tier(mergeStream, leadTier);
+    int32_t lead_ntile = pLead->selectedTilesCount;
+    int32_t lead_tile_h = pLead->tile_height;
+    int32_t lead_hc = 0;
+    int32_t height = 0;
 
-        pps->num_tile_columns = HR_wc + LR_wc;
-        for (uint32_t i = 0; i < pps->num_tile_columns; i++)
+    if (1 == mergedTierNum)
+    {
+        if(!pLead->bOrdered)
         {
-            pps->column_width[i] = i < HR_wc ? HR_tile_w : LR_tile_w;
-            pps->column_width[i] /= LCU_SIZE;
+            lead_hc = (int32_t)sqrt(lead_ntile);
+            while(lead_hc && lead_ntile%lead_hc){lead_hc--;}
         }
-        // No tile in rows!
-        pps->num_tile_rows = 1;
-
-        // left - HR + right - LR
-        int32_t pic_width = HR_wc * HR_tile_w + LR_wc * LR_tile_w;
-        int32_t pic_height = HR_hc * HR_tile_h;
-        mergeStream->pic_width = pic_width;
-        mergeStream->pic_height = pic_height;
-
-        for (int32_t i = 0; i < HR_ntile ; i++)
+        else
         {
-            int32_t addr = (i % HR_hc) * HR_tile_h / LCU_SIZE * pic_width / LCU_SIZE + (i / HR_hc) * HR_tile_w / LCU_SIZE;
-            mergeStream->slice_segment_address[i] = addr;
+            lead_hc = pLead->num_tile_rows;
         }
-        for (int32_t i = 0; i < LR_ntile ; i++)
+        height = lead_hc * lead_tile_h;
+    }
+    else if(!pLead->bOrdered)
+    {
+        // Suppose all tiles of one stream have same resolution
+        height = lead_tile_h;
+        for (int32_t tier = leadTier + 1; tier < tierNum; tier++)
         {
-            int32_t addr = (i % LR_hc) * LR_tile_h / LCU_SIZE * pic_width / LCU_SIZE + (i / LR_hc) * LR_tile_w / LCU_SIZE + HR_wc * HR_tile_w / LCU_SIZE;
-            mergeStream->slice_segment_address[i + HR_ntile] = addr;
+            one_res *pRes = merge_get_tier(mergeStream, tier);
+            if (pRes->selectedTilesCount)
+                height = lcm(height, pRes->tile_height);
         }
+        int sqrtH = (int)(ceil((double)sqrt(lead_ntile)));
+        //find the max height of the stitched YUV, maybe we can try every possible value later.
+        while(sqrtH && lead_ntile%sqrtH){sqrtH--;}
+
+        lead_hc = lead_tile_h ? height / lead_tile_h : 0;
+        lead_hc = lcm(lead_hc, sqrtH);
+        height = lead_hc * lead_tile_h;
     }
-    else if(0 == HR_ntile && 0 != LR_ntile)
+    else
     {
-        int32_t LR_hc = 0;
-        int32_t LR_wc = 0;
+        lead_hc = pLead->num_tile_rows;
+        height = lead_tile_h * lead_hc;
+    }
 
-        if(!mergeStream->lowRes.bOrdered)
+    // Check if the input tile number is legitimate
+    bool bLegitimate = height > 0 && lead_hc > 0;
+    for (int32_t tier = leadTier; bLegitimate && tier < tierNum; tier++)
+    {
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        if (pRes->selectedTilesCount)
+            bLegitimate = pRes->tile_height > 0 && !(height % pRes->tile_height)
+                && !(pRes->selectedTilesCount % (height / pRes->tile_height));
+    }
+    if (!bLegitimate)
+    {
+        printf("The input tile number is not legitimate!\n");
+        return -1;
+    }
+
+    // the columns of the tiers from left to right
+    uint32_t maxColumns = sizeof(pps->column_width) / sizeof(pps->column_width[0]);
+    int32_t pic_width = 0;
+    pps->num_tile_columns = 0;
+    for (int32_t tier = leadTier; tier < tierNum; tier++)
+    {
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        if (!pRes->selectedTilesCount)
+            continue;
+        uint32_t wc = (1 == mergedTierNum && pRes->bOrdered) ? pRes->num_tile_columns : pRes->selectedTilesCount / (height / pRes->tile_height);
+        if (pps->num_tile_columns + wc > maxColumns)
         {
-            LR_hc = (int32_t)sqrt(LR_ntile);
-            while(LR_hc && HR_ntile%LR_hc){LR_hc--;}
-            LR_wc = LR_ntile / LR_hc;
+            printf("The merged tile columns are more than %d!\n", maxColumns);
+            return -1;
         }
-        else
+        for (uint32_t i = 0; i < wc; i++)
         {
-            LR_hc = mergeStream->lowRes.num_tile_rows;
-            LR_wc = mergeStream->lowRes.num_tile_columns;
+            pps->column_width[pps->num_tile_columns++] = pRes->tile_width / LCU_SIZE;
         }
+        pic_width += wc * pRes->tile_width;
+    }
+    // No tile in rows!
+    pps->num_tile_rows = 1;
 
-        pps->num_tile_columns = LR_wc;
-        for (uint32_t i = 0; i < pps->num_tile_columns; i++)
+    mergeStream->pic_width = pic_width;
+    mergeStream->pic_height = height;
+
+    int32_t tileIdx = 0;
+    int32_t left = 0;
+    for (int32_t tier = leadTier; tier < tierNum; tier++)
+    {
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        int32_t ntile = pRes->selectedTilesCount;
+        if (!ntile)
+            continue;
+        int32_t tile_h = pRes->tile_height;
+        int32_t tile_w = pRes->tile_width;
+        int32_t hc = height / tile_h;
+        for (int32_t i = 0; i < ntile ; i++)
         {
-            pps->column_width[i] = LR_tile_w;
-            pps->column_width[i] /= LCU_SIZE;
+            int32_t addr = (i % hc) * tile_h / LCU_SIZE * pic_width / LCU_SIZE + (i / hc) * tile_w / LCU_SIZE + left / LCU_SIZE;
+            mergeStream->slice_segment_address[tileIdx++] = addr;
         }
-        // No tile in rows!
-        pps->num_tile_rows = 1;
+        left += (1 == mergedTierNum && pRes->bOrdered) ? pRes->num_tile_columns * tile_w : ntile / hc * tile_w;
+    }
 
-        int32_t pic_width = LR_wc * LR_tile_w;
-        int32_t pic_height = LR_hc * LR_tile_h;
-        mergeStream->pic_width = pic_width;
-        mergeStream->pic_height = pic_height;
+    return 0;
+}
 
-        for (int32_t i = 0; i < LR_ntile ; i++)
+int32_t get_merge_solution_cached(hevc_mergeStream *mergeStream)
+{
+    if (!mergeStream)
+        return -1;
+    int32_t tileNum = merge_tile_num(mergeStream);
+    HEVC_PPS *pps = &(mergeStream->pps);
+
+    // the merge solution only depends on the count, the size and the order of the tiles of all the tiers
+    int32_t tierNum = merge_tier_num(mergeStream);
+    int32_t layoutParams[MERGE_LAYOUT_TIER_NUM][MERGE_LAYOUT_PARAM_NUM];
+    if (tierNum > MERGE_LAYOUT_TIER_NUM)
+    {
+        mergeStream->pLayout = NULL;
+        return get_merge_solution(mergeStream);
+    }
+    uint64_t key = 0;
+    for (int32_t tier = 0; tier < tierNum; tier++)
+    {
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        int32_t *pParams = layoutParams[tier];
+        pParams[0] = pRes->selectedTilesCount;
+        pParams[1] = pRes->tile_width;
+        pParams[2] = pRes->tile_height;
+        pParams[3] = pRes->num_tile_columns;
+        pParams[4] = pRes->num_tile_rows;
+        pParams[5] = (int32_t)pRes->bOrdered;
+        key = gts_media_hevc_fingerprint((const uint8_t*)pParams, sizeof(layoutParams[0]), key);
+    }
+
+    // the fingerprint only finds the layout, the params of the tiers are the same too when it is the same layout
+    merge_layout *pLayout = NULL;
+    merge_layout *pOldest = &mergeStream->layouts[0];
+    for (int32_t i = 0; i < MERGE_LAYOUT_CACHE_SIZE; i++)
+    {
+        merge_layout *pCur = &mergeStream->layouts[i];
+        if (pCur->lastUsed && pCur->key == key && pCur->tierNum == tierNum
+            && !memcmp(pCur->layoutParams, layoutParams, tierNum * sizeof(layoutParams[0])))
         {
-            int32_t addr = (i % LR_hc) * LR_tile_h / LCU_SIZE * pic_width / LCU_SIZE + (i / LR_hc) * LR_tile_w / LCU_SIZE;
-            mergeStream->slice_segment_address[i] = addr;
+            pLayout = pCur;
+            break;
         }
+        if (pCur->lastUsed < pOldest->lastUsed)
+            pOldest = pCur;
     }
-    else if(0 != HR_ntile && 0 == LR_ntile)
+    mergeStream->layoutUseCount++;
+
+    if (pLayout)
     {
-        int32_t HR_hc = 0;
-        int32_t HR_wc = 0;
-        if(!mergeStream->highRes.bOrdered)
+        mergeStream->pic_width = pLayout->pic_width;
+        mergeStream->pic_height = pLayout->pic_height;
+        pps->num_tile_columns = pLayout->num_tile_columns;
+        pps->num_tile_rows = pLayout->num_tile_rows;
+        memcpy(pps->column_width, pLayout->column_width, sizeof(pps->column_width));
+        memcpy(pps->row_height, pLayout->row_height, sizeof(pps->row_height));
+        memcpy(mergeStream->slice_segment_address, pLayout->slice_segment_address, tileNum * sizeof(int32_t));
+        pLayout->lastUsed = mergeStream->layoutUseCount;
+        mergeStream->pLayout = pLayout;
+        return 0;
+    }
+
+    mergeStream->pLayout = NULL;
+    int32_t ret = get_merge_solution(mergeStream);
+    if (ret || !pOldest->slice_segment_address)
+        return ret;
+
+    // replace the least recently used layout
+    pOldest->key = key;
+    pOldest->tierNum = tierNum;
+    memcpy(pOldest->layoutParams, layoutParams, tierNum * sizeof(layoutParams[0]));
+    pOldest->lastUsed = mergeStream->layoutUseCount;
+    pOldest->pic_width = mergeStream->pic_width;
+    pOldest->pic_height = mergeStream->pic_height;
+    pOldest->num_tile_columns = pps->num_tile_columns;
+    pOldest->num_tile_rows = pps->num_tile_rows;
+    memcpy(pOldest->column_width, pps->column_width, sizeof(pOldest->column_width));
+    memcpy(pOldest->row_height, pps->row_height, sizeof(pOldest->row_height));
+    memcpy(pOldest->slice_segment_address, mergeStream->slice_segment_address, tileNum * sizeof(int32_t));
+    pOldest->paramSetsSize = 0;
+    pOldest->parsedParamSetsSize = 0;
+    mergeStream->pLayout = pOldest;
+    return 0;
+}
+
+// Make the tasks of threadNum threads, their states are allocated once and kept over frames
+static int32_t merge_tasks_reserve(hevc_mergeStream *mergeStream, int32_t taskNum)
+{
+    if (mergeStream->taskNum >= taskNum)
+        return 0;
+    merge_task *pTasks = (merge_task *)realloc(mergeStream->pTasks, taskNum * sizeof(merge_task));
+    if (!pTasks)
+        return -1;
+    mergeStream->pTasks = pTasks;
+    int32_t tierNum = merge_tier_num(mergeStream);
+    for (; mergeStream->taskNum < taskNum; mergeStream->taskNum++)
+    {
+        merge_task *task = &pTasks[mergeStream->taskNum];
+        memset(task, 0, sizeof(merge_task));
+        task->pHevcSlices = (HEVCState **)malloc(tierNum * sizeof(HEVCState *));
+        task->pParamSetCounts = (int64_t *)malloc(tierNum * sizeof(int64_t));
+        task->pSliceHeaderTemplates = (HEVCSliceHeaderTemplate *)malloc(tierNum * sizeof(HEVCSliceHeaderTemplate));
+        bool bAllocated = task->pHevcSlices && task->pParamSetCounts && task->pSliceHeaderTemplates;
+        for (int32_t tier = 0; bAllocated && tier < tierNum; tier++)
         {
-            HR_hc = (int32_t)sqrt(HR_ntile);
-            while(HR_hc && HR_ntile%HR_hc){HR_hc--;}
-            HR_wc = HR_ntile / HR_hc;
+            task->pHevcSlices[tier] = (HEVCState*)malloc(sizeof(HEVCState));
+            task->pParamSetCounts[tier] = -1;
+            if (!task->pHevcSlices[tier])
+            {
+                for (int32_t i = 0; i < tier; i++)
+                    free(task->pHevcSlices[i]);
+                bAllocated = false;
+            }
         }
-        else
+        if (!bAllocated)
         {
-            HR_hc = mergeStream->highRes.num_tile_rows;
-            HR_wc = mergeStream->highRes.num_tile_columns;
+            free(task->pHevcSlices);
+            free(task->pParamSetCounts);
+            free(task->pSliceHeaderTemplates);
+            return -1;
         }
+    }
+    return 0;
+}
+
+static void merge_tasks_free(hevc_mergeStream *mergeStream)
+{
+    for (int32_t i = 0; i < mergeStream->taskNum; i++)
+    {
+        for (int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
+            free(mergeStream->pTasks[i].pHevcSlices[tier]);
+        free(mergeStream->pTasks[i].pHevcSlices);
+        free(mergeStream->pTasks[i].pParamSetCounts);
+        free(mergeStream->pTasks[i].pSliceHeaderTemplates);
+        merge_segments_free(&mergeStream->pTasks[i].segments);
+    }
+    if (mergeStream->pTasks)
+        free(mergeStream->pTasks);
+    mergeStream->pTasks = NULL;
+    mergeStream->taskNum = 0;
+}
+
+// Bring the state of the task for a tier to the tier state. The whole state is copied only when the parameter
+// sets of one of them were parsed since the last copy. Otherwise only the slice info, the sei and the ids of the
+// last parsed sets are copied, with the sps and the pps modify_parameter_sets and modify_slice_header change
+static void merge_task_sync_state(merge_task *task, int32_t tier, const HEVCState *pTierHevc)
+{
+    HEVCState *hevc = task->pHevcSlices[tier];
+    int64_t count = task->pParamSetCounts[tier];
+    if (count != (int64_t)pTierHevc->param_set_parse_count || count != (int64_t)hevc->param_set_parse_count)
+    {
+        memcpy(hevc, pTierHevc, sizeof(HEVCState));
+        hevc->param_set_cache = NULL;
+        task->pParamSetCounts[tier] = pTierHevc->param_set_parse_count;
+        return;
+    }
+    hevc->full_slice_header_parse = pTierHevc->full_slice_header_parse;
+    hevc->sps_active_idx = pTierHevc->sps_active_idx;
+    hevc->s_info = pTierHevc->s_info;
+    hevc->sei = pTierHevc->sei;
+    hevc->last_parsed_vps_id = pTierHevc->last_parsed_vps_id;
+    hevc->last_parsed_sps_id = pTierHevc->last_parsed_sps_id;
+    hevc->last_parsed_pps_id = pTierHevc->last_parsed_pps_id;
+    hevc->first_nal = pTierHevc->first_nal;
+    hevc->tile_slice_count = pTierHevc->tile_slice_count;
+    hevc->sps[0] = pTierHevc->sps[0];
+    if (pTierHevc->last_parsed_pps_id >= 0 && pTierHevc->last_parsed_pps_id < 64)
+        hevc->pps[pTierHevc->last_parsed_pps_id] = pTierHevc->pps[pTierHevc->last_parsed_pps_id];
+}
+
+static void merge_task_run(merge_task *task)
+{
+    hevc_mergeStream *mergeStream = task->mergeStream;
+    task->ret = 0;
+    int32_t tier = 0;
+    int32_t tierStart = 0;
+    for (int32_t i = task->start; i < task->end; i++)
+    {
+        // the tiles are counted in the order of the tiers
+        while (i - tierStart >= merge_get_tier(mergeStream, tier)->selectedTilesCount)
+            tierStart += merge_get_tier(mergeStream, tier++)->selectedTilesCount;
+        oneStream_info *pSlice = merge_get_tier(mergeStream, tier)->pTiledBitstreams[i - tierStart];
+        HEVCState *tmpHevcSlice = pSlice->hevcSlice;
+        uint64_t totalLen = task->segments.totalLen;
+        pSlice->hevcSlice = task->pHevcSlices[tier];
+        task->ret |= merge_header(NULL, pSlice, NULL, tier, mergeStream, NULL, &task->segments,
+            &task->pSliceHeaderTemplates[tier]);
+        pSlice->hevcSlice = tmpHevcSlice;
+        if (task->bCountOutput)
+            pSlice->outputBufferLen += (uint32_t)(task->segments.totalLen - totalLen);
+    }
+    merge_segments_finish(&task->segments);
+}
+
+static void merge_task_copy(merge_task *task)
+{
+    uint8_t *pOutput = task->pOutput;
+    for (uint32_t i = 0; i < task->segments.segmentNum; i++)
+    {
+        BitstreamSegment *pSegment = &task->segments.pSegments[i];
+        memcpy(pOutput, pSegment->pData, pSegment->dataLen);
+        pOutput += pSegment->dataLen;
+    }
+}
+
+// The worker threads of a handle, they wait for the tasks of each dispatch, the worker i runs the task i
+struct MERGE_WORKERS
+{
+    std::mutex               mutex;
+    std::condition_variable  startCond;    //a dispatch starts, or the workers stop
+    std::condition_variable  doneCond;     //the last worker is done with the dispatch
+    std::vector<std::thread> threads;
+    merge_task              *tasks;
+    int32_t                  taskNum;
+    void                   (*func)(merge_task *);
+    uint64_t                 dispatchCount;
+    int32_t                  pending;      //the workers not done with the current dispatch
+    bool                     bStop;
+};
+
+static void merge_worker_run(MERGE_WORKERS *pWorkers, int32_t idx)
+{
+    uint64_t dispatchCount = 0;
+    std::unique_lock<std::mutex> lock(pWorkers->mutex);
+    while (1)
+    {
+        while (!pWorkers->bStop && pWorkers->dispatchCount == dispatchCount)
+            pWorkers->startCond.wait(lock);
+        if (pWorkers->bStop)
+            break;
+        dispatchCount = pWorkers->dispatchCount;
+        lock.unlock();
+
+        if (idx < pWorkers->taskNum)
+            pWorkers->func(&pWorkers->tasks[idx]);
+
+        lock.lock();
+        if (--pWorkers->pending == 0)
+            pWorkers->doneCond.notify_one();
+    }
+}
+
+static void merge_workers_close(hevc_mergeStream *mergeStream)
+{
+    MERGE_WORKERS *pWorkers = mergeStream->pWorkers;
+    if (!pWorkers)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(pWorkers->mutex);
+        pWorkers->bStop = true;
+    }
+    pWorkers->startCond.notify_all();
+    for (size_t t = 0; t < pWorkers->threads.size(); t++)
+        pWorkers->threads[t].join();
+    delete pWorkers;
+    mergeStream->pWorkers = NULL;
+}
+
+// Start the threadNum - 1 workers, the tasks without a worker run on the calling thread
+static int32_t merge_workers_init(hevc_mergeStream *mergeStream, int32_t threadNum)
+{
+    merge_workers_close(mergeStream);
+    if (threadNum <= 1)
+        return 0;
+
+    MERGE_WORKERS *pWorkers = new (std::nothrow) MERGE_WORKERS;
+    if (!pWorkers)
+        return -1;
+    pWorkers->tasks = NULL;
+    pWorkers->taskNum = 0;
+    pWorkers->func = NULL;
+    pWorkers->dispatchCount = 0;
+    pWorkers->pending = 0;
+    pWorkers->bStop = false;
+    mergeStream->pWorkers = pWorkers;
+    try
+    {
+        pWorkers->threads.reserve(threadNum - 1);
+        for (int32_t t = 1; t < threadNum; t++)
+            pWorkers->threads.push_back(std::thread(merge_worker_run, pWorkers, t));
+    }
+    catch (...)
+    {
+        // the workers started so far are kept, the other tasks run on the calling thread
+    }
+    return 0;
+}
+
+// Run the function of the tasks, the first one on the calling thread
+static void merge_tasks_dispatch(hevc_mergeStream *mergeStream, merge_task *tasks, int32_t threadNum, void (*func)(merge_task *))
+{
+    MERGE_WORKERS *pWorkers = mergeStream->pWorkers;
+    int32_t workerNum = pWorkers ? (int32_t)pWorkers->threads.size() : 0;
+    if (workerNum)
+    {
+        std::lock_guard<std::mutex> lock(pWorkers->mutex);
+        pWorkers->tasks = tasks;
+        pWorkers->taskNum = threadNum;
+        pWorkers->func = func;
+        pWorkers->pending = workerNum;
+        pWorkers->dispatchCount++;
+    }
+    if (workerNum)
+        pWorkers->startCond.notify_all();
+
+    func(&tasks[0]);
+    for (int32_t t = workerNum + 1; t < threadNum; t++)
+        func(&tasks[t]);
+
+    if (workerNum)
+    {
+        std::unique_lock<std::mutex> lock(pWorkers->mutex);
+        while (pWorkers->pending)
+            pWorkers->doneCond.wait(lock);
+    }
+}
 
-        pps->num_tile_columns = HR_wc;
-        for (uint32_t i = 0; i < pps->num_tile_columns; i++)
+// Merge the tiles on the threads, each one from the states got with the stream headers, then
+// join their segments in order into the output or after pSegments
+static int32_t merge_tiles_parallel(GTS_BitStream *bs, uint8_t *pOutBitstream, hevc_mergeStream *mergeStream, merge_segments *pSegments)
+{
+    int32_t tierNum = merge_tier_num(mergeStream);
+    int32_t tileNum = merge_tile_num(mergeStream);
+    int32_t threadNum = mergeStream->threadNum < tileNum ? mergeStream->threadNum : tileNum;
+    if (merge_tasks_reserve(mergeStream, threadNum))
+        return -1;
+
+    merge_task *tasks = mergeStream->pTasks;
+    for (int32_t t = 0; t < threadNum; t++)
+    {
+        merge_task *task = &tasks[t];
+        task->mergeStream = mergeStream;
+        task->start = (int32_t)((int64_t)tileNum * t / threadNum);
+        task->end = (int32_t)((int64_t)tileNum * (t + 1) / threadNum);
+        task->bCountOutput = !pSegments;
+        for (int32_t tier = 0; tier < tierNum; tier++)
         {
-            pps->column_width[i] = HR_tile_w;
-            pps->column_width[i] /= LCU_SIZE;
+            one_res *pRes = merge_get_tier(mergeStream, tier);
+            if (pRes->selectedTilesCount)
+                merge_task_sync_state(task, tier, pRes->hevcSlice);
+            task->pSliceHeaderTemplates[tier] = pRes->sliceHeaderTemplate;
         }
-        // No tile in rows!
-        pps->num_tile_rows = 1;
+        merge_segments_reset(&task->segments);
+    }
+
+    merge_tasks_dispatch(mergeStream, tasks, threadNum, merge_task_run);
 
-        int32_t pic_width = HR_wc * HR_tile_w;
-        int32_t pic_height = HR_hc * HR_tile_h;
-        mergeStream->pic_width = pic_width;
-        mergeStream->pic_height = pic_height;
+    // the first thread keeps the templates for the serial merging
+    for (int32_t tier = 0; tier < tierNum; tier++)
+        merge_get_tier(mergeStream, tier)->sliceHeaderTemplate = tasks[0].pSliceHeaderTemplates[tier];
 
-        for (int32_t i = 0; i < HR_ntile ; i++)
+    int32_t ret = 0;
+    for (int32_t t = 0; t < threadNum; t++)
+        ret |= tasks[t].ret;
+    if (ret)
+        return -1;
+
+    if (pSegments)
+    {
+        if (merge_segments_add(pSegments, NULL, 0))
+            return -1;
+        merge_segments_finish(pSegments);
+        for (int32_t t = 0; t < threadNum; t++)
         {
-            int32_t addr = (i % HR_hc) * HR_tile_h / LCU_SIZE * pic_width / LCU_SIZE + (i / HR_hc) * HR_tile_w / LCU_SIZE;
-            mergeStream->slice_segment_address[i] = addr;
+            if (merge_segments_append(pSegments, &tasks[t].segments))
+                return -1;
         }
+        return 0;
     }
-    else
-    {
+
+    // the place of each thread in the output is known now, so the tiles are copied in parallel too
+    uint64_t totalLen = 0;
+    for (int32_t t = 0; t < threadNum; t++)
+        totalLen += tasks[t].segments.totalLen;
+    if (bs->position + totalLen > bs->size)
         return -1;
+    for (int32_t t = 0; t < threadNum; t++)
+    {
+        tasks[t].pOutput = pOutBitstream;
+        pOutBitstream += tasks[t].segments.totalLen;
+        bs->position += tasks[t].segments.totalLen;
     }
+    merge_tasks_dispatch(mergeStream, tasks, threadNum, merge_task_copy);
+    return 0;
+}
 
+// Allocate the header, the tiles and the states of one tier
+static int32_t merge_tier_init(one_res *pRes, one_res_param *pParam)
+{
+    copy_tile_params(pRes, pParam);
+
+    pRes->hevcSlice = (HEVCState*)malloc(sizeof(HEVCState));
+    if (!pRes->hevcSlice)
+        return -1;
+    memset(pRes->hevcSlice, 0, sizeof(HEVCState));
+
+    init_one_bitstream(&pRes->pHeader);
+    if (pRes->pHeader && pRes->pHeader->hevcSlice)
+        pRes->pHeader->hevcSlice->param_set_cache = gts_media_hevc_param_set_cache_new();
+    pRes->pTiledBitstreams = (oneStream_info**)malloc(pRes->selectedTilesCount * sizeof(oneStream_info *));
+    if (!pRes->pTiledBitstreams)
+        return -1;
+    for(int32_t i = 0 ; i < pRes->selectedTilesCount ; i++)
+    {
+        init_one_bitstream(&pRes->pTiledBitstreams[i]);
+    }
     return 0;
 }
 
+static void merge_tier_close(one_res *pRes)
+{
+    if (pRes->pHeader && pRes->pHeader->hevcSlice)
+        gts_media_hevc_param_set_cache_del(pRes->pHeader->hevcSlice->param_set_cache);
+    destory_one_bitstream(&pRes->pHeader);
+
+    for(int32_t i = 0 ; pRes->pTiledBitstreams && i < pRes->selectedTilesCount ; i++)
+    {
+        destory_one_bitstream(&pRes->pTiledBitstreams[i]);
+    }
+    if(pRes->pTiledBitstreams)
+    {
+        free(pRes->pTiledBitstreams);
+        pRes->pTiledBitstreams = NULL;
+    }
+    if(pRes->hevcSlice)
+    {
+        free(pRes->hevcSlice);
+        pRes->hevcSlice = NULL;
+    }
+}
+
 void* tile_merge_Init(param_mergeStream *mergeStreamParams)
 {
     if(!mergeStreamParams)
         return NULL;
+    if(mergeStreamParams->midResNum < 0 || (mergeStreamParams->midResNum && !mergeStreamParams->pMidRes))
+        return NULL;
 
     hevc_mergeStream *mergeStream = (hevc_mergeStream *)malloc(sizeof(hevc_mergeStream));
     if(!mergeStream)
         return NULL;
     memset(mergeStream, 0, sizeof(hevc_mergeStream));
 
-    int32_t HR_ntile = mergeStreamParams->highRes.selectedTilesCount;
-    int32_t LR_ntile = mergeStreamParams->lowRes.selectedTilesCount;
-    copy_tile_params(&(mergeStream->highRes), &(mergeStreamParams->highRes));
-    copy_tile_params(&(mergeStream->lowRes), &(mergeStreamParams->lowRes));
+    if(mergeStreamParams->midResNum)
+    {
+        mergeStream->pMidRes = (one_res *)malloc(mergeStreamParams->midResNum * sizeof(one_res));
+        if(!mergeStream->pMidRes)
+        {
+            free(mergeStream);
+            return NULL;
+        }
+        memset(mergeStream->pMidRes, 0, mergeStreamParams->midResNum * sizeof(one_res));
+        mergeStream->midResNum = mergeStreamParams->midResNum;
+    }
+    for(int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
+    {
+        copy_tile_params(merge_get_tier(mergeStream, tier), merge_get_tier_param(mergeStreamParams, tier));
+    }
+    int32_t tileNum = merge_tile_num(mergeStream);
 
-    mergeStream->slice_segment_address = (int32_t *)malloc((HR_ntile+LR_ntile) * sizeof(int32_t));
-    memset(mergeStream->slice_segment_address, 0, (HR_ntile+LR_ntile) * sizeof(int32_t));
+    mergeStream->slice_segment_address = (int32_t *)malloc(tileNum * sizeof(int32_t));
+    if(mergeStream->slice_segment_address)
+        memset(mergeStream->slice_segment_address, 0, tileNum * sizeof(int32_t));
 
     mergeStream->inputBistreamsLen = 0;
+    mergeStream->threadNum = 1;
 
-    init_one_bitstream(&mergeStream->highRes.pHeader);
-    init_one_bitstream(&mergeStream->lowRes.pHeader);
-    mergeStream->highRes.pTiledBitstreams = (oneStream_info**)malloc(HR_ntile * sizeof(oneStream_info *));
-    for(int32_t i = 0 ; i < HR_ntile ; i++)
+    //the layouts are still got without the cache if their tile addresses can't be allocated
+    int32_t *pLayoutAddress = (int32_t *)malloc(MERGE_LAYOUT_CACHE_SIZE * tileNum * sizeof(int32_t));
+    for (int32_t i = 0; pLayoutAddress && i < MERGE_LAYOUT_CACHE_SIZE; i++)
     {
-        init_one_bitstream(&mergeStream->highRes.pTiledBitstreams[i]);
+        mergeStream->layouts[i].slice_segment_address = pLayoutAddress + i * tileNum;
     }
-    mergeStream->lowRes.pTiledBitstreams = (oneStream_info**)malloc(LR_ntile * sizeof(oneStream_info *));
-    for(int32_t i = 0 ; i < LR_ntile ; i++)
+
+    for(int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
     {
-        init_one_bitstream(&mergeStream->lowRes.pTiledBitstreams[i]);
+        if (merge_tier_init(merge_get_tier(mergeStream, tier), merge_get_tier_param(mergeStreamParams, tier)))
+        {
+            tile_merge_Close(mergeStream);
+            return NULL;
+        }
     }
     return mergeStream;
 }
@@ -420,19 +934,10 @@ int32_t tile_merge_Close(void* handle)
     hevc_mergeStream *mergeStream = (hevc_mergeStream *)handle;
     if (!mergeStream)
         return -1;
-    int32_t HR_ntile = mergeStream->highRes.selectedTilesCount;
-    int32_t LR_ntile = mergeStream->lowRes.selectedTilesCount;
-
-    destory_one_bitstream(&mergeStream->highRes.pHeader);
-    destory_one_bitstream(&mergeStream->lowRes.pHeader);
 
-    for(int32_t i = 0 ; i < HR_ntile ; i++)
-    {
-        destory_one_bitstream(&mergeStream->highRes.pTiledBitstreams[i]);
-    }
-    for(int32_t i = 0 ; i < LR_ntile ; i++)
+    for (int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
     {
-        destory_one_bitstream(&mergeStream->lowRes.pTiledBitstreams[i]);
+        merge_tier_close(merge_get_tier(mergeStream, tier));
     }
 
     if(mergeStream->slice_segment_address)
@@ -441,15 +946,20 @@ int32_t tile_merge_Close(void* handle)
         mergeStream->slice_segment_address = NULL;
     }
 
-    if(mergeStream->highRes.pTiledBitstreams)
+    merge_workers_close(mergeStream);
+    merge_segments_free(&mergeStream->segments);
+    merge_tasks_free(mergeStream);
+    if(mergeStream->layouts[0].slice_segment_address)
     {
-        free(mergeStream->highRes.pTiledBitstreams);
-        mergeStream->highRes.pTiledBitstreams = NULL;
+        free(mergeStream->layouts[0].slice_segment_address);
+        memset(mergeStream->layouts, 0, sizeof(mergeStream->layouts));
     }
-    if(mergeStream->lowRes.pTiledBitstreams)
+    mergeStream->pLayout = NULL;
+
+    if(mergeStream->pMidRes)
     {
-        free(mergeStream->lowRes.pTiledBitstreams);
-        mergeStream->lowRes.pTiledBitstreams = NULL;
+        free(mergeStream->pMidRes);
+        mergeStream->pMidRes = NULL;
     }
     if(mergeStream)
     {
@@ -460,33 +970,37 @@ int32_t tile_merge_Close(void* handle)
     return 0;
 }
 
-int32_t tile_merge_Process(param_mergeStream *mergeStreamParams, void* handle)
+// Take the tiles of this frame from the parameters and get the merge solution,
+// the length of all the input tiles is returned in pInputLen
+static int32_t merge_prepare(param_mergeStream *mergeStreamParams, hevc_mergeStream *mergeStream, uint32_t *pInputLen)
 {
-    hevc_mergeStream *mergeStream = (hevc_mergeStream *)handle;
-    if (!mergeStream || !mergeStreamParams)
-        return -1;
     int32_t HR_ntile = mergeStream->highRes.selectedTilesCount;
-    int32_t LR_ntile = mergeStream->lowRes.selectedTilesCount;
-
-    if( 0 == HR_ntile && 0 == LR_ntile)
-        return 0;
+    if (mergeStreamParams->midResNum != mergeStream->midResNum)
+    {
+        *pInputLen = 0;
+        return -1;
+    }
 
     mergeStream->bWroteHeader = mergeStreamParams->bWroteHeader;
 
-    mergeStream->highRes.pHeader->pTiledBitstreamBuffer =  mergeStreamParams->highRes.pHeader->pTiledBitstreamBuffer;
-    mergeStream->highRes.pHeader->inputBufferLen =  mergeStreamParams->highRes.pHeader->inputBufferLen;
-    mergeStream->lowRes.pHeader->pTiledBitstreamBuffer =  mergeStreamParams->lowRes.pHeader->pTiledBitstreamBuffer;
-    mergeStream->lowRes.pHeader->inputBufferLen = mergeStreamParams->lowRes.pHeader->inputBufferLen;
-    mergeStream->highRes.bOrdered = mergeStreamParams->highRes.bOrdered;
-    mergeStream->lowRes.bOrdered = mergeStreamParams->lowRes.bOrdered;
-
     // Calculate input length
-    mergeStream->inputBistreamsLen += mergeStream->highRes.pHeader->inputBufferLen;
-    mergeStream->inputBistreamsLen += mergeStream->lowRes.pHeader->inputBufferLen;
+    uint32_t inputLen = 0;
+    for (int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
+    {
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        one_res_param *pParam = merge_get_tier_param(mergeStreamParams, tier);
+        pRes->pHeader->pTiledBitstreamBuffer = pParam->pHeader->pTiledBitstreamBuffer;
+        pRes->pHeader->inputBufferLen = pParam->pHeader->inputBufferLen;
+        pRes->bOrdered = pParam->bOrdered;
+        inputLen += pRes->pHeader->inputBufferLen;
+    }
     int32_t num_tile_columns = mergeStreamParams->highRes.num_tile_columns;
     int32_t num_tile_rows = mergeStreamParams->highRes.num_tile_rows;
     if(mergeStream->highRes.bOrdered && (!num_tile_columns || !num_tile_rows))
+    {
+        *pInputLen = inputLen;
         return -1;
+    }
     if(mergeStream->highRes.bOrdered)
     {
         mergeStream->highRes.num_tile_columns = num_tile_columns;
@@ -501,89 +1015,165 @@ int32_t tile_merge_Process(param_mergeStream *mergeStreamParams, void* handle)
         //printf("inverseIdx = %d, i = %d\n", inverseIdx, i);
         mergeStream->highRes.pTiledBitstreams[i]->pTiledBitstreamBuffer = mergeStreamParams->highRes.pTiledBitstreams[inverseIdx]->pTiledBitstreamBuffer;
         mergeStream->highRes.pTiledBitstreams[i]->inputBufferLen = mergeStreamParams->highRes.pTiledBitstreams[inverseIdx]->inputBufferLen;
-        mergeStream->inputBistreamsLen += mergeStreamParams->highRes.pTiledBitstreams[inverseIdx]->inputBufferLen;
+        inputLen += mergeStreamParams->highRes.pTiledBitstreams[inverseIdx]->inputBufferLen;
         mergeStream->highRes.pTiledBitstreams[i]->currentTileIdx = i;
     }
-    for(int32_t i = 0 ; i < LR_ntile ; i++)
+    // the tiles of the lower tiers are merged in the given order
+    int32_t tileIdx = HR_ntile;
+    for (int32_t tier = 1; tier < merge_tier_num(mergeStream); tier++)
     {
-        mergeStream->lowRes.pTiledBitstreams[i]->pTiledBitstreamBuffer = mergeStreamParams->lowRes.pTiledBitstreams[i]->pTiledBitstreamBuffer;
-        mergeStream->lowRes.pTiledBitstreams[i]->inputBufferLen = mergeStreamParams->lowRes.pTiledBitstreams[i]->inputBufferLen;
-        mergeStream->inputBistreamsLen += mergeStreamParams->lowRes.pTiledBitstreams[i]->inputBufferLen;
-        mergeStream->lowRes.pTiledBitstreams[i]->currentTileIdx = HR_ntile + i;
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        one_res_param *pParam = merge_get_tier_param(mergeStreamParams, tier);
+        for(int32_t i = 0 ; i < pRes->selectedTilesCount ; i++)
+        {
+            pRes->pTiledBitstreams[i]->pTiledBitstreamBuffer = pParam->pTiledBitstreams[i]->pTiledBitstreamBuffer;
+            pRes->pTiledBitstreams[i]->inputBufferLen = pParam->pTiledBitstreams[i]->inputBufferLen;
+            inputLen += pParam->pTiledBitstreams[i]->inputBufferLen;
+            pRes->pTiledBitstreams[i]->currentTileIdx = tileIdx++;
+        }
     }
-
-    mergeStream->pOutputBitstream = mergeStreamParams->pOutputBitstream;
+    *pInputLen = inputLen;
 
     // Get tiles merge solution
-    int32_t err = get_merge_solution(mergeStream);
-    if(err)
-        return err;
-
-    // Merge
-    GTS_BitStream *bs = gts_bs_new((const int8_t *)mergeStream->pOutputBitstream, 2*mergeStream->inputBistreamsLen, GTS_BITSTREAM_WRITE);
-    uint8_t *pOutBitstream = mergeStream->pOutputBitstream;
+    return get_merge_solution_cached(mergeStream);
+}
 
-    HEVCState *HRhevcSlice = (HEVCState*)malloc(sizeof(HEVCState));
-    HEVCState *LRhevcSlice = (HEVCState*)malloc(sizeof(HEVCState));
+// Merge the headers and then all the tiles of one frame, the tiles are parsed
+// with the states of their stream headers
+static int32_t merge_frame(GTS_BitStream *bs, uint8_t *pOutBitstream, hevc_mergeStream *mergeStream, merge_segments *pSegments)
+{
+    int32_t tierNum = merge_tier_num(mergeStream);
     HEVCState *tmpHevcSlice = NULL;
+    int32_t ret = 0;
 
-    if(HR_ntile)
+    for (int32_t tier = 0; tier < tierNum; tier++)
     {
-        merge_header(bs, mergeStream->highRes.pHeader, &pOutBitstream, 1, mergeStream, HRhevcSlice);
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        if(pRes->selectedTilesCount)
+        {
+            ret |= merge_header(bs, pRes->pHeader, &pOutBitstream, tier, mergeStream, pRes->hevcSlice, pSegments, NULL);
+        }
     }
-    if(LR_ntile)
+    if (mergeStream->threadNum > 1 && merge_tile_num(mergeStream) > 1)
     {
-        merge_header(bs, mergeStream->lowRes.pHeader, &pOutBitstream, 0, mergeStream, LRhevcSlice);
+        ret |= merge_tiles_parallel(bs, pOutBitstream, mergeStream, pSegments);
+        return ret ? -1 : 0;
     }
     // Just merge one frame
-    for(int32_t i = 0 ; i < HR_ntile; i++)
-    {
-        tmpHevcSlice = mergeStream->highRes.pTiledBitstreams[i]->hevcSlice;
-        mergeStream->highRes.pTiledBitstreams[i]->hevcSlice = HRhevcSlice;
-        merge_header(bs, mergeStream->highRes.pTiledBitstreams[i], &pOutBitstream, 1, mergeStream,NULL);
-        mergeStream->highRes.pTiledBitstreams[i]->hevcSlice = tmpHevcSlice;
-    }
-    for(int32_t i = 0 ; i < LR_ntile; i++)
+    for (int32_t tier = 0; tier < tierNum; tier++)
     {
-        tmpHevcSlice = mergeStream->lowRes.pTiledBitstreams[i]->hevcSlice;
-        mergeStream->lowRes.pTiledBitstreams[i]->hevcSlice = LRhevcSlice;
-        merge_header(bs, mergeStream->lowRes.pTiledBitstreams[i], &pOutBitstream, 0, mergeStream,NULL);
-        mergeStream->lowRes.pTiledBitstreams[i]->hevcSlice = tmpHevcSlice;
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        for(int32_t i = 0 ; i < pRes->selectedTilesCount; i++)
+        {
+            tmpHevcSlice = pRes->pTiledBitstreams[i]->hevcSlice;
+            pRes->pTiledBitstreams[i]->hevcSlice = pRes->hevcSlice;
+            ret |= merge_header(bs, pRes->pTiledBitstreams[i], &pOutBitstream, tier, mergeStream, NULL, pSegments, NULL);
+            pRes->pTiledBitstreams[i]->hevcSlice = tmpHevcSlice;
+        }
     }
+    return ret ? -1 : 0;
+}
 
-    // Calculate output length
+int32_t tile_merge_Process(param_mergeStream *mergeStreamParams, void* handle)
+{
+    hevc_mergeStream *mergeStream = (hevc_mergeStream *)handle;
+    if (!mergeStream || !mergeStreamParams)
+        return -1;
+    int32_t headerTier = merge_header_tier(mergeStream);
+
+    if(headerTier < 0)
+        return 0;
+
+    uint32_t inputLen = 0;
+    int32_t err = merge_prepare(mergeStreamParams, mergeStream, &inputLen);
+    mergeStream->inputBistreamsLen += inputLen;
+    if(err)
+        return err;
+
+    mergeStream->pOutputBitstream = mergeStreamParams->pOutputBitstream;
+
+    // Merge, the merging fails instead of writing past the output buffer
+    GTS_BitStream *bs = &mergeStream->writer;
+    uint64_t outputSize = mergeStreamParams->outputBitstreamSize ? mergeStreamParams->outputBitstreamSize : 2 * (uint64_t)mergeStream->inputBistreamsLen;
+    if (gts_bs_init(bs, (const int8_t *)mergeStream->pOutputBitstream, outputSize, GTS_BITSTREAM_WRITE) != GTS_OK)
+        return -1;
+    if (merge_frame(bs, mergeStream->pOutputBitstream, mergeStream, NULL))
+        return -1;
+
+    // Calculate output length, the headers are the ones of the lowest tier with tiles
     int32_t outputBufferLen = 0;
-    if(LR_ntile)
-    {
-        outputBufferLen += mergeStream->lowRes.pHeader->outputBufferLen;
-    }
-    else
+    outputBufferLen += merge_get_tier(mergeStream, headerTier)->pHeader->outputBufferLen;
+    for (int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
     {
-        outputBufferLen += mergeStream->highRes.pHeader->outputBufferLen;
-    }
-    for(int32_t i = 0 ; i < HR_ntile ; i++)
-    {
-        outputBufferLen += mergeStream->highRes.pTiledBitstreams[i]->outputBufferLen;
-    }
-    for(int32_t i = 0 ; i < LR_ntile ; i++)
-    {
-        outputBufferLen += mergeStream->lowRes.pTiledBitstreams[i]->outputBufferLen;
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        for(int32_t i = 0 ; i < pRes->selectedTilesCount ; i++)
+        {
+            outputBufferLen += pRes->pTiledBitstreams[i]->outputBufferLen;
+        }
     }
     mergeStream->outputiledbistreamlen = outputBufferLen;
     mergeStreamParams->outputiledbistreamlen = mergeStream->outputiledbistreamlen;
 
-    if (bs) gts_bs_del(bs);
+    return 0;
+}
 
-    if(HRhevcSlice)
-    {
-        free(HRhevcSlice);
-        HRhevcSlice = NULL;
-    }
-    if(LRhevcSlice)
-    {
-        free(LRhevcSlice);
-        LRhevcSlice = NULL;
-    }
+int32_t tile_merge_ProcessSegments(param_mergeStream *mergeStreamParams, void* handle, BitstreamSegment **ppSegments, uint32_t *pSegmentNum)
+{
+    hevc_mergeStream *mergeStream = (hevc_mergeStream *)handle;
+    if (!mergeStream || !mergeStreamParams || !ppSegments || !pSegmentNum)
+        return -1;
+    merge_segments *pSegments = &mergeStream->segments;
+    merge_segments_reset(pSegments);
+    *ppSegments = NULL;
+    *pSegmentNum = 0;
+    mergeStreamParams->outputiledbistreamlen = 0;
+    if(merge_header_tier(mergeStream) < 0)
+        return 0;
+
+    uint32_t inputLen = 0;
+    int32_t err = merge_prepare(mergeStreamParams, mergeStream, &inputLen);
+    if(err)
+        return err;
+
+    if (merge_frame(NULL, NULL, mergeStream, pSegments))
+        return -1;
+    merge_segments_finish(pSegments);
+
+    *ppSegments = pSegments->pSegments;
+    *pSegmentNum = pSegments->segmentNum;
+    mergeStream->outputiledbistreamlen = (uint32_t)pSegments->totalLen;
+    mergeStreamParams->outputiledbistreamlen = mergeStream->outputiledbistreamlen;
+    return 0;
+}
+
+int32_t tile_merge_GetOutputSize(param_mergeStream *mergeStreamParams, void* handle, uint32_t *pOutputSize)
+{
+    if (!pOutputSize)
+        return -1;
+    *pOutputSize = 0;
+
+    // the frame is merged into segments, which copies no tile data, and only their length is kept
+    hevc_mergeStream *mergeStream = (hevc_mergeStream *)handle;
+    if (!mergeStream || !mergeStreamParams)
+        return -1;
+    BitstreamSegment *pSegments = NULL;
+    uint32_t segmentNum = 0;
+    uint32_t outputLen = mergeStreamParams->outputiledbistreamlen;
+    int32_t err = tile_merge_ProcessSegments(mergeStreamParams, handle, &pSegments, &segmentNum);
+    *pOutputSize = mergeStreamParams->outputiledbistreamlen;
+    mergeStreamParams->outputiledbistreamlen = outputLen;
+    mergeStream->outputiledbistreamlen = outputLen;
+    return err;
+}
+
+int32_t tile_merge_SetThreads(void* handle, int32_t threadNum)
+{
+    hevc_mergeStream *mergeStream = (hevc_mergeStream *)handle;
+    if (!mergeStream || threadNum <= 0)
+        return -1;
+    if (merge_workers_init(mergeStream, threadNum))
+        return -1;
+    mergeStream->threadNum = threadNum;
     return 0;
 }
 
@@ -592,25 +1182,21 @@ int32_t tile_merge_reset(void* handle)
     hevc_mergeStream *mergeStream = (hevc_mergeStream *)handle;
     if (!mergeStream)
         return -1;
-    int32_t HR_ntile = mergeStream->highRes.selectedTilesCount;
-    int32_t LR_ntile = mergeStream->lowRes.selectedTilesCount;
 
-    if (0 == HR_ntile && 0 == LR_ntile)
+    if (merge_header_tier(mergeStream) < 0)
         return -1;
 
     mergeStream->bWroteHeader = 0;
 
     mergeStream->inputBistreamsLen = 0;
-    mergeStream->highRes.pHeader->outputBufferLen = 0;
-    mergeStream->lowRes.pHeader->outputBufferLen = 0;
-
-    for (int32_t i = 0; i < HR_ntile; i++)
+    for (int32_t tier = 0; tier < merge_tier_num(mergeStream); tier++)
     {
-        mergeStream->highRes.pTiledBitstreams[i]->outputBufferLen = 0;
-    }
-    for (int32_t i = 0; i < LR_ntile; i++)
-    {
-        mergeStream->lowRes.pTiledBitstreams[i]->outputBufferLen = 0;
+        one_res *pRes = merge_get_tier(mergeStream, tier);
+        pRes->pHeader->outputBufferLen = 0;
+        for (int32_t i = 0; i < pRes->selectedTilesCount; i++)
+        {
+            pRes->pTiledBitstreams[i]->outputBufferLen = 0;
+        }
     }
     return 0;
 }
@@ -27,6 +27,7 @@
 #define _360SCVP_HEVC_TILEMERGE_H_
 
 #include "360SCVPHevcTilestream.h"
+#include "360SCVPHevcEncHdr.h"
 
 typedef struct ONE_RES
 {
@@ -41,12 +42,62 @@ typedef struct ONE_RES
     int32_t                num_tile_columns;
     int32_t                num_tile_rows;
     bool                   bOrdered;
+    HEVCSliceHeaderTemplate sliceHeaderTemplate;
+    HEVCState             *hevcSlice;    //the states got with the stream headers, kept over frames
 }one_res;
 
+//the number of merge layouts kept, the least recently used one is replaced
+#define MERGE_LAYOUT_CACHE_SIZE 4
+//the layouts of up to this number of tiers are kept, the count, the size and the order of the tiles of one tier
+#define MERGE_LAYOUT_TIER_NUM   6
+#define MERGE_LAYOUT_PARAM_NUM  6
+
+//the merge solution of one tile layout and the parameter sets written for it
+typedef struct MERGE_LAYOUT
+{
+    uint64_t       key;              //fingerprint of what the merge solution is got from
+    uint64_t       lastUsed;         //0 if the entry is empty
+    int32_t        tierNum;
+    int32_t        layoutParams[MERGE_LAYOUT_TIER_NUM][MERGE_LAYOUT_PARAM_NUM];
+    int32_t        pic_width;
+    int32_t        pic_height;
+    uint32_t       num_tile_columns;
+    uint32_t       num_tile_rows;
+    uint32_t       column_width[22];
+    uint32_t       row_height[20];
+    int32_t       *slice_segment_address;
+    uint64_t       paramSetsKey;
+    uint32_t       paramSetsSize;    //0 if no parameter sets are written for this layout yet
+    uint8_t        paramSets[HEVC_WRITTEN_PARAM_SETS_SIZE];
+    uint32_t       parsedParamSetsSize;
+    uint8_t        parsedParamSets[HEVC_WRITTEN_PARAM_SETS_SIZE];   //the parameter sets they are written from
+}merge_layout;
+
+struct HEVC_MERGEBITSTREAM;
+struct MERGE_WORKERS;
+
+//the tiles [start, end) of one frame merged by one thread, the tiles are counted in the order
+//of the tiers, each thread parses with its own states and writes into its own segments
+typedef struct MERGE_TASK
+{
+    struct HEVC_MERGEBITSTREAM *mergeStream;
+    int32_t                 start;
+    int32_t                 end;
+    HEVCState             **pHevcSlices;       //one state for each tier, kept over frames
+    int64_t                *pParamSetCounts;   //the parse count of the tier state each state has the parameter sets of, -1 if none
+    HEVCSliceHeaderTemplate *pSliceHeaderTemplates;
+    merge_segments          segments;
+    bool                    bCountOutput;  //add the merged bytes to outputBufferLen of the tiles
+    uint8_t                *pOutput;       //where the segments are copied to when they are joined
+    int32_t                 ret;
+}merge_task;
+
 typedef struct HEVC_MERGEBITSTREAM
 {
     one_res        highRes;
     one_res        lowRes;
+    one_res       *pMidRes;      //the tiers between highRes and lowRes, from high to low
+    int32_t        midResNum;
     uint32_t       inputBistreamsLen;
     uint8_t       *pOutputBitstream;
     uint32_t       outputiledbistreamlen;
@@ -55,6 +106,20 @@ typedef struct HEVC_MERGEBITSTREAM
     int32_t        pic_height;
     int32_t       *slice_segment_address;
     bool           bWroteHeader;
+    //the writer is kept over frames so that merging doesn't allocate
+    GTS_BitStream  writer;
+    //the merged frame when it's given as segments
+    merge_segments segments;
+    //the merge layouts of the last tile layouts, pLayout is the one of the current frame
+    merge_layout   layouts[MERGE_LAYOUT_CACHE_SIZE];
+    merge_layout  *pLayout;
+    uint64_t       layoutUseCount;
+    //the tiles are merged by threadNum threads, 1 by default
+    int32_t        threadNum;
+    merge_task    *pTasks;
+    int32_t        taskNum;
+    //the threads merging with the calling one, kept from tile_merge_SetThreads until the handle is closed
+    struct MERGE_WORKERS *pWorkers;
 }hevc_mergeStream;
 
 //modify resolution and tile segmentation
@@ -62,8 +127,15 @@ int32_t modify_parameter_sets(HEVCState *hevc, hevc_mergeStream *mergeStream);
 int32_t init_one_bitstream(oneStream_info **pBs);
 int32_t destory_one_bitstream(oneStream_info **pBs);
 int32_t modify_slice_header(HEVCState *hevc, hevc_mergeStream *mergeStream, uint32_t tile_index);
-int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitstream, bool isHR, hevc_mergeStream *mergeStream, HEVCState *orgHevc);
-// Put all LR tiles at the right of HR tiles
+// Add the headers and the slice data to pSegments instead of writing them when it's not NULL,
+// the slice headers are spliced from pTemplate, or from the template of the stream if it's NULL
+// the slice belongs to the tier of index tier, see merge_get_tier
+int32_t merge_header(GTS_BitStream *bs, oneStream_info* pSlice, uint8_t **pBitstream, int32_t tier, hevc_mergeStream *mergeStream, HEVCState *orgHevc, merge_segments *pSegments, HEVCSliceHeaderTemplate *pTemplate);
+// Get the tier of index tier in the merge order: highRes, the middle tiers and then lowRes
+one_res *merge_get_tier(hevc_mergeStream *mergeStream, int32_t tier);
+// Put the tiles of each lower tier at the right of the tiles of the tier before
 int32_t get_merge_solution(hevc_mergeStream *mergeStream);
+// Get the merge solution from the layout cache, it is got by get_merge_solution and kept when not found
+int32_t get_merge_solution_cached(hevc_mergeStream *mergeStream);
 
 #endif //_360SCVP_HEVC_TILEMERGE_H_
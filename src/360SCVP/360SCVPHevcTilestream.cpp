@@ -39,13 +39,12 @@ int32_t hevc_import_ffextradata(hevc_specialInfo* pSpecialInfo, HEVCState* hevc,
     if(!extradata || !hevc || !pSize)
         return GTS_BAD_PARAM;
     int32_t bfinished = 0;
-    GTS_BitStream *bs;
-    int8_t *buffer = NULL;
-    uint32_t buffer_size = 0;
+    //the nal units are parsed in place, so no memory is allocated
+    GTS_BitStream bs_storage;
+    GTS_BitStream *bs = &bs_storage;
     if (!extradata || (extradata_size < sizeof(uint32_t)))
         return GTS_BAD_PARAM;
-    bs = gts_bs_new((const int8_t *)extradata, extradata_size, GTS_BITSTREAM_READ);
-    if (!bs)
+    if (gts_bs_init(bs, (const int8_t *)extradata, extradata_size, GTS_BITSTREAM_READ) != GTS_OK)
         return GTS_BAD_PARAM;
 
     uint32_t nal_size;
@@ -64,26 +63,19 @@ int32_t hevc_import_ffextradata(hevc_specialInfo* pSpecialInfo, HEVCState* hevc,
             startcodeSize = 3;
         }
         if (start_code != 0x00000001) {
-            gts_bs_del(bs);
-            if (buffer) gts_free(buffer);
             //if (vpss && spss && ppss) return GTS_OK;
             return GTS_BAD_PARAM;
         }
         nal_start = gts_bs_get_position(bs);
         nal_size = gts_media_nalu_next_start_code_bs(bs);
         if (nal_start + nal_size > extradata_size) {
-            gts_bs_del(bs);
             return GTS_BAD_PARAM;
         }
-        if (nal_size > buffer_size) {
-            buffer = (int8_t*)gts_realloc(buffer, nal_size);
-            buffer_size = nal_size;
-        }
-        gts_bs_read_data(bs, buffer, nal_size);
+        gts_bs_seek(bs, nal_start + nal_size);
 
         //uint64_t start_position = bs->position - nal_size + 2;
         //printf("<nalu bs at:%d, %d \n",start_position,nal_size);
-        if (buffer) gts_media_hevc_parse_nalu(pSpecialInfo, buffer, nal_size, hevc);
+        gts_media_hevc_parse_nalu(pSpecialInfo, (int8_t *)extradata + nal_start, nal_size, hevc);
 
         nal_unit_type = pSpecialInfo->naluType;
         int32_t slicehdr_size = pSpecialInfo->sliceHeaderLen;
@@ -92,8 +84,6 @@ int32_t hevc_import_ffextradata(hevc_specialInfo* pSpecialInfo, HEVCState* hevc,
             bfinished++;
 
         if (pSpecialInfo->layer_id) {
-            gts_bs_del(bs);
-            gts_free(buffer);
             return GTS_BAD_PARAM;
         }
 
@@ -171,9 +161,6 @@ int32_t hevc_import_ffextradata(hevc_specialInfo* pSpecialInfo, HEVCState* hevc,
 
     }
 
-    gts_bs_del(bs);
-    if (buffer) gts_free(buffer);
-
     return idx;
 }
 
@@ -380,6 +367,122 @@ int32_t parse_tiles_info(hevc_gen_tiledstream* pGenTilesStream)
     return specialLen;
 }
 
+void merge_segments_reset(merge_segments *pSegments)
+{
+    if (!pSegments)
+        return;
+    pSegments->segmentNum = 0;
+    pSegments->arenaUsed = 0;
+    pSegments->totalLen = 0;
+    if (gts_bs_init(&pSegments->writer, pSegments->pArena, pSegments->arenaSize, GTS_BITSTREAM_WRITE) != GTS_OK)
+        memset(&pSegments->writer, 0, sizeof(GTS_BitStream));
+}
+
+int32_t merge_segments_reserve(merge_segments *pSegments, uint32_t size)
+{
+    if (!pSegments)
+        return GTS_BAD_PARAM;
+    uint64_t position = pSegments->writer.position;
+    if (position + size <= pSegments->arenaSize)
+        return 0;
+
+    uint64_t arenaSize = pSegments->arenaSize ? pSegments->arenaSize : MERGE_SEGMENTS_ARENA_MARGIN;
+    while (arenaSize < position + size)
+        arenaSize *= 2;
+    if (arenaSize > 0xFFFFFFFF)
+        return GTS_OUT_OF_MEM;
+    int8_t *pArena = (int8_t *)realloc(pSegments->pArena, (size_t)arenaSize);
+    if (!pArena)
+        return GTS_OUT_OF_MEM;
+    pSegments->pArena = pArena;
+    pSegments->arenaSize = (uint32_t)arenaSize;
+
+    // the headers end on a byte boundary, so only the position is kept
+    gts_bs_init(&pSegments->writer, pArena, arenaSize, GTS_BITSTREAM_WRITE);
+    pSegments->writer.position = position;
+    return 0;
+}
+
+static int32_t merge_segments_push(merge_segments *pSegments, uint8_t *pData, uint32_t dataLen)
+{
+    if (pSegments->segmentNum == pSegments->segmentMaxNum)
+    {
+        uint32_t segmentMaxNum = pSegments->segmentMaxNum ? 2 * pSegments->segmentMaxNum : 64;
+        BitstreamSegment *pNew = (BitstreamSegment *)realloc(pSegments->pSegments, segmentMaxNum * sizeof(BitstreamSegment));
+        if (!pNew)
+            return GTS_OUT_OF_MEM;
+        pSegments->pSegments = pNew;
+        pSegments->segmentMaxNum = segmentMaxNum;
+    }
+    pSegments->pSegments[pSegments->segmentNum].pData = pData;
+    pSegments->pSegments[pSegments->segmentNum].dataLen = dataLen;
+    pSegments->segmentNum++;
+    pSegments->totalLen += dataLen;
+    return 0;
+}
+
+int32_t merge_segments_add(merge_segments *pSegments, uint8_t *pData, uint32_t dataLen)
+{
+    if (!pSegments)
+        return GTS_BAD_PARAM;
+
+    // the arena segments are pointed at when finished, the arena may still move
+    uint32_t written = (uint32_t)(pSegments->writer.position - pSegments->arenaUsed);
+    if (written)
+    {
+        BitstreamSegment *pLast = pSegments->segmentNum ? &pSegments->pSegments[pSegments->segmentNum - 1] : NULL;
+        if (pLast && !pLast->pData)
+        {
+            pLast->dataLen += written;
+            pSegments->totalLen += written;
+        }
+        else if (merge_segments_push(pSegments, NULL, written))
+            return GTS_OUT_OF_MEM;
+        pSegments->arenaUsed = pSegments->writer.position;
+    }
+    if (pData && dataLen)
+        return merge_segments_push(pSegments, pData, dataLen);
+    return 0;
+}
+
+void merge_segments_finish(merge_segments *pSegments)
+{
+    if (!pSegments)
+        return;
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < pSegments->segmentNum; i++)
+    {
+        BitstreamSegment *pSegment = &pSegments->pSegments[i];
+        if (pSegment->pData)
+            continue;
+        pSegment->pData = (uint8_t *)pSegments->pArena + offset;
+        offset += pSegment->dataLen;
+    }
+}
+
+int32_t merge_segments_append(merge_segments *pSegments, const merge_segments *pOther)
+{
+    if (!pSegments || !pOther)
+        return GTS_BAD_PARAM;
+    for (uint32_t i = 0; i < pOther->segmentNum; i++)
+    {
+        if (merge_segments_push(pSegments, pOther->pSegments[i].pData, (uint32_t)pOther->pSegments[i].dataLen))
+            return GTS_OUT_OF_MEM;
+    }
+    return 0;
+}
+
+void merge_segments_free(merge_segments *pSegments)
+{
+    if (!pSegments)
+        return;
+    if (pSegments->pSegments)
+        free(pSegments->pSegments);
+    if (pSegments->pArena)
+        free(pSegments->pArena);
+    memset(pSegments, 0, sizeof(merge_segments));
+}
+
 int32_t set_genHandle_params(oneStream_info* cur, param_oneStream_info* in)
 {
     if (!cur || !in)
@@ -94,6 +94,34 @@ typedef struct HEVC_GEN_TILEDSTREAM
     HEVC_PPS         pps;
 }hevc_gen_tiledstream;
 
+//the merged stream given as segments, the rewritten headers are written into
+//the arena and the slice data segments point into the input streams
+typedef struct MERGE_SEGMENTS
+{
+    BitstreamSegment     *pSegments;
+    uint32_t              segmentNum;
+    uint32_t              segmentMaxNum;
+    int8_t               *pArena;
+    uint32_t              arenaSize;
+    uint64_t              arenaUsed; //the arena bytes already in the segments
+    uint64_t              totalLen;
+    GTS_BitStream         writer;    //writes into the arena
+}merge_segments;
+
+//the arena room kept for the headers rewritten from the input ones, the SEIs are added to them
+#define MERGE_SEGMENTS_ARENA_MARGIN 8192
+
+void    merge_segments_reset(merge_segments *pSegments);
+//make room for size bytes more in the arena, the writer stays at its position
+int32_t merge_segments_reserve(merge_segments *pSegments, uint32_t size);
+//add what was written in the arena since the last call, then the data if it's not NULL
+int32_t merge_segments_add(merge_segments *pSegments, uint8_t *pData, uint32_t dataLen);
+//point the header segments into the arena, it can't move any more until the next reset
+void    merge_segments_finish(merge_segments *pSegments);
+//add the segments of pOther after the finished segments, pOther must be finished too
+int32_t merge_segments_append(merge_segments *pSegments, const merge_segments *pOther);
+void    merge_segments_free(merge_segments *pSegments);
+
 int32_t set_genHandle_params(oneStream_info* cur, param_oneStream_info* in);
 int32_t parse_tiles_info(hevc_gen_tiledstream* pGenTilesStream);
 int32_t hevc_import_ffextradata(hevc_specialInfo* pSpecialInfo, HEVCState* hevc, uint32_t *pSize, int32_t *spsCnt, int32_t bParse);
@@ -27,6 +27,7 @@
 #include "stdlib.h"
 #include "string.h"
 #include "assert.h"
+#include "math.h"
 #include "360SCVPTiledstreamAPI.h"
 #include "360SCVPViewportAPI.h"
 #include "360SCVPMergeStreamAPI.h"
@@ -34,6 +35,7 @@
 #include "360SCVPHevcEncHdr.h"
 #include "360SCVPImpl.h"
 #include "360SCVPHevcTileMerge.h"
+#include "360SCVPHevcNalScan.h"
 
 
 TstitchStream::TstitchStream()
@@ -49,6 +51,13 @@ TstitchStream::TstitchStream()
         memset(m_hevcState, 0, sizeof(HEVCState));
         m_hevcState->sps_active_idx = -1;
     }
+    m_paramSetCache[0] = gts_media_hevc_param_set_cache_new();
+    m_paramSetCache[1] = gts_media_hevc_param_set_cache_new();
+    if (m_hevcState)
+        m_hevcState->param_set_cache = m_paramSetCache[0];
+    memset(&m_sliceHdrTemplate, 0, sizeof(HEVCSliceHeaderTemplate));
+    memset(&m_segments, 0, sizeof(merge_segments));
+    m_headerNalPos = -1;
     memset(&m_pViewportParam, 0, sizeof(generateViewPortParam));
     memset(&m_mergeStreamParam, 0, sizeof(param_mergeStream));
     memset(&m_streamStitch, 0, sizeof(param_gen_tiledStream));
@@ -73,6 +82,29 @@ TstitchStream::TstitchStream()
     m_tileHeightCountSel[0] = 0;
     m_specialInfo[0] = new unsigned char[200];
     m_specialInfo[1] = new unsigned char[200];
+    m_pParsedInput[0] = NULL;
+    m_pParsedInput[1] = NULL;
+    //the streams of the mid tiers are allocated when they are merged
+    for (int32_t i = 2; i < STREAM_NUM_MAX; i++)
+    {
+        m_pNalInfo[i] = NULL;
+        m_paramSetCache[i] = NULL;
+        m_specialInfo[i] = NULL;
+        m_specialDataLen[i] = 0;
+        m_pParsedInput[i] = NULL;
+        m_tileWidthCountSel[i] = 0;
+        m_tileHeightCountSel[i] = 0;
+        m_tileWidthCountOri[i] = 0;
+        m_tileHeightCountOri[i] = 0;
+    }
+    m_midTierNum = 0;
+    for (int32_t i = 0; i < MAX_MID_TIER_NUM; i++)
+    {
+        m_pMidTierTiles[i] = NULL;
+        m_midTilesInCol[i] = 1;
+        m_midTilesInRow[i] = 1;
+    }
+    memset(m_midResParam, 0, sizeof(m_midResParam));
     m_sliceHeaderLen = 0;
     m_dstWidthNet = 0;
     m_dstHeightNet = 0;
@@ -94,6 +126,8 @@ TstitchStream::TstitchStream()
     m_xTopLeftNet = 0;
     m_yTopLeftNet = 0;
     m_dstRwpk = RegionWisePacking();
+    m_mappingThreads = 1;
+    m_mergeThreads = 1;
 }
 
 TstitchStream::TstitchStream(TstitchStream& other)
@@ -113,6 +147,17 @@ TstitchStream::TstitchStream(TstitchStream& other)
     {
         memcpy(m_hevcState, other.m_hevcState, sizeof(HEVCState));
     }
+    for (int32_t i = 0; i < 2; i++)
+    {
+        m_paramSetCache[i] = gts_media_hevc_param_set_cache_new();
+        if (m_paramSetCache[i] && other.m_paramSetCache[i])
+            memcpy(m_paramSetCache[i], other.m_paramSetCache[i], sizeof(HEVCParamSetCache));
+    }
+    if (m_hevcState)
+        m_hevcState->param_set_cache = m_paramSetCache[0];
+    memcpy(&m_sliceHdrTemplate, &(other.m_sliceHdrTemplate), sizeof(HEVCSliceHeaderTemplate));
+    memset(&m_segments, 0, sizeof(merge_segments));
+    m_headerNalPos = -1;
 
     memcpy(&m_pViewportParam, &(other.m_pViewportParam), sizeof(generateViewPortParam));
     memcpy(&m_mergeStreamParam, &(other.m_mergeStreamParam), sizeof(param_mergeStream));
@@ -147,6 +192,52 @@ TstitchStream::TstitchStream(TstitchStream& other)
     memcpy(m_specialInfo[0], other.m_specialInfo[0], 200 * sizeof(unsigned char));
     m_specialInfo[1] = new unsigned char[200];
     memcpy(m_specialInfo[1], other.m_specialInfo[1], 200 * sizeof(unsigned char));
+    m_pParsedInput[0] = other.m_pParsedInput[0];
+    m_pParsedInput[1] = other.m_pParsedInput[1];
+    for (int32_t i = 2; i < STREAM_NUM_MAX; i++)
+    {
+        m_pNalInfo[i] = NULL;
+        m_paramSetCache[i] = NULL;
+        m_specialInfo[i] = NULL;
+        if (other.m_pNalInfo[i])
+        {
+            m_pNalInfo[i] = new nal_info[1000];
+            memcpy(m_pNalInfo[i], other.m_pNalInfo[i], 1000 * sizeof(nal_info));
+        }
+        if (other.m_paramSetCache[i])
+        {
+            m_paramSetCache[i] = gts_media_hevc_param_set_cache_new();
+            if (m_paramSetCache[i])
+                memcpy(m_paramSetCache[i], other.m_paramSetCache[i], sizeof(HEVCParamSetCache));
+        }
+        if (other.m_specialInfo[i])
+        {
+            m_specialInfo[i] = new unsigned char[200];
+            memcpy(m_specialInfo[i], other.m_specialInfo[i], 200 * sizeof(unsigned char));
+        }
+        m_specialDataLen[i] = other.m_specialDataLen[i];
+        m_pParsedInput[i] = other.m_pParsedInput[i];
+        m_tileWidthCountSel[i] = other.m_tileWidthCountSel[i];
+        m_tileHeightCountSel[i] = other.m_tileHeightCountSel[i];
+        m_tileWidthCountOri[i] = other.m_tileWidthCountOri[i];
+        m_tileHeightCountOri[i] = other.m_tileHeightCountOri[i];
+    }
+    m_midTierNum = other.m_midTierNum;
+    for (int32_t i = 0; i < MAX_MID_TIER_NUM; i++)
+    {
+        m_pMidTierTiles[i] = NULL;
+        if (other.m_pMidTierTiles[i])
+        {
+            int32_t tileNum = m_tileWidthCountSel[i + 2] * m_tileHeightCountSel[i + 2];
+            m_pMidTierTiles[i] = new int32_t[tileNum];
+            memcpy(m_pMidTierTiles[i], other.m_pMidTierTiles[i], tileNum * sizeof(int32_t));
+        }
+        m_midTilesInCol[i] = other.m_midTilesInCol[i];
+        m_midTilesInRow[i] = other.m_midTilesInRow[i];
+    }
+    memcpy(m_midResParam, other.m_midResParam, sizeof(m_midResParam));
+    if (m_mergeStreamParam.pMidRes)
+        m_mergeStreamParam.pMidRes = m_midResParam;
     m_sliceHeaderLen = other.m_sliceHeaderLen;
     m_dstWidthNet = other.m_dstWidthNet;
     m_dstHeightNet = other.m_dstHeightNet;
@@ -168,6 +259,8 @@ TstitchStream::TstitchStream(TstitchStream& other)
     m_yTopLeftNet = other.m_yTopLeftNet;
     m_dstRwpk = RegionWisePacking();
     m_dstRwpk = other.m_dstRwpk;
+    m_mappingThreads = other.m_mappingThreads;
+    m_mergeThreads = other.m_mergeThreads;
 }
 
 TstitchStream::~TstitchStream()
@@ -184,25 +277,32 @@ TstitchStream::~TstitchStream()
         delete []m_pDownRight;
         m_pDownRight = nullptr;
     }
-    if (m_pNalInfo[0]) {
-        delete []m_pNalInfo[0];
-        m_pNalInfo[0] = nullptr;
-    }
-    if (m_pNalInfo[1]) {
-        delete []m_pNalInfo[1];
-        m_pNalInfo[1] = nullptr;
+    for (int32_t i = 0; i < STREAM_NUM_MAX; i++) {
+        if (m_pNalInfo[i]) {
+            delete []m_pNalInfo[i];
+            m_pNalInfo[i] = nullptr;
+        }
     }
     if (m_hevcState) {
         delete m_hevcState;
         m_hevcState = nullptr;
     }
-    if (m_specialInfo[0]) {
-        delete []m_specialInfo[0];
-        m_specialInfo[0] = nullptr;
+    for (int32_t i = 0; i < STREAM_NUM_MAX; i++) {
+        gts_media_hevc_param_set_cache_del(m_paramSetCache[i]);
+        m_paramSetCache[i] = nullptr;
     }
-    if (m_specialInfo[1]) {
-        delete []m_specialInfo[1];
-        m_specialInfo[1] = nullptr;
+    merge_segments_free(&m_segments);
+    for (int32_t i = 0; i < STREAM_NUM_MAX; i++) {
+        if (m_specialInfo[i]) {
+            delete []m_specialInfo[i];
+            m_specialInfo[i] = nullptr;
+        }
+    }
+    for (int32_t i = 0; i < MAX_MID_TIER_NUM; i++) {
+        if (m_pMidTierTiles[i]) {
+            delete []m_pMidTierTiles[i];
+            m_pMidTierTiles[i] = nullptr;
+        }
     }
 }
 
@@ -210,6 +310,11 @@ int32_t TstitchStream::initViewport(Param_ViewPortInfo* pViewPortInfo, int32_t t
 {
     if (pViewPortInfo == NULL)
         return -1;
+    if (pViewPortInfo->mappingMode != E_VIEWPORT_MAPPING_FULL && pViewPortInfo->mappingMode != E_VIEWPORT_MAPPING_BOUNDARY)
+        return -1;
+    if (pViewPortInfo->precision != E_VIEWPORT_PRECISION_DOUBLE && pViewPortInfo->precision != E_VIEWPORT_PRECISION_FAST
+        && pViewPortInfo->precision != E_VIEWPORT_PRECISION_VALIDATE)
+        return -1;
     m_pViewportParam.m_pDownRight = m_pDownRight;
     m_pViewportParam.m_pUpLeft = m_pUpLeft;
     m_pViewportParam.m_iInputHeight = pViewPortInfo->faceHeight;
@@ -224,7 +329,10 @@ int32_t TstitchStream::initViewport(Param_ViewPortInfo* pViewPortInfo, int32_t t
     m_pViewportParam.m_viewPort_fYaw = pViewPortInfo->viewPortYaw;
     m_pViewportParam.m_viewPort_hFOV = pViewPortInfo->viewPortFOVH;
     m_pViewportParam.m_viewPort_vFOV = pViewPortInfo->viewPortFOVV;
+    m_pViewportParam.m_mappingMode = pViewPortInfo->mappingMode;
+    m_pViewportParam.m_precision = pViewPortInfo->precision;
     m_pViewport = genViewport_Init(&m_pViewportParam);
+    genViewport_setMappingThreads(m_pViewport, m_mappingThreads);
     return 0;
 }
 
@@ -275,6 +383,13 @@ int32_t TstitchStream::initMerge(param_360SCVP* pParamStitchStream, int32_t slic
     int HR_ntile = m_tileHeightCountSel[0] * m_tileWidthCountSel[0];// m_mergeStreamParam.highRes.selectedTilesCount;
     int LR_ntile = m_mergeStreamParam.lowRes.selectedTilesCount;
 
+    //each merged tile is one region of the rwpk SEI, which counts them on 8 bits
+    int32_t regionNum = HR_ntile + LR_ntile;
+    for (int32_t k = 0; k < m_midTierNum; k++)
+        regionNum += m_tileWidthCountSel[k + 2] * m_tileHeightCountSel[k + 2];
+    if (regionNum > 255)
+        return -1;
+
     m_mergeStreamParam.highRes.pHeader = (param_oneStream_info *)malloc(sizeof(param_oneStream_info));
     m_mergeStreamParam.lowRes.pHeader = (param_oneStream_info *)malloc(sizeof(param_oneStream_info));
     m_mergeStreamParam.highRes.pTiledBitstreams = (param_oneStream_info **)malloc(HR_ntile * sizeof(param_oneStream_info *));
@@ -308,7 +423,48 @@ int32_t TstitchStream::initMerge(param_360SCVP* pParamStitchStream, int32_t slic
             return -1;
     }
 
+    // the mid tiers are merged from the windows around the viewport, the count is set first
+    // so that the tiers allocated so far are freed when one fails
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        m_midResParam[k].pHeader = NULL;
+        m_midResParam[k].pTiledBitstreams = NULL;
+    }
+    m_mergeStreamParam.pMidRes = m_midTierNum ? m_midResParam : NULL;
+    m_mergeStreamParam.midResNum = m_midTierNum;
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        int32_t streamIdx = k + 2;
+        one_res_param *pMidRes = &m_midResParam[k];
+        pMidRes->width = pParamStitchStream->pMidTiers[k].frameWidth;
+        pMidRes->height = pParamStitchStream->pMidTiers[k].frameHeight;
+        pMidRes->num_tile_columns = m_tileWidthCountSel[streamIdx];
+        pMidRes->num_tile_rows = m_tileHeightCountSel[streamIdx];
+        pMidRes->totalTilesCount = m_tileWidthCountOri[streamIdx] * m_tileHeightCountOri[streamIdx];
+        pMidRes->selectedTilesCount = m_tileWidthCountSel[streamIdx] * m_tileHeightCountSel[streamIdx];
+        pMidRes->tile_width = pMidRes->width / m_tileWidthCountOri[streamIdx];
+        pMidRes->tile_height = pMidRes->height / m_tileHeightCountOri[streamIdx];
+        pMidRes->bOrdered = 0;
+        pMidRes->pHeader = (param_oneStream_info *)malloc(sizeof(param_oneStream_info));
+        pMidRes->pTiledBitstreams = (param_oneStream_info **)malloc(pMidRes->selectedTilesCount * sizeof(param_oneStream_info *));
+        bool bAllocated = pMidRes->pHeader && pMidRes->pTiledBitstreams;
+        if (pMidRes->pTiledBitstreams)
+            memset(pMidRes->pTiledBitstreams, 0, pMidRes->selectedTilesCount * sizeof(param_oneStream_info *));
+        for (int32_t i = 0; bAllocated && i < pMidRes->selectedTilesCount; i++)
+        {
+            pMidRes->pTiledBitstreams[i] = (param_oneStream_info *)malloc(sizeof(param_oneStream_info));
+            bAllocated = (pMidRes->pTiledBitstreams[i] != NULL);
+        }
+        if (!bAllocated)
+        {
+            freeMidTierParams();
+            return -1;
+        }
+    }
+
     m_pMergeStream = tile_merge_Init(&m_mergeStreamParam);
+    if (m_pMergeStream)
+        tile_merge_SetThreads(m_pMergeStream, m_mergeThreads);
     return 0;
 }
 
@@ -317,8 +473,8 @@ int32_t TstitchStream::init(param_360SCVP* pParamStitchStream)
     if (pParamStitchStream == NULL)
         return -1;
     int32_t ret = 0;
-    m_specialDataLen[0] = 0;
-    m_specialDataLen[1] = 0;
+    for (int32_t i = 0; i < STREAM_NUM_MAX; i++)
+        m_specialDataLen[i] = 0;
     m_usedType = pParamStitchStream->usedType;
     m_dstRwpk.rectRegionPacking = NULL;
     if (m_usedType == E_PARSER_FOR_CLIENT)
@@ -338,6 +494,13 @@ int32_t TstitchStream::init(param_360SCVP* pParamStitchStream)
         m_pSteamStitch = genTiledStream_Init(&m_streamStitch);
         if (!m_pSteamStitch)
             return -1;
+        //the tiles of the stitched streams share the parameter set cache
+        hevc_gen_tiledstream* pGenTilesStream = (hevc_gen_tiledstream*)m_pSteamStitch;
+        for (int32_t i = 0; pGenTilesStream->pTiledBitstreams && i < m_streamStitch.tilesHeightCount * m_streamStitch.tilesWidthCount; i++)
+        {
+            if (pGenTilesStream->pTiledBitstreams[i] && pGenTilesStream->pTiledBitstreams[i]->hevcSlice)
+                pGenTilesStream->pTiledBitstreams[i]->hevcSlice->param_set_cache = m_paramSetCache[0];
+        }
         return ret;
     }
     if (parseNals(pParamStitchStream, pParamStitchStream->usedType, NULL, 0) < 0)
@@ -345,12 +508,22 @@ int32_t TstitchStream::init(param_360SCVP* pParamStitchStream)
 
     if (pParamStitchStream->usedType == E_MERGE_AND_VIEWPORT)
     {
+        if (initMidTiers(pParamStitchStream) < 0 || parseMidTiers(pParamStitchStream) < 0)
+            return -1;
+        for (int32_t k = 0; k < m_midTierNum; k++)
+        {
+            //the window of a mid tier is inside its frame
+            if (m_tileWidthCountSel[k + 2] > m_tileWidthCountOri[k + 2] || m_tileHeightCountSel[k + 2] > m_tileHeightCountOri[k + 2])
+                return -1;
+        }
         parseNals(pParamStitchStream, E_MERGE_AND_VIEWPORT, NULL, 1);
         int32_t tilecolCount = m_tileWidthCountOri[0];
         int32_t tilerowCount = m_tileHeightCountOri[0];
 
         // Init the viewport library
         ret = initViewport(&pParamStitchStream->paramViewPort, tilecolCount, tilerowCount);
+        if (ret)
+            return ret;
 
         int32_t sliceHeight = pParamStitchStream->paramViewPort.faceHeight / tilerowCount;
         int32_t sliceWidth = pParamStitchStream->paramViewPort.faceWidth / tilecolCount;
@@ -402,6 +575,7 @@ int32_t TstitchStream::uninit()
                 m_mergeStreamParam.lowRes.pTiledBitstreams[i] = NULL;
             }
         }
+        freeMidTierParams();
         ret = tile_merge_Close(m_pMergeStream);
     }
     if(m_pViewport)
@@ -417,22 +591,34 @@ int32_t TstitchStream::uninit()
     if (m_pDownRight)
         delete[]m_pDownRight;
     m_pDownRight = NULL;
-    if(m_pNalInfo[0])
-        delete[]m_pNalInfo[0];
-    m_pNalInfo[0] = NULL;
-    if(m_pNalInfo[1])
-        delete[]m_pNalInfo[1];
-    m_pNalInfo[1] = NULL;
+    for (int32_t i = 0; i < STREAM_NUM_MAX; i++)
+    {
+        if(m_pNalInfo[i])
+            delete[]m_pNalInfo[i];
+        m_pNalInfo[i] = NULL;
+    }
 
     if (m_hevcState)
         delete m_hevcState;
     m_hevcState = NULL;
-    if (m_specialInfo[0])
-         delete[]m_specialInfo[0];
-     m_specialInfo[0] = NULL;
-    if (m_specialInfo[1])
-         delete[]m_specialInfo[1];
-    m_specialInfo[1] = NULL;
+    for (int32_t i = 0; i < STREAM_NUM_MAX; i++)
+    {
+        gts_media_hevc_param_set_cache_del(m_paramSetCache[i]);
+        m_paramSetCache[i] = NULL;
+    }
+    merge_segments_free(&m_segments);
+    for (int32_t i = 0; i < STREAM_NUM_MAX; i++)
+    {
+        if (m_specialInfo[i])
+             delete[]m_specialInfo[i];
+        m_specialInfo[i] = NULL;
+    }
+    for (int32_t i = 0; i < MAX_MID_TIER_NUM; i++)
+    {
+        if (m_pMidTierTiles[i])
+            delete[]m_pMidTierTiles[i];
+        m_pMidTierTiles[i] = NULL;
+    }
 
     if (m_dstRwpk.rectRegionPacking)
         delete[]m_dstRwpk.rectRegionPacking;
@@ -464,14 +650,21 @@ int32_t TstitchStream::parseNals(param_360SCVP* pParamStitchStream, int32_t pars
             TiledBitstream.pTiledBitstreamBuffer = pParamStitchStream->pInputBitstream;
             TiledBitstream.inputBufferLen = pParamStitchStream->inputBitstreamLen;
         }
-        else
+        else if (streamIdx == 1)
         {
             TiledBitstream.pTiledBitstreamBuffer = pParamStitchStream->pInputLowBitstream;
             TiledBitstream.inputBufferLen = pParamStitchStream->inputLowBistreamLen;
         }
+        else
+        {
+            if (streamIdx - 2 >= pParamStitchStream->midTierNum || !pParamStitchStream->pMidTiers || !m_pNalInfo[streamIdx])
+                return -1;
+            TiledBitstream.pTiledBitstreamBuffer = pParamStitchStream->pMidTiers[streamIdx - 2].pInputBitstream;
+            TiledBitstream.inputBufferLen = pParamStitchStream->pMidTiers[streamIdx - 2].inputBitstreamLen;
+        }
         if (m_specialDataLen[streamIdx] > 0)
         {
-            memmove(TiledBitstream.pTiledBitstreamBuffer + m_specialDataLen[streamIdx], TiledBitstream.pTiledBitstreamBuffer, pParamStitchStream->inputBitstreamLen);
+            memmove(TiledBitstream.pTiledBitstreamBuffer + m_specialDataLen[streamIdx], TiledBitstream.pTiledBitstreamBuffer, TiledBitstream.inputBufferLen);
             memcpy(TiledBitstream.pTiledBitstreamBuffer, m_specialInfo[streamIdx], m_specialDataLen[streamIdx]);
             TiledBitstream.inputBufferLen += m_specialDataLen[streamIdx];
         }
@@ -484,6 +677,8 @@ int32_t TstitchStream::parseNals(param_360SCVP* pParamStitchStream, int32_t pars
 
     *GenStreamParam.pTiledBitstream = &TiledBitstream;
     GenStreamParam.pNalInfo = m_pNalInfo[streamIdx];
+    if (pParamStitchStream)
+        m_pParsedInput[streamIdx] = TiledBitstream.pTiledBitstreamBuffer;
 
     int32_t ret = -1;
     pGenStream = genTiledStream_Init(&GenStreamParam);
@@ -497,6 +692,7 @@ int32_t TstitchStream::parseNals(param_360SCVP* pParamStitchStream, int32_t pars
             return -1;
         }
         oneStream_info * pSlice = pGenTilesStream->pTiledBitstreams[0];
+        pSlice->hevcSlice->param_set_cache = m_paramSetCache[streamIdx];
         if (((pGenTilesStream->parseType == E_PARSER_ONENAL)) && m_bSPSReady && m_bPPSReady)
         {
             memcpy(pSlice->hevcSlice->sps, m_hevcState->sps,  6 * sizeof(HEVC_SPS));
@@ -545,27 +741,109 @@ int32_t TstitchStream::parseNals(param_360SCVP* pParamStitchStream, int32_t pars
     return ret;
  }
 
+int32_t TstitchStream::parseAccessUnit(uint8_t* pBitstream, int32_t bitstreamLen, Nalu* pNalus, int32_t maxNaluNum)
+{
+    if (!pBitstream || bitstreamLen <= 0 || maxNaluNum < 0 || !m_hevcState)
+        return -1;
+
+    // the parameter sets are parsed into the state used by parseNals, the slice state of the merging is kept
+    HEVCSliceInfo sliceInfo;
+    hevc_specialInfo specialInfo;
+    memcpy(&sliceInfo, &m_hevcState->s_info, sizeof(HEVCSliceInfo));
+
+    uint32_t size = (uint32_t)bitstreamLen;
+    uint32_t startCode = nalScanFindStartCode(pBitstream, size);
+    int32_t naluNum = 0;
+    int32_t ret = 0;
+    while (startCode < size)
+    {
+        // the zero byte before the start code is counted in the start codes, the others in the previous nal unit
+        uint32_t naluStart = (startCode > 0 && !pBitstream[startCode - 1]) ? startCode - 1 : startCode;
+        uint32_t payloadStart = startCode + 3;
+        uint32_t naluEnd = size;
+        startCode = size;
+        if (payloadStart < size)
+        {
+            startCode = payloadStart + nalScanFindStartCode(pBitstream + payloadStart, size - payloadStart);
+            if (startCode < size)
+                naluEnd = pBitstream[startCode - 1] ? startCode : startCode - 1;
+        }
+        if (naluEnd < payloadStart + 2)
+        {
+            ret = -1;
+            break;
+        }
+
+        if (pNalus && naluNum < maxNaluNum)
+        {
+            Nalu* pNalu = &pNalus[naluNum];
+            memset(&specialInfo, 0, sizeof(hevc_specialInfo));
+            gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)pBitstream + payloadStart, naluEnd - payloadStart, m_hevcState);
+            pNalu->data = pBitstream + naluStart;
+            pNalu->dataSize = naluEnd - naluStart;
+            pNalu->startCodesSize = payloadStart - naluStart;
+            pNalu->naluType = specialInfo.naluType;
+            pNalu->seiPayloadType = specialInfo.seiPayloadType;
+            pNalu->sliceHeaderLen = specialInfo.sliceHeaderLen;
+            if (specialInfo.naluType == GTS_HEVC_NALU_SEQ_PARAM)
+                m_bSPSReady = 1;
+            if (specialInfo.naluType == GTS_HEVC_NALU_PIC_PARAM)
+                m_bPPSReady = 1;
+        }
+        naluNum++;
+    }
+
+    memcpy(&m_hevcState->s_info, &sliceInfo, sizeof(HEVCSliceInfo));
+    return ret ? ret : naluNum;
+}
+
 int32_t TstitchStream::feedParamToGenStream(param_360SCVP* pParamStitchStream)
 {
     if (pParamStitchStream == NULL)
         return -1;
+    uint8_t *pInputs[STREAM_NUM_MAX] = { pParamStitchStream->pInputBitstream, pParamStitchStream->pInputLowBitstream };
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        if (k >= pParamStitchStream->midTierNum || !pParamStitchStream->pMidTiers)
+            return -1;
+        pInputs[k + 2] = pParamStitchStream->pMidTiers[k].pInputBitstream;
+    }
+    return feedTilesToGenStream(pInputs, this);
+}
+
+int32_t TstitchStream::feedSharedToGenStream(const TstitchStream* pShared)
+{
+    if (pShared == NULL || pShared->m_midTierNum != m_midTierNum)
+        return -1;
+    for (int32_t i = 0; i < m_midTierNum + 2; i++)
+    {
+        if (!pShared->m_pParsedInput[i])
+            return -1;
+    }
+    return feedTilesToGenStream((uint8_t**)pShared->m_pParsedInput, pShared);
+}
+
+int32_t TstitchStream::feedTilesToGenStream(uint8_t** ppInputs, const TstitchStream* pSource)
+{
+    //the tiles selected by this handle are taken from the nal units parsed by pSource
+    nal_info *const *pNalInfo = pSource->m_pNalInfo;
+    const int32_t *specialDataLen = pSource->m_specialDataLen;
     param_oneStream_info **pTmpHigh = m_mergeStreamParam.highRes.pTiledBitstreams;
     param_oneStream_info **pTmpLow = m_mergeStreamParam.lowRes.pTiledBitstreams;
     //demux the whole frame to get each selected tile data and its length
     int32_t idx = 0;
     TileDef *pTmpTile = m_pOutTile;
     param_oneStream_info *pTmpHighHdr = m_mergeStreamParam.highRes.pHeader;
-    pTmpHighHdr->pTiledBitstreamBuffer = pParamStitchStream->pInputBitstream;
-    pTmpHighHdr->inputBufferLen = m_specialDataLen[0];
+    pTmpHighHdr->pTiledBitstreamBuffer = ppInputs[0];
+    pTmpHighHdr->inputBufferLen = specialDataLen[0];
 
     param_oneStream_info *pTmpLowHdr = m_mergeStreamParam.lowRes.pHeader;
-    pTmpLowHdr->pTiledBitstreamBuffer = pParamStitchStream->pInputLowBitstream;
-    pTmpLowHdr->inputBufferLen = m_specialDataLen[1];
-    printf("the tiled idx=");
+    pTmpLowHdr->pTiledBitstreamBuffer = ppInputs[1];
+    pTmpLowHdr->inputBufferLen = specialDataLen[1];
 
     tile_merge_reset(m_pMergeStream);
 
-    if (m_specialDataLen[0] == 0)
+    if (specialDataLen[0] == 0)
     {
         m_mergeStreamParam.bWroteHeader = 0;
     }
@@ -577,9 +855,8 @@ int32_t TstitchStream::feedParamToGenStream(param_360SCVP* pParamStitchStream)
             pTmpHigh[idx]->tilesHeightCount = 1;
             pTmpHigh[idx]->tilesWidthCount = 1;
 
-            pTmpHigh[idx]->inputBufferLen = (pTmpTile->idx!=0) ? m_pNalInfo[0][pTmpTile->idx].nalLen : m_pNalInfo[0][pTmpTile->idx].nalLen- m_specialDataLen[0];
-            pTmpHigh[idx]->pTiledBitstreamBuffer = (pTmpTile->idx != 0) ? m_pNalInfo[0][pTmpTile->idx].pNalStream : m_pNalInfo[0][pTmpTile->idx].pNalStream + m_specialDataLen[0];
-            printf(" %d ", pTmpTile->idx);
+            pTmpHigh[idx]->inputBufferLen = (pTmpTile->idx!=0) ? pNalInfo[0][pTmpTile->idx].nalLen : pNalInfo[0][pTmpTile->idx].nalLen- specialDataLen[0];
+            pTmpHigh[idx]->pTiledBitstreamBuffer = (pTmpTile->idx != 0) ? pNalInfo[0][pTmpTile->idx].pNalStream : pNalInfo[0][pTmpTile->idx].pNalStream + specialDataLen[0];
             pTmpTile++;
             idx++;
         }
@@ -593,13 +870,175 @@ int32_t TstitchStream::feedParamToGenStream(param_360SCVP* pParamStitchStream)
             pTmpLow[idx]->tilesHeightCount = 1;
             pTmpLow[idx]->tilesWidthCount = 1;
 
-            pTmpLow[idx]->inputBufferLen = (idx != 0) ? m_pNalInfo[1][idx].nalLen : m_pNalInfo[1][idx].nalLen - m_specialDataLen[1];
-            pTmpLow[idx]->pTiledBitstreamBuffer = (idx != 0) ? m_pNalInfo[1][idx].pNalStream : m_pNalInfo[1][idx].pNalStream + m_specialDataLen[1];
-            printf(" %d ", idx);
+            pTmpLow[idx]->inputBufferLen = (idx != 0) ? pNalInfo[1][idx].nalLen : pNalInfo[1][idx].nalLen - specialDataLen[1];
+            pTmpLow[idx]->pTiledBitstreamBuffer = (idx != 0) ? pNalInfo[1][idx].pNalStream : pNalInfo[1][idx].pNalStream + specialDataLen[1];
             idx++;
         }
     }
-    printf("\n");
+
+    //the tiles of the window of each mid tier
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        int32_t streamIdx = k + 2;
+        one_res_param *pMidRes = &m_midResParam[k];
+        pMidRes->pHeader->pTiledBitstreamBuffer = ppInputs[streamIdx];
+        pMidRes->pHeader->inputBufferLen = specialDataLen[streamIdx];
+        for (idx = 0; idx < pMidRes->selectedTilesCount; idx++)
+        {
+            int32_t tileIdx = m_pMidTierTiles[k][idx];
+            pMidRes->pTiledBitstreams[idx]->tilesHeightCount = 1;
+            pMidRes->pTiledBitstreams[idx]->tilesWidthCount = 1;
+
+            pMidRes->pTiledBitstreams[idx]->inputBufferLen = (tileIdx != 0) ? pNalInfo[streamIdx][tileIdx].nalLen : pNalInfo[streamIdx][tileIdx].nalLen - specialDataLen[streamIdx];
+            pMidRes->pTiledBitstreams[idx]->pTiledBitstreamBuffer = (tileIdx != 0) ? pNalInfo[streamIdx][tileIdx].pNalStream : pNalInfo[streamIdx][tileIdx].pNalStream + specialDataLen[streamIdx];
+        }
+    }
+    return 0;
+}
+
+int32_t TstitchStream::initSharedFrame(param_360SCVP* pParamStitchStream)
+{
+    if (pParamStitchStream == NULL || pParamStitchStream->usedType != E_MERGE_AND_VIEWPORT)
+        return -1;
+    m_usedType = pParamStitchStream->usedType;
+    m_specialDataLen[0] = 0;
+    m_specialDataLen[1] = 0;
+    if (initMidTiers(pParamStitchStream) < 0)
+        return -1;
+    return parseSharedFrame(pParamStitchStream);
+}
+
+int32_t TstitchStream::parseSharedFrame(param_360SCVP* pParamStitchStream)
+{
+    if (pParamStitchStream == NULL)
+        return -1;
+    //the same parsing as the process of one handle, but done once for all the handles
+    if (parseNals(pParamStitchStream, E_MERGE_AND_VIEWPORT, NULL, 0) < 0)
+        return -1;
+    if (parseMidTiers(pParamStitchStream) < 0)
+        return -1;
+    if (parseNals(pParamStitchStream, E_MERGE_AND_VIEWPORT, NULL, 1) < 0)
+        return -1;
+    return 0;
+}
+
+int32_t TstitchStream::initMidTiers(param_360SCVP* pParamStitchStream)
+{
+    int32_t midTierNum = pParamStitchStream->midTierNum;
+    if (midTierNum < 0 || midTierNum > MAX_MID_TIER_NUM || (midTierNum && !pParamStitchStream->pMidTiers))
+        return -1;
+    //the windows of the mid tiers are got on the equirectangular frame
+    if (midTierNum && pParamStitchStream->paramViewPort.geoTypeInput != E_SVIDEO_EQUIRECT)
+        return -1;
+    for (int32_t k = 0; k < midTierNum; k++)
+    {
+        int32_t streamIdx = k + 2;
+        param_midTier *pTier = &pParamStitchStream->pMidTiers[k];
+        if (!pTier->pInputBitstream || pTier->tileWidthNumSel <= 0 || pTier->tileHeightNumSel <= 0)
+            return -1;
+        if (!m_pNalInfo[streamIdx])
+            m_pNalInfo[streamIdx] = new nal_info[1000];
+        if (!m_paramSetCache[streamIdx])
+            m_paramSetCache[streamIdx] = gts_media_hevc_param_set_cache_new();
+        if (!m_specialInfo[streamIdx])
+            m_specialInfo[streamIdx] = new unsigned char[200];
+        m_specialDataLen[streamIdx] = 0;
+        m_tileWidthCountSel[streamIdx] = pTier->tileWidthNumSel;
+        m_tileHeightCountSel[streamIdx] = pTier->tileHeightNumSel;
+        if (m_pMidTierTiles[k])
+            delete[]m_pMidTierTiles[k];
+        m_pMidTierTiles[k] = new int32_t[pTier->tileWidthNumSel * pTier->tileHeightNumSel];
+    }
+    m_midTierNum = midTierNum;
+    return 0;
+}
+
+void TstitchStream::freeMidTierParams()
+{
+    for (int32_t k = 0; k < m_mergeStreamParam.midResNum; k++)
+    {
+        one_res_param *pMidRes = &m_mergeStreamParam.pMidRes[k];
+        if (pMidRes->pHeader)
+        {
+            free(pMidRes->pHeader);
+            pMidRes->pHeader = NULL;
+        }
+        for (int32_t i = 0; pMidRes->pTiledBitstreams && i < pMidRes->selectedTilesCount; i++)
+        {
+            free(pMidRes->pTiledBitstreams[i]);
+        }
+        if (pMidRes->pTiledBitstreams)
+        {
+            free(pMidRes->pTiledBitstreams);
+            pMidRes->pTiledBitstreams = NULL;
+        }
+    }
+    m_mergeStreamParam.pMidRes = NULL;
+    m_mergeStreamParam.midResNum = 0;
+}
+
+int32_t TstitchStream::parseMidTiers(param_360SCVP* pParamStitchStream)
+{
+    if (pParamStitchStream == NULL)
+        return -1;
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        if (parseNals(pParamStitchStream, E_MERGE_AND_VIEWPORT, NULL, k + 2) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+int32_t TstitchStream::selectMidTierTiles()
+{
+    int32_t highTilesNum = m_tileWidthCountSel[0] * m_tileHeightCountSel[0];
+    if (!m_midTierNum || highTilesNum <= 0 || !m_tileWidthCountOri[0] || !m_tileHeightCountOri[0])
+        return 0;
+
+    //the center of the selected high resolution tiles, averaged on the circle as the frame wraps horizontally
+    const double pi = 3.14159265358979323846;
+    double frameWidth = m_pViewportParam.m_iInputWidth;
+    double frameHeight = m_pViewportParam.m_iInputHeight;
+    double tileWidth = frameWidth / m_tileWidthCountOri[0];
+    double tileHeight = frameHeight / m_tileHeightCountOri[0];
+    double sumCos = 0;
+    double sumSin = 0;
+    double sumY = 0;
+    for (int32_t i = 0; i < highTilesNum; i++)
+    {
+        double angle = 2 * pi * (m_pOutTile[i].x + tileWidth / 2) / frameWidth;
+        sumCos += cos(angle);
+        sumSin += sin(angle);
+        sumY += m_pOutTile[i].y + tileHeight / 2;
+    }
+    double centerX = atan2(sumSin, sumCos) / (2 * pi);
+    centerX = centerX < 0 ? centerX + 1 : centerX;
+    double centerY = sumY / highTilesNum / frameHeight;
+
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        int32_t streamIdx = k + 2;
+        int32_t cols = m_tileWidthCountOri[streamIdx];
+        int32_t rows = m_tileHeightCountOri[streamIdx];
+        int32_t selCols = m_tileWidthCountSel[streamIdx];
+        int32_t selRows = m_tileHeightCountSel[streamIdx];
+        if (!m_pMidTierTiles[k] || selCols > cols || selRows > rows)
+            return -1;
+        int32_t left = (int32_t)floor(centerX * cols - selCols / 2.0 + 0.5);
+        int32_t top = (int32_t)floor(centerY * rows - selRows / 2.0 + 0.5);
+        top = top < 0 ? 0 : (top > rows - selRows ? rows - selRows : top);
+
+        //the tiles are given column by column, as they are put in the merged frame
+        int32_t idx = 0;
+        for (int32_t c = 0; c < selCols; c++)
+        {
+            int32_t col = ((left + c) % cols + cols) % cols;
+            for (int32_t r = 0; r < selRows; r++)
+            {
+                m_pMidTierTiles[k][idx++] = (top + r) * cols + col;
+            }
+        }
+    }
     return 0;
 }
 
@@ -634,6 +1073,8 @@ int32_t TstitchStream::getViewPortTiles()
         m_yTopLeftNet = m_pViewportParam.m_pUpLeft->y;
 
     }
+    if (selectMidTierTiles() < 0)
+        return -1;
     return ret;
 }
 
@@ -641,18 +1082,43 @@ TileDef* TstitchStream::getSelectedTile()
 {
     return m_pOutTile;
 }
+int32_t TstitchStream::getTilesForPoses(ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks)
+{
+    if (!m_pViewport)
+        return -1;
+    return genViewport_getTilesForPoses(m_pViewport, pPoses, poseNum, pTileMasks);
+}
+
+int32_t TstitchStream::getTileCoverage(float* pCoverage)
+{
+    if (!m_pViewport)
+        return -1;
+    return genViewport_getTileCoverage(m_pViewport, pCoverage);
+}
+
 int32_t TstitchStream::setViewPort(float yaw, float pitch)
 {
     return genViewport_setViewPort(m_pViewport, yaw, pitch);
 }
 
 
-int32_t TstitchStream::doMerge(param_360SCVP* pParamStitchStream)
+int32_t TstitchStream::doMerge(param_360SCVP* pParamStitchStream, BitstreamSegment** ppSegments, int32_t* pSegmentNum)
 {
     int32_t ret = 0;
     if (pParamStitchStream == NULL)
         return -1;
-    ret = tile_merge_Process(&m_mergeStreamParam, m_pMergeStream);
+    if (ppSegments)
+    {
+        uint32_t segmentNum = 0;
+        if (!pSegmentNum)
+            return -1;
+        ret = tile_merge_ProcessSegments(&m_mergeStreamParam, m_pMergeStream, ppSegments, &segmentNum);
+        *pSegmentNum = (int32_t)segmentNum;
+    }
+    else
+    {
+        ret = tile_merge_Process(&m_mergeStreamParam, m_pMergeStream);
+    }
     if (ret < 0)
         return -1;
     hevc_mergeStream *mergeStream = (hevc_mergeStream *)m_pMergeStream;
@@ -660,9 +1126,16 @@ int32_t TstitchStream::doMerge(param_360SCVP* pParamStitchStream)
     m_hrTilesInRow = mergeStream->highRes.selectedTilesCount / m_hrTilesInCol;
     m_lrTilesInCol = mergeStream->pic_height / mergeStream->lowRes.tile_height;
     m_lrTilesInRow = mergeStream->lowRes.selectedTilesCount / m_lrTilesInCol;
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        m_midTilesInCol[k] = mergeStream->pic_height / mergeStream->pMidRes[k].tile_height;
+        m_midTilesInRow[k] = mergeStream->pMidRes[k].selectedTilesCount / m_midTilesInCol[k];
+    }
 
     pParamStitchStream->outputSEILen = 0;
     m_dstRwpk.numRegions = m_tileWidthCountSel[0] * m_tileHeightCountSel[0] + m_tileWidthCountSel[1] * m_tileHeightCountSel[1];
+    for (int32_t k = 0; k < m_midTierNum; k++)
+        m_dstRwpk.numRegions += m_tileWidthCountSel[k + 2] * m_tileHeightCountSel[k + 2];
 
     if (!m_dstRwpk.rectRegionPacking)
     {
@@ -675,7 +1148,8 @@ int32_t TstitchStream::doMerge(param_360SCVP* pParamStitchStream)
         ret = EncRWPKSEI(&m_dstRwpk, pParamStitchStream->pOutputSEI, &pParamStitchStream->outputSEILen);
 
     pParamStitchStream->outputBitstreamLen = m_mergeStreamParam.outputiledbistreamlen;
-    memcpy(pParamStitchStream->pOutputBitstream, m_mergeStreamParam.pOutputBitstream, m_mergeStreamParam.outputiledbistreamlen);
+    if (!ppSegments)
+        memcpy(pParamStitchStream->pOutputBitstream, m_mergeStreamParam.pOutputBitstream, m_mergeStreamParam.outputiledbistreamlen);
 
     return ret;
 }
@@ -744,10 +1218,22 @@ int TstitchStream::GenerateRwpkInfo(RegionWisePacking *dstRwpk)
     int lowRes_tile_height = m_mergeStreamParam.lowRes.height / m_tileHeightCountOri[1];
     dstRwpk->constituentPicMatching = 0;
 
-    dstRwpk->packedPicWidth = highRes_tile_width * m_tileWidthCountSel[0] + lowRes_tile_width * m_tileHeightCountSel[1];
+    // the mid tiers are packed between the high and the low resolution tiles
+    int midTilesNum = 0;
+    int midTilesWidth = 0;
+    for (int32_t k = 0; k < m_midTierNum; k++)
+    {
+        midTilesNum += m_midResParam[k].selectedTilesCount;
+        midTilesWidth += m_midResParam[k].tile_width * m_midTilesInRow[k];
+    }
+
+    dstRwpk->packedPicWidth = highRes_tile_width * m_tileWidthCountSel[0] + midTilesWidth + lowRes_tile_width * m_tileHeightCountSel[1];
     dstRwpk->packedPicHeight = highRes_tile_height * m_tileHeightCountSel[0];
 
     uint8_t highTilesNum = m_tileWidthCountSel[0] * m_tileHeightCountSel[0];
+    int midTier = 0;
+    int midTierStart = highTilesNum;
+    int midTierLeft = highRes_tile_width * m_hrTilesInRow;
 
     for (uint8_t regionIdx = 0; regionIdx < dstRwpk->numRegions; regionIdx++)
     {
@@ -777,9 +1263,40 @@ int TstitchStream::GenerateRwpkInfo(RegionWisePacking *dstRwpk)
             rwpk->gbType3 = 0;
             pSelectTiles++;
         }
+        else if (regionIdx < highTilesNum + midTilesNum)
+        {
+            while (regionIdx - midTierStart >= m_midResParam[midTier].selectedTilesCount)
+            {
+                midTierStart += m_midResParam[midTier].selectedTilesCount;
+                midTierLeft += m_midResParam[midTier].tile_width * m_midTilesInRow[midTier];
+                midTier++;
+            }
+            int midIdx = regionIdx - midTierStart;
+            int tileIdx = m_pMidTierTiles[midTier][midIdx];
+            int tileColumns = m_tileWidthCountOri[midTier + 2];
+            rwpk->projRegWidth = m_midResParam[midTier].tile_width;
+            rwpk->projRegHeight = m_midResParam[midTier].tile_height;
+            rwpk->projRegTop = (tileIdx / tileColumns) * rwpk->projRegHeight;
+            rwpk->projRegLeft = (tileIdx % tileColumns) * rwpk->projRegWidth;
+
+            rwpk->packedRegWidth = rwpk->projRegWidth;
+            rwpk->packedRegHeight = rwpk->projRegHeight;
+            rwpk->packedRegTop = (midIdx % m_midTilesInCol[midTier]) * rwpk->projRegHeight;
+            rwpk->packedRegLeft = (midIdx / m_midTilesInCol[midTier]) * rwpk->projRegWidth + midTierLeft;
+
+            rwpk->leftGbWidth = 0;
+            rwpk->rightGbWidth = 0;
+            rwpk->topGbHeight = 0;
+            rwpk->bottomGbHeight = 0;
+            rwpk->gbNotUsedForPredFlag = true;
+            rwpk->gbType0 = 0;
+            rwpk->gbType1 = 0;
+            rwpk->gbType2 = 0;
+            rwpk->gbType3 = 0;
+        }
         else
         {
-            int lowIdx = regionIdx - highTilesNum;
+            int lowIdx = regionIdx - highTilesNum - midTilesNum;
             rwpk->projRegWidth = lowRes_tile_width;
             rwpk->projRegHeight = lowRes_tile_height;
             rwpk->projRegTop = (lowIdx / m_tileWidthCountOri[1]) * lowRes_tile_height;
@@ -788,7 +1305,7 @@ int TstitchStream::GenerateRwpkInfo(RegionWisePacking *dstRwpk)
             rwpk->packedRegWidth = rwpk->projRegWidth;
             rwpk->packedRegHeight = rwpk->projRegHeight;
             rwpk->packedRegTop = (lowIdx % m_lrTilesInCol) * lowRes_tile_height;
-            rwpk->packedRegLeft = (lowIdx / m_lrTilesInCol) * lowRes_tile_width + highRes_tile_width * m_hrTilesInRow;
+            rwpk->packedRegLeft = (lowIdx / m_lrTilesInCol) * lowRes_tile_width + highRes_tile_width * m_hrTilesInRow + midTilesWidth;
 
             rwpk->leftGbWidth = 0;
             rwpk->rightGbWidth = 0;
@@ -817,12 +1334,14 @@ int32_t TstitchStream::getFixedNumTiles(TileDef* pOutTile)
     return ret;
 }
 
-int32_t  TstitchStream::doStreamStitch(param_360SCVP* pParamStitchStream)
+int32_t  TstitchStream::doStreamStitch(param_360SCVP* pParamStitchStream, BitstreamSegment** ppSegments, int32_t* pSegmentNum)
 {
     int32_t ret = 0;
     int32_t outputlen = 0;
     if (pParamStitchStream == NULL)
         return -1;
+    if (ppSegments && !pSegmentNum)
+        return -1;
 
     m_streamStitch.inputBistreamsLen = pParamStitchStream->inputBitstreamLen;
     m_streamStitch.outputiledbistreamlen = pParamStitchStream->outputBitstreamLen;
@@ -847,7 +1366,12 @@ int32_t  TstitchStream::doStreamStitch(param_360SCVP* pParamStitchStream)
 
     pGenTilesStream->pOutputTiledBitstream = pParamStitchStream->pOutputBitstream;
 
-    ret = merge_partstream_into1bitstream(pParamStitchStream->inputBitstreamLen);
+    ret = merge_partstream_into1bitstream(pParamStitchStream->inputBitstreamLen, ppSegments ? &m_segments : NULL);
+    if (ppSegments)
+    {
+        *ppSegments = m_segments.pSegments;
+        *pSegmentNum = (int32_t)m_segments.segmentNum;
+    }
 
   //  int32_t tiled_idx = 0;
     input_count = 0;
@@ -874,10 +1398,10 @@ int32_t  TstitchStream::doStreamStitch(param_360SCVP* pParamStitchStream)
     return ret;
 }
 
-int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile)
+int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile, merge_segments *pSegments)
 {
     hevc_gen_tiledstream* pGenTilesStream = (hevc_gen_tiledstream*)m_pSteamStitch;
-    if (!pGenTilesStream || !pBitstream || !pSlice || !bs)
+    if (!pGenTilesStream || !pBitstream || !pSlice || (!bs && !pSegments))
         return GTS_BAD_PARAM;
 
     uint32_t nalsize[20];
@@ -888,7 +1412,7 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
     int32_t lenSlice = pSlice->inputBufferLen - pSlice->curBufferLen;
 
     uint8_t *pBitstreamCur = *pBitstream;
-    if (!pBitstreamCur)
+    if (!pBitstreamCur && !pSegments)
         return GTS_BAD_PARAM;
 
     HEVCState *hevc = pSlice->hevcSlice;
@@ -906,9 +1430,36 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
         = hevc->pps[hevc->last_parsed_pps_id].org_tiles_enabled_flag;
 
     memset(nalsize, 0, sizeof(nalsize));
-    uint64_t bs_position = bs->position;
     int32_t spsCnt;
     parse_hevc_specialinfo(&specialInfo, hevc, nalsize, &specialLen, &spsCnt, 0);
+    if (pSegments)
+    {
+        //the headers are rewritten into the arena
+        if (merge_segments_reserve(pSegments, 2 * specialLen + nalsize[SLICE_HEADER] + MERGE_SEGMENTS_ARENA_MARGIN))
+            return GTS_OUT_OF_MEM;
+        bs = &pSegments->writer;
+    }
+    uint64_t bs_position = bs->position;
+
+    //the written parameter sets only depend on the parsed ones and on the output layout
+    uint64_t paramSetsKey = 0;
+    uint32_t paramSetsLen = specialLen;
+    uint8_t stitchLayout[HEVC_WRITTEN_LAYOUT_SIZE];
+    uint32_t stitchLayoutSize = 0;
+    if (nalsize[SEQ_PARAM_SET] && pSlice->address == 0)
+    {
+        uint32_t layout[5] = { pGenTilesStream->frameWidth, pGenTilesStream->frameHeight,
+            (uint32_t)pGenTilesStream->outTilesWidthCount, (uint32_t)pGenTilesStream->outTilesHeightCount,
+            (uint32_t)pGenTilesStream->tilesUniformSpacing };
+        memcpy(stitchLayout, layout, sizeof(layout));
+        stitchLayoutSize = sizeof(layout);
+        memcpy(stitchLayout + stitchLayoutSize, pGenTilesStream->columnWidth, sizeof(pGenTilesStream->columnWidth));
+        stitchLayoutSize += sizeof(pGenTilesStream->columnWidth);
+        memcpy(stitchLayout + stitchLayoutSize, pGenTilesStream->rowHeight, sizeof(pGenTilesStream->rowHeight));
+        stitchLayoutSize += sizeof(pGenTilesStream->rowHeight);
+        paramSetsKey = gts_media_hevc_fingerprint(pBufferSliceCur, paramSetsLen, 0);
+        paramSetsKey = gts_media_hevc_fingerprint(stitchLayout, stitchLayoutSize, paramSetsKey);
+    }
 
     specialLen += nalsize[SLICE_HEADER];
     framesize = specialLen + nalsize[SLICE_DATA];
@@ -930,9 +1481,11 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
         //merge vps, sps, pps and SEI if at first tile
         if (pSlice->address == 0)
         {
+            if (pSegments)
+                m_headerNalPos = (int64_t)bs->position;
             pGenTilesStream->headerNal = (uint8_t*)bs->original + bs->position;
             pGenTilesStream->headerNalSize = (uint8_t)(bs->position);
-            hevc_write_parameter_sets(bs, hevc);
+            hevc_write_parameter_sets_cached(bs, hevc, paramSetsKey, pBufferSliceCur, paramSetsLen, stitchLayout, stitchLayoutSize);
             //add the sei information, rwpk, projectoin, sphere rotation, and framepacking
             if (m_seiRWPK_enable)
             {
@@ -968,7 +1521,16 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
 
     // modify the tiled slice header , and merge slice data
     gts_media_hevc_stitch_slice_segment(hevc, pSlice, pGenTilesStream->frameWidth, (uint32_t)pSlice->currentTileIdx);
-    hevc_write_slice_header(bs, hevc);
+    hevc_write_slice_header_spliced(bs, hevc, &m_sliceHdrTemplate);
+
+    if (pSegments)
+    {
+        //the slice data stays in the input
+        if (merge_segments_add(pSegments, pBufferSliceCur + specialLen, nalsize[SLICE_DATA]))
+            return GTS_OUT_OF_MEM;
+        pSlice->currentTileIdx++;
+        return framesize;
+    }
 
     //move to current address
     pBitstreamCur += bs->position - bs_position;
@@ -986,7 +1548,7 @@ int32_t TstitchStream::merge_one_tile(uint8_t **pBitstream, oneStream_info* pSli
     return framesize;
 }
 
-int32_t TstitchStream::merge_partstream_into1bitstream(int32_t totalInputLen)
+int32_t TstitchStream::merge_partstream_into1bitstream(int32_t totalInputLen, merge_segments *pSegments)
 {
     hevc_gen_tiledstream* pGenTilesStream = (hevc_gen_tiledstream*)m_pSteamStitch;
     if (!pGenTilesStream)
@@ -997,16 +1559,26 @@ int32_t TstitchStream::merge_partstream_into1bitstream(int32_t totalInputLen)
     int32_t outputBSLen = 2 * totalInputLen;
 
     uint8_t* pBitstreamCur = pGenTilesStream->pOutputTiledBitstream;
-    if (!pBitstreamCur)
+    if (!pBitstreamCur && !pSegments)
         return GTS_BAD_PARAM;
 
     // define nxm tiles here, uniform type is default setting
     int32_t tilesWidthCount = pGenTilesStream->tilesWidthCount;
     int32_t tilesHeightCount = pGenTilesStream->tilesHeightCount;
 
-    GTS_BitStream *bs = gts_bs_new((const int8_t *)pBitstreamCur, outputBSLen, GTS_BITSTREAM_WRITE);
-    if (!bs)
-        return GTS_OUT_OF_MEM;
+    GTS_BitStream *bs = NULL;
+    if (pSegments)
+    {
+        // the frame is given as segments, nothing is written to the output buffer
+        merge_segments_reset(pSegments);
+        m_headerNalPos = -1;
+    }
+    else
+    {
+        bs = gts_bs_new((const int8_t *)pBitstreamCur, outputBSLen, GTS_BITSTREAM_WRITE);
+        if (!bs)
+            return GTS_OUT_OF_MEM;
+    }
 
     parse_tiles_info(pGenTilesStream);
 
@@ -1032,13 +1604,23 @@ int32_t TstitchStream::merge_partstream_into1bitstream(int32_t totalInputLen)
 
             uint64_t bspos = 0;
             if (bs) bspos = bs->position;
+            if (pSegments) bspos = pSegments->totalLen;
             bool bFirstTile = (bool)((i == 0 && j == 0) == 1 ? 1 : 0);
-            int32_t curframesize = merge_one_tile(&pBitstreamCur, pSliceCur, bs, bFirstTile);
+            int32_t curframesize = merge_one_tile(&pBitstreamCur, pSliceCur, bs, bFirstTile, pSegments);
             pSliceCur->curBufferLen += curframesize;
-            pSliceCur->outputBufferLen += (uint32_t)(bs->position - bspos);
+            if (pSegments)
+                pSliceCur->outputBufferLen += (uint32_t)(pSegments->totalLen - bspos);
+            else
+                pSliceCur->outputBufferLen += (uint32_t)(bs->position - bspos);
         }
     }
 
+    if (pSegments)
+    {
+        merge_segments_finish(pSegments);
+        if (m_headerNalPos >= 0)
+            pGenTilesStream->headerNal = (uint8_t*)pSegments->pArena + m_headerNalPos;
+    }
     if (bs) gts_bs_del(bs);
     return 0;
 }
@@ -1094,6 +1676,8 @@ int32_t TstitchStream::setViewPortInfo(Param_ViewPortInfo* pViewPortInfo)
 
     // Init the viewport library
     ret = initViewport(pViewPortInfo, pViewPortInfo->tileNumCol, pViewPortInfo->tileNumRow);
+    if (ret)
+        return ret;
     // do the process to calculate the tiles
     ret = getViewPortTiles();
     // the ret is the tile number, if there is something wrong, the ret will be less than 0
@@ -1102,6 +1686,26 @@ int32_t TstitchStream::setViewPortInfo(Param_ViewPortInfo* pViewPortInfo)
     return ret;
 }
 
+int32_t  TstitchStream::setMappingThreads(int32_t threadNum)
+{
+    if (threadNum <= 0)
+        return -1;
+    m_mappingThreads = threadNum;
+    if (m_pViewport)
+        genViewport_setMappingThreads(m_pViewport, m_mappingThreads);
+    return 0;
+}
+
+int32_t  TstitchStream::setMergeThreads(int32_t threadNum)
+{
+    if (threadNum <= 0)
+        return -1;
+    m_mergeThreads = threadNum;
+    if (m_pMergeStream)
+        tile_merge_SetThreads(m_pMergeStream, m_mergeThreads);
+    return 0;
+}
+
 int32_t  TstitchStream::setSEIProjInfo(int32_t projType)
 {
     int32_t ret = 0;
@@ -1342,7 +1946,6 @@ int32_t  TstitchStream::GenerateSliceHdr(param_360SCVP* pParam360SCVP, int32_t n
 {
     int32_t ret = -1;
     GTS_BitStream *bsWrite = NULL;
-    HEVCState hevcTmp;
     if (!pParam360SCVP)
         return -1;
 
@@ -1368,23 +1971,30 @@ int32_t  TstitchStream::GenerateSliceHdr(param_360SCVP* pParam360SCVP, int32_t n
             }
             return ret;
         }
-        // modify the sliceheader
-        memcpy(&hevcTmp, m_hevcState, sizeof(HEVCState));
+        // modify the sliceheader in place, the modified values are restored after writing
+        HEVC_SPS *sps = &(m_hevcState->sps[0]);
+        HEVCSliceInfo *si = &m_hevcState->s_info;
+        uint32_t width = sps->width;
+        uint32_t height = sps->height;
+        bool firstSliceSegment = si->first_slice_segment_in_pic_flag;
+        uint32_t sliceAddress = si->slice_segment_address;
+        bool firstNal = m_hevcState->first_nal;
 
-        HEVC_SPS *sps = &(hevcTmp.sps[0]);
         sps->width = pParam360SCVP->destWidth;
         sps->height = pParam360SCVP->destHeight;
-
-        HEVCSliceInfo *si = &hevcTmp.s_info;
-        if (!si)
-            return -1;
         si->first_slice_segment_in_pic_flag = 1;
         if (newSliceAddr)
             si->first_slice_segment_in_pic_flag = 0;
         si->slice_segment_address = newSliceAddr;
 
         // write the new sliceheader
-        hevc_write_slice_header(bsWrite, &hevcTmp);
+        hevc_write_slice_header_spliced(bsWrite, m_hevcState, &m_sliceHdrTemplate);
+
+        sps->width = width;
+        sps->height = height;
+        si->first_slice_segment_in_pic_flag = firstSliceSegment;
+        si->slice_segment_address = sliceAddress;
+        m_hevcState->first_nal = firstNal;
         pParam360SCVP->outputBitstreamLen = gts_bs_get_position(bsWrite);
         gts_bs_del(bsWrite);
         ret = 0;
@@ -26,6 +26,10 @@
 #ifndef _360SCVP_IMPL_H_
 #define _360SCVP_IMPL_H_
 #include "360SCVPHevcTilestream.h"
+#include "360SCVPHevcEncHdr.h"
+
+//the high and the low resolution streams are 0 and 1, the mid tiers are from 2
+#define STREAM_NUM_MAX (2 + MAX_MID_TIER_NUM)
 
 class TstitchStream
 {
@@ -55,13 +59,13 @@ protected:
     OMNIViewPort*       m_pSeiViewport;
 
     //the below variables are got from the parsing
-    int32_t         m_tileWidthCountSel[2];
-    int32_t         m_tileHeightCountSel[2];
-    int32_t         m_tileWidthCountOri[2];
-    int32_t         m_tileHeightCountOri[2];
+    int32_t         m_tileWidthCountSel[STREAM_NUM_MAX];
+    int32_t         m_tileHeightCountSel[STREAM_NUM_MAX];
+    int32_t         m_tileWidthCountOri[STREAM_NUM_MAX];
+    int32_t         m_tileHeightCountOri[STREAM_NUM_MAX];
     SliceType       m_sliceType;
-    nal_info       *m_pNalInfo[2]; //support two bitstream parsing and stitch
-    int32_t         m_specialDataLen[2];
+    nal_info       *m_pNalInfo[STREAM_NUM_MAX]; //support the high, the low resolution and the mid tier bitstreams parsing and stitch
+    int32_t         m_specialDataLen[STREAM_NUM_MAX];
     TileDef        *m_pOutTile;
     point          *m_pUpLeft;
     point          *m_pDownRight;
@@ -69,12 +73,24 @@ protected:
     int32_t         m_bSPSReady; //used in the usetype = E_PARSER_ONENAL
     int32_t         m_bPPSReady; //used in the usetype = E_PARSER_ONENAL
     HEVCState      *m_hevcState;
-    unsigned char * m_specialInfo[2];
+    HEVCParamSetCache *m_paramSetCache[STREAM_NUM_MAX];
+    HEVCSliceHeaderTemplate m_sliceHdrTemplate;
+    merge_segments  m_segments;     //the stitched frame when it is given as segments
+    int64_t         m_headerNalPos; //the position of the headers in the arena of m_segments, -1 if not written
+    unsigned char * m_specialInfo[STREAM_NUM_MAX];
+    uint8_t        *m_pParsedInput[STREAM_NUM_MAX]; //the input bitstreams of the last parsing, read by the handles merging from this one
+    int32_t         m_midTierNum;
+    int32_t        *m_pMidTierTiles[MAX_MID_TIER_NUM]; //the tile indexes of the window of each mid tier in the merge order
+    one_res_param   m_midResParam[MAX_MID_TIER_NUM];
+    int32_t         m_midTilesInCol[MAX_MID_TIER_NUM];
+    int32_t         m_midTilesInRow[MAX_MID_TIER_NUM];
     int32_t         m_lrTilesInCol;
     int32_t         m_lrTilesInRow;
     int32_t         m_hrTilesInRow;
     int32_t         m_hrTilesInCol;
     RegionWisePacking m_dstRwpk;
+    int32_t         m_mappingThreads; //the thread number of the viewport mapping
+    int32_t         m_mergeThreads;   //the thread number of the tile merging
 
 public:
     uint16_t        m_nalType;
@@ -98,10 +114,17 @@ public:
     int32_t  uninit();
     int32_t  getViewPortTiles();
     int32_t  feedParamToGenStream(param_360SCVP* pParamStitchStream);
+    int32_t  feedSharedToGenStream(const TstitchStream* pShared);
+    int32_t  initSharedFrame(param_360SCVP* pParamStitchStream);
+    int32_t  parseSharedFrame(param_360SCVP* pParamStitchStream);
+    int32_t  parseMidTiers(param_360SCVP* pParamStitchStream);
     int32_t  setViewPort(float yaw, float pitch);
-    int32_t  doMerge(param_360SCVP* pParamStitchStream);
+    int32_t  doMerge(param_360SCVP* pParamStitchStream, BitstreamSegment** ppSegments, int32_t* pSegmentNum);
     int32_t  getFixedNumTiles(TileDef* pOutTile);
+    int32_t  getTilesForPoses(ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks);
+    int32_t  getTileCoverage(float* pCoverage);
     int32_t  parseNals(param_360SCVP* pParamStitchStream, int32_t parseType, Nalu* pNALU, int32_t streamIdx);
+    int32_t  parseAccessUnit(uint8_t* pBitstream, int32_t bitstreamLen, Nalu* pNalus, int32_t maxNaluNum);
     int32_t  GenerateRWPK(RegionWisePacking* pRWPK, uint8_t *pRWPKBits, int32_t* pRWPKBitsSize);
     int32_t  GenerateProj(int32_t projType, uint8_t *pProjBits, int32_t* pProjBitsSize);
     int32_t  GeneratePPS(param_360SCVP* pParamStitchStream, TileArrangement* pTileArrange);
@@ -116,8 +139,10 @@ public:
     int32_t  setSphereRot(SphereRotation* pSphereRot);
     int32_t  setFramePacking(FramePacking* pFramePacking);
     int32_t  setViewportSEI(OMNIViewPort* pSeiViewport);
-    int32_t  doStreamStitch(param_360SCVP* pParamStitchStream);
-    int32_t  merge_one_tile(uint8_t **pBitstream, oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile);
+    int32_t  setMappingThreads(int32_t threadNum);
+    int32_t  setMergeThreads(int32_t threadNum);
+    int32_t  doStreamStitch(param_360SCVP* pParamStitchStream, BitstreamSegment** ppSegments, int32_t* pSegmentNum);
+    int32_t  merge_one_tile(uint8_t **pBitstream, oneStream_info* pSlice, GTS_BitStream *bs, bool bFirstTile, merge_segments *pSegments);
     int32_t  GenerateRwpkInfo(RegionWisePacking *dstRwpk);
     int32_t  EncRWPKSEI(RegionWisePacking* pRWPK, uint8_t *pRWPKBits, uint32_t* pRWPKBitsSize);
     int32_t  DecRWPKSEI(RegionWisePacking* pRWPK, uint8_t *pRWPKBits, uint32_t RWPKBitsSize);
@@ -126,7 +151,11 @@ public:
 protected:
     int32_t initMerge(param_360SCVP* pParamStitchStream, int32_t sliceSize);
     int32_t initViewport(Param_ViewPortInfo* pViewPortInfo, int32_t tilecolCount, int32_t tilerowCount);
-    int32_t merge_partstream_into1bitstream(int32_t totalInputLen);
+    int32_t initMidTiers(param_360SCVP* pParamStitchStream);
+    void    freeMidTierParams();
+    int32_t selectMidTierTiles();
+    int32_t feedTilesToGenStream(uint8_t** ppInputs, const TstitchStream* pSource);
+    int32_t merge_partstream_into1bitstream(int32_t totalInputLen, merge_segments *pSegments);
 };// END CLASS DEFINITION
 
 #endif // _360SCVP_IMPL_H_
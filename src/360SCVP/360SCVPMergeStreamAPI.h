@@ -53,16 +53,23 @@ typedef struct PARAM_MERGEBITSTREAM
 {
     one_res_param          highRes;                //!< parameters of high resolution stream
     one_res_param          lowRes;                 //!< parameters of low resolution stream
+    one_res_param         *pMidRes;                //!< parameters of the streams between the high and the low resolution, from high to low
+    int32_t                midResNum;              //!< number of the streams in pMidRes, 0 if only highRes and lowRes are merged
     uint32_t               inputBistreamsLen;      //!< input bitstream length
     uint8_t               *pOutputBitstream;       //!< pointer to output bitstream
     uint32_t               outputiledbistreamlen;  //!< length of output bitstream
     bool                   bWroteHeader;           //!< flag for whether Headers need to be wrote
+    uint32_t               outputBitstreamSize;    //!< size of the buffer of pOutputBitstream, 0 if it is not known, then
+                                                   //!< the merged stream is supposed to fit in twice the input length
 }param_mergeStream;
 
 //!
 //! \brief    Initialize tile merge library
 //! \details  Allocate memory for pointer members of stream data and parameters,
-//!           and get handle
+//!           and get handle. The selected tiles of each stream are merged at the
+//!           right of the ones of the stream before, in the order highRes,
+//!           pMidRes and lowRes, the parameter sets are the ones of the last
+//!           stream with selected tiles
 //!
 //! \param    [in] mergeStreamParams
 //!           Input pointer to stream parameters
@@ -99,6 +106,66 @@ int32_t tile_merge_Close(void* handle);
 //!
 int32_t tile_merge_Process(param_mergeStream *mergeStreamParams, void* handle);
 
+//!
+//! \brief    Process tile merge library with the output given as segments
+//! \details  Merge all the input tiled streams like tile_merge_Process, but
+//!           instead of copying them into pOutputBitstream, give the merged
+//!           stream as segments: the rewritten headers are in a buffer of the
+//!           handle and the slice data segments point into the input tiles.
+//!           The segments are valid until the next call with the handle
+//!
+//! \param    [in] mergeStreamParams
+//!           Input pointer to stream parameters, outputiledbistreamlen is
+//!           set to the length of all the segments
+//! \param    [in] handle
+//!           Pointer to library handle
+//! \param    [out] ppSegments
+//!           Pointer to the segments of the merged stream in order
+//! \param    [out] pSegmentNum
+//!           Pointer to the number of the segments
+//!
+//! \return   int32_t
+//!           0 if success, else non-zero value
+//!
+int32_t tile_merge_ProcessSegments(param_mergeStream *mergeStreamParams, void* handle, BitstreamSegment **ppSegments, uint32_t *pSegmentNum);
+
+//!
+//! \brief    Set the number of threads to merge the tiles
+//! \details  The selected tiles of a frame are split to the threads, each
+//!           one rewrites the slice headers of its tiles into its own
+//!           buffer and the buffers are joined in order, so the merged
+//!           stream is the same as with one thread
+//!
+//! \param    [in] handle
+//!           Pointer to library handle
+//! \param    [in] threadNum
+//!           The number of threads, 1 by default
+//!
+//! \return   int32_t
+//!           0 if success, else non-zero value
+//!
+int32_t tile_merge_SetThreads(void* handle, int32_t threadNum);
+
+//!
+//! \brief    Get the size of the merged stream
+//! \details  Merge the input tiled streams like tile_merge_Process does, but
+//!           only count the bytes, so that pOutputBitstream can be allocated
+//!           with the exact size before the frame is merged
+//!           The segments given by tile_merge_ProcessSegments before are not
+//!           valid any more
+//!
+//! \param    [in] mergeStreamParams
+//!           Input pointer to stream parameters
+//! \param    [in] handle
+//!           Pointer to library handle
+//! \param    [out] pOutputSize
+//!           Pointer to the size of the merged stream in bytes
+//!
+//! \return   int32_t
+//!           0 if success, else non-zero value
+//!
+int32_t tile_merge_GetOutputSize(param_mergeStream *mergeStreamParams, void* handle, uint32_t *pOutputSize);
+
 //!
 //! \brief    reset the merge function
 //!
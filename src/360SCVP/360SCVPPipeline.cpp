@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include <system_error>
+#include "360SCVPTiledstreamAPI.h"
+#include "360SCVPViewportAPI.h"
+#include "360SCVPMergeStreamAPI.h"
+#include "360SCVPAPI.h"
+#include "360SCVPCommonDef.h"
+#include "360SCVPHevcEncHdr.h"
+#include "360SCVPImpl.h"
+#include "360SCVPPipeline.h"
+
+TstitchPipeline::TstitchPipeline()
+{
+    m_pStitch = NULL;
+    m_nextSlot = 0;
+    m_pCallback = NULL;
+    m_pUserData = NULL;
+    m_inFlight = 0;
+    m_pending = 0;
+    m_bStop = false;
+    m_bViewportSet = false;
+    m_yaw = 0;
+    m_pitch = 0;
+}
+
+TstitchPipeline::~TstitchPipeline()
+{
+    uninit();
+}
+
+int32_t TstitchPipeline::init(TstitchStream *pStitch, param_360SCVP *pParam, int32_t queueDepth, I360SCVP_FrameDoneCallback pCallback, void *pUserData)
+{
+    if (!pStitch || !pParam || pParam->usedType != E_MERGE_AND_VIEWPORT || queueDepth <= 0 || !pCallback)
+        return -1;
+    m_pStitch = pStitch;
+    m_pCallback = pCallback;
+    m_pUserData = pUserData;
+
+    //each shared frame starts from the first frame like the handle, so that it knows the stream headers
+    for (int32_t i = 0; i < queueDepth; i++)
+    {
+        TstitchStream *pSlot = new TstitchStream;
+        if (pSlot->initSharedFrame(pParam) < 0)
+        {
+            pSlot->uninit();
+            delete pSlot;
+            uninit();
+            return -1;
+        }
+        m_slots.push_back(pSlot);
+    }
+
+    try
+    {
+        m_parseThread = std::thread(&TstitchPipeline::parseLoop, this);
+        m_mergeThread = std::thread(&TstitchPipeline::mergeLoop, this);
+    }
+    catch (const std::system_error&)
+    {
+        uninit();
+        return -1;
+    }
+    return 0;
+}
+
+int32_t TstitchPipeline::uninit()
+{
+    //the merging thread can't wait for itself, nor join itself
+    if (std::this_thread::get_id() == m_mergeThread.get_id())
+        return -1;
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_parseCond.notify_all();
+    m_mergeCond.notify_all();
+    m_doneCond.notify_all();
+    if (m_parseThread.joinable())
+        m_parseThread.join();
+    if (m_mergeThread.joinable())
+        m_mergeThread.join();
+
+    for (size_t i = 0; i < m_slots.size(); i++)
+    {
+        m_slots[i]->uninit();
+        delete m_slots[i];
+    }
+    m_slots.clear();
+    return 0;
+}
+
+int32_t TstitchPipeline::submit(param_360SCVP *pParam)
+{
+    if (!pParam)
+        return -1;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    //the frames are done in order, so the shared frame of the frame queueDepth before is free here
+    while (!m_bStop && m_inFlight >= (int32_t)m_slots.size())
+        m_doneCond.wait(lock);
+    if (m_bStop || m_slots.empty())
+        return -1;
+
+    PipelineFrame frame;
+    frame.pParam = pParam;
+    frame.pSlot = m_slots[m_nextSlot];
+    frame.ret = 0;
+    m_nextSlot = (m_nextSlot + 1) % (int32_t)m_slots.size();
+    m_inFlight++;
+    m_pending++;
+    m_parseQueue.push_back(frame);
+    lock.unlock();
+    m_parseCond.notify_one();
+    return 0;
+}
+
+int32_t TstitchPipeline::setViewPort(float yaw, float pitch)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_yaw = yaw;
+    m_pitch = pitch;
+    m_bViewportSet = true;
+    return 0;
+}
+
+int32_t TstitchPipeline::flush()
+{
+    //the callback would wait for the frame it is called for
+    if (std::this_thread::get_id() == m_mergeThread.get_id())
+        return -1;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_bStop && m_pending > 0)
+        m_doneCond.wait(lock);
+    return 0;
+}
+
+void TstitchPipeline::parseLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (1)
+    {
+        while (!m_bStop && m_parseQueue.empty())
+            m_parseCond.wait(lock);
+        if (m_parseQueue.empty())
+            break;
+        PipelineFrame frame = m_parseQueue.front();
+        m_parseQueue.pop_front();
+        lock.unlock();
+
+        frame.ret = frame.pSlot->parseSharedFrame(frame.pParam);
+
+        lock.lock();
+        m_mergeQueue.push_back(frame);
+        m_mergeCond.notify_one();
+    }
+}
+
+void TstitchPipeline::mergeLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (1)
+    {
+        while (!m_bStop && m_mergeQueue.empty())
+            m_mergeCond.wait(lock);
+        if (m_mergeQueue.empty())
+            break;
+        PipelineFrame frame = m_mergeQueue.front();
+        m_mergeQueue.pop_front();
+        bool bViewportSet = m_bViewportSet;
+        float yaw = m_yaw;
+        float pitch = m_pitch;
+        m_bViewportSet = false;
+        lock.unlock();
+
+        //the viewport is only changed between two frames, the tiles of the frames after are selected with it
+        if (bViewportSet)
+        {
+            if (m_pStitch->setViewPort(yaw, pitch) || m_pStitch->getViewPortTiles() < 0)
+                frame.ret = -1;
+        }
+        if (frame.ret == 0)
+            frame.ret = m_pStitch->feedSharedToGenStream(frame.pSlot);
+        if (frame.ret == 0)
+            frame.ret = m_pStitch->doMerge(frame.pParam, NULL, NULL);
+
+        //the shared frame is free before the callback, so that the callback can submit the next frame
+        lock.lock();
+        m_inFlight--;
+        m_doneCond.notify_all();
+        lock.unlock();
+
+        m_pCallback(m_pUserData, frame.pParam, frame.ret);
+
+        lock.lock();
+        m_pending--;
+        m_doneCond.notify_all();
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef _360SCVP_PIPELINE_H_
+#define _360SCVP_PIPELINE_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include "360SCVPAPI.h"
+
+class TstitchStream;
+
+//the frames given to the pipeline are parsed on one thread and merged by the handle on another,
+//so the parsing of a frame runs while the frame before is merged. each frame in flight is parsed
+//into its own shared frame, at most queueDepth frames are in flight
+class TstitchPipeline
+{
+protected:
+    struct PipelineFrame
+    {
+        param_360SCVP *pParam;
+        TstitchStream *pSlot;   //the shared frame the frame is parsed into
+        int32_t        ret;
+    };
+
+    TstitchStream                *m_pStitch;
+    std::vector<TstitchStream*>   m_slots;
+    int32_t                       m_nextSlot;
+    I360SCVP_FrameDoneCallback    m_pCallback;
+    void                         *m_pUserData;
+
+    std::mutex                    m_mutex;
+    std::condition_variable       m_parseCond;   //a frame is queued for the parsing, or the pipeline stops
+    std::condition_variable       m_mergeCond;   //a frame is parsed, or the pipeline stops
+    std::condition_variable       m_doneCond;    //a frame is merged, or its callback is done
+    std::deque<PipelineFrame>     m_parseQueue;
+    std::deque<PipelineFrame>     m_mergeQueue;
+    int32_t                       m_inFlight;    //the frames using a shared frame, it is free once they are merged
+    int32_t                       m_pending;     //the frames whose callback is not done yet
+    bool                          m_bStop;
+    //the viewport set while the frames are in flight, applied before the next merge
+    bool                          m_bViewportSet;
+    float                         m_yaw;
+    float                         m_pitch;
+
+    std::thread                   m_parseThread;
+    std::thread                   m_mergeThread;
+
+    void parseLoop();
+    void mergeLoop();
+
+public:
+    TstitchPipeline();
+    virtual ~TstitchPipeline();
+    int32_t init(TstitchStream *pStitch, param_360SCVP *pParam, int32_t queueDepth, I360SCVP_FrameDoneCallback pCallback, void *pUserData);
+    int32_t uninit();
+    int32_t submit(param_360SCVP *pParam);
+    int32_t setViewPort(float yaw, float pitch);
+    int32_t flush();
+};
+
+#endif // _360SCVP_PIPELINE_H_
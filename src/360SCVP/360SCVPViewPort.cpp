@@ -31,6 +31,7 @@
 #include <assert.h>
 #include <math.h>
 #include "360SCVPViewPort.h"
+#include "360SCVPGeometryBatch.h"
 
 
 ViewPort::ViewPort(SVideoInfo& sVideoInfo) : Geometry()
@@ -110,8 +111,29 @@ void ViewPort::matInv(POSType K[3][3])
   m_matInvK[2][1] = (K[2][0] * K[0][1] - K[0][0] * K[2][1]) /det;
   m_matInvK[2][2] = (K[0][0] * K[1][1] - K[1][0] * K[0][1]) /det;
 }
-void ViewPort::map3DTo2D(SPos *,SPos *)
+//project the 3D position into the viewport, faceIdx is -1 if the position is behind the camera
+void ViewPort::map3DTo2D(SPos *pSPosIn, SPos *pSPosOut)
 {
-    assert(!"Viewport 3D to 2D is not supported ");
+    // rotate back: p1 = R' * p
+    POSType x1 = m_matRotMatx[0][0]*pSPosIn->x + m_matRotMatx[1][0]*pSPosIn->y + m_matRotMatx[2][0]*pSPosIn->z;
+    POSType y1 = m_matRotMatx[0][1]*pSPosIn->x + m_matRotMatx[1][1]*pSPosIn->y + m_matRotMatx[2][1]*pSPosIn->z;
+    POSType z1 = m_matRotMatx[0][2]*pSPosIn->x + m_matRotMatx[1][2]*pSPosIn->y + m_matRotMatx[2][2]*pSPosIn->z;
+
+    pSPosOut->z = 0;
+    if (z1 < S_EPS)
+    {
+        pSPosOut->faceIdx = -1;
+        pSPosOut->x = 0;
+        pSPosOut->y = 0;
+        return;
+    }
+    // perspective division and K, the inverse of map2DTo3D
+    pSPosOut->faceIdx = 0;
+    pSPosOut->x = (x1/z1 - m_matInvK[0][2]) / m_matInvK[0][0] - (POSType)(0.5);
+    pSPosOut->y = (y1/z1 - m_matInvK[1][2]) / m_matInvK[1][1] - (POSType)(0.5);
 }
 
+void ViewPort::map2DTo3DBatch(SPosArray& sPosIn, SPosArray *pSPosOut, int32_t num)
+{
+    geoBatchViewportMap2DTo3D(m_matInvK, m_matRotMatx, &sPosIn, pSPosOut, num);
+}
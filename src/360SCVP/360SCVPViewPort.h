@@ -44,6 +44,7 @@ public:
     ViewPort(SVideoInfo& sVideoInfo);
     virtual ~ViewPort();
     virtual void map2DTo3D(SPos& IPosIn, SPos *pSPosOut);
+    virtual void map2DTo3DBatch(SPosArray& sPosIn, SPosArray *pSPosOut, int32_t num);
     //own methods;
     virtual void map3DTo2D(SPos *pSPosIn, SPos *pSPosOut);
     void setViewPort(float, float, float, float);
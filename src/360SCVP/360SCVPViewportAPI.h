@@ -62,6 +62,10 @@ typedef struct POINTDEF
 //! \param    m_pDownRight,          output,   the list of the down right point for each face in the input according to the view port information
 //! \param    viewportDestWidth,     output,    the destination width of the viewport
 //! \param    viewportDestHeight,    output,    the destination height of the viewport
+//! \param    m_lutYawStep,          input,    the yaw step (degree) of the pose-to-tile lookup table, 0 disables the table
+//! \param    m_lutPitchStep,        input,    the pitch step (degree) of the pose-to-tile lookup table, 0 disables the table
+//! \param    m_mappingMode,         input,    the way to map the viewport to the source, refer to EViewportMappingMode
+//! \param    m_precision,           input,    the precision of the mapping, refer to EViewportPrecision
 typedef struct GENERATE_VIEWPORT_PARAM
 {
     int32_t m_iViewportWidth;
@@ -81,7 +85,10 @@ typedef struct GENERATE_VIEWPORT_PARAM
     point*  m_pDownRight;
     int32_t m_viewportDestWidth;
     int32_t m_viewportDestHeight;
-
+    float   m_lutYawStep;
+    float   m_lutPitchStep;
+    int32_t m_mappingMode;
+    int32_t m_precision;
 } generateViewPortParam;
 
 //!
@@ -132,6 +139,19 @@ int32_t genViewport_setViewPort(void* pGenHandle, float yaw, float pitch);
 //!
 int32_t genViewport_setMaxSelTiles(void* pGenHandle, int32_t maxSelTiles);
 
+//!
+//! \brief    This function sets the number of threads to map the viewport to the source in genViewport_process,
+//!           the rows of the viewport are split to the threads and the result is the same as one thread.
+//!
+//! \param    void*     pGenHandle,        input, which is created by the genTiledStream_Init function
+//! \param    int32_t   threadNum,         input, the number of threads, 1 by default
+//!
+//! \return   s32, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t genViewport_setMappingThreads(void* pGenHandle, int32_t threadNum);
+
 //!
 //! \brief    This function judges whether one area(topleft(x,y), width,height, faceid) is inside the viewPort.
 //!
@@ -174,6 +194,100 @@ int32_t genViewport_getViewportTiles(void* pGenHandle, TileDef* pOutTile);
 
 int32_t genViewport_getContentCoverage(void* pGenHandle, CCDef* pOutCC);
 
+//!
+//! \brief    This function processes the viewport set by genViewport_setViewPort and outputs the tiles inside the
+//!           viewport, the content coverage and the viewport range from one mapping, which replaces the sequence of
+//!           genViewport_process, genViewport_getContentCoverage and the tile query. If the pose has moved no more
+//!           than the threshold of genViewport_setPoseThreshold since the last computation of this function, the
+//!           results of that computation are output again without any mapping.
+//!
+//! \param    generateViewPortParam* pParamGenViewport, output, the range of the viewport, as genViewport_process
+//! \param    void*      pGenHandle,   input,  which is created by the genViewport_Init function
+//! \param    TileDef*   pOutTile,     output, the tiles inside the viewport in the original picture order, it can be NULL,
+//!                                           the size of the list should be the total tile number
+//! \param    CCDef*     pOutCC,       output, the content coverage, as genViewport_getContentCoverage, it can be NULL
+//!
+//! \return   int32_t, the number of the tiles inside the viewport if succeed, negative if fail
+//!
+int32_t genViewport_processSelection(generateViewPortParam* pParamGenViewport, void* pGenHandle, TileDef* pOutTile, CCDef* pOutCC);
+
+//!
+//! \brief    This function sets the pose threshold of genViewport_processSelection
+//!
+//! \param    void*   pGenHandle,   input, which is created by the genViewport_Init function
+//! \param    float   threshold,    input, the largest change (degree) of yaw or pitch to reuse the last results,
+//!                                        0 (default) only reuses them for the same pose
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t genViewport_setPoseThreshold(void* pGenHandle, float threshold);
+
+//!
+//! \brief    This function selects the tiles inside the viewport for a batch of poses, the geometries are created once
+//!           and mapped again for each pose. The result of the last genViewport_process is kept.
+//!
+//! \param    void*          pGenHandle,   input,  which is created by the genViewport_Init function
+//! \param    ViewportPose*  pPoses,       input,  the poses
+//! \param    int32_t        poseNum,      input,  the number of the poses
+//! \param    uint64_t*      pTileMasks,   output, the tile masks of the poses one by one, refer to I360SCVP_getTilesForPoses
+//!
+//! \return   int32_t, the number of 64-bit words of each mask if succeed, negative if fail
+//!
+int32_t genViewport_getTilesForPoses(void* pGenHandle, ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks);
+
+//!
+//! \brief    This function computes, for each tile, the fraction of the viewport that is mapped into the tile, for the
+//!           viewport set by genViewport_setViewPort. The viewport is sampled on a grid of up to 128x128 points.
+//!
+//! \param    void*   pGenHandle,   input,  which is created by the genViewport_Init function
+//! \param    float*  pCoverage,    output, the fractions indexed by the tile idx, the sum of them is 1.
+//!                                         if it is NULL, only the number of tiles is returned
+//!
+//! \return   int32_t, the number of the tiles if succeed, negative if fail
+//!
+int32_t genViewport_getTileCoverage(void* pGenHandle, float* pCoverage);
+
+//!
+//! \brief    This function gets the validation result of E_VIEWPORT_PRECISION_VALIDATE, the poses whose tile set of
+//!           the single precision mapping is different from the one of the double precision mapping are counted
+//!
+//! \param    void*   pGenHandle,   input,  which is created by the genViewport_Init function
+//!
+//! \return   int32_t, the number of the poses with different tile sets since the init, negative if fail
+//!
+int32_t genViewport_getPrecisionMismatch(void* pGenHandle);
+
+//!
+//! \brief    This function serializes the pose-to-tile lookup table built in genViewport_Init, so that it can be shipped
+//!           with the content and loaded by genViewport_loadLUT instead of being built again.
+//!
+//! \param    void*      pGenHandle,   input,         which is created by the genViewport_Init function
+//! \param    uint8_t*   pBuffer,      output,        the buffer to hold the table, if it is NULL, only the size is returned
+//! \param    uint32_t*  pSize,        input/output,  the size of pBuffer as input, and the size of the table as output
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t genViewport_saveLUT(void* pGenHandle, uint8_t* pBuffer, uint32_t* pSize);
+
+//!
+//! \brief    This function loads the pose-to-tile lookup table generated by genViewport_saveLUT, the table must be built with
+//!           the same FOV, viewport size, source size, tile grid and projection as the handle. After loading, genViewport_process
+//!           quantizes the pose to the table step and looks up the result instead of mapping the geometry.
+//!
+//! \param    void*            pGenHandle,   input,  which is created by the genViewport_Init function
+//! \param    const uint8_t*   pBuffer,      input,  the serialized table
+//! \param    uint32_t         size,         input,  the size of the serialized table
+//!
+//! \return   int32_t, the status of the function.
+//!           0,     if succeed
+//!           not 0, if fail
+//!
+int32_t genViewport_loadLUT(void* pGenHandle, const uint8_t* pBuffer, uint32_t size);
+
 //!
 //! \brief      This function completes the un-initialization, free the memory
 //!
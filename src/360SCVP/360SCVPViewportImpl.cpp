@@ -60,6 +60,8 @@ void* genViewport_Init(generateViewPortParam* pParamGenViewport)
     cTAppConvCfg->m_sourceSVideoInfo.geoType = pParamGenViewport->m_input_geoType;
     cTAppConvCfg->m_iInputWidth = pParamGenViewport->m_iInputWidth;
     cTAppConvCfg->m_iInputHeight = pParamGenViewport->m_iInputHeight;
+    cTAppConvCfg->m_mappingMode = pParamGenViewport->m_mappingMode;
+    cTAppConvCfg->m_precision = pParamGenViewport->m_precision;
     if (cTAppConvCfg->create(pParamGenViewport->m_tileNumRow, pParamGenViewport->m_tileNumCol) < 0)
     {
         delete cTAppConvCfg;
@@ -150,26 +152,30 @@ void* genViewport_Init(generateViewPortParam* pParamGenViewport)
         pParamGenViewport->m_viewportDestWidth = maxTileNumCol * cTAppConvCfg->m_srd[0].tilewidth;
         pParamGenViewport->m_viewportDestHeight = maxTileNumRow * cTAppConvCfg->m_srd[0].tileheight;
     }
+
+    //build the pose-to-tile lookup table once, then the viewport process is only a lookup
+    if (pParamGenViewport->m_lutYawStep > 0 && pParamGenViewport->m_lutPitchStep > 0)
+    {
+        if (cTAppConvCfg->buildLUT(pParamGenViewport->m_lutYawStep, pParamGenViewport->m_lutPitchStep) < 0)
+        {
+            cTAppConvCfg->destroy();
+            delete cTAppConvCfg;
+            cTAppConvCfg = NULL;
+            return NULL;
+        }
+    }
     return (void*)cTAppConvCfg;
 }
 
-int32_t   genViewport_process(generateViewPortParam* pParamGenViewport, void* pGenHandle)
+//the faces taken by the viewport are output one by one
+static void copyExtents(generateViewPortParam* pParamGenViewport, int32_t numFaces, SPos* pUpLeft, SPos* pDownRight)
 {
-    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
-    if (!cTAppConvCfg || !pParamGenViewport)
-        return -1;
-    if (cTAppConvCfg->parseCfg() < 0)
-        return -1;
-
-    if (cTAppConvCfg->convert() < 0)
-        return -1;
-
-    pParamGenViewport->m_numFaces = cTAppConvCfg->m_numFaces;
+    pParamGenViewport->m_numFaces = numFaces;
 
     point* pTmpUpleftDst = pParamGenViewport->m_pUpLeft;
     point* pTmpDownRightDst = pParamGenViewport->m_pDownRight;
-    SPos * pTmpUpleftSrc = cTAppConvCfg->m_pUpLeft;
-    SPos * pTmpDownRightSrc = cTAppConvCfg->m_pDownRight;
+    SPos * pTmpUpleftSrc = pUpLeft;
+    SPos * pTmpDownRightSrc = pDownRight;
 
     for (int32_t i = 0; i < FACE_NUMBER; i++)
     {
@@ -188,12 +194,29 @@ int32_t   genViewport_process(generateViewPortParam* pParamGenViewport, void* pG
         pTmpUpleftSrc++;
         pTmpDownRightSrc++;
     }
+}
 
+int32_t   genViewport_process(generateViewPortParam* pParamGenViewport, void* pGenHandle)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg || !pParamGenViewport)
+        return -1;
+    if (cTAppConvCfg->parseCfg() < 0)
+        return -1;
+
+    if (!cTAppConvCfg->m_lut.empty())
+    {
+        if (cTAppConvCfg->applyLUT() < 0)
+            return -1;
+    }
+    else if (cTAppConvCfg->convert() < 0)
+        return -1;
+
+    copyExtents(pParamGenViewport, cTAppConvCfg->m_numFaces, cTAppConvCfg->m_pUpLeft, cTAppConvCfg->m_pDownRight);
     return 0;
 
 }
 
-
 int32_t genViewport_setMaxSelTiles(void* pGenHandle, int32_t maxSelTiles)
 {
     TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
@@ -203,6 +226,15 @@ int32_t genViewport_setMaxSelTiles(void* pGenHandle, int32_t maxSelTiles)
     return 0;
 
 }
+int32_t genViewport_setMappingThreads(void* pGenHandle, int32_t threadNum)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg || threadNum <= 0)
+        return -1;
+    cTAppConvCfg->m_mappingThreads = threadNum;
+    return 0;
+}
+
 int32_t genViewport_setViewPort(void* pGenHandle, float yaw, float pitch)
 {
     TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
@@ -235,39 +267,27 @@ int32_t genViewport_getContentCoverage(void* pGenHandle, CCDef* pOutCC)
     if(!pOutCC)
         return -1;
 
-    SPos *pUpLeft = cTAppConvCfg->m_pUpLeft;
-    SPos *pDownRight = cTAppConvCfg->m_pDownRight;
-
-    int32_t videoWidth = cTAppConvCfg->m_iInputWidth;
-    int32_t videoHeight = cTAppConvCfg->m_iInputHeight;
-
-    int32_t faceNum = (cTAppConvCfg->m_sourceSVideoInfo.geoType==SVIDEO_CUBEMAP) ? 6 : 2;
-    // ERP mode may have 2 faces for boundary case
-    if(cTAppConvCfg->m_sourceSVideoInfo.geoType == SVIDEO_EQUIRECT)
-    {
-        int32_t w = 0, h = 0, x = 0, y = 0;
-        bool coverBoundary = pUpLeft[1].faceIdx == 0 ? true : false;
-        x = pUpLeft[0].x;
-        y = pUpLeft[0].y;
-
-        w = pDownRight[0].x - pUpLeft[0].x + coverBoundary * (pDownRight[1].x - pUpLeft[1].x);
-        h = pDownRight[0].y - pUpLeft[0].y + coverBoundary * (pDownRight[1].y - pUpLeft[1].y);
-
-        pOutCC->centreAzimuth   = (int32_t)((((videoWidth / 2) - (float)(x + w / 2)) * 360 * 65536) / videoWidth);
-        pOutCC->centreElevation = (int32_t)((((videoHeight / 2) - (float)(y + h / 2)) * 180 * 65536) / videoHeight);
-        pOutCC->azimuthRange    = (uint32_t)((w * 360.f * 65536) / videoWidth);
-        pOutCC->elevationRange  = (uint32_t)((h * 180.f * 65536) / videoHeight);
-    }
-    else //if(cTAppConvCfg->m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP)
-    {
-        for (int32_t faceid = 0; faceid < faceNum; faceid++)
-        {
+    return cTAppConvCfg->calcContentCoverage(cTAppConvCfg->m_pUpLeft, cTAppConvCfg->m_pDownRight, pOutCC);
+}
 
-            pUpLeft++;
-            pDownRight++;
-        }
-    }
+int32_t genViewport_processSelection(generateViewPortParam* pParamGenViewport, void* pGenHandle, TileDef* pOutTile, CCDef* pOutCC)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg || !pParamGenViewport)
+        return -1;
+    int32_t tileNum = cTAppConvCfg->processSelection(pOutTile, pOutCC);
+    if (tileNum < 0)
+        return -1;
+    copyExtents(pParamGenViewport, cTAppConvCfg->m_selNumFaces, cTAppConvCfg->m_selUpLeft, cTAppConvCfg->m_selDownRight);
+    return tileNum;
+}
 
+int32_t genViewport_setPoseThreshold(void* pGenHandle, float threshold)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg || threshold < 0)
+        return -1;
+    cTAppConvCfg->m_poseThreshold = threshold;
     return 0;
 }
 
@@ -290,10 +310,13 @@ int32_t genViewport_getFixedNumTiles(void* pGenHandle, TileDef* pOutTile)
     printf("the max tile count = %d additionalTilesNum = %d\n", maxTileNum, additionalTilesNum);
     if (additionalTilesNum < 0)
         printf("there is an error in the judgement\n");
+    //the tiles of all the faces are counted, so all of them are walked
+    int32_t faceNum = (cTAppConvCfg->m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+    int32_t tileTotal = faceNum * cTAppConvCfg->m_tileNumCol * cTAppConvCfg->m_tileNumRow;
     int32_t pos = 0;
     for (int32_t i = 0; i < additionalTilesNum; i++)
     {
-        for (uint32_t j = pos; j < cTAppConvCfg->m_tileNumCol*cTAppConvCfg->m_tileNumRow; j++)
+        for (int32_t j = pos; j < tileTotal; j++)
         {
             if (cTAppConvCfg->m_srd[j].isOccupy == 0)
             {
@@ -304,26 +327,20 @@ int32_t genViewport_getFixedNumTiles(void* pGenHandle, TileDef* pOutTile)
         }
     }
 
-    //set the occupy tile into the output parameter
-    int32_t idx = 0;
+    //set the occupy tile into the output parameter, the number of the tiles set is returned
     TileDef* pOutTileTmp = pOutTile;
-    tileNum = tileNum + additionalTilesNum;
-    for (uint32_t col = 0; col < cTAppConvCfg->m_tileNumCol; col++)
+    for (int32_t idx = 0; idx < tileTotal; idx++)
     {
-        for (uint32_t row = 0; row < cTAppConvCfg->m_tileNumRow; row++)
+        if (cTAppConvCfg->m_srd[idx].isOccupy == 1)
         {
-            if (cTAppConvCfg->m_srd[idx].isOccupy == 1)
-            {
-                pOutTileTmp->faceId = cTAppConvCfg->m_srd[idx].faceId;
-                pOutTileTmp->x = cTAppConvCfg->m_srd[idx].x;
-                pOutTileTmp->y = cTAppConvCfg->m_srd[idx].y;
-                pOutTileTmp->idx = idx;
-                pOutTileTmp++;
-            }
-            idx++;
+            pOutTileTmp->faceId = cTAppConvCfg->m_srd[idx].faceId;
+            pOutTileTmp->x = cTAppConvCfg->m_srd[idx].x;
+            pOutTileTmp->y = cTAppConvCfg->m_srd[idx].y;
+            pOutTileTmp->idx = idx;
+            pOutTileTmp++;
         }
     }
-    return tileNum;
+    return (int32_t)(pOutTileTmp - pOutTile);
 }
 
 
@@ -395,7 +412,7 @@ int32_t genViewport_getViewportTiles(void* pGenHandle, TileDef* pOutTile)
             }
             rowStartIdx++;
             colStartIdx = colStartIdxOri;
-            if (rowStartIdx >= cTAppConvCfg->m_tileNumCol)
+            if (rowStartIdx >= cTAppConvCfg->m_tileNumRow)
             {
                 rowStartIdx = 0;
             }
@@ -405,6 +422,46 @@ int32_t genViewport_getViewportTiles(void* pGenHandle, TileDef* pOutTile)
     return tileNum;
 }
 
+int32_t genViewport_getTilesForPoses(void* pGenHandle, ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg)
+        return -1;
+    return cTAppConvCfg->getTilesForPoses(pPoses, poseNum, pTileMasks);
+}
+
+int32_t genViewport_getTileCoverage(void* pGenHandle, float* pCoverage)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg)
+        return -1;
+    return cTAppConvCfg->calcTileCoverage(pCoverage);
+}
+
+int32_t genViewport_getPrecisionMismatch(void* pGenHandle)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg)
+        return -1;
+    return cTAppConvCfg->m_precisionMismatch;
+}
+
+int32_t genViewport_saveLUT(void* pGenHandle, uint8_t* pBuffer, uint32_t* pSize)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg || !pSize)
+        return -1;
+    return cTAppConvCfg->saveLUT(pBuffer, pSize);
+}
+
+int32_t genViewport_loadLUT(void* pGenHandle, const uint8_t* pBuffer, uint32_t size)
+{
+    TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
+    if (!cTAppConvCfg || !pBuffer)
+        return -1;
+    return cTAppConvCfg->loadLUT(pBuffer, size);
+}
+
 int32_t   genViewport_unInit(void* pGenHandle)
 {
     TgenViewport* cTAppConvCfg = (TgenViewport*)(pGenHandle);
@@ -412,11 +469,8 @@ int32_t   genViewport_unInit(void* pGenHandle)
         return 1;
 
     cTAppConvCfg->destroy();
-    if(pGenHandle)
-    {
-        free(pGenHandle);
-        pGenHandle = NULL;
-    }
+    delete cTAppConvCfg;
+    cTAppConvCfg = NULL;
 
     return 0;
 }
@@ -439,12 +493,34 @@ TgenViewport::TgenViewport()
     m_iInputWidth = 0;
     m_iInputHeight = 0;
     m_maxTileNum = 0;
+    m_mappingMode = E_VIEWPORT_MAPPING_FULL;
+    m_mappingThreads = 1;
+    m_precision = E_VIEWPORT_PRECISION_DOUBLE;
+    m_precisionMismatch = 0;
+    m_poseThreshold = 0;
+    m_selValid = false;
+    m_selYaw = 0;
+    m_selPitch = 0;
+    m_selNumFaces = 0;
+    memset(&m_selCC, 0, sizeof(CCDef));
     m_numFaces = 0;
+    m_lutYawStep = 0;
+    m_lutPitchStep = 0;
+    m_lutYawNum = 0;
+    m_lutPitchNum = 0;
+    m_lutWordsPerEntry = 0;
+    m_lutCurIdx = -1;
+    m_pSourceGeometry = NULL;
+    m_pCodingGeometry = NULL;
+    m_pMapWorkers = NULL;
     m_srd = new ITileInfo;
 }
 
 TgenViewport::~TgenViewport()
 {
+    releaseGeometries();
+    mapWorkersDestroy(m_pMapWorkers);
+    m_pMapWorkers = NULL;
     if(m_pUpLeft)
     {
         delete[] m_pUpLeft;
@@ -568,68 +644,371 @@ int32_t TgenViewport::parseCfg(  )
     return 0;
 }
 
-int32_t  TgenViewport::convert()
+//the geometries are created at the first call and only created again when the
+//layout changes, a new pose just resets the viewport and maps it again
+int32_t TgenViewport::prepareGeometries()
 {
-    Geometry  *pcInputGeomtry = NULL;
-    Geometry  *pcCodingGeomtry = NULL;
-    pcInputGeomtry = Geometry::create(m_sourceSVideoInfo);
-    if(!pcInputGeomtry)
+    if (m_pSourceGeometry && m_pCodingGeometry)
+    {
+        SVideoInfo *pSrc = &m_sourceSVideoInfo;
+        SVideoInfo *pCoding = &m_codingSVideoInfo;
+        const SVideoInfo *pSrcOld = m_pSourceGeometry->getVideoInfo();
+        const SVideoInfo *pCodingOld = m_pCodingGeometry->getVideoInfo();
+        bool bSame = pSrc->geoType == pSrcOld->geoType && pSrc->iFaceWidth == pSrcOld->iFaceWidth
+            && pSrc->iFaceHeight == pSrcOld->iFaceHeight && pSrc->iNumFaces == pSrcOld->iNumFaces
+            && !memcmp(&pSrc->sVideoRotation, &pSrcOld->sVideoRotation, sizeof(GeometryRotation))
+            && pCoding->geoType == pCodingOld->geoType && pCoding->iFaceWidth == pCodingOld->iFaceWidth
+            && pCoding->iFaceHeight == pCodingOld->iFaceHeight && pCoding->iNumFaces == pCodingOld->iNumFaces
+            && !memcmp(&pCoding->sVideoRotation, &pCodingOld->sVideoRotation, sizeof(GeometryRotation));
+        if (!bSame)
+            releaseGeometries();
+    }
+    if (!m_pSourceGeometry)
+    {
+        m_pSourceGeometry = Geometry::create(m_sourceSVideoInfo);
+        if (!m_pSourceGeometry)
+            return -1;
+    }
+    if (!m_pCodingGeometry)
     {
+        m_pCodingGeometry = Geometry::create(m_codingSVideoInfo);
+        if (!m_pCodingGeometry)
+            return -1;
+    }
+
+    if (m_pCodingGeometry->getType() == SVIDEO_VIEWPORT)
+    {
+        ViewPortSettings *pView = &m_codingSVideoInfo.viewPort;
+        ((ViewPort*)m_pCodingGeometry)->setViewPort(pView->hFOV, pView->vFOV, pView->fYaw, pView->fPitch);
+    }
+    m_pCodingGeometry->resetMapping();
+    m_pCodingGeometry->setBoundarySampling(m_mappingMode == E_VIEWPORT_MAPPING_BOUNDARY);
+    m_pCodingGeometry->setMappingThreads(m_mappingThreads);
+    //the workers are kept over the poses and only started again when the thread number changes
+    if (mapWorkersThreadNum(m_pMapWorkers) != m_mappingThreads)
+    {
+        mapWorkersDestroy(m_pMapWorkers);
+        m_pMapWorkers = (m_mappingThreads > 1) ? mapWorkersCreate(m_mappingThreads) : NULL;
+    }
+    m_pCodingGeometry->setMappingWorkers(m_pMapWorkers);
+    m_pSourceGeometry->setSinglePrecision(m_precision == E_VIEWPORT_PRECISION_FAST);
+    return 0;
+}
+
+void TgenViewport::releaseGeometries()
+{
+    if (m_pSourceGeometry)
+    {
+        delete m_pSourceGeometry;
+        m_pSourceGeometry = NULL;
+    }
+    if (m_pCodingGeometry)
+    {
+        if (m_pCodingGeometry->getType() == SVIDEO_VIEWPORT)
+            m_pCodingGeometry->geoUnInit();
+        delete m_pCodingGeometry;
+        m_pCodingGeometry = NULL;
+    }
+}
+
+int32_t  TgenViewport::convert()
+{
+    if (prepareGeometries() < 0)
+        return -1;
+    m_lutCurIdx = -1;
+    if (m_precision == E_VIEWPORT_PRECISION_VALIDATE && m_pCodingGeometry->getType() == SVIDEO_VIEWPORT)
+        return validatePrecision();
+
+    m_pSourceGeometry->geoConvert(m_pCodingGeometry);
+
+    if (m_pCodingGeometry->getType() == SVIDEO_VIEWPORT)
+        storeExtents(m_pCodingGeometry);
+    return 0;
+}
+//the pose is mapped in single precision and then in double precision, the tile
+//sets of the two are compared and the double precision extents are kept
+int32_t TgenViewport::validatePrecision()
+{
+    int32_t faceNum = (m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+    int32_t tileTotal = faceNum * m_tileNumRow * m_tileNumCol;
+    if ((int32_t)m_validateOccupy.size() != tileTotal)
+        m_validateOccupy.resize(tileTotal);
+
+    m_pSourceGeometry->setSinglePrecision(true);
+    m_pSourceGeometry->geoConvert(m_pCodingGeometry);
+    storeExtents(m_pCodingGeometry);
+    if (calcTilesInViewport(m_srd, m_tileNumCol, m_tileNumRow) < 0)
+        return -1;
+    for (int32_t i = 0; i < tileTotal; i++)
+        m_validateOccupy[i] = m_srd[i].isOccupy;
+
+    m_pCodingGeometry->resetMapping();
+    m_pSourceGeometry->setSinglePrecision(false);
+    m_pSourceGeometry->geoConvert(m_pCodingGeometry);
+    storeExtents(m_pCodingGeometry);
+    if (calcTilesInViewport(m_srd, m_tileNumCol, m_tileNumRow) < 0)
         return -1;
+    for (int32_t i = 0; i < tileTotal; i++)
+    {
+        if (m_validateOccupy[i] != m_srd[i].isOccupy)
+        {
+            m_precisionMismatch++;
+            break;
+        }
     }
-    pcCodingGeomtry = Geometry::create(m_codingSVideoInfo);
-    if (!pcCodingGeomtry)
+    return 0;
+}
+
+void TgenViewport::storeExtents(Geometry* pcCodingGeomtry)
+{
+    ViewPort* pViewPort = (ViewPort*)pcCodingGeomtry;
+    m_numFaces = pViewPort->m_numFaces;
+    SPos *pUpLeftSrc = pViewPort->m_upLeft;
+    SPos *pDownRightSrc = pViewPort->m_downRight;
+    SPos *pUpLeftDst = m_pUpLeft;
+    SPos *pDownRightDst = m_pDownRight;
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
     {
-        delete pcInputGeomtry;
-        pcInputGeomtry = NULL;
+        pUpLeftDst->faceIdx = pUpLeftSrc->faceIdx;
+        pUpLeftDst->x = pUpLeftSrc->x;
+        pUpLeftDst->y = pUpLeftSrc->y;
+        pDownRightDst->faceIdx = pDownRightSrc->faceIdx;
+        pDownRightDst->x = pDownRightSrc->x;
+        pDownRightDst->y = pDownRightSrc->y;
+        pUpLeftDst++;
+        pDownRightDst++;
+        pUpLeftSrc++;
+        pDownRightSrc++;
+    }
+}
+
+//each pose is mapped with the geometries of the handle, the state of the last
+//genViewport_process is restored at the end
+int32_t TgenViewport::getTilesForPoses(ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks)
+{
+    int32_t faceNum = (m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+    int32_t tileTotal = faceNum * m_tileNumRow * m_tileNumCol;
+    int32_t wordsPerPose = (tileTotal + 63) / 64;
+    if (poseNum < 0 || (poseNum > 0 && (!pPoses || !pTileMasks)))
+        return -1;
+    if (!pTileMasks)
+        return wordsPerPose;
+    if (!m_srd)
         return -1;
+
+    float fYaw = m_codingSVideoInfo.viewPort.fYaw;
+    float fPitch = m_codingSVideoInfo.viewPort.fPitch;
+    int32_t numFaces = m_numFaces;
+    int32_t lutCurIdx = m_lutCurIdx;
+    SPos upLeft[FACE_NUMBER], downRight[FACE_NUMBER];
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
+    {
+        upLeft[i] = m_pUpLeft[i];
+        downRight[i] = m_pDownRight[i];
+    }
+    std::vector<ITileInfo> srd(m_srd, m_srd + tileTotal);
+
+    int32_t ret = parseCfg();
+    for (int32_t k = 0; k < poseNum && ret == 0; k++)
+    {
+        m_codingSVideoInfo.viewPort.fYaw = pPoses[k].yaw;
+        m_codingSVideoInfo.viewPort.fPitch = pPoses[k].pitch;
+        ret = m_lut.empty() ? convert() : applyLUT();
+        if (ret < 0 || calcTilesInViewport(m_srd, m_tileNumCol, m_tileNumRow) < 0)
+        {
+            ret = -1;
+            break;
+        }
+        uint64_t *pMask = pTileMasks + (int64_t)k * wordsPerPose;
+        memset(pMask, 0, wordsPerPose * sizeof(uint64_t));
+        for (int32_t i = 0; i < tileTotal; i++)
+        {
+            if (m_srd[i].isOccupy)
+                pMask[i >> 6] |= (uint64_t)1 << (i & 63);
+        }
     }
 
-    // starting time
-    double dResult;
-    clock_t lBefore = clock();
+    m_codingSVideoInfo.viewPort.fYaw = fYaw;
+    m_codingSVideoInfo.viewPort.fPitch = fPitch;
+    m_numFaces = numFaces;
+    m_lutCurIdx = lutCurIdx;
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
+    {
+        m_pUpLeft[i] = upLeft[i];
+        m_pDownRight[i] = downRight[i];
+    }
+    memcpy(m_srd, &srd[0], tileTotal * sizeof(ITileInfo));
+    return ret < 0 ? -1 : wordsPerPose;
+}
 
-    pcInputGeomtry->geoConvert(pcCodingGeomtry);
+#define COVERAGE_GRID 128
 
-    if (pcCodingGeomtry->getType() == SVIDEO_VIEWPORT)
+//the viewport is sampled on a COVERAGE_GRID x COVERAGE_GRID grid of the pixel
+//centres, and each sample is counted to the tile it is mapped into
+int32_t TgenViewport::calcTileCoverage(float* pCoverage)
+{
+    int32_t faceNum = (m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+    int32_t tileTotal = faceNum * m_tileNumRow * m_tileNumCol;
+    if (!pCoverage)
+        return tileTotal;
+    if (m_tileNumCol == 0 || m_tileNumRow == 0)
+        return -1;
+    int32_t stepX = m_iInputWidth / m_tileNumCol;
+    int32_t stepY = m_iInputHeight / m_tileNumRow;
+    if (stepX <= 0 || stepY <= 0 || m_iCodingFaceWidth <= 0 || m_iCodingFaceHeight <= 0)
+        return -1;
+
+    //the same layout as parseCfg, so the geometries of convert() are used
+    m_sourceSVideoInfo.iNumFaces = faceNum;
+    m_sourceSVideoInfo.iFaceWidth = m_iInputWidth;
+    m_sourceSVideoInfo.iFaceHeight = m_iInputHeight;
+    m_codingSVideoInfo.iNumFaces = 1;
+    m_codingSVideoInfo.iFaceWidth = m_iCodingFaceWidth;
+    m_codingSVideoInfo.iFaceHeight = m_iCodingFaceHeight;
+    if (prepareGeometries() < 0 || m_pCodingGeometry->getType() != SVIDEO_VIEWPORT)
+        return -1;
+    Geometry *pcInputGeomtry = m_pSourceGeometry;
+    Geometry *pcCodingGeomtry = m_pCodingGeometry;
+    pcInputGeomtry->setSinglePrecision(false);
+    ViewPort* pViewPort = (ViewPort*)pcCodingGeomtry;
+    pViewPort->setRotMat();
+    pViewPort->setInvK();
+
+    //the buffers only grow, so the coverage of the next poses does not allocate
+    int32_t gridW = m_iCodingFaceWidth < COVERAGE_GRID ? m_iCodingFaceWidth : COVERAGE_GRID;
+    int32_t gridH = m_iCodingFaceHeight < COVERAGE_GRID ? m_iCodingFaceHeight : COVERAGE_GRID;
+    if (m_coverageCount.size() < (size_t)tileTotal)
+        m_coverageCount.resize(tileTotal);
+    if (m_coverageFaceBuf.size() < (size_t)2 * gridW)
+        m_coverageFaceBuf.resize(2 * gridW);
+    if (m_coveragePosBuf.size() < (size_t)5 * gridW)
+        m_coveragePosBuf.resize(5 * gridW);
+    int32_t *count = &m_coverageCount[0];
+    int32_t *faceBuf = &m_coverageFaceBuf[0];
+    POSType *posBuf = &m_coveragePosBuf[0];
+    memset(count, 0, tileTotal * sizeof(int32_t));
+    SPosArray in = { &faceBuf[0], &posBuf[0], &posBuf[gridW], NULL };
+    SPosArray pos = { &faceBuf[gridW], &posBuf[2 * gridW], &posBuf[3 * gridW], &posBuf[4 * gridW] };
+    for (int32_t gy = 0; gy < gridH; gy++)
     {
-        ViewPort* pViewPort = (ViewPort*)pcCodingGeomtry;
-        m_numFaces = pViewPort->m_numFaces;
-        SPos *pUpLeftSrc = pViewPort->m_upLeft;
-        SPos *pDownRightSrc = pViewPort->m_downRight;
-        SPos *pUpLeftDst = m_pUpLeft;
-        SPos *pDownRightDst = m_pDownRight;
-        for (int32_t i = 0; i < FACE_NUMBER; i++)
+        for (int32_t gx = 0; gx < gridW; gx++)
         {
-            pUpLeftDst->faceIdx = pUpLeftSrc->faceIdx;
-            pUpLeftDst->x = pUpLeftSrc->x;
-            pUpLeftDst->y = pUpLeftSrc->y;
-            pDownRightDst->faceIdx = pDownRightSrc->faceIdx;
-            pDownRightDst->x = pDownRightSrc->x;
-            pDownRightDst->y = pDownRightSrc->y;
-            pUpLeftDst++;
-            pDownRightDst++;
-            pUpLeftSrc++;
-            pDownRightSrc++;
+            in.faceIdx[gx] = 0;
+            in.x[gx] = (gx + 0.5) * m_iCodingFaceWidth / gridW - 0.5;
+            in.y[gx] = (gy + 0.5) * m_iCodingFaceHeight / gridH - 0.5;
+        }
+        pcCodingGeomtry->mapToSourceBatch(pcInputGeomtry, in, pos, gridW);
+        for (int32_t k = 0; k < gridW; k++)
+        {
+            int32_t faceIdx = pos.faceIdx[k];
+            if (faceIdx < 0 || faceIdx >= faceNum)
+                continue;
+            int32_t col = (int32_t)floor(pos.x[k] + 0.5) / stepX;
+            int32_t row = (int32_t)floor(pos.y[k] + 0.5) / stepY;
+            col = col < 0 ? 0 : (col >= (int32_t)m_tileNumCol ? m_tileNumCol - 1 : col);
+            row = row < 0 ? 0 : (row >= (int32_t)m_tileNumRow ? m_tileNumRow - 1 : row);
+            count[(faceIdx * m_tileNumRow + row) * m_tileNumCol + col]++;
         }
-        pcCodingGeomtry->geoUnInit();
     }
+    for (int32_t i = 0; i < tileTotal; i++)
+        pCoverage[i] = (float)count[i] / (gridW * gridH);
+    return tileTotal;
+}
 
-    dResult = (double)(clock() - lBefore) / CLOCKS_PER_SEC;
-    printf("\n Total Time: %12.3f sec.\n", dResult);
+// output is the centre and range of Azimuth and Elevation of 3D sphere
+int32_t TgenViewport::calcContentCoverage(SPos* pUpLeft, SPos* pDownRight, CCDef* pOutCC)
+{
+    int32_t videoWidth = m_iInputWidth;
+    int32_t videoHeight = m_iInputHeight;
 
-    if(pcInputGeomtry)
+    int32_t faceNum = (m_sourceSVideoInfo.geoType==SVIDEO_CUBEMAP) ? 6 : 2;
+    // ERP mode may have 2 faces for boundary case
+    if(m_sourceSVideoInfo.geoType == SVIDEO_EQUIRECT)
     {
-        delete pcInputGeomtry;
-        pcInputGeomtry=NULL;
+        int32_t w = 0, h = 0, x = 0, y = 0;
+        bool coverBoundary = pUpLeft[1].faceIdx == 0 ? true : false;
+        x = pUpLeft[0].x;
+        y = pUpLeft[0].y;
+
+        w = pDownRight[0].x - pUpLeft[0].x + coverBoundary * (pDownRight[1].x - pUpLeft[1].x);
+        h = pDownRight[0].y - pUpLeft[0].y + coverBoundary * (pDownRight[1].y - pUpLeft[1].y);
+
+        pOutCC->centreAzimuth   = (int32_t)((((videoWidth / 2) - (float)(x + w / 2)) * 360 * 65536) / videoWidth);
+        pOutCC->centreElevation = (int32_t)((((videoHeight / 2) - (float)(y + h / 2)) * 180 * 65536) / videoHeight);
+        pOutCC->azimuthRange    = (uint32_t)((w * 360.f * 65536) / videoWidth);
+        pOutCC->elevationRange  = (uint32_t)((h * 180.f * 65536) / videoHeight);
     }
-    if(pcCodingGeomtry)
+    else //if(m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP)
     {
-        delete pcCodingGeomtry;
-        pcCodingGeomtry=NULL;
+        for (int32_t faceid = 0; faceid < faceNum; faceid++)
+        {
+
+            pUpLeft++;
+            pDownRight++;
+        }
     }
+
     return 0;
 }
+
+//the mapping, the tile list and the content coverage of one pose are done
+//together and kept, so that a pose close to it is answered from them
+int32_t TgenViewport::processSelection(TileDef* pOutTile, CCDef* pOutCC)
+{
+    float yaw = m_codingSVideoInfo.viewPort.fYaw;
+    float pitch = m_codingSVideoInfo.viewPort.fPitch;
+    float yawDiff = fabsf(yaw - m_selYaw);
+    if (yawDiff > 180)
+        yawDiff = 360 - yawDiff;
+    float pitchDiff = fabsf(pitch - m_selPitch);
+
+    if (!m_selValid || yawDiff > m_poseThreshold || pitchDiff > m_poseThreshold)
+    {
+        m_selValid = false;
+        if (parseCfg() < 0)
+            return -1;
+        int32_t ret = m_lut.empty() ? convert() : applyLUT();
+        if (ret < 0)
+            return -1;
+        if (calcTilesInViewport(m_srd, m_tileNumCol, m_tileNumRow) < 0)
+            return -1;
+
+        int32_t faceNum = (m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+        int32_t tileTotal = faceNum * m_tileNumRow * m_tileNumCol;
+        m_selTiles.resize(tileTotal);
+        int32_t tileNum = 0;
+        for (int32_t i = 0; i < tileTotal; i++)
+        {
+            if (!m_srd[i].isOccupy)
+                continue;
+            TileDef *pTile = &m_selTiles[tileNum++];
+            pTile->faceId = m_srd[i].faceId;
+            pTile->x = m_srd[i].x;
+            pTile->y = m_srd[i].y;
+            pTile->idx = i;
+        }
+        m_selTiles.resize(tileNum);
+
+        m_selNumFaces = m_numFaces;
+        for (int32_t i = 0; i < FACE_NUMBER; i++)
+        {
+            m_selUpLeft[i] = m_pUpLeft[i];
+            m_selDownRight[i] = m_pDownRight[i];
+        }
+        memset(&m_selCC, 0, sizeof(CCDef));
+        calcContentCoverage(m_selUpLeft, m_selDownRight, &m_selCC);
+        m_selYaw = yaw;
+        m_selPitch = pitch;
+        m_selValid = true;
+    }
+
+    if (pOutTile && !m_selTiles.empty())
+        memcpy(pOutTile, &m_selTiles[0], m_selTiles.size() * sizeof(TileDef));
+    if (pOutCC)
+        *pOutCC = m_selCC;
+    return (int32_t)m_selTiles.size();
+}
+
 bool TgenViewport::isInside(int32_t x, int32_t y, int32_t width, int32_t height, int32_t faceId)
 {
     bool ret = 0;
@@ -711,6 +1090,20 @@ int32_t TgenViewport::calcTilesInViewport(ITileInfo* pTileInfo, int32_t tileCol,
     int32_t ret = 0;
     ITileInfo *pTileInfoTmp = pTileInfo;
     int32_t faceNum = (m_sourceSVideoInfo.geoType==SVIDEO_CUBEMAP) ? 6 : 1;
+
+    //the occupancy has been computed when the lookup table is built
+    if (m_lutCurIdx >= 0)
+    {
+        const uint64_t *pOccupy = &m_lutOccupy[m_lutCurIdx * m_lutWordsPerEntry];
+        int32_t tileTotal = faceNum * tileRow * tileCol;
+        for (int32_t i = 0; i < tileTotal; i++)
+        {
+            pTileInfoTmp->isOccupy = (pOccupy[i >> 6] >> (i & 63)) & 1;
+            pTileInfoTmp++;
+        }
+        return m_lut[m_lutCurIdx].tileNum;
+    }
+
     for (int32_t faceid = 0; faceid < faceNum; faceid++)
     {
         for (int32_t row = 0; row < tileRow; row++)
@@ -728,4 +1121,246 @@ int32_t TgenViewport::calcTilesInViewport(ITileInfo* pTileInfo, int32_t tileCol,
     }
     return ret;
 }
+
+#define LUT_MAGIC   0x54554c53   // "SLUT"
+#define LUT_VERSION 1
+
+static void lut_put(uint8_t **ppDst, const void *pSrc, uint32_t size)
+{
+    memcpy(*ppDst, pSrc, size);
+    *ppDst += size;
+}
+
+static void lut_get(const uint8_t **ppSrc, void *pDst, uint32_t size)
+{
+    memcpy(pDst, *ppSrc, size);
+    *ppSrc += size;
+}
+
+int32_t TgenViewport::buildLUT(float yawStep, float pitchStep)
+{
+    if (yawStep <= 0 || pitchStep <= 0 || yawStep > 360 || pitchStep > 180)
+        return -1;
+
+    float fYaw = m_codingSVideoInfo.viewPort.fYaw;
+    float fPitch = m_codingSVideoInfo.viewPort.fPitch;
+    int32_t faceNum = (m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+    int32_t tileTotal = faceNum * m_tileNumRow * m_tileNumCol;
+
+    m_lut.clear();
+    m_lutOccupy.clear();
+    m_lutYawStep = yawStep;
+    m_lutPitchStep = pitchStep;
+    m_lutYawNum = (int32_t)ceil(360.0 / yawStep);
+    m_lutPitchNum = (int32_t)floor(180.0 / pitchStep) + 1;
+    m_lutWordsPerEntry = (tileTotal + 63) / 64;
+
+    std::vector<ILUTEntry> lut(m_lutYawNum * m_lutPitchNum);
+    std::vector<uint64_t> occupy(lut.size() * m_lutWordsPerEntry, 0);
+    int32_t idx = 0;
+    for (int32_t p = 0; p < m_lutPitchNum; p++)
+    {
+        for (int32_t y = 0; y < m_lutYawNum; y++)
+        {
+            m_codingSVideoInfo.viewPort.fYaw = -180 + y * yawStep;
+            m_codingSVideoInfo.viewPort.fPitch = (-90 + p * pitchStep > 90) ? 90 : -90 + p * pitchStep;
+            if (parseCfg() < 0 || convert() < 0)
+            {
+                m_codingSVideoInfo.viewPort.fYaw = fYaw;
+                m_codingSVideoInfo.viewPort.fPitch = fPitch;
+                return -1;
+            }
+
+            ILUTEntry *pEntry = &lut[idx];
+            pEntry->numFaces = m_numFaces;
+            pEntry->tileNum = calcTilesInViewport(m_srd, m_tileNumCol, m_tileNumRow);
+            for (int32_t i = 0; i < FACE_NUMBER; i++)
+            {
+                pEntry->upLeft[i] = m_pUpLeft[i];
+                pEntry->downRight[i] = m_pDownRight[i];
+            }
+            uint64_t *pOccupy = &occupy[idx * m_lutWordsPerEntry];
+            for (int32_t i = 0; i < tileTotal; i++)
+            {
+                if (m_srd[i].isOccupy)
+                    pOccupy[i >> 6] |= (uint64_t)1 << (i & 63);
+            }
+            idx++;
+        }
+    }
+    m_lut.swap(lut);
+    m_selValid = false;
+    m_lutOccupy.swap(occupy);
+
+    m_codingSVideoInfo.viewPort.fYaw = fYaw;
+    m_codingSVideoInfo.viewPort.fPitch = fPitch;
+    return 0;
+}
+
+int32_t TgenViewport::applyLUT()
+{
+    if (m_lut.empty())
+        return -1;
+
+    // quantize the pose to the nearest entry, yaw wraps around and pitch is clamped
+    double yaw = fmod((double)m_codingSVideoInfo.viewPort.fYaw + 180.0, 360.0);
+    if (yaw < 0)
+        yaw += 360.0;
+    int32_t yawIdx = (int32_t)floor(yaw / m_lutYawStep + 0.5);
+    if (yawIdx >= m_lutYawNum)
+        yawIdx = 0;
+    int32_t pitchIdx = (int32_t)floor(((double)m_codingSVideoInfo.viewPort.fPitch + 90.0) / m_lutPitchStep + 0.5);
+    if (pitchIdx < 0)
+        pitchIdx = 0;
+    if (pitchIdx >= m_lutPitchNum)
+        pitchIdx = m_lutPitchNum - 1;
+
+    m_lutCurIdx = pitchIdx * m_lutYawNum + yawIdx;
+    const ILUTEntry *pEntry = &m_lut[m_lutCurIdx];
+    m_numFaces = pEntry->numFaces;
+    for (int32_t i = 0; i < FACE_NUMBER; i++)
+    {
+        m_pUpLeft[i] = pEntry->upLeft[i];
+        m_pDownRight[i] = pEntry->downRight[i];
+    }
+    return 0;
+}
+
+int32_t TgenViewport::saveLUT(uint8_t* pBuffer, uint32_t* pSize)
+{
+    if (m_lut.empty() || !pSize)
+        return -1;
+
+    uint32_t entrySize = 2 * sizeof(int32_t) + 2 * FACE_NUMBER * (sizeof(int32_t) + 2 * sizeof(POSType));
+    uint32_t totalSize = sizeof(ILUTHeader) + m_lut.size() * entrySize + m_lutOccupy.size() * sizeof(uint64_t);
+    if (!pBuffer)
+    {
+        *pSize = totalSize;
+        return 0;
+    }
+    if (*pSize < totalSize)
+        return -1;
+
+    ILUTHeader header;
+    memset(&header, 0, sizeof(ILUTHeader));
+    header.magic = LUT_MAGIC;
+    header.version = LUT_VERSION;
+    header.inputGeoType = m_sourceSVideoInfo.geoType;
+    header.outputGeoType = m_codingSVideoInfo.geoType;
+    header.inputWidth = m_iInputWidth;
+    header.inputHeight = m_iInputHeight;
+    header.viewportWidth = m_iCodingFaceWidth;
+    header.viewportHeight = m_iCodingFaceHeight;
+    header.tileNumRow = m_tileNumRow;
+    header.tileNumCol = m_tileNumCol;
+    header.hFOV = m_codingSVideoInfo.viewPort.hFOV;
+    header.vFOV = m_codingSVideoInfo.viewPort.vFOV;
+    header.yawStep = m_lutYawStep;
+    header.pitchStep = m_lutPitchStep;
+    header.yawNum = m_lutYawNum;
+    header.pitchNum = m_lutPitchNum;
+    header.wordsPerEntry = m_lutWordsPerEntry;
+
+    uint8_t *pDst = pBuffer;
+    lut_put(&pDst, &header, sizeof(ILUTHeader));
+    for (uint32_t i = 0; i < m_lut.size(); i++)
+    {
+        ILUTEntry *pEntry = &m_lut[i];
+        lut_put(&pDst, &pEntry->numFaces, sizeof(int32_t));
+        lut_put(&pDst, &pEntry->tileNum, sizeof(int32_t));
+        for (int32_t j = 0; j < FACE_NUMBER; j++)
+        {
+            SPos *pPos[2] = { &pEntry->upLeft[j], &pEntry->downRight[j] };
+            for (int32_t k = 0; k < 2; k++)
+            {
+                lut_put(&pDst, &pPos[k]->faceIdx, sizeof(int32_t));
+                lut_put(&pDst, &pPos[k]->x, sizeof(POSType));
+                lut_put(&pDst, &pPos[k]->y, sizeof(POSType));
+            }
+        }
+    }
+    lut_put(&pDst, m_lutOccupy.data(), m_lutOccupy.size() * sizeof(uint64_t));
+    *pSize = totalSize;
+    return 0;
+}
+
+int32_t TgenViewport::loadLUT(const uint8_t* pBuffer, uint32_t size)
+{
+    if (!pBuffer || size < sizeof(ILUTHeader))
+        return -1;
+
+    ILUTHeader header;
+    const uint8_t *pSrc = pBuffer;
+    lut_get(&pSrc, &header, sizeof(ILUTHeader));
+    if (header.magic != LUT_MAGIC || header.version != LUT_VERSION)
+        return -1;
+
+    // the table is only valid for the same FOV, tile grid and projection
+    if (header.inputGeoType != m_sourceSVideoInfo.geoType
+        || header.outputGeoType != m_codingSVideoInfo.geoType
+        || header.inputWidth != m_iInputWidth
+        || header.inputHeight != m_iInputHeight
+        || header.viewportWidth != m_iCodingFaceWidth
+        || header.viewportHeight != m_iCodingFaceHeight
+        || header.tileNumRow != m_tileNumRow
+        || header.tileNumCol != m_tileNumCol
+        || header.hFOV != m_codingSVideoInfo.viewPort.hFOV
+        || header.vFOV != m_codingSVideoInfo.viewPort.vFOV)
+        return -1;
+
+    int32_t faceNum = (m_sourceSVideoInfo.geoType == SVIDEO_CUBEMAP) ? 6 : 1;
+    if (header.yawNum <= 0 || header.pitchNum <= 0
+        || header.yawStep <= 0 || header.pitchStep <= 0
+        || header.wordsPerEntry != (int32_t)((faceNum * m_tileNumRow * m_tileNumCol + 63) / 64))
+        return -1;
+
+    // the sizes are got in 64 bits and the entry number is bounded by the buffer, so nothing wraps
+    uint64_t entryNum = (uint64_t)header.yawNum * (uint64_t)header.pitchNum;
+    uint64_t entrySize = 2 * sizeof(int32_t) + 2 * FACE_NUMBER * (sizeof(int32_t) + 2 * sizeof(POSType))
+        + (uint64_t)header.wordsPerEntry * sizeof(uint64_t);
+    if (entryNum > (size - sizeof(ILUTHeader)) / entrySize)
+        return -1;
+
+    std::vector<ILUTEntry> lut((size_t)entryNum);
+    std::vector<uint64_t> occupy((size_t)entryNum * header.wordsPerEntry);
+    for (uint32_t i = 0; i < entryNum; i++)
+    {
+        ILUTEntry *pEntry = &lut[i];
+        lut_get(&pSrc, &pEntry->numFaces, sizeof(int32_t));
+        lut_get(&pSrc, &pEntry->tileNum, sizeof(int32_t));
+        // the face number indexes the face arrays and the tile number is given to the caller
+        if (pEntry->numFaces < 0 || pEntry->numFaces > FACE_NUMBER
+            || pEntry->tileNum < 0 || pEntry->tileNum > (int32_t)(faceNum * m_tileNumRow * m_tileNumCol))
+            return -1;
+        for (int32_t j = 0; j < FACE_NUMBER; j++)
+        {
+            SPos *pPos[2] = { &pEntry->upLeft[j], &pEntry->downRight[j] };
+            for (int32_t k = 0; k < 2; k++)
+            {
+                lut_get(&pSrc, &pPos[k]->faceIdx, sizeof(int32_t));
+                lut_get(&pSrc, &pPos[k]->x, sizeof(POSType));
+                lut_get(&pSrc, &pPos[k]->y, sizeof(POSType));
+                pPos[k]->z = 0;
+                // the used corners index the tiles of the frame, -1 marks an unused face
+                if (pPos[k]->faceIdx < -1 || pPos[k]->faceIdx >= faceNum)
+                    return -1;
+                if (pPos[k]->faceIdx >= 0 && !(pPos[k]->x >= 0 && pPos[k]->x < m_iInputWidth
+                    && pPos[k]->y >= 0 && pPos[k]->y < m_iInputHeight))
+                    return -1;
+            }
+        }
+    }
+    lut_get(&pSrc, occupy.data(), occupy.size() * sizeof(uint64_t));
+
+    m_lut.swap(lut);
+    m_selValid = false;
+    m_lutOccupy.swap(occupy);
+    m_lutYawStep = header.yawStep;
+    m_lutPitchStep = header.pitchStep;
+    m_lutYawNum = header.yawNum;
+    m_lutPitchNum = header.pitchNum;
+    m_lutWordsPerEntry = header.wordsPerEntry;
+    m_lutCurIdx = -1;
+    return 0;
+}
 //! \}
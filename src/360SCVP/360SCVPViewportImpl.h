@@ -27,6 +27,8 @@
 #define __360SCVP_VIEWPORTIMPL__
 
 #include "360SCVPGeometry.h"
+#include "360SCVPViewPort.h"
+#include "360SCVPViewportAPI.h"
 
 #include <sstream>
 #include <vector>
@@ -69,6 +71,37 @@ struct ITileInfo
     int32_t   faceId;
     uint32_t  isOccupy;
 };
+
+///< one entry of the pose-to-tile lookup table, which keeps the convert() result at the centre pose of the entry
+struct ILUTEntry
+{
+    int32_t   numFaces;
+    int32_t   tileNum;
+    SPos      upLeft[FACE_NUMBER];
+    SPos      downRight[FACE_NUMBER];
+};
+
+///< the header of the serialized pose-to-tile lookup table
+struct ILUTHeader
+{
+    uint32_t  magic;
+    uint32_t  version;
+    int32_t   inputGeoType;
+    int32_t   outputGeoType;
+    int32_t   inputWidth;
+    int32_t   inputHeight;
+    int32_t   viewportWidth;
+    int32_t   viewportHeight;
+    uint32_t  tileNumRow;
+    uint32_t  tileNumCol;
+    float     hFOV;
+    float     vFOV;
+    float     yawStep;
+    float     pitchStep;
+    int32_t   yawNum;
+    int32_t   pitchNum;
+    int32_t   wordsPerEntry;
+};
 /// generate viewport class
 class TgenViewport
 {
@@ -93,6 +126,38 @@ public:
     int32_t       m_aiPad[2];                                       ///< number of padded pixels for width and height
     int32_t   m_faceSizeAlignment;
     int32_t       m_maxTileNum;
+    int32_t       m_mappingMode;                                    ///< full scan or boundary sampling of the viewport
+    int32_t       m_mappingThreads;                                 ///< number of threads of the full scan
+    int32_t       m_precision;                                      ///< precision of the mapping, refer to EViewportPrecision
+    int32_t       m_precisionMismatch;                              ///< number of poses with different tile sets in the validation
+    std::vector<uint32_t>  m_validateOccupy;                        ///< occupancy of the single precision mapping in the validation
+    //results of the last processSelection, reused while the pose moves no more than m_poseThreshold
+    float         m_poseThreshold;
+    bool          m_selValid;
+    float         m_selYaw;
+    float         m_selPitch;
+    int32_t       m_selNumFaces;
+    SPos          m_selUpLeft[FACE_NUMBER];
+    SPos          m_selDownRight[FACE_NUMBER];
+    CCDef         m_selCC;
+    std::vector<TileDef>   m_selTiles;
+    //pose-to-tile lookup table, it is used when it is not empty
+    float         m_lutYawStep;
+    float         m_lutPitchStep;
+    int32_t       m_lutYawNum;
+    int32_t       m_lutPitchNum;
+    int32_t       m_lutWordsPerEntry;                               ///< number of 64-bit occupancy words of one entry
+    int32_t       m_lutCurIdx;                                      ///< the entry used by the last process, -1 if the geometry is mapped
+    std::vector<ILUTEntry> m_lut;
+    std::vector<uint64_t>  m_lutOccupy;
+    //the geometries of convert(), kept for the lifetime of the handle
+    Geometry     *m_pSourceGeometry;
+    Geometry     *m_pCodingGeometry;
+    SMapWorkers  *m_pMapWorkers;                                    ///< the threads of the full scan, started once for m_mappingThreads
+    //scratch of calcTileCoverage, kept for the next poses
+    std::vector<int32_t>   m_coverageCount;
+    std::vector<int32_t>   m_coverageFaceBuf;
+    std::vector<POSType>   m_coveragePosBuf;
     inline int32_t round(POSType t) { return (int32_t)(t+ (t>=0? 0.5 :-0.5)); };
 public:
     TgenViewport();
@@ -104,9 +169,22 @@ public:
     void     destroy();    ///< destroy option handling class
     int32_t  parseCfg(  );  ///< parse configuration file to fill member variables
     int32_t  convert();
+    int32_t  prepareGeometries();
+    void     releaseGeometries();
+    int32_t  validatePrecision();
+    void     storeExtents(Geometry* pcCodingGeomtry);
     //analysis;
     bool     isInside(int32_t x, int32_t y, int32_t width, int32_t height, int32_t faceId);
+    int32_t  calcContentCoverage(SPos* pUpLeft, SPos* pDownRight, CCDef* pOutCC);
+    int32_t  processSelection(TileDef* pOutTile, CCDef* pOutCC);
     int32_t  calcTilesInViewport(ITileInfo* pTileInfo, int32_t tileCol, int32_t tileRow);
+    int32_t  getTilesForPoses(ViewportPose* pPoses, int32_t poseNum, uint64_t* pTileMasks);
+    int32_t  calcTileCoverage(float* pCoverage);
+    //pose-to-tile lookup table
+    int32_t  buildLUT(float yawStep, float pitchStep);
+    int32_t  applyLUT();
+    int32_t  saveLUT(uint8_t* pBuffer, uint32_t* pSize);
+    int32_t  loadLUT(const uint8_t* pBuffer, uint32_t size);
 
 };// END CLASS DEFINITION
 
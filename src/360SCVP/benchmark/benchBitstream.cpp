@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//! microbenchmark of the bitstream reader, it reports the bits per second of
+//! the fixed length reads and writes, the exp-golomb codes per second, the bytes per second
+//! of the start code scanning and of the emulation prevention byte removal for
+//! each kernel level supported by the cpu, and
+//! the nal units per second of the hevc parsing, once with the whole nal units
+//! and once with the slice headers only, the later is the parsing done for each
+//! merged tile, and the slice headers written per second, in full and spliced
+//!
+//! usage: benchBitstream [stream] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include "../360SCVPHevcParser.h"
+#include "../360SCVPHevcNalScan.h"
+#include "../360SCVPHevcEncHdr.h"
+
+static const char* s_levelName[NAL_SCAN_NUM] = { "scalar", "sse2", "avx2" };
+
+static double elapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* name, int64_t count, const char* unit, double seconds)
+{
+    printf("%-16s %10.2f M%s/s\n", name, count / seconds / 1e6, unit);
+}
+
+// the bitstream for the exp-golomb codes
+static void writeBits(std::vector<uint8_t>& buffer, uint64_t* pBitNum, uint32_t value, uint32_t nBits)
+{
+    for (int32_t i = nBits - 1; i >= 0; i--, (*pBitNum)++)
+    {
+        if ((*pBitNum >> 3) >= buffer.size())
+            buffer.push_back(0);
+        buffer[*pBitNum >> 3] |= ((value >> i) & 1) << (7 - (*pBitNum & 7));
+    }
+}
+
+// the nal units of the stream, without the start codes
+static void splitNalus(std::vector<uint8_t>& stream, std::vector<std::pair<uint32_t, uint32_t> >& nalus)
+{
+    uint32_t start = 0;
+    for (uint32_t i = 0; i + 3 <= stream.size(); i++)
+    {
+        if (stream[i] == 0 && stream[i + 1] == 0 && stream[i + 2] == 1)
+        {
+            uint32_t end = (i > 0 && stream[i - 1] == 0) ? i - 1 : i;
+            if (start && end > start)
+                nalus.push_back(std::make_pair(start, end - start));
+            start = i + 3;
+            i += 2;
+        }
+    }
+    if (start && start < stream.size())
+        nalus.push_back(std::make_pair(start, (uint32_t)stream.size() - start));
+}
+
+int main(int argc, char** argv)
+{
+    const char* streamName = argc > 1 ? argv[1] : "../test/test.265";
+    int32_t iterations = argc > 2 ? atoi(argv[2]) : 200;
+    GTS_BitStream* pFile = gts_bs_from_file_mapped(streamName, true);
+    if (!pFile || iterations <= 0)
+    {
+        printf("usage: %s [stream] [iterations]\n", argv[0]);
+        gts_bs_del(pFile);
+        return -1;
+    }
+    std::vector<uint8_t> stream(pFile->original, pFile->original + pFile->size);
+    gts_bs_del(pFile);
+
+    // fixed length reads of 1 to 32 bits
+    const uint32_t bufferSize = 1 << 20;
+    std::vector<uint8_t> buffer(bufferSize);
+    std::vector<uint32_t> widths(4096);
+    srand(1);
+    for (uint32_t i = 0; i < bufferSize; i++)
+        buffer[i] = (uint8_t)(rand() & 0xff);
+    for (uint32_t i = 0; i < widths.size(); i++)
+        widths[i] = 1 + rand() % 32;
+    int64_t bits = 0;
+    uint32_t sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        GTS_BitStream* bs = gts_bs_new((int8_t*)&buffer[0], bufferSize, GTS_BITSTREAM_READ);
+        uint64_t left = (uint64_t)bufferSize * 8;
+        for (uint32_t i = 0; left >= 32; i = (i + 1) & 4095)
+        {
+            sum += gts_bs_read_int(bs, widths[i]);
+            left -= widths[i];
+            bits += widths[i];
+        }
+        gts_bs_del(bs);
+    }
+    report("read_int", bits, "bits", elapsedSeconds(start));
+
+    // fixed length writes of the same widths, the buffer has room for the emulation prevention bytes
+    std::vector<uint8_t> written(bufferSize * 2);
+    bits = 0;
+    start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        GTS_BitStream* bs = gts_bs_new((int8_t*)&written[0], written.size(), GTS_BITSTREAM_WRITE);
+        uint64_t left = (uint64_t)bufferSize * 8;
+        for (uint32_t i = 0, j = 0; left >= 32; i = (i + 1) & 4095, j = (j + 4) & (bufferSize - 4))
+        {
+            gts_bs_write_int(bs, *(int32_t*)&buffer[j], widths[i]);
+            left -= widths[i];
+            bits += widths[i];
+        }
+        sum += (uint32_t)gts_bs_get_position(bs);
+        gts_bs_del(bs);
+    }
+    report("write_int", bits, "bits", elapsedSeconds(start));
+
+    // exp-golomb codes of the values used in the headers
+    std::vector<uint8_t> codes;
+    uint64_t bitNum = 0;
+    int32_t codeNum = 0;
+    while (bitNum < (uint64_t)bufferSize * 8)
+    {
+        uint32_t value = 1 + rand() % (1 << (rand() % 12));
+        uint32_t len = 32 - __builtin_clz(value);
+        writeBits(codes, &bitNum, 0, len - 1);
+        writeBits(codes, &bitNum, value, len);
+        codeNum++;
+    }
+    start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        GTS_BitStream* bs = gts_bs_new((int8_t*)&codes[0], codes.size(), GTS_BITSTREAM_READ);
+        for (int32_t i = 0; i < codeNum; i++)
+            sum += gts_bs_read_ue(bs);
+        gts_bs_del(bs);
+    }
+    report("read_ue", (int64_t)codeNum * iterations, "codes", elapsedSeconds(start));
+
+    // start code scanning and emulation prevention byte removal of the whole stream
+    std::vector<uint8_t> unescaped(stream.size());
+    int32_t maxLevel = nalScanGetLevel();
+    for (int32_t level = NAL_SCAN_SCALAR; level <= maxLevel; level++)
+    {
+        char name[32];
+        int32_t found = 0;
+        nalScanSetLevel(level);
+        start = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; it++)
+        {
+            uint32_t pos = 0;
+            while (pos < stream.size())
+            {
+                pos += nalScanFindStartCode(&stream[pos], (uint32_t)stream.size() - pos) + 3;
+                found++;
+            }
+        }
+        snprintf(name, sizeof(name), "startcode %s", s_levelName[level]);
+        report(name, (int64_t)stream.size() * iterations, "bytes", elapsedSeconds(start));
+        sum += found;
+
+        start = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; it++)
+            found += gts_media_nalu_remove_emulation_bytes((int8_t*)&stream[0], (int8_t*)&unescaped[0], (uint32_t)stream.size());
+        snprintf(name, sizeof(name), "unescape %s", s_levelName[level]);
+        report(name, (int64_t)stream.size() * iterations, "bytes", elapsedSeconds(start));
+        sum += found;
+    }
+    nalScanSetLevel(NAL_SCAN_NUM);
+
+    // hevc parsing, the parameter sets are parsed first for the slices
+    std::vector<std::pair<uint32_t, uint32_t> > nalus;
+    splitNalus(stream, nalus);
+    HEVCState* pHevc = new HEVCState;
+    memset(pHevc, 0, sizeof(HEVCState));
+    hevc_specialInfo specialInfo;
+    memset(&specialInfo, 0, sizeof(hevc_specialInfo));
+    std::vector<std::pair<uint32_t, uint32_t> > slices;
+    for (uint32_t i = 0; i < nalus.size(); i++)
+    {
+        gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)&stream[nalus[i].first], nalus[i].second, pHevc);
+        if (specialInfo.naluType < 32 && specialInfo.sliceHeaderLen)
+            slices.push_back(std::make_pair(nalus[i].first, (uint32_t)specialInfo.sliceHeaderLen + 8));
+    }
+    printf("stream %s, nal units %d, slices %d, iterations %d\n", streamName,
+        (int32_t)nalus.size(), (int32_t)slices.size(), iterations);
+
+    start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        for (uint32_t i = 0; i < nalus.size(); i++)
+            gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)&stream[nalus[i].first], nalus[i].second, pHevc);
+    }
+    report("nalu", (int64_t)nalus.size() * iterations, "nalus", elapsedSeconds(start));
+
+    start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        for (uint32_t i = 0; i < slices.size(); i++)
+            gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)&stream[slices[i].first], slices[i].second, pHevc);
+    }
+    report("slice header", (int64_t)slices.size() * iterations, "headers", elapsedSeconds(start));
+
+    // slice header generation of the last parsed slice, done for each tile of the extractor tracks
+    start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        for (uint32_t i = 0; i < slices.size(); i++)
+        {
+            GTS_BitStream* bs = gts_bs_new((int8_t*)&written[0], written.size(), GTS_BITSTREAM_WRITE);
+            hevc_write_slice_header(bs, pHevc);
+            sum += (uint32_t)gts_bs_get_position(bs);
+            gts_bs_del(bs);
+        }
+    }
+    report("slice header wr", (int64_t)slices.size() * iterations, "headers", elapsedSeconds(start));
+
+    // the same headers with new addresses, spliced from the first one written
+    HEVCSliceHeaderTemplate headerTemplate;
+    memset(&headerTemplate, 0, sizeof(HEVCSliceHeaderTemplate));
+    pHevc->s_info.first_slice_segment_in_pic_flag = 0;
+    start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        for (uint32_t i = 0; i < slices.size(); i++)
+        {
+            GTS_BitStream* bs = gts_bs_new((int8_t*)&written[0], written.size(), GTS_BITSTREAM_WRITE);
+            pHevc->s_info.slice_segment_address = i;
+            hevc_write_slice_header_spliced(bs, pHevc, &headerTemplate);
+            sum += (uint32_t)gts_bs_get_position(bs);
+            gts_bs_del(bs);
+        }
+    }
+    report("slice header spl", (int64_t)slices.size() * iterations, "headers", elapsedSeconds(start));
+
+    delete pHevc;
+    return sum == 0x12345678 ? 1 : 0;
+}
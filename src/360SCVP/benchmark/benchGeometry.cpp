@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//! microbenchmark of the geometry coordinate mapping, it reports the points
+//! per second of the per point functions and of the batch kernels for each
+//! kernel level supported by the cpu, erp-fast is the single precision erp kernel
+//!
+//! usage: benchGeometry [points] [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include "../360SCVPViewPort.h"
+#include "../360SCVPGeometryBatch.h"
+
+static const char* s_levelName[GEO_KERNEL_NUM] = { "scalar", "sse4", "avx2" };
+
+static double elapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* geometry, const char* kernel, int64_t points, double seconds)
+{
+    printf("%-10s %-10s %10.2f Mpoints/s\n", geometry, kernel, points / seconds / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    int32_t num = argc > 1 ? atoi(argv[1]) : 4096;
+    int32_t iterations = argc > 2 ? atoi(argv[2]) : 1000;
+    if (num <= 0 || iterations <= 0)
+    {
+        printf("usage: %s [points] [iterations]\n", argv[0]);
+        return -1;
+    }
+
+    SVideoInfo infos[3] = {};
+    int32_t geoTypes[3] = { SVIDEO_EQUIRECT, SVIDEO_CUBEMAP, SVIDEO_VIEWPORT };
+    for (int32_t g = 0; g < 3; g++)
+    {
+        infos[g].geoType = geoTypes[g];
+        infos[g].iFaceWidth = (g == 0) ? 3840 : 960;
+        infos[g].iFaceHeight = (g == 0) ? 2048 : 960;
+        infos[g].iNumFaces = (g == 1) ? 6 : 1;
+        infos[g].viewPort.hFOV = 80;
+        infos[g].viewPort.vFOV = 80;
+        infos[g].viewPort.fYaw = 35;
+        infos[g].viewPort.fPitch = -20;
+    }
+    Geometry* pSrc[2] = { Geometry::create(infos[0]), Geometry::create(infos[1]) };
+    const char* srcName[2] = { "erp", "cubemap" };
+    ViewPort* pViewport = (ViewPort*)Geometry::create(infos[2]);
+    pViewport->setRotMat();
+    pViewport->setInvK();
+
+    std::vector<int32_t> faceBuf(3 * num, 0);
+    std::vector<POSType> posBuf(9 * num, 0);
+    SPosArray in = { &faceBuf[0], &posBuf[0], &posBuf[num], &posBuf[2 * num] };
+    SPosArray pos = { &faceBuf[num], &posBuf[3 * num], &posBuf[4 * num], &posBuf[5 * num] };
+    SPosArray out = { &faceBuf[2 * num], &posBuf[6 * num], &posBuf[7 * num], &posBuf[8 * num] };
+    for (int32_t i = 0; i < num; i++)
+    {
+        in.x[i] = (POSType)(i % 960);
+        in.y[i] = (POSType)((i / 960) % 960);
+    }
+    pViewport->map2DTo3DBatch(in, &pos, num);
+
+    int64_t points = (int64_t)num * iterations;
+    int32_t maxLevel = geoKernelGetLevel();
+    printf("points %d, iterations %d, cpu level %s\n", num, iterations, s_levelName[maxLevel]);
+
+    // per point virtual functions, the reference of the batch kernels
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int32_t it = 0; it < iterations; it++)
+    {
+        for (int32_t i = 0; i < num; i++)
+        {
+            SPos pt(0, in.x[i], in.y[i], 0), res;
+            pViewport->map2DTo3D(pt, &res);
+            out.x[i] = res.x;
+        }
+    }
+    report("viewport", "per-point", points, elapsedSeconds(start));
+    for (int32_t g = 0; g < 2; g++)
+    {
+        start = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; it++)
+        {
+            for (int32_t i = 0; i < num; i++)
+            {
+                SPos pt(0, pos.x[i], pos.y[i], pos.z[i]), res;
+                pSrc[g]->map3DTo2D(&pt, &res);
+                out.x[i] = res.x;
+            }
+        }
+        report(srcName[g], "per-point", points, elapsedSeconds(start));
+    }
+
+    for (int32_t level = GEO_KERNEL_SCALAR; level <= maxLevel; level++)
+    {
+        geoKernelSetLevel(level);
+        start = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; it++)
+            pViewport->map2DTo3DBatch(in, &out, num);
+        report("viewport", s_levelName[level], points, elapsedSeconds(start));
+
+        start = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; it++)
+        {
+            memcpy(out.x, pos.x, num * sizeof(POSType));
+            memcpy(out.y, pos.y, num * sizeof(POSType));
+            memcpy(out.z, pos.z, num * sizeof(POSType));
+            geoBatchRotate3D(&out, num, 10, 20, 30);
+        }
+        report("rotate", s_levelName[level], points, elapsedSeconds(start));
+
+        for (int32_t g = 0; g < 2; g++)
+        {
+            start = std::chrono::steady_clock::now();
+            for (int32_t it = 0; it < iterations; it++)
+                pSrc[g]->map3DTo2DBatch(&pos, &out, num);
+            report(srcName[g], s_levelName[level], points, elapsedSeconds(start));
+        }
+
+        pSrc[0]->setSinglePrecision(true);
+        start = std::chrono::steady_clock::now();
+        for (int32_t it = 0; it < iterations; it++)
+            pSrc[0]->map3DTo2DBatch(&pos, &out, num);
+        report("erp-fast", s_levelName[level], points, elapsedSeconds(start));
+        pSrc[0]->setSinglePrecision(false);
+    }
+    geoKernelSetLevel(GEO_KERNEL_NUM);
+
+    delete pSrc[0];
+    delete pSrc[1];
+    pViewport->geoUnInit();
+    delete pViewport;
+    return 0;
+}
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//! benchmark of the tile merging, it synthesizes 8K tiled frames from the
+//! parameter sets and the first slice of a stream, then merges all the tiles
+//! of each grid frame after frame with tile_merge_Process, and reports the
+//! merged frames per second and the merged bytes per second of each grid,
+//! the tiles are merged by the given number of threads
+//!
+//! with -p, the frames of a high and a low resolution stream are merged
+//! around a viewport by I360SCVP_process, then by a pipeline of the given
+//! queue depth which parses the next frame while one is merged, and the
+//! frames per second of both are reported
+//!
+//! usage: benchMerge [stream] [frames] [frame bytes] [threads]
+//!        benchMerge -p [stream] [low stream] [frames] [queue depth]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include "../360SCVPAPI.h"
+#include "../360SCVPMergeStreamAPI.h"
+#include "../360SCVPHevcParser.h"
+#include "../360SCVPHevcEncHdr.h"
+#include "../360SCVPHevcNalScan.h"
+
+#define FRAME_WIDTH  7680
+#define FRAME_HEIGHT 4096
+#define CTU_SIZE     64
+
+struct TileGrid
+{
+    int32_t cols;
+    int32_t rows;
+};
+
+static const TileGrid s_grids[] = { { 2, 2 }, { 4, 2 }, { 6, 4 }, { 8, 4 }, { 12, 8 } };
+
+static double elapsedSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// parse the nal units until a slice is found, the state keeps the parameter sets and the slice header
+static bool parseFirstSlice(const uint8_t* pStream, uint32_t size, HEVCState* pHevc)
+{
+    hevc_specialInfo specialInfo;
+    uint32_t pos = nalScanFindStartCode(pStream, size) + 3;
+    while (pos < size)
+    {
+        uint32_t end = pos + nalScanFindStartCode(pStream + pos, size - pos);
+        uint32_t next = end + 3;
+        while (end > pos && !pStream[end - 1])
+            end--;
+        memset(&specialInfo, 0, sizeof(hevc_specialInfo));
+        gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)pStream + pos, end - pos, pHevc);
+        if (specialInfo.naluType < 32 && specialInfo.sliceHeaderLen)
+            return true;
+        pos = next;
+    }
+    return false;
+}
+
+// write the parameter sets of the tiled frame and one slice per tile, the
+// slice data is filled with bytes which never need emulation prevention
+static void synthesizeFrame(HEVCState* pHevc, const TileGrid& grid, uint32_t frameBytes,
+    std::vector<uint8_t>& header, std::vector<std::vector<uint8_t> >& tiles)
+{
+    HEVC_SPS* sps = &pHevc->sps[pHevc->last_parsed_sps_id];
+    HEVC_PPS* pps = &pHevc->pps[pHevc->last_parsed_pps_id];
+    int32_t widthInCtu = FRAME_WIDTH / CTU_SIZE;
+    int32_t heightInCtu = FRAME_HEIGHT / CTU_SIZE;
+    sps->width = FRAME_WIDTH;
+    sps->height = FRAME_HEIGHT;
+    pps->tiles_enabled_flag = true;
+    pps->uniform_spacing_flag = false;
+    pps->num_tile_columns = grid.cols;
+    pps->num_tile_rows = grid.rows;
+    for (int32_t i = 0; i < grid.cols; i++)
+        pps->column_width[i] = widthInCtu / grid.cols;
+    for (int32_t i = 0; i < grid.rows; i++)
+        pps->row_height[i] = heightInCtu / grid.rows;
+
+    std::vector<uint8_t> buffer(64 * 1024);
+    GTS_BitStream* bs = gts_bs_new((int8_t*)&buffer[0], buffer.size(), GTS_BITSTREAM_WRITE);
+    hevc_write_parameter_sets(bs, pHevc);
+    header.assign(buffer.begin(), buffer.begin() + (size_t)gts_bs_get_position(bs));
+    gts_bs_del(bs);
+
+    uint32_t tileBytes = frameBytes / (grid.cols * grid.rows);
+    tiles.resize(grid.cols * grid.rows);
+    for (int32_t i = 0; i < grid.cols * grid.rows; i++)
+    {
+        int32_t x = i % grid.cols;
+        int32_t y = i / grid.cols;
+        pHevc->s_info.first_slice_segment_in_pic_flag = (i == 0);
+        pHevc->s_info.slice_segment_address = y * (heightInCtu / grid.rows) * widthInCtu + x * (widthInCtu / grid.cols);
+        bs = gts_bs_new((int8_t*)&buffer[0], buffer.size(), GTS_BITSTREAM_WRITE);
+        hevc_write_slice_header(bs, pHevc);
+        tiles[i].assign(buffer.begin(), buffer.begin() + (size_t)gts_bs_get_position(bs));
+        gts_bs_del(bs);
+        for (uint32_t j = 0; j < tileBytes; j++)
+            tiles[i].push_back((uint8_t)(1 + rand() % 255));
+    }
+}
+
+// the frames of the pipeline, a frame reuses the buffers of the frame queueDepth before once it is done
+struct PipelineBench
+{
+    std::mutex              mutex;
+    std::condition_variable doneCond;
+    int32_t                 doneFrames;
+    int32_t                 failedFrames;
+    int64_t                 mergedBytes;
+};
+
+static void onFrameDone(void* pUserData, param_360SCVP* pParam360SCVP, int32_t ret)
+{
+    PipelineBench* pBench = (PipelineBench*)pUserData;
+    std::lock_guard<std::mutex> lock(pBench->mutex);
+    pBench->doneFrames++;
+    pBench->failedFrames += (ret != 0);
+    pBench->mergedBytes += pParam360SCVP->outputBitstreamLen;
+    pBench->doneCond.notify_one();
+}
+
+// the parsing puts the headers before the input, so each frame is parsed from a new copy of the stream
+static void copyInput(std::vector<uint8_t>& dst, const std::vector<uint8_t>& src)
+{
+    memcpy(&dst[0], &src[0], src.size());
+}
+
+static bool readStream(const char* name, std::vector<uint8_t>& stream, int32_t* pWidth, int32_t* pHeight)
+{
+    GTS_BitStream* pFile = gts_bs_from_file_mapped(name, true);
+    if (!pFile)
+        return false;
+    HEVCState* pHevc = new HEVCState;
+    memset(pHevc, 0, sizeof(HEVCState));
+    bool bParsed = parseFirstSlice((uint8_t*)pFile->original, (uint32_t)pFile->size, pHevc);
+    stream.assign((uint8_t*)pFile->original, (uint8_t*)pFile->original + pFile->size);
+    *pWidth = pHevc->sps[pHevc->last_parsed_sps_id].width;
+    *pHeight = pHevc->sps[pHevc->last_parsed_sps_id].height;
+    gts_bs_del(pFile);
+    delete pHevc;
+    return bParsed;
+}
+
+static int32_t benchPipeline(int argc, char** argv)
+{
+    const char* streamName = argc > 2 ? argv[2] : "../test/test.265";
+    const char* lowStreamName = argc > 3 ? argv[3] : "../test/test_low.265";
+    int32_t frames = argc > 4 ? atoi(argv[4]) : 200;
+    int32_t queueDepth = argc > 5 ? atoi(argv[5]) : 2;
+    std::vector<uint8_t> stream, lowStream;
+    int32_t width = 0, height = 0, lowWidth = 0, lowHeight = 0;
+    if (frames <= 0 || queueDepth <= 0 || !readStream(streamName, stream, &width, &height)
+        || !readStream(lowStreamName, lowStream, &lowWidth, &lowHeight))
+    {
+        printf("usage: %s -p [stream] [low stream] [frames] [queue depth]\n", argv[0]);
+        return -1;
+    }
+
+    // the buffers of the frames in flight, the input has room for the headers put before it
+    std::vector<std::vector<uint8_t> > input(queueDepth), lowInput(queueDepth), output(queueDepth), sei(queueDepth);
+    std::vector<param_360SCVP> params(queueDepth);
+    for (int32_t i = 0; i < queueDepth; i++)
+    {
+        input[i].resize(stream.size() + 4096);
+        lowInput[i].resize(lowStream.size() + 4096);
+        output[i].resize(stream.size() + lowStream.size() + 4096);
+        sei[i].resize(2000);
+        copyInput(input[i], stream);
+        copyInput(lowInput[i], lowStream);
+
+        param_360SCVP* pParam = &params[i];
+        memset(pParam, 0, sizeof(param_360SCVP));
+        pParam->usedType = E_MERGE_AND_VIEWPORT;
+        pParam->pInputBitstream = &input[i][0];
+        pParam->inputBitstreamLen = (uint32_t)stream.size();
+        pParam->pInputLowBitstream = &lowInput[i][0];
+        pParam->inputLowBistreamLen = (uint32_t)lowStream.size();
+        pParam->frameWidth = width;
+        pParam->frameHeight = height;
+        pParam->frameWidthLow = lowWidth;
+        pParam->frameHeightLow = lowHeight;
+        pParam->pOutputBitstream = &output[i][0];
+        pParam->pOutputSEI = &sei[i][0];
+        pParam->paramViewPort.faceWidth = width;
+        pParam->paramViewPort.faceHeight = height;
+        pParam->paramViewPort.geoTypeInput = E_SVIDEO_EQUIRECT;
+        pParam->paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+        pParam->paramViewPort.viewportWidth = 960;
+        pParam->paramViewPort.viewportHeight = 960;
+        pParam->paramViewPort.viewPortFOVH = 80;
+        pParam->paramViewPort.viewPortFOVV = 80;
+    }
+
+    printf("mode, queue depth, frames, failed, merged bytes, frames/s\n");
+
+    // one frame after the other on the calling thread
+    void* pI360SCVP = I360SCVP_Init(&params[0]);
+    if (!pI360SCVP)
+    {
+        printf("init failed\n");
+        return -1;
+    }
+    int32_t failedFrames = 0;
+    int64_t mergedBytes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int32_t f = 0; f < frames; f++)
+    {
+        copyInput(input[0], stream);
+        copyInput(lowInput[0], lowStream);
+        failedFrames += (I360SCVP_process(&params[0], pI360SCVP) != 0);
+        mergedBytes += params[0].outputBitstreamLen;
+    }
+    double seconds = elapsedSeconds(start);
+    printf("process, 1, %d, %d, %lld, %.1f\n", frames, failedFrames, (long long)mergedBytes, frames / seconds);
+    I360SCVP_unInit(pI360SCVP);
+
+    // the frames given to the pipeline, the frame f waits until the frame f - queueDepth is done
+    copyInput(input[0], stream);
+    copyInput(lowInput[0], lowStream);
+    pI360SCVP = I360SCVP_Init(&params[0]);
+    PipelineBench bench;
+    bench.doneFrames = 0;
+    bench.failedFrames = 0;
+    bench.mergedBytes = 0;
+    void* pPipeline = pI360SCVP ? I360SCVP_PipelineInit(pI360SCVP, &params[0], queueDepth, onFrameDone, &bench) : NULL;
+    if (!pPipeline)
+    {
+        printf("pipeline init failed\n");
+        I360SCVP_unInit(pI360SCVP);
+        return -1;
+    }
+    start = std::chrono::steady_clock::now();
+    for (int32_t f = 0; f < frames; f++)
+    {
+        int32_t i = f % queueDepth;
+        {
+            std::unique_lock<std::mutex> lock(bench.mutex);
+            while (bench.doneFrames < f - queueDepth + 1)
+                bench.doneCond.wait(lock);
+        }
+        copyInput(input[i], stream);
+        copyInput(lowInput[i], lowStream);
+        if (I360SCVP_processAsync(pPipeline, &params[i]))
+        {
+            std::lock_guard<std::mutex> lock(bench.mutex);
+            bench.doneFrames++;
+            bench.failedFrames++;
+        }
+    }
+    I360SCVP_PipelineFlush(pPipeline);
+    seconds = elapsedSeconds(start);
+    printf("pipeline, %d, %d, %d, %lld, %.1f\n", queueDepth, frames, bench.failedFrames, (long long)bench.mergedBytes, frames / seconds);
+    I360SCVP_PipelineUnInit(pPipeline);
+    I360SCVP_unInit(pI360SCVP);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && !strcmp(argv[1], "-p"))
+        return benchPipeline(argc, argv);
+
+    const char* streamName = argc > 1 ? argv[1] : "../test/test.265";
+    int32_t frames = argc > 2 ? atoi(argv[2]) : 2000;
+    uint32_t frameBytes = argc > 3 ? (uint32_t)atoi(argv[3]) : 200000;
+    int32_t threadNum = argc > 4 ? atoi(argv[4]) : 1;
+    GTS_BitStream* pFile = gts_bs_from_file_mapped(streamName, true);
+    HEVCState* pHevc = new HEVCState;
+    memset(pHevc, 0, sizeof(HEVCState));
+    if (!pFile || frames <= 0 || threadNum <= 0 || !parseFirstSlice((uint8_t*)pFile->original, (uint32_t)pFile->size, pHevc))
+    {
+        printf("usage: %s [stream] [frames] [frame bytes] [threads]\n", argv[0]);
+        gts_bs_del(pFile);
+        delete pHevc;
+        return -1;
+    }
+    gts_bs_del(pFile);
+    srand(1);
+
+    printf("grid, tiles, threads, frame bytes, merged bytes, frames/s, MB/s\n");
+    for (uint32_t g = 0; g < sizeof(s_grids) / sizeof(s_grids[0]); g++)
+    {
+        const TileGrid& grid = s_grids[g];
+        int32_t tileNum = grid.cols * grid.rows;
+        std::vector<uint8_t> header;
+        std::vector<std::vector<uint8_t> > tiles;
+        synthesizeFrame(pHevc, grid, frameBytes, header, tiles);
+
+        // all the tiles of the high resolution stream are merged in order, no low resolution tile
+        std::vector<param_oneStream_info> tileInfo(tileNum);
+        std::vector<param_oneStream_info*> pTileInfo(tileNum);
+        param_oneStream_info headerInfo, lowHeaderInfo;
+        memset(&tileInfo[0], 0, tileNum * sizeof(param_oneStream_info));
+        memset(&headerInfo, 0, sizeof(param_oneStream_info));
+        memset(&lowHeaderInfo, 0, sizeof(param_oneStream_info));
+        headerInfo.pTiledBitstreamBuffer = &header[0];
+        headerInfo.inputBufferLen = (uint32_t)header.size();
+        for (int32_t i = 0; i < tileNum; i++)
+        {
+            tileInfo[i].pTiledBitstreamBuffer = &tiles[i][0];
+            tileInfo[i].inputBufferLen = (uint32_t)tiles[i].size();
+            pTileInfo[i] = &tileInfo[i];
+        }
+
+        param_mergeStream param;
+        memset(&param, 0, sizeof(param_mergeStream));
+        param.highRes.width = FRAME_WIDTH;
+        param.highRes.height = FRAME_HEIGHT;
+        param.highRes.totalTilesCount = tileNum;
+        param.highRes.selectedTilesCount = tileNum;
+        param.highRes.pTiledBitstreams = &pTileInfo[0];
+        param.highRes.pHeader = &headerInfo;
+        param.highRes.tile_width = FRAME_WIDTH / grid.cols;
+        param.highRes.tile_height = FRAME_HEIGHT / grid.rows;
+        param.highRes.num_tile_columns = grid.cols;
+        param.highRes.num_tile_rows = grid.rows;
+        param.highRes.bOrdered = true;
+        param.lowRes.pHeader = &lowHeaderInfo;
+        param.lowRes.tile_width = param.highRes.tile_width;
+        param.lowRes.tile_height = param.highRes.tile_height;
+        param.bWroteHeader = true;
+
+        void* handle = tile_merge_Init(&param);
+        uint32_t outputSize = 0;
+        if (!handle || tile_merge_SetThreads(handle, threadNum) || tile_merge_GetOutputSize(&param, handle, &outputSize) || !outputSize)
+        {
+            printf("%dx%d merge init failed\n", grid.cols, grid.rows);
+            tile_merge_Close(handle);
+            continue;
+        }
+        // the merged size is exact, so the output buffer is no larger than it
+        std::vector<uint8_t> output(outputSize);
+        param.pOutputBitstream = &output[0];
+        param.outputBitstreamSize = outputSize;
+
+        int64_t mergedBytes = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int32_t f = 0; f < frames; f++)
+        {
+            tile_merge_reset(handle);
+            if (tile_merge_Process(&param, handle))
+                break;
+            mergedBytes += param.outputiledbistreamlen;
+        }
+        double seconds = elapsedSeconds(start);
+        if (param.outputiledbistreamlen != outputSize)
+            printf("%dx%d merged %d bytes, %d expected\n", grid.cols, grid.rows, param.outputiledbistreamlen, outputSize);
+        printf("%dx%d, %d, %d, %d, %d, %.1f, %.1f\n", grid.cols, grid.rows, tileNum, threadNum, frameBytes, outputSize,
+            frames / seconds, mergedBytes / seconds / 1e6);
+        tile_merge_Close(handle);
+    }
+
+    delete pHevc;
+    return 0;
+}
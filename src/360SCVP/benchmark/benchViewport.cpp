@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2019, Intel Corporation
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//! benchmark of the viewport selection, it replays yaw/pitch trajectories
+//! through I360SCVP_setViewPort, genViewport_process and
+//! genViewport_getContentCoverage for erp and cubemap sources at several tile
+//! grids and FOVs, and reports the p50/p99 latency per call and the calls per
+//! second of each case as csv lines
+//!
+//! usage: benchViewport [-n poses] [-m full|boundary] [-p double|fast] [-t trajectory] [-o output.csv]
+//!
+//! the trajectory file is a recorded head motion, one "yaw pitch" (or
+//! "yaw,pitch") pair in degree per line, the lines starting with '#' are
+//! skipped. The library prints logs at init, so -o is recommended to keep the
+//! csv clean
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include "../360SCVPAPI.h"
+#include "../360SCVPViewportAPI.h"
+
+struct Trajectory
+{
+    std::string name;
+    std::vector<ViewportPose> poses;
+};
+
+struct SourceCase
+{
+    const char *name;
+    EGeometryType geoType;
+    int32_t width;
+    int32_t height;
+    int32_t tileRow;
+    int32_t tileCol;
+};
+
+static const SourceCase s_sources[] =
+{
+    { "erp",     E_SVIDEO_EQUIRECT, 3840, 2048, 4, 8 },
+    { "erp",     E_SVIDEO_EQUIRECT, 3840, 2048, 8, 16 },
+    { "cubemap", E_SVIDEO_CUBEMAP,  960,  960,  2, 2 },
+    { "cubemap", E_SVIDEO_CUBEMAP,  960,  960,  4, 4 },
+};
+
+static const float s_fovs[] = { 80, 100 };
+
+static float wrapYaw(float yaw)
+{
+    while (yaw >= 180)
+        yaw -= 360;
+    while (yaw < -180)
+        yaw += 360;
+    return yaw;
+}
+
+static float clampPitch(float pitch)
+{
+    return pitch > 90 ? 90 : (pitch < -90 ? -90 : pitch);
+}
+
+// a steady pan with a slow nod
+static void genSweep(Trajectory *pTraj, int32_t num)
+{
+    pTraj->name = "sweep";
+    for (int32_t i = 0; i < num; i++)
+    {
+        ViewportPose pose = { wrapYaw(-180 + 2.0f * i), (float)(30 * sin(i * 0.05)) };
+        pTraj->poses.push_back(pose);
+    }
+}
+
+// small random steps, the usual head motion between two frames
+static void genRandomWalk(Trajectory *pTraj, int32_t num, uint32_t seed)
+{
+    pTraj->name = "randomwalk";
+    float yaw = 0, pitch = 0;
+    srand(seed);
+    for (int32_t i = 0; i < num; i++)
+    {
+        yaw = wrapYaw(yaw + (rand() % 1001 - 500) / 100.0f);
+        pitch = clampPitch(pitch + (rand() % 1001 - 500) / 200.0f);
+        ViewportPose pose = { yaw, pitch };
+        pTraj->poses.push_back(pose);
+    }
+}
+
+// random jumps over the whole sphere, no coherence between the calls
+static void genSaccade(Trajectory *pTraj, int32_t num, uint32_t seed)
+{
+    pTraj->name = "saccade";
+    srand(seed);
+    for (int32_t i = 0; i < num; i++)
+    {
+        ViewportPose pose = { (float)(rand() % 3600) / 10 - 180, (float)(rand() % 1800) / 10 - 90 };
+        pTraj->poses.push_back(pose);
+    }
+}
+
+static int32_t loadTrajectory(Trajectory *pTraj, const char *path)
+{
+    FILE *pFile = fopen(path, "r");
+    if (!pFile)
+        return -1;
+    const char *pName = strrchr(path, '/');
+    pTraj->name = std::string("file:") + (pName ? pName + 1 : path);
+    char line[256];
+    while (fgets(line, sizeof(line), pFile))
+    {
+        ViewportPose pose;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%f%*[ ,\t]%f", &pose.yaw, &pose.pitch) == 2)
+        {
+            pose.yaw = wrapYaw(pose.yaw);
+            pose.pitch = clampPitch(pose.pitch);
+            pTraj->poses.push_back(pose);
+        }
+    }
+    fclose(pFile);
+    return pTraj->poses.empty() ? -1 : 0;
+}
+
+static double elapsedMicroseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(FILE *pOut, const char *api, const SourceCase &src, float fov, const Trajectory &traj,
+                   const char *mode, std::vector<double> &latency)
+{
+    if (latency.empty())
+        return;
+    double total = 0;
+    for (size_t i = 0; i < latency.size(); i++)
+        total += latency[i];
+    std::sort(latency.begin(), latency.end());
+    double p50 = latency[(latency.size() - 1) * 50 / 100];
+    double p99 = latency[(latency.size() - 1) * 99 / 100];
+    fprintf(pOut, "%s,%s,%dx%d,%.0f,%s,%s,%d,%.3f,%.3f,%.1f\n", api, src.name, src.tileRow, src.tileCol, fov,
+            traj.name.c_str(), mode, (int32_t)latency.size(), p50, p99, latency.size() / (total / 1e6));
+    fflush(pOut);
+}
+
+static void initViewportParam(Param_ViewPortInfo *pInfo, const SourceCase &src, float fov, EViewportMappingMode mode,
+                              EViewportPrecision precision)
+{
+    memset(pInfo, 0, sizeof(Param_ViewPortInfo));
+    pInfo->viewportWidth = 1024;
+    pInfo->viewportHeight = 1024;
+    pInfo->viewPortFOVH = fov;
+    pInfo->viewPortFOVV = fov;
+    pInfo->geoTypeOutput = E_SVIDEO_VIEWPORT;
+    pInfo->geoTypeInput = src.geoType;
+    pInfo->faceWidth = src.width;
+    pInfo->faceHeight = src.height;
+    pInfo->tileNumRow = src.tileRow;
+    pInfo->tileNumCol = src.tileCol;
+    pInfo->mappingMode = mode;
+    pInfo->precision = precision;
+}
+
+int main(int argc, char** argv)
+{
+    int32_t poseNum = 200;
+    EViewportMappingMode mode = E_VIEWPORT_MAPPING_BOUNDARY;
+    EViewportPrecision precision = E_VIEWPORT_PRECISION_DOUBLE;
+    const char *pTrajFile = NULL;
+    const char *pOutFile = NULL;
+    for (int32_t i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            poseNum = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            mode = strcmp(argv[++i], "full") ? E_VIEWPORT_MAPPING_BOUNDARY : E_VIEWPORT_MAPPING_FULL;
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            precision = strcmp(argv[++i], "fast") ? E_VIEWPORT_PRECISION_DOUBLE : E_VIEWPORT_PRECISION_FAST;
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            pTrajFile = argv[++i];
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            pOutFile = argv[++i];
+        else
+            poseNum = 0;
+    }
+    if (poseNum <= 0)
+    {
+        printf("usage: %s [-n poses] [-m full|boundary] [-p double|fast] [-t trajectory] [-o output.csv]\n", argv[0]);
+        return -1;
+    }
+
+    std::vector<Trajectory> trajs(3);
+    genSweep(&trajs[0], poseNum);
+    genRandomWalk(&trajs[1], poseNum, 1);
+    genSaccade(&trajs[2], poseNum, 2);
+    if (pTrajFile)
+    {
+        Trajectory traj;
+        if (loadTrajectory(&traj, pTrajFile) < 0)
+        {
+            printf("can not load the trajectory %s\n", pTrajFile);
+            return -1;
+        }
+        trajs.push_back(traj);
+    }
+
+    FILE *pOut = pOutFile ? fopen(pOutFile, "w") : stdout;
+    if (!pOut)
+    {
+        printf("can not open %s\n", pOutFile);
+        return -1;
+    }
+    char modeName[32];
+    snprintf(modeName, sizeof(modeName), "%s-%s", mode == E_VIEWPORT_MAPPING_FULL ? "full" : "boundary",
+             precision == E_VIEWPORT_PRECISION_FAST ? "fast" : "double");
+    fprintf(pOut, "api,source,grid,fov,trajectory,mode,calls,p50_us,p99_us,calls_per_s\n");
+
+    point upLeft[6], downRight[6];
+    std::vector<double> latency;
+    for (size_t s = 0; s < sizeof(s_sources) / sizeof(s_sources[0]); s++)
+    {
+        const SourceCase &src = s_sources[s];
+        for (size_t f = 0; f < sizeof(s_fovs) / sizeof(s_fovs[0]); f++)
+        {
+            Param_ViewPortInfo info;
+            initViewportParam(&info, src, s_fovs[f], mode, precision);
+
+            // the whole selection of the library: the pose, the mapping and the tile list
+            param_360SCVP param;
+            memset(&param, 0, sizeof(param_360SCVP));
+            param.usedType = E_PARSER_FOR_CLIENT;
+            void* p360SCVP = I360SCVP_Init(&param);
+            if (!p360SCVP || I360SCVP_SetParameter(p360SCVP, ID_SCVP_PARAM_VIEWPORT, &info) < 0)
+            {
+                printf("I360SCVP init fails for %s %dx%d\n", src.name, src.tileRow, src.tileCol);
+                return -1;
+            }
+
+            generateViewPortParam paramViewport;
+            memset(&paramViewport, 0, sizeof(generateViewPortParam));
+            paramViewport.m_iViewportWidth = info.viewportWidth;
+            paramViewport.m_iViewportHeight = info.viewportHeight;
+            paramViewport.m_viewPort_hFOV = info.viewPortFOVH;
+            paramViewport.m_viewPort_vFOV = info.viewPortFOVV;
+            paramViewport.m_output_geoType = info.geoTypeOutput;
+            paramViewport.m_input_geoType = info.geoTypeInput;
+            paramViewport.m_iInputWidth = info.faceWidth;
+            paramViewport.m_iInputHeight = info.faceHeight;
+            paramViewport.m_tileNumRow = info.tileNumRow;
+            paramViewport.m_tileNumCol = info.tileNumCol;
+            paramViewport.m_pUpLeft = upLeft;
+            paramViewport.m_pDownRight = downRight;
+            paramViewport.m_mappingMode = mode;
+            paramViewport.m_precision = precision;
+            void* pViewport = genViewport_Init(&paramViewport);
+            if (!pViewport)
+            {
+                printf("genViewport init fails for %s %dx%d\n", src.name, src.tileRow, src.tileCol);
+                return -1;
+            }
+
+            for (size_t t = 0; t < trajs.size(); t++)
+            {
+                const std::vector<ViewportPose> &poses = trajs[t].poses;
+
+                latency.clear();
+                for (size_t k = 0; k < poses.size(); k++)
+                {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    I360SCVP_setViewPort(p360SCVP, poses[k].yaw, poses[k].pitch);
+                    latency.push_back(elapsedMicroseconds(start));
+                }
+                report(pOut, "I360SCVP_setViewPort", src, s_fovs[f], trajs[t], modeName, latency);
+
+                latency.clear();
+                for (size_t k = 0; k < poses.size(); k++)
+                {
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    genViewport_setViewPort(pViewport, poses[k].yaw, poses[k].pitch);
+                    genViewport_process(&paramViewport, pViewport);
+                    latency.push_back(elapsedMicroseconds(start));
+                }
+                report(pOut, "genViewport_process", src, s_fovs[f], trajs[t], modeName, latency);
+
+                latency.clear();
+                for (size_t k = 0; k < poses.size(); k++)
+                {
+                    CCDef cc;
+                    genViewport_setViewPort(pViewport, poses[k].yaw, poses[k].pitch);
+                    genViewport_process(&paramViewport, pViewport);
+                    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    genViewport_getContentCoverage(pViewport, &cc);
+                    latency.push_back(elapsedMicroseconds(start));
+                }
+                report(pOut, "genViewport_getContentCoverage", src, s_fovs[f], trajs[t], modeName, latency);
+            }
+
+            genViewport_unInit(pViewport);
+            I360SCVP_unInit(p360SCVP);
+        }
+    }
+
+    if (pOut != stdout)
+        fclose(pOut);
+    return 0;
+}
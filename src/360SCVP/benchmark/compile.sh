@@ -0,0 +1,12 @@
+#!/bin/bash -e
+
+LD_FLAGS="-I/usr/local/include/ -l360SCVP -lstdc++ -lpthread -lm -L/usr/local/lib"
+for bench in benchGeometry benchViewport benchBitstream benchMerge; do
+    g++ -std=c++11 -O2 -g -c ${bench}.cpp -D_GLIBCXX_USE_CXX11_ABI=0
+    g++ -L/usr/local/lib ${bench}.o -o ${bench} ${LD_FLAGS}
+done
+./benchGeometry
+./benchViewport -o benchViewport.csv
+./benchBitstream
+./benchMerge
+./benchMerge -p
@@ -28,6 +28,38 @@
 #include <string>
 #include <fstream>
 #include "../360SCVPAPI.h"
+#include "../360SCVPViewportAPI.h"
+#include "../360SCVPViewPort.h"
+#include "../360SCVPViewportImpl.h"
+#include "../360SCVPGeometryBatch.h"
+#include "../360SCVPBitstream.h"
+#include "../360SCVPHevcParser.h"
+#include "../360SCVPHevcEncHdr.h"
+#include "../360SCVPHevcNalScan.h"
+#include "../360SCVPMergeStreamAPI.h"
+#include "../360SCVPHevcTileMerge.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+//count the heap allocations of the whole process, used to check the steady-state paths
+static std::atomic<int64_t> g_allocCount(0);
+
+void* operator new(size_t size)
+{
+    g_allocCount++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
 
 namespace{
 class I360SCVPTest : public testing::Test {
@@ -416,6 +448,14 @@ TEST_F(I360SCVPTest, SetParameter_SetViewport)
     paramViewPorInfo.viewPortFOVV = 80;
     paramViewPorInfo.tileNumCol = 6;
     paramViewPorInfo.tileNumRow = 3;
+    // an unknown mapping mode or precision is rejected
+    paramViewPorInfo.mappingMode = EViewportMappingMode(E_VIEWPORT_MAPPING_BOUNDARY + 1);
+    paramViewPorInfo.precision = E_VIEWPORT_PRECISION_DOUBLE;
+    EXPECT_TRUE(I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo) != 0);
+    paramViewPorInfo.mappingMode = E_VIEWPORT_MAPPING_FULL;
+    paramViewPorInfo.precision = EViewportPrecision(E_VIEWPORT_PRECISION_VALIDATE + 1);
+    EXPECT_TRUE(I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo) != 0);
+    paramViewPorInfo.precision = E_VIEWPORT_PRECISION_DOUBLE;
     ret = I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo);
     I360SCVP_unInit(pI360SCVP);
     EXPECT_TRUE(ret ==0);
@@ -547,6 +587,8 @@ TEST_F(I360SCVPTest, SetViewportSEI)
     paramViewPorInfo.viewPortFOVV = 80;
     paramViewPorInfo.tileNumCol = 6;
     paramViewPorInfo.tileNumRow = 3;
+    paramViewPorInfo.mappingMode = E_VIEWPORT_MAPPING_FULL;
+    paramViewPorInfo.precision = E_VIEWPORT_PRECISION_DOUBLE;
     ret = I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo);    EXPECT_TRUE(ret == 0);
     if (ret)
     {
@@ -653,6 +695,8 @@ TEST_F(I360SCVPTest, SetRWPKSEI)
     paramViewPorInfo.viewPortFOVV = 80;
     paramViewPorInfo.tileNumCol = 6;
     paramViewPorInfo.tileNumRow = 3;
+    paramViewPorInfo.mappingMode = E_VIEWPORT_MAPPING_FULL;
+    paramViewPorInfo.precision = E_VIEWPORT_PRECISION_DOUBLE;
     ret = I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo);    
     EXPECT_TRUE(ret == 0);
     if (ret)
@@ -740,6 +784,8 @@ TEST_F(I360SCVPTest, SetRotationSEI)
     paramViewPorInfo.viewPortFOVV = 80;
     paramViewPorInfo.tileNumCol = 6;
     paramViewPorInfo.tileNumRow = 3;
+    paramViewPorInfo.mappingMode = E_VIEWPORT_MAPPING_FULL;
+    paramViewPorInfo.precision = E_VIEWPORT_PRECISION_DOUBLE;
     ret = I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo);
     EXPECT_TRUE(ret == 0);
     if (ret)
@@ -827,6 +873,8 @@ TEST_F(I360SCVPTest, SetFramePackingSEI)
     paramViewPorInfo.viewPortFOVV = 80;
     paramViewPorInfo.tileNumCol = 6;
     paramViewPorInfo.tileNumRow = 3;
+    paramViewPorInfo.mappingMode = E_VIEWPORT_MAPPING_FULL;
+    paramViewPorInfo.precision = E_VIEWPORT_PRECISION_DOUBLE;
     ret = I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo);
     EXPECT_TRUE(ret == 0);
     if (ret)
@@ -1004,4 +1052,2121 @@ TEST_F(I360SCVPTest, parseRWPK)
     EXPECT_TRUE(ret == 0);
 }
 
+TEST_F(I360SCVPTest, ViewportLUT)
+{
+    int ret = 0;
+    point upLeft[6], downRight[6];
+    generateViewPortParam paramViewport;
+    memset(&paramViewport, 0, sizeof(generateViewPortParam));
+    paramViewport.m_iViewportWidth = 960;
+    paramViewport.m_iViewportHeight = 960;
+    paramViewport.m_viewPort_hFOV = 80;
+    paramViewport.m_viewPort_vFOV = 80;
+    paramViewport.m_output_geoType = E_SVIDEO_VIEWPORT;
+    paramViewport.m_input_geoType = E_SVIDEO_EQUIRECT;
+    paramViewport.m_iInputWidth = frameWidth;
+    paramViewport.m_iInputHeight = frameHeight;
+    paramViewport.m_tileNumRow = 4;
+    paramViewport.m_tileNumCol = 8;
+    paramViewport.m_pUpLeft = upLeft;
+    paramViewport.m_pDownRight = downRight;
+    void* pGeometry = genViewport_Init(&paramViewport);
+
+    paramViewport.m_lutYawStep = 45;
+    paramViewport.m_lutPitchStep = 45;
+    void* pLUT = genViewport_Init(&paramViewport);
+    EXPECT_TRUE(pGeometry != NULL);
+    EXPECT_TRUE(pLUT != NULL);
+    if (!pGeometry || !pLUT)
+    {
+        genViewport_unInit(pGeometry);
+        genViewport_unInit(pLUT);
+        return;
+    }
+
+    uint32_t size = 0;
+    ret = genViewport_saveLUT(pLUT, NULL, &size);
+    EXPECT_TRUE(ret == 0 && size > 0);
+    uint8_t* pLUTBuffer = new uint8_t[size];
+    ret |= genViewport_saveLUT(pLUT, pLUTBuffer, &size);
+
+    paramViewport.m_lutYawStep = 0;
+    paramViewport.m_lutPitchStep = 0;
+    void* pLoaded = genViewport_Init(&paramViewport);
+    ret |= genViewport_loadLUT(pLoaded, pLUTBuffer, size);
+
+    // the table only fits the grid it is built with
+    paramViewport.m_tileNumCol = 6;
+    void* pOtherGrid = genViewport_Init(&paramViewport);
+    EXPECT_TRUE(genViewport_loadLUT(pOtherGrid, pLUTBuffer, size) != 0);
+    genViewport_unInit(pOtherGrid);
+    EXPECT_TRUE(ret == 0);
+
+    // a truncated or corrupt table is rejected
+    paramViewport.m_tileNumCol = 8;
+    void* pCorrupt = genViewport_Init(&paramViewport);
+    std::vector<uint8_t> corrupt(pLUTBuffer, pLUTBuffer + size);
+    EXPECT_TRUE(genViewport_loadLUT(pCorrupt, &corrupt[0], size - 1) != 0);
+    EXPECT_TRUE(genViewport_loadLUT(pCorrupt, &corrupt[0], sizeof(ILUTHeader)) != 0);
+    ILUTHeader header;
+    memcpy(&header, pLUTBuffer, sizeof(ILUTHeader));
+    // the entry number wraps in 32 bits
+    header.yawNum = 65537;
+    header.pitchNum = 65535;
+    memcpy(&corrupt[0], &header, sizeof(ILUTHeader));
+    EXPECT_TRUE(genViewport_loadLUT(pCorrupt, &corrupt[0], size) != 0);
+    header.yawNum = 0x7fffffff;
+    header.pitchNum = 0x7fffffff;
+    memcpy(&corrupt[0], &header, sizeof(ILUTHeader));
+    EXPECT_TRUE(genViewport_loadLUT(pCorrupt, &corrupt[0], size) != 0);
+    int32_t badValues[2][2] = { { FACE_NUMBER + 1, 0 }, { 1, -1 } };
+    for (int32_t i = 0; i < 2; i++)
+    {
+        corrupt.assign(pLUTBuffer, pLUTBuffer + size);
+        memcpy(&corrupt[sizeof(ILUTHeader)], badValues[i], sizeof(badValues[i]));
+        EXPECT_TRUE(genViewport_loadLUT(pCorrupt, &corrupt[0], size) != 0);
+    }
+    // the corners of the first entry must be a face of the frame and inside it
+    size_t cornerOffset = sizeof(ILUTHeader) + 2 * sizeof(int32_t);
+    int32_t badFaces[2] = { 1, -2 };
+    for (int32_t i = 0; i < 2; i++)
+    {
+        corrupt.assign(pLUTBuffer, pLUTBuffer + size);
+        memcpy(&corrupt[cornerOffset], &badFaces[i], sizeof(int32_t));
+        EXPECT_TRUE(genViewport_loadLUT(pCorrupt, &corrupt[0], size) != 0);
+    }
+    POSType badPositions[4][2] = { { -1, 0 }, { (POSType)frameWidth, 0 }, { 0, (POSType)frameHeight }, { 0, NAN } };
+    for (int32_t i = 0; i < 4; i++)
+    {
+        int32_t faceIdx = 0;
+        corrupt.assign(pLUTBuffer, pLUTBuffer + size);
+        memcpy(&corrupt[cornerOffset], &faceIdx, sizeof(int32_t));
+        memcpy(&corrupt[cornerOffset + sizeof(int32_t)], badPositions[i], sizeof(badPositions[i]));
+        EXPECT_TRUE(genViewport_loadLUT(pCorrupt, &corrupt[0], size) != 0);
+    }
+    // the rejected tables leave the handle on the computed mapping
+    TileDef tilesComputed[1024];
+    TileDef tilesRejected[1024];
+    genViewport_setViewPort(pGeometry, 0, 0);
+    genViewport_process(&paramViewport, pGeometry);
+    genViewport_setViewPort(pCorrupt, 0, 0);
+    EXPECT_EQ(0, genViewport_process(&paramViewport, pCorrupt));
+    int32_t numComputed = genViewport_getViewportTiles(pGeometry, tilesComputed);
+    EXPECT_EQ(numComputed, genViewport_getViewportTiles(pCorrupt, tilesRejected));
+    for (int32_t k = 0; k < numComputed; k++)
+        EXPECT_EQ(tilesComputed[k].idx, tilesRejected[k].idx);
+    corrupt.assign(pLUTBuffer, pLUTBuffer + size);
+    EXPECT_EQ(0, genViewport_loadLUT(pCorrupt, &corrupt[0], size));
+    genViewport_unInit(pCorrupt);
+
+    // the pose is quantized to the table step, so the lookup matches the mapping at the bin centre
+    float poses[][3] = { {0, 0, 0}, {-90, 0, -90}, {100, 10, 90}, {170, -50, 180}, {-22, 80, 0}, {44, -89, 45} };
+    TileDef tilesGeometry[1024];
+    TileDef tilesLUT[1024];
+    for (uint32_t i = 0; i < sizeof(poses) / sizeof(poses[0]); i++)
+    {
+        float pitchCentre = (poses[i][1] > 67.5) ? 90 : (poses[i][1] > 22.5) ? 45 : (poses[i][1] > -22.5) ? 0 : (poses[i][1] > -67.5) ? -45 : -90;
+        genViewport_setViewPort(pGeometry, poses[i][2], pitchCentre);
+        genViewport_process(&paramViewport, pGeometry);
+        int32_t numGeometry = genViewport_getViewportTiles(pGeometry, tilesGeometry);
+
+        void* handles[2] = { pLUT, pLoaded };
+        for (int32_t j = 0; j < 2; j++)
+        {
+            genViewport_setViewPort(handles[j], poses[i][0], poses[i][1]);
+            genViewport_process(&paramViewport, handles[j]);
+            int32_t numLUT = genViewport_getViewportTiles(handles[j], tilesLUT);
+            EXPECT_EQ(numGeometry, numLUT);
+            for (int32_t k = 0; k < numGeometry && k < numLUT; k++)
+                EXPECT_EQ(tilesGeometry[k].idx, tilesLUT[k].idx);
+        }
+    }
+
+    delete[] pLUTBuffer;
+    genViewport_unInit(pGeometry);
+    genViewport_unInit(pLUT);
+    genViewport_unInit(pLoaded);
+}
+
+TEST_F(I360SCVPTest, ViewportBoundarySampling)
+{
+    point upLeft[2][6], downRight[2][6];
+    TileDef tiles[2][1024];
+    int32_t geoTypes[2] = { E_SVIDEO_EQUIRECT, E_SVIDEO_CUBEMAP };
+    for (int32_t g = 0; g < 2; g++)
+    {
+        generateViewPortParam paramViewport[2];
+        void* handles[2];
+        for (int32_t m = 0; m < 2; m++)
+        {
+            memset(&paramViewport[m], 0, sizeof(generateViewPortParam));
+            paramViewport[m].m_iViewportWidth = 960;
+            paramViewport[m].m_iViewportHeight = 960;
+            paramViewport[m].m_viewPort_hFOV = 80;
+            paramViewport[m].m_viewPort_vFOV = 80;
+            paramViewport[m].m_output_geoType = E_SVIDEO_VIEWPORT;
+            paramViewport[m].m_input_geoType = geoTypes[g];
+            paramViewport[m].m_iInputWidth = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameWidth;
+            paramViewport[m].m_iInputHeight = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameHeight;
+            paramViewport[m].m_tileNumRow = 4;
+            paramViewport[m].m_tileNumCol = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 4 : 8;
+            paramViewport[m].m_pUpLeft = upLeft[m];
+            paramViewport[m].m_pDownRight = downRight[m];
+            paramViewport[m].m_mappingMode = (m == 0) ? E_VIEWPORT_MAPPING_FULL : E_VIEWPORT_MAPPING_BOUNDARY;
+            handles[m] = genViewport_Init(&paramViewport[m]);
+            EXPECT_TRUE(handles[m] != NULL);
+        }
+        if (!handles[0] || !handles[1])
+        {
+            genViewport_unInit(handles[0]);
+            genViewport_unInit(handles[1]);
+            return;
+        }
+
+        int32_t tileTotal = ((geoTypes[g] == E_SVIDEO_CUBEMAP) ? 6 : 1) * paramViewport[0].m_tileNumRow * paramViewport[0].m_tileNumCol;
+        for (int32_t pitch = -90; pitch <= 90; pitch += 30)
+        {
+            for (int32_t yaw = -180; yaw < 180; yaw += 30)
+            {
+                int32_t tileNum[2];
+                uint64_t masks[2][2];
+                ViewportPose pose = { (float)yaw, (float)pitch };
+                for (int32_t m = 0; m < 2; m++)
+                {
+                    genViewport_setViewPort(handles[m], yaw, pitch);
+                    EXPECT_TRUE(genViewport_process(&paramViewport[m], handles[m]) == 0);
+                    tileNum[m] = genViewport_getFixedNumTiles(handles[m], tiles[m]);
+                    EXPECT_EQ((tileTotal + 63) / 64, genViewport_getTilesForPoses(handles[m], &pose, 1, masks[m]));
+                }
+
+                // the boundary mode only selects tiles of the full scan, and its extents still reach every erp tile
+                // the viewport is mapped into
+                for (int32_t i = 0; i < tileTotal; i++)
+                {
+                    bool bFull = (masks[0][i >> 6] >> (i & 63)) & 1;
+                    bool bBoundary = (masks[1][i >> 6] >> (i & 63)) & 1;
+                    EXPECT_TRUE(bFull || !bBoundary);
+                }
+                if (geoTypes[g] == E_SVIDEO_EQUIRECT)
+                {
+                    float coverage[32];
+                    int32_t tileWidth = frameWidth / paramViewport[1].m_tileNumCol;
+                    int32_t tileHeight = frameHeight / paramViewport[1].m_tileNumRow;
+                    EXPECT_EQ(tileTotal, genViewport_getTileCoverage(handles[1], coverage));
+                    for (int32_t i = 0; i < tileTotal; i++)
+                    {
+                        if (coverage[i] == 0)
+                            continue;
+                        int32_t x = (i % paramViewport[1].m_tileNumCol) * tileWidth;
+                        int32_t y = (i / paramViewport[1].m_tileNumCol) * tileHeight;
+                        bool bCovered = false;
+                        for (int32_t f = 0; f < paramViewport[1].m_numFaces; f++)
+                        {
+                            bCovered |= upLeft[1][f].x < x + tileWidth && downRight[1][f].x >= x
+                                && upLeft[1][f].y < y + tileHeight && downRight[1][f].y >= y;
+                        }
+                        EXPECT_TRUE(bCovered);
+                    }
+                }
+
+                // the full scan splits the erp seam by rows, which is only exact when the seam is vertical in the viewport,
+                // so the boundary mode can be tighter there
+                if (geoTypes[g] == E_SVIDEO_EQUIRECT && pitch != 0 && abs(pitch) < 60 && abs(yaw) > 90)
+                    continue;
+                EXPECT_EQ(tileNum[0], tileNum[1]);
+                for (int32_t i = 0; i < tileNum[0] && i < tileNum[1]; i++)
+                {
+                    EXPECT_EQ(tiles[0][i].idx, tiles[1][i].idx);
+                    EXPECT_EQ(tiles[0][i].faceId, tiles[1][i].faceId);
+                }
+
+                // the extents only differ by the pixel rounding, except around the erp poles where the full scan also splits the seam
+                if (geoTypes[g] == E_SVIDEO_EQUIRECT && abs(pitch) >= 60)
+                    continue;
+                EXPECT_EQ(paramViewport[0].m_numFaces, paramViewport[1].m_numFaces);
+                for (int32_t i = 0; i < paramViewport[0].m_numFaces && i < paramViewport[1].m_numFaces; i++)
+                {
+                    EXPECT_EQ(upLeft[0][i].faceId, upLeft[1][i].faceId);
+                    EXPECT_LE(abs(upLeft[0][i].x - upLeft[1][i].x), 1);
+                    EXPECT_LE(abs(upLeft[0][i].y - upLeft[1][i].y), 1);
+                    EXPECT_LE(abs(downRight[0][i].x - downRight[1][i].x), 1);
+                    EXPECT_LE(abs(downRight[0][i].y - downRight[1][i].y), 1);
+                }
+            }
+        }
+        genViewport_unInit(handles[0]);
+        genViewport_unInit(handles[1]);
+    }
+}
+
+TEST_F(I360SCVPTest, ViewportMappingThreads)
+{
+    point upLeft[2][6], downRight[2][6];
+    TileDef tiles[2][1024];
+    memset(tiles, 0, sizeof(tiles));
+    int32_t geoTypes[2] = { E_SVIDEO_EQUIRECT, E_SVIDEO_CUBEMAP };
+    int32_t threadNums[2] = { 1, 4 };
+    for (int32_t g = 0; g < 2; g++)
+    {
+        generateViewPortParam paramViewport[2];
+        void* handles[2];
+        for (int32_t m = 0; m < 2; m++)
+        {
+            memset(&paramViewport[m], 0, sizeof(generateViewPortParam));
+            paramViewport[m].m_iViewportWidth = 960;
+            paramViewport[m].m_iViewportHeight = 960;
+            paramViewport[m].m_viewPort_hFOV = 80;
+            paramViewport[m].m_viewPort_vFOV = 80;
+            paramViewport[m].m_output_geoType = E_SVIDEO_VIEWPORT;
+            paramViewport[m].m_input_geoType = geoTypes[g];
+            paramViewport[m].m_iInputWidth = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameWidth;
+            paramViewport[m].m_iInputHeight = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameHeight;
+            paramViewport[m].m_tileNumRow = 4;
+            paramViewport[m].m_tileNumCol = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 4 : 8;
+            paramViewport[m].m_pUpLeft = upLeft[m];
+            paramViewport[m].m_pDownRight = downRight[m];
+            handles[m] = genViewport_Init(&paramViewport[m]);
+            EXPECT_TRUE(handles[m] != NULL);
+            EXPECT_TRUE(genViewport_setMappingThreads(handles[m], threadNums[m]) == 0);
+        }
+        if (!handles[0] || !handles[1])
+        {
+            genViewport_unInit(handles[0]);
+            genViewport_unInit(handles[1]);
+            return;
+        }
+        EXPECT_TRUE(genViewport_setMappingThreads(handles[1], 0) != 0);
+
+        // the tilted erp seams are included, the result must be the same as one thread anyway
+        for (int32_t pitch = -90; pitch <= 90; pitch += 45)
+        {
+            for (int32_t yaw = -180; yaw < 180; yaw += 45)
+            {
+                int32_t tileNum[2];
+                for (int32_t m = 0; m < 2; m++)
+                {
+                    genViewport_setViewPort(handles[m], yaw, pitch);
+                    EXPECT_TRUE(genViewport_process(&paramViewport[m], handles[m]) == 0);
+                    for (int32_t i = 0; i < 1024; i++)
+                        tiles[m][i].idx = -1;
+                    tileNum[m] = genViewport_getFixedNumTiles(handles[m], tiles[m]);
+                    // every tile counted is set
+                    for (int32_t i = 0; i < tileNum[m]; i++)
+                        EXPECT_GE(tiles[m][i].idx, 0);
+                }
+                EXPECT_EQ(tileNum[0], tileNum[1]);
+                for (int32_t i = 0; i < tileNum[0] && i < tileNum[1]; i++)
+                {
+                    EXPECT_EQ(tiles[0][i].idx, tiles[1][i].idx);
+                    EXPECT_EQ(tiles[0][i].faceId, tiles[1][i].faceId);
+                }
+                EXPECT_EQ(paramViewport[0].m_numFaces, paramViewport[1].m_numFaces);
+                for (int32_t i = 0; i < paramViewport[0].m_numFaces && i < paramViewport[1].m_numFaces; i++)
+                {
+                    EXPECT_EQ(upLeft[0][i].faceId, upLeft[1][i].faceId);
+                    EXPECT_EQ(upLeft[0][i].x, upLeft[1][i].x);
+                    EXPECT_EQ(upLeft[0][i].y, upLeft[1][i].y);
+                    EXPECT_EQ(downRight[0][i].x, downRight[1][i].x);
+                    EXPECT_EQ(downRight[0][i].y, downRight[1][i].y);
+                }
+            }
+        }
+        genViewport_unInit(handles[0]);
+        genViewport_unInit(handles[1]);
+    }
+
+    param.usedType = E_PARSER_ONENAL;
+    void* pI360SCVP = I360SCVP_Init(&param);
+    EXPECT_TRUE(pI360SCVP != NULL);
+    if (!pI360SCVP)
+        return;
+    int32_t threadNum = 4;
+    EXPECT_TRUE(I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_MAPPING_THREADS, &threadNum) == 0);
+    threadNum = 0;
+    EXPECT_TRUE(I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_MAPPING_THREADS, &threadNum) != 0);
+    I360SCVP_unInit(pI360SCVP);
+}
+
+TEST_F(I360SCVPTest, TilesForPoses)
+{
+    point upLeft[6], downRight[6];
+    TileDef tiles[1024];
+    ViewportPose poses[64];
+    int32_t poseNum = 0;
+    for (int32_t pitch = -90; pitch <= 90; pitch += 30)
+    {
+        for (int32_t yaw = -180; yaw < 180; yaw += 40)
+        {
+            poses[poseNum].yaw = yaw;
+            poses[poseNum].pitch = pitch;
+            poseNum++;
+        }
+    }
+    int32_t geoTypes[2] = { E_SVIDEO_EQUIRECT, E_SVIDEO_CUBEMAP };
+    for (int32_t g = 0; g < 2; g++)
+    {
+        generateViewPortParam paramViewport;
+        memset(&paramViewport, 0, sizeof(generateViewPortParam));
+        paramViewport.m_iViewportWidth = 960;
+        paramViewport.m_iViewportHeight = 960;
+        paramViewport.m_viewPort_hFOV = 80;
+        paramViewport.m_viewPort_vFOV = 80;
+        paramViewport.m_output_geoType = E_SVIDEO_VIEWPORT;
+        paramViewport.m_input_geoType = geoTypes[g];
+        paramViewport.m_iInputWidth = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameWidth;
+        paramViewport.m_iInputHeight = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameHeight;
+        paramViewport.m_tileNumRow = 4;
+        paramViewport.m_tileNumCol = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 4 : 8;
+        paramViewport.m_pUpLeft = upLeft;
+        paramViewport.m_pDownRight = downRight;
+        paramViewport.m_mappingMode = E_VIEWPORT_MAPPING_BOUNDARY;
+        void* pHandle = genViewport_Init(&paramViewport);
+        EXPECT_TRUE(pHandle != NULL);
+        if (!pHandle)
+            return;
+
+        int32_t words = genViewport_getTilesForPoses(pHandle, NULL, 0, NULL);
+        EXPECT_EQ(-1, genViewport_getTilesForPoses(pHandle, poses, poseNum, NULL));
+        int32_t tileTotal = paramViewport.m_tileNumRow * paramViewport.m_tileNumCol * ((geoTypes[g] == E_SVIDEO_CUBEMAP) ? 6 : 1);
+        EXPECT_EQ((tileTotal + 63) / 64, words);
+        std::vector<uint64_t> masks(poseNum * words);
+        EXPECT_EQ(-1, genViewport_getTilesForPoses(pHandle, NULL, poseNum, &masks[0]));
+        EXPECT_EQ(words, genViewport_getTilesForPoses(pHandle, poses, poseNum, &masks[0]));
+
+        // the same tiles as the one pose path, the max tile number is 0 so no tile is added to the list
+        genViewport_setMaxSelTiles(pHandle, 0);
+        for (int32_t k = 0; k < poseNum; k++)
+        {
+            genViewport_setViewPort(pHandle, poses[k].yaw, poses[k].pitch);
+            EXPECT_TRUE(genViewport_process(&paramViewport, pHandle) == 0);
+            memset(tiles, 0xff, sizeof(tiles));
+            genViewport_getFixedNumTiles(pHandle, tiles);
+            std::vector<uint64_t> expected(words, 0);
+            for (int32_t i = 0; i < tileTotal && tiles[i].idx >= 0; i++)
+                expected[tiles[i].idx >> 6] |= (uint64_t)1 << (tiles[i].idx & 63);
+            for (int32_t w = 0; w < words; w++)
+                EXPECT_EQ(expected[w], masks[k * words + w]);
+        }
+
+        // the result of the last process is kept
+        memset(tiles, 0xff, sizeof(tiles));
+        genViewport_getFixedNumTiles(pHandle, tiles);
+        std::vector<TileDef> before(tiles, tiles + tileTotal);
+        EXPECT_EQ(words, genViewport_getTilesForPoses(pHandle, poses, poseNum, &masks[0]));
+        memset(tiles, 0xff, sizeof(tiles));
+        genViewport_getFixedNumTiles(pHandle, tiles);
+        EXPECT_EQ(0, memcmp(&before[0], tiles, tileTotal * sizeof(TileDef)));
+        genViewport_unInit(pHandle);
+    }
+
+    param.usedType = E_PARSER_ONENAL;
+    void* pI360SCVP = I360SCVP_Init(&param);
+    EXPECT_TRUE(pI360SCVP != NULL);
+    if (!pI360SCVP)
+        return;
+    Param_ViewPortInfo paramViewPorInfo;
+    memset(&paramViewPorInfo, 0, sizeof(Param_ViewPortInfo));
+    paramViewPorInfo.faceWidth = frameWidth;
+    paramViewPorInfo.faceHeight = frameHeight;
+    paramViewPorInfo.geoTypeInput = E_SVIDEO_EQUIRECT;
+    paramViewPorInfo.viewportHeight = 960;
+    paramViewPorInfo.viewportWidth = 960;
+    paramViewPorInfo.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    paramViewPorInfo.viewPortFOVH = 80;
+    paramViewPorInfo.viewPortFOVV = 80;
+    paramViewPorInfo.tileNumCol = 10;
+    paramViewPorInfo.tileNumRow = 8;
+    paramViewPorInfo.mappingMode = E_VIEWPORT_MAPPING_BOUNDARY;
+    EXPECT_TRUE(I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo) == 0);
+    int32_t words = I360SCVP_getTilesForPoses(pI360SCVP, NULL, 0, NULL);
+    EXPECT_EQ(-1, I360SCVP_getTilesForPoses(pI360SCVP, poses, poseNum, NULL));
+    EXPECT_EQ(2, words);
+    std::vector<uint64_t> masks(poseNum * words);
+    EXPECT_EQ(-1, I360SCVP_getTilesForPoses(pI360SCVP, NULL, poseNum, &masks[0]));
+    EXPECT_EQ(words, I360SCVP_getTilesForPoses(pI360SCVP, poses, poseNum, &masks[0]));
+    for (int32_t k = 0; k < poseNum; k++)
+        EXPECT_TRUE(masks[k * words] != 0 || masks[k * words + 1] != 0);
+    I360SCVP_unInit(pI360SCVP);
+}
+
+TEST_F(I360SCVPTest, TileCoverage)
+{
+    point upLeft[6], downRight[6];
+    int32_t geoTypes[2] = { E_SVIDEO_EQUIRECT, E_SVIDEO_CUBEMAP };
+    for (int32_t g = 0; g < 2; g++)
+    {
+        generateViewPortParam paramViewport;
+        memset(&paramViewport, 0, sizeof(generateViewPortParam));
+        paramViewport.m_iViewportWidth = 960;
+        paramViewport.m_iViewportHeight = 960;
+        paramViewport.m_viewPort_hFOV = 80;
+        paramViewport.m_viewPort_vFOV = 80;
+        paramViewport.m_output_geoType = E_SVIDEO_VIEWPORT;
+        paramViewport.m_input_geoType = geoTypes[g];
+        paramViewport.m_iInputWidth = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameWidth;
+        paramViewport.m_iInputHeight = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameHeight;
+        paramViewport.m_tileNumRow = 4;
+        paramViewport.m_tileNumCol = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 4 : 8;
+        paramViewport.m_pUpLeft = upLeft;
+        paramViewport.m_pDownRight = downRight;
+        void* pHandle = genViewport_Init(&paramViewport);
+        EXPECT_TRUE(pHandle != NULL);
+        if (!pHandle)
+            return;
+
+        int32_t tileNum = genViewport_getTileCoverage(pHandle, NULL);
+        EXPECT_EQ((geoTypes[g] == E_SVIDEO_CUBEMAP) ? 96 : 32, tileNum);
+        std::vector<float> coverage(tileNum);
+        genViewport_setViewPort(pHandle, 0, 0);
+        EXPECT_EQ(tileNum, genViewport_getTileCoverage(pHandle, &coverage[0]));
+        float sum = 0;
+        for (int32_t i = 0; i < tileNum; i++)
+        {
+            EXPECT_TRUE(coverage[i] >= 0 && coverage[i] <= 1);
+            sum += coverage[i];
+        }
+        EXPECT_NEAR(1.0, sum, 1e-4);
+
+        // the next poses reuse the geometries and the buffers of the handle, also between the processes
+        std::vector<float> coverageNext(tileNum);
+        genViewport_setViewPort(pHandle, 60, 20);
+        int64_t allocBefore = g_allocCount;
+        EXPECT_EQ(tileNum, genViewport_getTileCoverage(pHandle, &coverageNext[0]));
+        EXPECT_EQ(0, g_allocCount - allocBefore);
+        EXPECT_EQ(0, genViewport_process(&paramViewport, pHandle));
+        genViewport_setViewPort(pHandle, 0, 0);
+        EXPECT_EQ(tileNum, genViewport_getTileCoverage(pHandle, &coverageNext[0]));
+        EXPECT_EQ(0, memcmp(&coverage[0], &coverageNext[0], tileNum * sizeof(float)));
+
+        if (geoTypes[g] == E_SVIDEO_EQUIRECT)
+        {
+            // the viewport centre is the picture centre, the four centre tiles cover it symmetrically
+            EXPECT_GT(coverage[1 * 8 + 3], 0.2);
+            EXPECT_NEAR(coverage[1 * 8 + 3], coverage[1 * 8 + 4], 1e-6);
+            EXPECT_NEAR(coverage[1 * 8 + 3], coverage[2 * 8 + 3], 1e-6);
+            EXPECT_NEAR(coverage[1 * 8 + 3], coverage[2 * 8 + 4], 1e-6);
+            EXPECT_EQ(0, coverage[0]);
+        }
+        else
+        {
+            // the FOV is less than 90 degrees, so the viewport in front of a face centre is inside that face
+            float maxFace = 0;
+            for (int32_t f = 0; f < 6; f++)
+            {
+                float faceSum = 0;
+                for (int32_t i = 0; i < 16; i++)
+                    faceSum += coverage[f * 16 + i];
+                if (faceSum > maxFace)
+                    maxFace = faceSum;
+            }
+            EXPECT_NEAR(1.0, maxFace, 1e-4);
+        }
+        genViewport_unInit(pHandle);
+    }
+
+    param.usedType = E_PARSER_ONENAL;
+    void* pI360SCVP = I360SCVP_Init(&param);
+    EXPECT_TRUE(pI360SCVP != NULL);
+    if (!pI360SCVP)
+        return;
+    Param_ViewPortInfo paramViewPorInfo;
+    memset(&paramViewPorInfo, 0, sizeof(Param_ViewPortInfo));
+    paramViewPorInfo.faceWidth = frameWidth;
+    paramViewPorInfo.faceHeight = frameHeight;
+    paramViewPorInfo.geoTypeInput = E_SVIDEO_EQUIRECT;
+    paramViewPorInfo.viewportHeight = 960;
+    paramViewPorInfo.viewportWidth = 960;
+    paramViewPorInfo.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    paramViewPorInfo.viewPortYaw = 90;
+    paramViewPorInfo.viewPortPitch = 30;
+    paramViewPorInfo.viewPortFOVH = 80;
+    paramViewPorInfo.viewPortFOVV = 80;
+    paramViewPorInfo.tileNumCol = 10;
+    paramViewPorInfo.tileNumRow = 8;
+    EXPECT_TRUE(I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_VIEWPORT, &paramViewPorInfo) == 0);
+    EXPECT_EQ(80, I360SCVP_getTileCoverage(pI360SCVP, NULL));
+    std::vector<float> coverage(80);
+    EXPECT_EQ(80, I360SCVP_getTileCoverage(pI360SCVP, &coverage[0]));
+    float sum = 0;
+    for (int32_t i = 0; i < 80; i++)
+        sum += coverage[i];
+    EXPECT_NEAR(1.0, sum, 1e-4);
+    I360SCVP_unInit(pI360SCVP);
+}
+
+TEST_F(I360SCVPTest, ViewportProcessNoAllocation)
+{
+    point upLeft[6], downRight[6], upLeftRef[6], downRightRef[6];
+    int32_t geoTypes[2] = { E_SVIDEO_EQUIRECT, E_SVIDEO_CUBEMAP };
+    int32_t modes[2] = { E_VIEWPORT_MAPPING_FULL, E_VIEWPORT_MAPPING_BOUNDARY };
+    int32_t threadNums[2] = { 1, 3 };
+    for (int32_t g = 0; g < 2; g++)
+    {
+        for (int32_t c = 0; c < 2 * 2; c++)
+        {
+            int32_t m = c / 2;
+            int32_t threadNum = threadNums[c % 2];
+            generateViewPortParam paramViewport;
+            memset(&paramViewport, 0, sizeof(generateViewPortParam));
+            paramViewport.m_iViewportWidth = 960;
+            paramViewport.m_iViewportHeight = 960;
+            paramViewport.m_viewPort_hFOV = 80;
+            paramViewport.m_viewPort_vFOV = 80;
+            paramViewport.m_output_geoType = E_SVIDEO_VIEWPORT;
+            paramViewport.m_input_geoType = geoTypes[g];
+            paramViewport.m_iInputWidth = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameWidth;
+            paramViewport.m_iInputHeight = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 960 : frameHeight;
+            paramViewport.m_tileNumRow = 4;
+            paramViewport.m_tileNumCol = (geoTypes[g] == E_SVIDEO_CUBEMAP) ? 4 : 8;
+            paramViewport.m_pUpLeft = upLeft;
+            paramViewport.m_pDownRight = downRight;
+            paramViewport.m_mappingMode = modes[m];
+            void* pHandle = genViewport_Init(&paramViewport);
+            EXPECT_TRUE(pHandle != NULL);
+            if (!pHandle)
+                return;
+            EXPECT_EQ(0, genViewport_setMappingThreads(pHandle, threadNum));
+            EXPECT_EQ(0, genViewport_process(&paramViewport, pHandle));
+
+            // the poses after the first one reuse the geometries, the buffers and the mapping threads of the handle
+            int32_t poseNum = (modes[m] == E_VIEWPORT_MAPPING_FULL) ? 4 : 32;
+            int32_t ret = 0;
+            int64_t allocBefore = g_allocCount;
+            for (int32_t k = 0; k < poseNum; k++)
+            {
+                genViewport_setViewPort(pHandle, -170 + k * 37 % 340, -80 + k * 23 % 160);
+                ret |= genViewport_process(&paramViewport, pHandle);
+            }
+            int64_t allocNum = g_allocCount - allocBefore;
+            EXPECT_EQ(0, ret);
+            EXPECT_EQ(0, allocNum);
+
+            // the last result is the same as the one of a new handle
+            generateViewPortParam paramRef = paramViewport;
+            paramRef.m_viewPort_fYaw = -170 + (poseNum - 1) * 37 % 340;
+            paramRef.m_viewPort_fPitch = -80 + (poseNum - 1) * 23 % 160;
+            paramRef.m_pUpLeft = upLeftRef;
+            paramRef.m_pDownRight = downRightRef;
+            void* pHandleRef = genViewport_Init(&paramRef);
+            EXPECT_TRUE(pHandleRef != NULL);
+            if (!pHandleRef)
+                return;
+            EXPECT_EQ(0, genViewport_process(&paramRef, pHandleRef));
+            EXPECT_EQ(paramRef.m_numFaces, paramViewport.m_numFaces);
+            for (int32_t i = 0; i < paramRef.m_numFaces; i++)
+            {
+                EXPECT_EQ(upLeftRef[i].faceId, upLeft[i].faceId);
+                EXPECT_EQ(upLeftRef[i].x, upLeft[i].x);
+                EXPECT_EQ(upLeftRef[i].y, upLeft[i].y);
+                EXPECT_EQ(downRightRef[i].x, downRight[i].x);
+                EXPECT_EQ(downRightRef[i].y, downRight[i].y);
+            }
+            genViewport_unInit(pHandleRef);
+            genViewport_unInit(pHandle);
+        }
+    }
+}
+
+TEST_F(I360SCVPTest, GeometryBatchKernels)
+{
+    const int32_t num = 1027;
+    SVideoInfo infos[3] = {};
+    int32_t geoTypes[3] = { SVIDEO_EQUIRECT, SVIDEO_CUBEMAP, SVIDEO_VIEWPORT };
+    for (int32_t g = 0; g < 3; g++)
+    {
+        infos[g].geoType = geoTypes[g];
+        infos[g].iFaceWidth = (g == 0) ? 3840 : 960;
+        infos[g].iFaceHeight = (g == 0) ? 2048 : 960;
+        infos[g].iNumFaces = (g == 1) ? 6 : 1;
+        infos[g].viewPort.hFOV = 80;
+        infos[g].viewPort.vFOV = 80;
+        infos[g].viewPort.fYaw = 35;
+        infos[g].viewPort.fPitch = -20;
+    }
+    Geometry* pERP = Geometry::create(infos[0]);
+    Geometry* pCube = Geometry::create(infos[1]);
+    ViewPort* pViewport = (ViewPort*)Geometry::create(infos[2]);
+    pViewport->setRotMat();
+    pViewport->setInvK();
+
+    std::vector<int32_t> faceBuf(3 * num, 0);
+    std::vector<POSType> posBuf(9 * num, 0);
+    SPosArray in = { &faceBuf[0], &posBuf[0], &posBuf[num], &posBuf[2 * num] };
+    SPosArray pos = { &faceBuf[num], &posBuf[3 * num], &posBuf[4 * num], &posBuf[5 * num] };
+    SPosArray out = { &faceBuf[2 * num], &posBuf[6 * num], &posBuf[7 * num], &posBuf[8 * num] };
+    srand(1);
+    for (int32_t i = 0; i < num; i++)
+    {
+        in.x[i] = (POSType)(rand() % 1200) - 120 + (POSType)(rand() % 8) / 8;
+        in.y[i] = (POSType)(rand() % 1200) - 120;
+    }
+
+    for (int32_t level = GEO_KERNEL_SCALAR; level < GEO_KERNEL_NUM; level++)
+    {
+        geoKernelSetLevel(level);
+        pViewport->map2DTo3DBatch(in, &pos, num);
+        for (int32_t i = 0; i < num; i++)
+        {
+            SPos pt(0, in.x[i], in.y[i], 0), ref;
+            pViewport->map2DTo3D(pt, &ref);
+            EXPECT_TRUE(pos.x[i] == ref.x && pos.y[i] == ref.y && pos.z[i] == ref.z);
+        }
+
+        Geometry* pSrc[2] = { pERP, pCube };
+        for (int32_t g = 0; g < 2; g++)
+        {
+            pSrc[g]->map3DTo2DBatch(&pos, &out, num);
+            for (int32_t i = 0; i < num; i++)
+            {
+                SPos pt(0, pos.x[i], pos.y[i], pos.z[i]), ref;
+                pSrc[g]->map3DTo2D(&pt, &ref);
+                EXPECT_TRUE(out.faceIdx[i] == ref.faceIdx && out.x[i] == ref.x && out.y[i] == ref.y);
+            }
+        }
+    }
+    geoKernelSetLevel(GEO_KERNEL_NUM);
+
+    delete pERP;
+    delete pCube;
+    pViewport->geoUnInit();
+    delete pViewport;
+}
+
+
+TEST_F(I360SCVPTest, ViewportSinglePrecision)
+{
+    const int32_t num = 1027;
+    SVideoInfo info = {};
+    info.geoType = SVIDEO_EQUIRECT;
+    info.iFaceWidth = 7680;
+    info.iFaceHeight = 3840;
+    info.iNumFaces = 1;
+    Geometry* pERP = Geometry::create(info);
+
+    std::vector<int32_t> faceBuf(3 * num, 0);
+    std::vector<POSType> posBuf(9 * num, 0);
+    SPosArray pos = { &faceBuf[0], &posBuf[0], &posBuf[num], &posBuf[2 * num] };
+    SPosArray out = { &faceBuf[num], &posBuf[3 * num], &posBuf[4 * num], &posBuf[5 * num] };
+    SPosArray ref = { &faceBuf[2 * num], &posBuf[6 * num], &posBuf[7 * num], &posBuf[8 * num] };
+    srand(1);
+    for (int32_t i = 0; i < num; i++)
+    {
+        pos.x[i] = (POSType)(rand() % 2001 - 1000) / 1000;
+        pos.y[i] = (POSType)(rand() % 2001 - 1000) / 1000;
+        pos.z[i] = (POSType)(rand() % 2001 - 1000) / 1000;
+    }
+    // the poles and the seam
+    pos.x[0] = 0; pos.y[0] = 1; pos.z[0] = 0;
+    pos.x[1] = 0; pos.y[1] = -1; pos.z[1] = 0;
+    pos.x[2] = -1; pos.y[2] = 0; pos.z[2] = -0.0;
+    pos.x[3] = -1; pos.y[3] = 0.5; pos.z[3] = 0;
+
+    pERP->map3DTo2DBatch(&pos, &ref, num);
+    pERP->setSinglePrecision(true);
+    std::vector<POSType> firstX, firstY;
+    for (int32_t level = GEO_KERNEL_SCALAR; level < GEO_KERNEL_NUM; level++)
+    {
+        geoKernelSetLevel(level);
+        pERP->map3DTo2DBatch(&pos, &out, num);
+        if (level == GEO_KERNEL_SCALAR)
+        {
+            firstX.assign(out.x, out.x + num);
+            firstY.assign(out.y, out.y + num);
+        }
+        for (int32_t i = 0; i < num; i++)
+        {
+            // all the levels give the same result, within 0.01 pixel of the double precision
+            EXPECT_TRUE(out.x[i] == firstX[i] && out.y[i] == firstY[i]);
+            POSType dx = sfabs(out.x[i] - ref.x[i]);
+            if (dx > info.iFaceWidth / 2)
+                dx = info.iFaceWidth - dx;
+            EXPECT_LT(dx, 0.01);
+            EXPECT_LT(sfabs(out.y[i] - ref.y[i]), 0.01);
+            EXPECT_EQ(0, out.faceIdx[i]);
+        }
+    }
+    geoKernelSetLevel(GEO_KERNEL_NUM);
+    delete pERP;
+
+    // the validation outputs the double precision result and counts the different tile sets
+    point upLeft[3][6], downRight[3][6];
+    void* pHandle[3];
+    generateViewPortParam paramViewport[3];
+    for (int32_t p = 0; p < 3; p++)
+    {
+        memset(&paramViewport[p], 0, sizeof(generateViewPortParam));
+        paramViewport[p].m_iViewportWidth = 960;
+        paramViewport[p].m_iViewportHeight = 960;
+        paramViewport[p].m_viewPort_hFOV = 80;
+        paramViewport[p].m_viewPort_vFOV = 80;
+        paramViewport[p].m_output_geoType = E_SVIDEO_VIEWPORT;
+        paramViewport[p].m_input_geoType = E_SVIDEO_EQUIRECT;
+        paramViewport[p].m_iInputWidth = frameWidth;
+        paramViewport[p].m_iInputHeight = frameHeight;
+        paramViewport[p].m_tileNumRow = 8;
+        paramViewport[p].m_tileNumCol = 16;
+        paramViewport[p].m_pUpLeft = upLeft[p];
+        paramViewport[p].m_pDownRight = downRight[p];
+        paramViewport[p].m_precision = E_VIEWPORT_PRECISION_DOUBLE + p;
+        pHandle[p] = genViewport_Init(&paramViewport[p]);
+        EXPECT_TRUE(pHandle[p] != NULL);
+        if (!pHandle[p])
+            return;
+    }
+    float poses[4][2] = { { 0.3f, 0.7f }, { 175.3f, -20.3f }, { -90.3f, 60.7f }, { 45.3f, -79.3f } };
+    for (int32_t k = 0; k < 4; k++)
+    {
+        for (int32_t p = 0; p < 3; p++)
+        {
+            genViewport_setViewPort(pHandle[p], poses[k][0], poses[k][1]);
+            EXPECT_EQ(0, genViewport_process(&paramViewport[p], pHandle[p]));
+        }
+        EXPECT_EQ(paramViewport[0].m_numFaces, paramViewport[2].m_numFaces);
+        EXPECT_EQ(paramViewport[0].m_numFaces, paramViewport[1].m_numFaces);
+        for (int32_t i = 0; i < paramViewport[0].m_numFaces; i++)
+        {
+            EXPECT_EQ(upLeft[0][i].x, upLeft[2][i].x);
+            EXPECT_EQ(upLeft[0][i].y, upLeft[2][i].y);
+            EXPECT_EQ(downRight[0][i].x, downRight[2][i].x);
+            EXPECT_EQ(downRight[0][i].y, downRight[2][i].y);
+            EXPECT_LE(abs(upLeft[0][i].x - upLeft[1][i].x), 1);
+            EXPECT_LE(abs(upLeft[0][i].y - upLeft[1][i].y), 1);
+            EXPECT_LE(abs(downRight[0][i].x - downRight[1][i].x), 1);
+            EXPECT_LE(abs(downRight[0][i].y - downRight[1][i].y), 1);
+        }
+    }
+    EXPECT_EQ(0, genViewport_getPrecisionMismatch(pHandle[0]));
+    EXPECT_EQ(0, genViewport_getPrecisionMismatch(pHandle[2]));
+    for (int32_t p = 0; p < 3; p++)
+        genViewport_unInit(pHandle[p]);
+}
+
+
+TEST_F(I360SCVPTest, ProcessSelection)
+{
+    point upLeft[6], downRight[6], upLeftSel[6], downRightSel[6];
+    TileDef tiles[1024], tilesSel[1024];
+    generateViewPortParam paramViewport;
+    memset(&paramViewport, 0, sizeof(generateViewPortParam));
+    paramViewport.m_iViewportWidth = 960;
+    paramViewport.m_iViewportHeight = 960;
+    paramViewport.m_viewPort_hFOV = 80;
+    paramViewport.m_viewPort_vFOV = 80;
+    paramViewport.m_output_geoType = E_SVIDEO_VIEWPORT;
+    paramViewport.m_input_geoType = E_SVIDEO_EQUIRECT;
+    paramViewport.m_iInputWidth = frameWidth;
+    paramViewport.m_iInputHeight = frameHeight;
+    paramViewport.m_tileNumRow = 4;
+    paramViewport.m_tileNumCol = 8;
+    paramViewport.m_pUpLeft = upLeft;
+    paramViewport.m_pDownRight = downRight;
+    paramViewport.m_mappingMode = E_VIEWPORT_MAPPING_BOUNDARY;
+    generateViewPortParam paramSel = paramViewport;
+    paramSel.m_pUpLeft = upLeftSel;
+    paramSel.m_pDownRight = downRightSel;
+    void* pHandle = genViewport_Init(&paramViewport);
+    void* pHandleSel = genViewport_Init(&paramSel);
+    EXPECT_TRUE(pHandle != NULL && pHandleSel != NULL);
+    if (!pHandle || !pHandleSel)
+        return;
+    EXPECT_NE(0, genViewport_setPoseThreshold(pHandleSel, -1));
+
+    // the combined call gives the results of the separated calls
+    float poses[5][2] = { { 0, 0 }, { 170, 10 }, { -175, -30 }, { 60, 80 }, { -90, -85 } };
+    for (int32_t k = 0; k < 5; k++)
+    {
+        CCDef cc, ccSel;
+        memset(&cc, 0, sizeof(CCDef));
+        genViewport_setViewPort(pHandle, poses[k][0], poses[k][1]);
+        EXPECT_EQ(0, genViewport_process(&paramViewport, pHandle));
+        EXPECT_EQ(0, genViewport_getContentCoverage(pHandle, &cc));
+        uint64_t mask = 0;
+        ViewportPose pose = { poses[k][0], poses[k][1] };
+        EXPECT_EQ(1, genViewport_getTilesForPoses(pHandle, &pose, 1, &mask));
+        int32_t tileNum = 0;
+        for (int32_t i = 0; i < 32; i++)
+        {
+            if (mask & (1ULL << i))
+                tiles[tileNum++].idx = i;
+        }
+
+        genViewport_setViewPort(pHandleSel, poses[k][0], poses[k][1]);
+        EXPECT_EQ(tileNum, genViewport_processSelection(&paramSel, pHandleSel, tilesSel, &ccSel));
+        for (int32_t i = 0; i < tileNum; i++)
+            EXPECT_EQ(tiles[i].idx, tilesSel[i].idx);
+        EXPECT_EQ(cc.centreAzimuth, ccSel.centreAzimuth);
+        EXPECT_EQ(cc.centreElevation, ccSel.centreElevation);
+        EXPECT_EQ(cc.azimuthRange, ccSel.azimuthRange);
+        EXPECT_EQ(cc.elevationRange, ccSel.elevationRange);
+        EXPECT_EQ(paramViewport.m_numFaces, paramSel.m_numFaces);
+        for (int32_t i = 0; i < paramViewport.m_numFaces; i++)
+        {
+            EXPECT_EQ(upLeft[i].x, upLeftSel[i].x);
+            EXPECT_EQ(upLeft[i].y, upLeftSel[i].y);
+            EXPECT_EQ(downRight[i].x, downRightSel[i].x);
+            EXPECT_EQ(downRight[i].y, downRightSel[i].y);
+        }
+    }
+
+    // a pose within the threshold reuses the last results, a larger move computes again
+    CCDef ccFirst, ccNear, ccFar, ccRef;
+    EXPECT_EQ(0, genViewport_setPoseThreshold(pHandleSel, 5));
+    genViewport_setViewPort(pHandleSel, 10, 0);
+    int32_t tileNumFirst = genViewport_processSelection(&paramSel, pHandleSel, NULL, &ccFirst);
+    genViewport_setViewPort(pHandleSel, 14, -4);
+    EXPECT_EQ(tileNumFirst, genViewport_processSelection(&paramSel, pHandleSel, NULL, &ccNear));
+    EXPECT_EQ(0, memcmp(&ccFirst, &ccNear, sizeof(CCDef)));
+    genViewport_setViewPort(pHandleSel, 40, 0);
+    EXPECT_GT(genViewport_processSelection(&paramSel, pHandleSel, NULL, &ccFar), 0);
+    memset(&ccRef, 0, sizeof(CCDef));
+    genViewport_setViewPort(pHandle, 40, 0);
+    genViewport_process(&paramViewport, pHandle);
+    genViewport_getContentCoverage(pHandle, &ccRef);
+    EXPECT_EQ(0, memcmp(&ccRef, &ccFar, sizeof(CCDef)));
+    EXPECT_NE(ccFirst.centreAzimuth, ccFar.centreAzimuth);
+
+    genViewport_unInit(pHandle);
+    genViewport_unInit(pHandleSel);
+}
+
+
+TEST_F(I360SCVPTest, BitstreamReader)
+{
+    // the reads of any width give the bits of the buffer, and the bits after the end are 0
+    const uint32_t size = 61;
+    uint8_t buffer[size];
+    srand(3);
+    for (uint32_t i = 0; i < size; i++)
+        buffer[i] = (uint8_t)(rand() & 0xff);
+    auto refRead = [&](uint64_t offset, uint32_t nBits) {
+        uint32_t value = 0;
+        for (uint32_t i = 0; i < nBits; i++, offset++)
+        {
+            uint32_t bit = (offset < size * 8) ? ((buffer[offset >> 3] >> (7 - (offset & 7))) & 1) : 0;
+            value = (value << 1) | bit;
+        }
+        return value;
+    };
+    GTS_BitStream* bs = gts_bs_new((int8_t*)buffer, size, GTS_BITSTREAM_READ);
+    ASSERT_TRUE(bs != NULL);
+    for (int32_t pass = 0; pass < 2; pass++)
+    {
+        uint64_t offset = 0;
+        while (offset < size * 8 + 64)
+        {
+            uint32_t nBits = rand() % 33;
+            if (offset + nBits <= size * 8)
+            {
+                EXPECT_EQ(offset, gts_bs_get_bit_offset(bs));
+                EXPECT_EQ(refRead(offset, nBits > 8 ? 8 : nBits), gts_bs_peek_bits(bs, nBits > 8 ? 8 : nBits, 0));
+            }
+            EXPECT_EQ(refRead(offset, nBits), gts_bs_read_int(bs, nBits));
+            offset += nBits;
+        }
+        EXPECT_EQ(0, gts_bs_available(bs));
+        EXPECT_EQ(GTS_OK, gts_bs_seek(bs, 0));
+    }
+    EXPECT_EQ(((uint64_t)refRead(0, 20) << 32) | refRead(20, 32), gts_bs_read_long_int(bs, 52));
+    gts_bs_del(bs);
+
+    // exp-golomb codes, the long ones and the ones at the end of the buffer take the byte by byte path
+    uint32_t values[200];
+    uint8_t codes[2048];
+    memset(codes, 0, sizeof(codes));
+    uint64_t bitNum = 0;
+    auto writeBits = [&](uint32_t value, uint32_t nBits) {
+        for (int32_t i = nBits - 1; i >= 0; i--, bitNum++)
+            codes[bitNum >> 3] |= ((value >> i) & 1) << (7 - (bitNum & 7));
+    };
+    for (int32_t i = 0; i < 200; i++)
+    {
+        values[i] = (i % 10 == 9) ? (rand() % 0x3fffff) : (rand() % (1 << (rand() % 16)));
+        uint32_t codeNum = values[i] + 1;
+        uint32_t len = 32 - __builtin_clz(codeNum);
+        writeBits(0, len - 1);
+        writeBits(codeNum, len);
+        writeBits(i & ((1 << (i % 4)) - 1), i % 4);
+    }
+    bs = gts_bs_new((int8_t*)codes, (bitNum + 7) >> 3, GTS_BITSTREAM_READ);
+    ASSERT_TRUE(bs != NULL);
+    for (int32_t i = 0; i < 200; i++)
+    {
+        if (i & 1)
+        {
+            EXPECT_EQ(values[i], gts_bs_read_ue(bs));
+        }
+        else
+        {
+            int32_t se = (values[i] & 1) ? (int32_t)((values[i] + 1) >> 1) : -(int32_t)(values[i] >> 1);
+            EXPECT_EQ(se, gts_bs_read_se(bs));
+        }
+        EXPECT_EQ((uint32_t)(i & ((1 << (i % 4)) - 1)), gts_bs_read_int(bs, i % 4));
+    }
+    EXPECT_EQ(bitNum, gts_bs_get_bit_offset(bs));
+    gts_bs_del(bs);
+}
+
+
+// the byte by byte scanning with a rolling 32-bit value, the reference of the start code scanning
+static uint32_t refNextStartCode(const uint8_t* pData, uint32_t size, uint32_t start)
+{
+    uint32_t v = 0xffffffff;
+    for (uint32_t pos = start; pos < size; pos++)
+    {
+        v = (v << 8) | pData[pos];
+        if (v == 0x00000001)
+            return pos - 3 - start;
+        if ((v & 0x00FFFFFF) == 0x00000001)
+            return pos - 2 - start;
+    }
+    return size - start;
+}
+
+TEST_F(I360SCVPTest, StartCodeScanner)
+{
+    std::vector<uint8_t> buffer(4099);
+    srand(5);
+    int32_t maxLevel = nalScanGetLevel();
+    for (int32_t round = 0; round < 300; round++)
+    {
+        // mostly zeros and ones around random bytes, so that all the partial prefixes show up
+        uint32_t size = 3 + rand() % (uint32_t)(buffer.size() - 3);
+        int32_t density = 1 + rand() % 64;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            int32_t r = rand() % (density * 4);
+            buffer[i] = (r < density * 2) ? 0 : (r < density * 3) ? 1 : (r % 2) ? 3 : (uint8_t)(rand() & 0xff);
+        }
+        if (round % 3 == 0)
+        {
+            for (uint32_t i = 2; i < size; i++)
+            {
+                if (!buffer[i - 2] && !buffer[i - 1] && buffer[i] == 1)
+                    buffer[i] = 2;
+            }
+        }
+        uint32_t start = 3 + rand() % (size - 2);
+        if (start > size)
+            start = size;
+        for (int32_t level = NAL_SCAN_SCALAR; level <= maxLevel; level++)
+        {
+            nalScanSetLevel(level);
+            GTS_BitStream* bs = gts_bs_new((int8_t*)&buffer[0], size, GTS_BITSTREAM_READ);
+            ASSERT_TRUE(bs != NULL);
+            EXPECT_EQ(GTS_OK, gts_bs_seek(bs, start));
+            EXPECT_EQ(refNextStartCode(&buffer[0], size, start), gts_media_nalu_next_start_code_bs(bs));
+            EXPECT_EQ(start, gts_bs_get_position(bs));
+            gts_bs_del(bs);
+
+            uint32_t offset = rand() % size;
+            uint32_t found = size - offset;
+            for (uint32_t i = offset; i + 2 < size; i++)
+            {
+                if (!buffer[i] && !buffer[i + 1] && buffer[i + 2] == 1)
+                {
+                    found = i - offset;
+                    break;
+                }
+            }
+            EXPECT_EQ(found, nalScanFindStartCode(&buffer[offset], size - offset));
+        }
+    }
+    nalScanSetLevel(NAL_SCAN_NUM);
+}
+
+
+// the byte by byte removal of the emulation prevention bytes, the reference of the block copies
+static uint32_t refRemoveEmulationBytes(const int8_t* src, int8_t* dst, uint32_t size, uint32_t* pCount)
+{
+    uint32_t n = 0, count = 0;
+    uint8_t zeroCounter = 0;
+    while (n < size)
+    {
+        if (zeroCounter == 2 && src[n] == 0x03 && n + 1 < size && src[n + 1] < 0x04)
+        {
+            zeroCounter = 0;
+            count++;
+            n++;
+        }
+        dst[n - count] = src[n];
+        zeroCounter = src[n] ? 0 : zeroCounter + 1;
+        n++;
+    }
+    *pCount = count;
+    return size - count;
+}
+
+// the byte by byte insertion of the emulation prevention bytes, dst holds up to size * 3 / 2 + 1 bytes
+static uint32_t refInsertEmulationBytes(const int8_t* src, int8_t* dst, uint32_t size)
+{
+    uint32_t dstSize = 0;
+    uint8_t zeroCounter = 0;
+    for (uint32_t n = 0; n < size; n++)
+    {
+        if (zeroCounter == 2 && (uint8_t)src[n] < 0x04)
+        {
+            dst[dstSize++] = 0x03;
+            zeroCounter = 0;
+        }
+        dst[dstSize++] = src[n];
+        zeroCounter = src[n] ? 0 : zeroCounter + 1;
+    }
+    return dstSize;
+}
+
+TEST_F(I360SCVPTest, EmulationPrevention)
+{
+    std::vector<int8_t> src(3000), dst(4600), ref(4600), escaped(4600), back(4600);
+    srand(7);
+    int32_t maxLevel = nalScanGetLevel();
+    for (int32_t round = 0; round < 300; round++)
+    {
+        uint32_t size = 1 + rand() % (uint32_t)src.size();
+        int32_t density = 1 + rand() % 32;
+        for (uint32_t i = 0; i < size; i++)
+        {
+            int32_t r = rand() % (density * 4);
+            src[i] = (int8_t)((r < density * 2) ? 0 : (r < density * 3) ? 3 : (r % 3) ? (rand() % 4) : (rand() & 0xff));
+        }
+        uint32_t refCount = 0;
+        uint32_t refSize = refRemoveEmulationBytes(&src[0], &ref[0], size, &refCount);
+        uint32_t prefix = 1 + rand() % (size + 8);
+        for (int32_t level = NAL_SCAN_SCALAR; level <= maxLevel; level++)
+        {
+            nalScanSetLevel(level);
+            EXPECT_EQ(refCount, gts_media_nalu_emulation_bytes_remove_count(&src[0], size));
+            EXPECT_EQ(refSize, gts_media_nalu_remove_emulation_bytes(&src[0], &dst[0], size));
+            EXPECT_EQ(0, memcmp(&ref[0], &dst[0], refSize));
+            uint32_t prefixSize = prefix < refSize ? prefix : refSize;
+            EXPECT_EQ(prefixSize, gts_media_nalu_remove_emulation_bytes_prefix(&src[0], size, &dst[0], prefix));
+            EXPECT_EQ(0, memcmp(&ref[0], &dst[0], prefixSize));
+
+            // the escaping is the one of the bitstream writer, and it is undone by the removal
+            // except for the 03 bytes the writer does not escape and the last one when the 00 00 03 ends the data
+            GTS_BitStream* bs = gts_bs_new(&escaped[0], escaped.size(), GTS_BITSTREAM_WRITE);
+            ASSERT_TRUE(bs != NULL);
+            for (uint32_t i = 0; i < size; i++)
+                gts_bs_write_int(bs, (uint8_t)src[i], 8);
+            uint32_t escapedSize = (uint32_t)gts_bs_get_position(bs);
+            gts_bs_del(bs);
+            EXPECT_EQ(escapedSize, refInsertEmulationBytes(&src[0], &dst[0], size));
+            EXPECT_EQ(0, memcmp(&escaped[0], &dst[0], escapedSize));
+            if (level == maxLevel && !(src[size - 1] == 3 && size >= 3 && !src[size - 2] && !src[size - 3]))
+            {
+                uint32_t backSize = gts_media_nalu_remove_emulation_bytes(&dst[0], &back[0], escapedSize);
+                EXPECT_EQ(size, backSize);
+                EXPECT_EQ(0, memcmp(&src[0], &back[0], size));
+            }
+        }
+    }
+    nalScanSetLevel(NAL_SCAN_NUM);
+}
+
+TEST_F(I360SCVPTest, ParseAccessUnit)
+{
+    param.usedType = E_PARSER_ONENAL;
+    void* pNalParser = I360SCVP_Init(&param);
+    void* pAuParser = I360SCVP_Init(&param);
+    EXPECT_TRUE(pNalParser != NULL);
+    EXPECT_TRUE(pAuParser != NULL);
+    if (!pNalParser || !pAuParser)
+    {
+        I360SCVP_unInit(pNalParser);
+        I360SCVP_unInit(pAuParser);
+        return;
+    }
+
+    // the reference is I360SCVP_ParseNAL called nal unit by nal unit
+    std::vector<Nalu> nalus;
+    uint8_t* pData = pInputBuffer;
+    int32_t restLen = bufferlen;
+    while (restLen > 0)
+    {
+        Nalu nal;
+        nal.data = pData;
+        nal.dataSize = restLen;
+        if (I360SCVP_ParseNAL(&nal, pNalParser) || nal.data != pData || nal.dataSize <= 0)
+            break;
+        nalus.push_back(nal);
+        pData += nal.dataSize;
+        restLen -= nal.dataSize;
+    }
+    EXPECT_EQ(restLen, 0);
+
+    int32_t naluNum = I360SCVP_ParseAccessUnit(pAuParser, pInputBuffer, bufferlen, NULL, 0);
+    EXPECT_EQ(naluNum, (int32_t)nalus.size());
+
+    std::vector<Nalu> index(nalus.size() / 2);
+    naluNum = I360SCVP_ParseAccessUnit(pAuParser, pInputBuffer, bufferlen, &index[0], (int32_t)index.size());
+    EXPECT_EQ(naluNum, (int32_t)nalus.size());
+    index.resize(nalus.size());
+    naluNum = I360SCVP_ParseAccessUnit(pAuParser, pInputBuffer, bufferlen, &index[0], (int32_t)index.size());
+    EXPECT_EQ(naluNum, (int32_t)nalus.size());
+    int32_t slices = 0;
+    for (uint32_t i = 0; i < nalus.size() && i < index.size(); i++)
+    {
+        EXPECT_EQ(index[i].data, nalus[i].data);
+        EXPECT_EQ(index[i].dataSize, nalus[i].dataSize);
+        EXPECT_EQ(index[i].startCodesSize, nalus[i].startCodesSize);
+        EXPECT_EQ(index[i].naluType, nalus[i].naluType);
+        EXPECT_EQ(index[i].seiPayloadType, nalus[i].seiPayloadType);
+        EXPECT_EQ(index[i].sliceHeaderLen, nalus[i].sliceHeaderLen);
+        if (index[i].naluType < 32 && index[i].sliceHeaderLen)
+            slices++;
+    }
+    EXPECT_GT(slices, 0);
+
+    // the bytes before the first start code are skipped
+    uint8_t skipped = nalus[0].startCodesSize;
+    naluNum = I360SCVP_ParseAccessUnit(pAuParser, pInputBuffer + skipped, bufferlen - skipped, &index[0], (int32_t)index.size());
+    EXPECT_EQ(naluNum, (int32_t)nalus.size() - 1);
+    EXPECT_EQ(index[0].data, nalus[1].data);
+    EXPECT_EQ(I360SCVP_ParseAccessUnit(pAuParser, NULL, bufferlen, NULL, 0), -1);
+
+    I360SCVP_unInit(pNalParser);
+    I360SCVP_unInit(pAuParser);
+}
+
+TEST_F(I360SCVPTest, ParamSetCache)
+{
+    HEVCState* pHevc = new HEVCState;
+    HEVCState* pCachedHevc = new HEVCState;
+    memset(pHevc, 0, sizeof(HEVCState));
+    memset(pCachedHevc, 0, sizeof(HEVCState));
+    pCachedHevc->param_set_cache = gts_media_hevc_param_set_cache_new();
+    ASSERT_TRUE(pCachedHevc->param_set_cache != NULL);
+
+    // the parameter sets come before the first slice
+    hevc_specialInfo specialInfo;
+    hevc_specialInfo cachedInfo;
+    int32_t paramSetNum = 0;
+    uint32_t pos = nalScanFindStartCode(pInputBuffer, bufferlen) + 3;
+    while (pos < (uint32_t)bufferlen)
+    {
+        uint32_t end = pos + nalScanFindStartCode(pInputBuffer + pos, bufferlen - pos);
+        uint32_t next = end + 3;
+        while (end > pos && !pInputBuffer[end - 1])
+            end--;
+        uint8_t type = pInputBuffer[pos] >> 1;
+        if (type < GTS_HEVC_NALU_VID_PARAM)
+            break;
+        for (int32_t round = 0; round < 2; round++)
+        {
+            memset(&specialInfo, 0, sizeof(hevc_specialInfo));
+            memset(&cachedInfo, 0, sizeof(hevc_specialInfo));
+            int32_t ret = gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)pInputBuffer + pos, end - pos, pHevc);
+            EXPECT_EQ(ret, gts_media_hevc_parse_nalu(&cachedInfo, (int8_t*)pInputBuffer + pos, end - pos, pCachedHevc));
+            EXPECT_EQ(specialInfo.naluType, cachedInfo.naluType);
+            EXPECT_EQ(specialInfo.temporal_id, cachedInfo.temporal_id);
+        }
+        if (type <= GTS_HEVC_NALU_PIC_PARAM)
+            paramSetNum++;
+        pos = next;
+    }
+    EXPECT_EQ(3, paramSetNum);
+    EXPECT_TRUE(pCachedHevc->param_set_cache->sps_entry[pHevc->last_parsed_sps_id].size > 0);
+    EXPECT_TRUE(pCachedHevc->param_set_cache->pps_entry[pHevc->last_parsed_pps_id].size > 0);
+    EXPECT_EQ(pHevc->last_parsed_vps_id, pCachedHevc->last_parsed_vps_id);
+    EXPECT_EQ(pHevc->last_parsed_sps_id, pCachedHevc->last_parsed_sps_id);
+    EXPECT_EQ(pHevc->last_parsed_pps_id, pCachedHevc->last_parsed_pps_id);
+    EXPECT_EQ(pHevc->sps_active_idx, pCachedHevc->sps_active_idx);
+    EXPECT_EQ(pHevc->tile_slice_count, pCachedHevc->tile_slice_count);
+    EXPECT_EQ(0, memcmp(pHevc->vps, pCachedHevc->vps, sizeof(pHevc->vps)));
+    EXPECT_EQ(0, memcmp(pHevc->sps, pCachedHevc->sps, sizeof(pHevc->sps)));
+    EXPECT_EQ(0, memcmp(pHevc->pps, pCachedHevc->pps, sizeof(pHevc->pps)));
+
+    // the cached parameter sets are written as the first ones
+    std::vector<int8_t> ref(2048), out(2048);
+    GTS_BitStream* bs = gts_bs_new(&ref[0], ref.size(), GTS_BITSTREAM_WRITE);
+    hevc_write_parameter_sets(bs, pHevc);
+    uint32_t refSize = (uint32_t)gts_bs_get_position(bs);
+    gts_bs_del(bs);
+    uint8_t parsed[4] = { 1, 2, 3, 4 };
+    uint32_t layout[2] = { 3840, 1920 };
+    for (int32_t round = 0; round < 2; round++)
+    {
+        bs = gts_bs_new(&out[0], out.size(), GTS_BITSTREAM_WRITE);
+        hevc_write_parameter_sets_cached(bs, pCachedHevc, 1, parsed, sizeof(parsed), (uint8_t*)layout, sizeof(layout));
+        EXPECT_EQ(refSize, gts_bs_get_position(bs));
+        EXPECT_EQ(0, memcmp(&ref[0], &out[0], refSize));
+        gts_bs_del(bs);
+        EXPECT_EQ(refSize, pCachedHevc->param_set_cache->written_size);
+    }
+
+    // the same key with other parsed sets or another layout is a collision, the sets are written again
+    for (int32_t round = 0; round < 2; round++)
+    {
+        pHevc->sps[0].width += 64;
+        pCachedHevc->sps[0].width += 64;
+        if (round == 0)
+            parsed[3]++;
+        else
+            layout[0] += 64;
+        bs = gts_bs_new(&ref[0], ref.size(), GTS_BITSTREAM_WRITE);
+        hevc_write_parameter_sets(bs, pHevc);
+        refSize = (uint32_t)gts_bs_get_position(bs);
+        gts_bs_del(bs);
+        bs = gts_bs_new(&out[0], out.size(), GTS_BITSTREAM_WRITE);
+        hevc_write_parameter_sets_cached(bs, pCachedHevc, 1, parsed, sizeof(parsed), (uint8_t*)layout, sizeof(layout));
+        EXPECT_EQ(refSize, gts_bs_get_position(bs));
+        EXPECT_EQ(0, memcmp(&ref[0], &out[0], refSize));
+        gts_bs_del(bs);
+    }
+
+    gts_media_hevc_param_set_cache_del(pCachedHevc->param_set_cache);
+    delete pHevc;
+    delete pCachedHevc;
+}
+
+TEST_F(I360SCVPTest, BitWriter)
+{
+    std::vector<int8_t> bits(8192), ref(12288), out(12288);
+    srand(11);
+    for (int32_t round = 0; round < 100; round++)
+    {
+        // the values are mostly zero to get emulation prevention bytes
+        memset(&bits[0], 0, bits.size());
+        uint64_t bitNum = 0;
+        GTS_BitStream* bs = gts_bs_new(&out[0], out.size(), GTS_BITSTREAM_WRITE);
+        ASSERT_TRUE(bs != NULL);
+        while (bitNum + 64 < bits.size() * 8)
+        {
+            int32_t nBits = 1 + rand() % 40;
+            uint32_t value = (rand() % 4) ? (rand() % 4) : ((uint32_t)rand() << 16) ^ rand();
+            for (int32_t i = nBits - 1; i >= 0; i--, bitNum++)
+            {
+                if (i < 32 && ((value >> i) & 1))
+                    bits[bitNum >> 3] |= (int8_t)(0x80 >> (bitNum & 7));
+            }
+            gts_bs_write_int(bs, (int32_t)value, nBits);
+        }
+        EXPECT_EQ((uint32_t)(bitNum & 7), bs->nbBits);
+        gts_bs_align(bs);
+        uint32_t byteNum = (uint32_t)((bitNum + 7) >> 3);
+        uint32_t refSize = refInsertEmulationBytes(&bits[0], &ref[0], byteNum);
+        EXPECT_EQ(refSize, gts_bs_get_position(bs));
+        EXPECT_EQ(0, memcmp(&ref[0], &out[0], refSize));
+        gts_bs_del(bs);
+    }
+}
+
+TEST_F(I360SCVPTest, SliceHeaderSplice)
+{
+    HEVCState* pHevc = new HEVCState;
+    memset(pHevc, 0, sizeof(HEVCState));
+    HEVCSliceHeaderTemplate headerTemplate;
+    memset(&headerTemplate, 0, sizeof(HEVCSliceHeaderTemplate));
+    std::vector<int8_t> ref(256), out(256);
+    hevc_specialInfo specialInfo;
+    int32_t sliceNum = 0;
+    uint32_t pos = nalScanFindStartCode(pInputBuffer, bufferlen) + 3;
+    while (pos < (uint32_t)bufferlen && sliceNum < 64)
+    {
+        uint32_t end = pos + nalScanFindStartCode(pInputBuffer + pos, bufferlen - pos);
+        uint32_t next = end + 3;
+        while (end > pos && !pInputBuffer[end - 1])
+            end--;
+        memset(&specialInfo, 0, sizeof(hevc_specialInfo));
+        gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)pInputBuffer + pos, end - pos, pHevc);
+        if (specialInfo.naluType < 32)
+        {
+            // the addresses and the sizes change the address bits in front of the spliced ones
+            for (uint32_t addr = 0; addr < 600; addr += 37)
+            {
+                pHevc->s_info.first_slice_segment_in_pic_flag = !addr;
+                pHevc->s_info.slice_segment_address = addr;
+                pHevc->sps[pHevc->last_parsed_sps_id].width = (addr & 1) ? 7680 : 3840;
+                GTS_BitStream* bs = gts_bs_new(&ref[0], ref.size(), GTS_BITSTREAM_WRITE);
+                hevc_write_slice_header(bs, pHevc);
+                uint32_t refSize = (uint32_t)gts_bs_get_position(bs);
+                gts_bs_del(bs);
+                bs = gts_bs_new(&out[0], out.size(), GTS_BITSTREAM_WRITE);
+                hevc_write_slice_header_spliced(bs, pHevc, &headerTemplate);
+                EXPECT_EQ(refSize, gts_bs_get_position(bs));
+                EXPECT_EQ(0, memcmp(&ref[0], &out[0], refSize));
+                gts_bs_del(bs);
+                EXPECT_TRUE(headerTemplate.field_num > 0);
+            }
+            sliceNum++;
+        }
+        pos = next;
+    }
+    EXPECT_TRUE(sliceNum > 0);
+    delete pHevc;
+}
+
+TEST_F(I360SCVPTest, BitstreamFileMapped)
+{
+    EXPECT_TRUE(gts_bs_from_file_mapped("./not_existing.265", false) == NULL);
+    EXPECT_TRUE(gts_bs_from_file_mapped(NULL, false) == NULL);
+
+    GTS_BitStream* bs = gts_bs_from_file_mapped("./test.265", true);
+    ASSERT_TRUE(bs != NULL);
+    EXPECT_EQ((uint64_t)bufferlen, gts_bs_get_size(bs));
+    EXPECT_EQ(0, memcmp(bs->original, pInputBuffer, bufferlen));
+
+    // the mapped file is read as a memory buffer
+    GTS_BitStream* ref = gts_bs_new((int8_t*)pInputBuffer, bufferlen, GTS_BITSTREAM_READ);
+    ASSERT_TRUE(ref != NULL);
+    srand(5);
+    for (int32_t i = 0; i < 1000; i++)
+    {
+        uint32_t nBits = 1 + rand() % 32;
+        EXPECT_EQ(gts_bs_read_int(ref, nBits), gts_bs_read_int(bs, nBits));
+        EXPECT_EQ(gts_bs_read_ue(ref), gts_bs_read_ue(bs));
+    }
+    EXPECT_EQ(GTS_OK, gts_bs_seek(bs, bufferlen - 1));
+    EXPECT_EQ(pInputBuffer[bufferlen - 1], gts_bs_read_int(bs, 8));
+    EXPECT_EQ(0u, gts_bs_available(bs));
+    gts_bs_del(ref);
+    gts_bs_del(bs);
+}
+
+// a 2x2 tiled frame made of the parameter sets and the first slice header of the stream, and the params merging it
+struct TileMergeFrame
+{
+    std::vector<uint8_t> header, tiles[4];
+    param_oneStream_info tileInfo[4], headerInfo, lowHeaderInfo;
+    param_oneStream_info* pTileInfo[4];
+    param_mergeStream param;
+};
+
+static void initTileMergeFrame(TileMergeFrame* pFrame, uint8_t* pInputBuffer, int32_t bufferlen, bool chromaQpOffsets = false)
+{
+    HEVCState* pHevc = new HEVCState;
+    memset(pHevc, 0, sizeof(HEVCState));
+    hevc_specialInfo specialInfo;
+    uint32_t pos = nalScanFindStartCode(pInputBuffer, bufferlen) + 3;
+    do
+    {
+        uint32_t end = pos + nalScanFindStartCode(pInputBuffer + pos, bufferlen - pos);
+        memset(&specialInfo, 0, sizeof(hevc_specialInfo));
+        gts_media_hevc_parse_nalu(&specialInfo, (int8_t*)pInputBuffer + pos, end - pos, pHevc);
+        pos = end + 3;
+    } while (pos < (uint32_t)bufferlen && !(specialInfo.naluType < 32 && specialInfo.sliceHeaderLen));
+    HEVC_PPS* pps = &pHevc->pps[pHevc->last_parsed_pps_id];
+    pHevc->sps[pHevc->last_parsed_sps_id].width = 3840;
+    pHevc->sps[pHevc->last_parsed_sps_id].height = 2048;
+    pps->tiles_enabled_flag = true;
+    pps->uniform_spacing_flag = false;
+    pps->num_tile_columns = pps->num_tile_rows = 2;
+    pps->column_width[0] = pps->column_width[1] = 30;
+    pps->row_height[0] = pps->row_height[1] = 16;
+    // the chroma offsets change the slice header syntax the tiles are parsed with
+    pps->slice_chroma_qp_offsets_present_flag = chromaQpOffsets;
+    pHevc->s_info.slice_cb_qp_offset = chromaQpOffsets ? 3 : 0;
+    pHevc->s_info.slice_cr_qp_offset = chromaQpOffsets ? -2 : 0;
+
+    std::vector<uint8_t>& header = pFrame->header;
+    header.resize(1024);
+    GTS_BitStream* bs = gts_bs_new((int8_t*)&header[0], header.size(), GTS_BITSTREAM_WRITE);
+    hevc_write_parameter_sets(bs, pHevc);
+    header.resize((size_t)gts_bs_get_position(bs));
+    gts_bs_del(bs);
+    memset(pFrame->tileInfo, 0, sizeof(pFrame->tileInfo));
+    memset(&pFrame->headerInfo, 0, sizeof(pFrame->headerInfo));
+    memset(&pFrame->lowHeaderInfo, 0, sizeof(pFrame->lowHeaderInfo));
+    for (int32_t i = 0; i < 4; i++)
+    {
+        std::vector<uint8_t>& tile = pFrame->tiles[i];
+        tile.resize(1024);
+        pHevc->s_info.first_slice_segment_in_pic_flag = (i == 0);
+        pHevc->s_info.slice_segment_address = (i / 2) * 16 * 60 + (i % 2) * 30;
+        bs = gts_bs_new((int8_t*)&tile[0], tile.size(), GTS_BITSTREAM_WRITE);
+        hevc_write_slice_header(bs, pHevc);
+        uint32_t headerSize = (uint32_t)gts_bs_get_position(bs);
+        gts_bs_del(bs);
+        tile.resize(headerSize);
+        tile.resize(headerSize + 100 * (i + 1), (uint8_t)(0x11 * (i + 1)));
+        pFrame->tileInfo[i].pTiledBitstreamBuffer = &tile[0];
+        pFrame->tileInfo[i].inputBufferLen = (uint32_t)tile.size();
+        pFrame->pTileInfo[i] = &pFrame->tileInfo[i];
+    }
+    pFrame->headerInfo.pTiledBitstreamBuffer = &header[0];
+    pFrame->headerInfo.inputBufferLen = (uint32_t)header.size();
+
+    param_mergeStream& param = pFrame->param;
+    memset(&param, 0, sizeof(param_mergeStream));
+    param.highRes.width = 3840;
+    param.highRes.height = 2048;
+    param.highRes.totalTilesCount = param.highRes.selectedTilesCount = 4;
+    param.highRes.pTiledBitstreams = pFrame->pTileInfo;
+    param.highRes.pHeader = &pFrame->headerInfo;
+    param.highRes.tile_width = param.lowRes.tile_width = 1920;
+    param.highRes.tile_height = param.lowRes.tile_height = 1024;
+    param.highRes.num_tile_columns = param.highRes.num_tile_rows = 2;
+    param.highRes.bOrdered = true;
+    param.lowRes.pHeader = &pFrame->lowHeaderInfo;
+    param.bWroteHeader = true;
+    delete pHevc;
+}
+
+TEST_F(I360SCVPTest, TileMergeOutputSize)
+{
+    TileMergeFrame mergeFrame;
+    initTileMergeFrame(&mergeFrame, pInputBuffer, bufferlen);
+    param_mergeStream& param = mergeFrame.param;
+    void* handle = tile_merge_Init(&param);
+    ASSERT_TRUE(handle != NULL);
+
+    uint32_t outputSize = 0;
+    EXPECT_EQ(-1, tile_merge_GetOutputSize(&param, handle, NULL));
+    EXPECT_EQ(0, tile_merge_GetOutputSize(&param, handle, &outputSize));
+    EXPECT_TRUE(outputSize > 1000);
+
+    // the size query leaves nothing behind, and the frames merged with the same state are the same
+    std::vector<uint8_t> first, output(outputSize);
+    param.pOutputBitstream = &output[0];
+    param.outputBitstreamSize = outputSize;
+    int64_t allocBefore = 0;
+    for (int32_t frame = 0; frame < 4; frame++)
+    {
+        tile_merge_reset(handle);
+        EXPECT_EQ(0, tile_merge_Process(&param, handle));
+        EXPECT_EQ(outputSize, param.outputiledbistreamlen);
+        if (!frame)
+        {
+            first = output;
+            allocBefore = g_allocCount;
+        }
+        else
+        {
+            EXPECT_TRUE(first == output);
+        }
+    }
+    // the frames after the first one merge without any allocation
+    EXPECT_EQ(0, g_allocCount - allocBefore);
+    // the tile data is copied after the rewritten slice headers
+    EXPECT_EQ(0x44, first[first.size() - 1]);
+
+    // the threads are started once, and merge the same frames without any allocation either
+    EXPECT_EQ(0, tile_merge_SetThreads(handle, 3));
+    for (int32_t frame = 0; frame < 4; frame++)
+    {
+        tile_merge_reset(handle);
+        EXPECT_EQ(0, tile_merge_Process(&param, handle));
+        if (!frame)
+            allocBefore = g_allocCount;
+        EXPECT_TRUE(first == output);
+    }
+    EXPECT_EQ(0, g_allocCount - allocBefore);
+
+    // the merging fails instead of writing past a buffer too small for the frame
+    param.outputBitstreamSize = outputSize - 1;
+    tile_merge_reset(handle);
+    EXPECT_EQ(-1, tile_merge_Process(&param, handle));
+
+    EXPECT_EQ(0, tile_merge_Close(handle));
+}
+
+TEST_F(I360SCVPTest, TileMergeThreadsHeaderChange)
+{
+    TileMergeFrame mergeFrames[2];
+    initTileMergeFrame(&mergeFrames[0], pInputBuffer, bufferlen);
+    initTileMergeFrame(&mergeFrames[1], pInputBuffer, bufferlen, true);
+    void* handle = tile_merge_Init(&mergeFrames[0].param);
+    ASSERT_TRUE(handle != NULL);
+    EXPECT_EQ(0, tile_merge_SetThreads(handle, 3));
+
+    // the threads keep their states over frames, and take the parameter sets of the frame they merge
+    std::vector<uint8_t> output(1 << 16);
+    static const int32_t frameOrder[6] = { 0, 1, 1, 0, 1, 0 };
+    for (int32_t frame = 0; frame < 6; frame++)
+    {
+        param_mergeStream& param = mergeFrames[frameOrder[frame]].param;
+        param.pOutputBitstream = pOutputBuffer;
+        tile_merge_reset(handle);
+        EXPECT_EQ(0, tile_merge_Process(&param, handle));
+        uint32_t mergedSize = param.outputiledbistreamlen;
+        memcpy(&output[0], pOutputBuffer, mergedSize);
+
+        void* newHandle = tile_merge_Init(&param);
+        ASSERT_TRUE(newHandle != NULL);
+        EXPECT_EQ(0, tile_merge_Process(&param, newHandle));
+        EXPECT_EQ(mergedSize, param.outputiledbistreamlen);
+        EXPECT_EQ(0, memcmp(&output[0], pOutputBuffer, mergedSize));
+        EXPECT_EQ(0, tile_merge_Close(newHandle));
+    }
+    EXPECT_EQ(0, tile_merge_Close(handle));
+}
+
+TEST_F(I360SCVPTest, TileMergeLayoutCache)
+{
+    TileMergeFrame mergeFrame;
+    initTileMergeFrame(&mergeFrame, pInputBuffer, bufferlen);
+    param_mergeStream& param = mergeFrame.param;
+    void* handle = tile_merge_Init(&param);
+    ASSERT_TRUE(handle != NULL);
+
+    // the layouts come back from the cache when they alternate, and give the frames merged by a new handle
+    static const int32_t layouts[6][2] = { { 2, 2 }, { 4, 1 }, { 2, 2 }, { 1, 4 }, { 4, 1 }, { 2, 2 } };
+    std::vector<uint8_t> merged[6];
+    param.pOutputBitstream = pOutputBuffer;
+    for (int32_t frame = 0; frame < 6; frame++)
+    {
+        param.highRes.num_tile_columns = layouts[frame][0];
+        param.highRes.num_tile_rows = layouts[frame][1];
+        tile_merge_reset(handle);
+        EXPECT_EQ(0, tile_merge_Process(&param, handle));
+        merged[frame].assign(pOutputBuffer, pOutputBuffer + param.outputiledbistreamlen);
+
+        void* newHandle = tile_merge_Init(&param);
+        ASSERT_TRUE(newHandle != NULL);
+        EXPECT_EQ(0, tile_merge_Process(&param, newHandle));
+        EXPECT_EQ(merged[frame].size(), param.outputiledbistreamlen);
+        EXPECT_EQ(0, memcmp(&merged[frame][0], pOutputBuffer, merged[frame].size()));
+        EXPECT_EQ(0, tile_merge_Close(newHandle));
+    }
+    EXPECT_TRUE(merged[0] == merged[2]);
+    EXPECT_TRUE(merged[0] == merged[5]);
+    EXPECT_TRUE(merged[1] == merged[4]);
+    EXPECT_FALSE(merged[0] == merged[1]);
+    EXPECT_FALSE(merged[1] == merged[3]);
+
+    // a layout with the same fingerprint as another one is not taken for it
+    hevc_mergeStream* mergeStream = (hevc_mergeStream*)handle;
+    merge_layout* pLayout2x2 = mergeStream->pLayout;
+    param.highRes.num_tile_columns = 4;
+    param.highRes.num_tile_rows = 1;
+    tile_merge_reset(handle);
+    EXPECT_EQ(0, tile_merge_Process(&param, handle));
+    mergeStream->pLayout->key = pLayout2x2->key;
+    pLayout2x2->lastUsed = 0;
+    param.highRes.num_tile_columns = param.highRes.num_tile_rows = 2;
+    tile_merge_reset(handle);
+    EXPECT_EQ(0, tile_merge_Process(&param, handle));
+    EXPECT_EQ(merged[0].size(), param.outputiledbistreamlen);
+    EXPECT_EQ(0, memcmp(&merged[0][0], pOutputBuffer, merged[0].size()));
+
+    // the written parameter sets are only taken for the parsed ones they are written from
+    ASSERT_TRUE(mergeStream->pLayout && mergeStream->pLayout->paramSetsSize);
+    mergeStream->pLayout->paramSets[mergeStream->pLayout->paramSetsSize - 2] ^= 0x55;
+    tile_merge_reset(handle);
+    EXPECT_EQ(0, tile_merge_Process(&param, handle));
+    EXPECT_NE(0, memcmp(&merged[0][0], pOutputBuffer, merged[0].size()));
+    mergeStream->pLayout->parsedParamSets[0] ^= 0x55;
+    tile_merge_reset(handle);
+    EXPECT_EQ(0, tile_merge_Process(&param, handle));
+    EXPECT_EQ(0, memcmp(&merged[0][0], pOutputBuffer, merged[0].size()));
+
+    EXPECT_EQ(0, tile_merge_Close(handle));
+}
+
+TEST_F(I360SCVPTest, ProcessSegments)
+{
+    param.paramViewPort.faceWidth = 3840;
+    param.paramViewPort.faceHeight = 2048;
+    param.paramViewPort.geoTypeInput = EGeometryType(E_SVIDEO_EQUIRECT);
+    param.paramViewPort.viewportHeight = 960;
+    param.paramViewPort.viewportWidth = 960;
+    param.paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    param.paramViewPort.viewPortYaw = -90;
+    param.paramViewPort.viewPortPitch = 0;
+    param.paramViewPort.viewPortFOVH = 80;
+    param.paramViewPort.viewPortFOVV = 80;
+    param.usedType = E_MERGE_AND_VIEWPORT;
+
+    // the segments one after the other are the merged bitstream, the slice data is not copied
+    void* pI360SCVP = I360SCVP_Init(&param);
+    ASSERT_TRUE(pI360SCVP != NULL);
+    EXPECT_EQ(0, I360SCVP_process(&param, pI360SCVP));
+    std::vector<uint8_t> merged(pOutputBuffer, pOutputBuffer + param.outputBitstreamLen);
+    I360SCVP_unInit(pI360SCVP);
+
+    pI360SCVP = I360SCVP_Init(&param);
+    ASSERT_TRUE(pI360SCVP != NULL);
+    BitstreamSegment* pSegments = NULL;
+    int32_t segmentNum = 0;
+    EXPECT_EQ(-1, I360SCVP_processSegments(&param, pI360SCVP, NULL, &segmentNum));
+    param.outputBitstreamLen = 0;
+    EXPECT_EQ(0, I360SCVP_processSegments(&param, pI360SCVP, &pSegments, &segmentNum));
+    ASSERT_TRUE(segmentNum > 1);
+    std::vector<uint8_t> gathered;
+    bool dataInInput = false;
+    for (int32_t i = 0; i < segmentNum; i++)
+    {
+        gathered.insert(gathered.end(), pSegments[i].pData, pSegments[i].pData + pSegments[i].dataLen);
+        dataInInput |= (pSegments[i].pData >= pInputBuffer && pSegments[i].pData < pInputBuffer + bufferlen);
+    }
+    EXPECT_TRUE(dataInInput);
+    EXPECT_EQ(merged.size(), (size_t)param.outputBitstreamLen);
+    EXPECT_TRUE(gathered == merged);
+    I360SCVP_unInit(pI360SCVP);
+}
+
+TEST_F(I360SCVPTest, StitchSegments)
+{
+    // the stream stitched with itself gives the same bitstream with and without segments
+    std::vector<uint8_t> merged;
+    std::vector<uint8_t> gathered;
+    BitstreamSegment* pSegments = NULL;
+    int32_t segmentNum = 0;
+    void* pI360SCVP = NULL;
+    param_oneStream_info streams[2];
+    param_oneStream_info* pStreams[2] = { &streams[0], &streams[1] };
+    memset(streams, 0, sizeof(streams));
+    param.usedType = E_STREAM_STITCH_ONLY;
+    param.paramPicInfo.picWidth = 3840 * 2;
+    param.paramPicInfo.picHeight = 2048;
+    param.paramPicInfo.tileWidthNum = 2;
+    param.paramPicInfo.tileHeightNum = 1;
+    param.paramPicInfo.tileIsUniform = 1;
+    param.paramStitchInfo.pTiledBitstream = pStreams;
+    param.inputBitstreamLen = bufferlen * 2;
+    for (int32_t segmented = 0; segmented < 2; segmented++)
+    {
+        pI360SCVP = I360SCVP_Init(&param);
+        ASSERT_TRUE(pI360SCVP != NULL);
+        for (int32_t i = 0; i < 2; i++)
+        {
+            streams[i].pTiledBitstreamBuffer = pInputBuffer;
+            streams[i].inputBufferLen = bufferlen;
+            streams[i].tilesIdx = i;
+        }
+        param.outputBitstreamLen = 0;
+        if (!segmented)
+        {
+            EXPECT_EQ(0, I360SCVP_process(&param, pI360SCVP));
+            merged.assign(pOutputBuffer, pOutputBuffer + param.outputBitstreamLen);
+        }
+        else
+        {
+            EXPECT_EQ(0, I360SCVP_processSegments(&param, pI360SCVP, &pSegments, &segmentNum));
+            gathered.clear();
+            for (int32_t i = 0; i < segmentNum; i++)
+                gathered.insert(gathered.end(), pSegments[i].pData, pSegments[i].pData + pSegments[i].dataLen);
+            EXPECT_EQ(merged.size(), (size_t)param.outputBitstreamLen);
+            EXPECT_TRUE(gathered == merged);
+        }
+        I360SCVP_unInit(pI360SCVP);
+    }
+    EXPECT_TRUE(merged.size() > 0);
+}
+
+TEST_F(I360SCVPTest, MergeThreads)
+{
+    param.paramViewPort.faceWidth = 3840;
+    param.paramViewPort.faceHeight = 2048;
+    param.paramViewPort.geoTypeInput = EGeometryType(E_SVIDEO_EQUIRECT);
+    param.paramViewPort.viewportHeight = 960;
+    param.paramViewPort.viewportWidth = 960;
+    param.paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    param.paramViewPort.viewPortYaw = 30;
+    param.paramViewPort.viewPortPitch = 20;
+    param.paramViewPort.viewPortFOVH = 80;
+    param.paramViewPort.viewPortFOVV = 80;
+    param.usedType = E_MERGE_AND_VIEWPORT;
+
+    // the tiles merged by any number of threads give the stream merged by one thread
+    std::vector<uint8_t> input(pInputBuffer, pInputBuffer + bufferlen);
+    std::vector<uint8_t> merged;
+    static const int32_t threads[4] = { 1, 2, 3, 64 };
+    for (int32_t t = 0; t < 4; t++)
+    {
+        for (int32_t segmented = 0; segmented < 2; segmented++)
+        {
+            // the merging changes the input, so each one starts from the same input
+            memcpy(pInputBuffer, &input[0], input.size());
+            void* pI360SCVP = I360SCVP_Init(&param);
+            ASSERT_TRUE(pI360SCVP != NULL);
+            int32_t threadNum = threads[t];
+            EXPECT_EQ(0, I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_MERGE_THREADS, &threadNum));
+            param.outputBitstreamLen = 0;
+            std::vector<uint8_t> output;
+            if (!segmented)
+            {
+                EXPECT_EQ(0, I360SCVP_process(&param, pI360SCVP));
+                output.assign(pOutputBuffer, pOutputBuffer + param.outputBitstreamLen);
+            }
+            else
+            {
+                BitstreamSegment* pSegments = NULL;
+                int32_t segmentNum = 0;
+                EXPECT_EQ(0, I360SCVP_processSegments(&param, pI360SCVP, &pSegments, &segmentNum));
+                for (int32_t i = 0; i < segmentNum; i++)
+                    output.insert(output.end(), pSegments[i].pData, pSegments[i].pData + pSegments[i].dataLen);
+                EXPECT_EQ(output.size(), (size_t)param.outputBitstreamLen);
+            }
+            if (merged.empty())
+                merged = output;
+            EXPECT_TRUE(output == merged);
+            I360SCVP_unInit(pI360SCVP);
+        }
+    }
+    EXPECT_TRUE(merged.size() > 0);
+}
+
+TEST_F(I360SCVPTest, SharedFrameMerge)
+{
+    param.paramViewPort.faceWidth = 3840;
+    param.paramViewPort.faceHeight = 2048;
+    param.paramViewPort.geoTypeInput = EGeometryType(E_SVIDEO_EQUIRECT);
+    param.paramViewPort.viewportHeight = 960;
+    param.paramViewPort.viewportWidth = 960;
+    param.paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    param.paramViewPort.viewPortPitch = 0;
+    param.paramViewPort.viewPortFOVH = 80;
+    param.paramViewPort.viewPortFOVV = 80;
+    param.usedType = E_MERGE_AND_VIEWPORT;
+
+    // the viewports merged from one shared parsing are the ones merged by their own handles
+    static const int32_t userNum = 3;
+    static const float yaws[userNum] = { -90, 0, 120 };
+    std::vector<uint8_t> input(pInputBuffer, pInputBuffer + bufferlen);
+    std::vector<uint8_t> inputLow(pInputBufferlow, pInputBufferlow + bufferlenlow);
+    std::vector<uint8_t> expected[userNum];
+    for (int32_t u = 0; u < userNum; u++)
+    {
+        memcpy(pInputBuffer, &input[0], input.size());
+        memcpy(pInputBufferlow, &inputLow[0], inputLow.size());
+        param.paramViewPort.viewPortYaw = yaws[u];
+        void* pI360SCVP = I360SCVP_Init(&param);
+        ASSERT_TRUE(pI360SCVP != NULL);
+        EXPECT_EQ(0, I360SCVP_process(&param, pI360SCVP));
+        expected[u].assign(pOutputBuffer, pOutputBuffer + param.outputBitstreamLen);
+        I360SCVP_unInit(pI360SCVP);
+    }
+
+    memcpy(pInputBuffer, &input[0], input.size());
+    memcpy(pInputBufferlow, &inputLow[0], inputLow.size());
+    param_360SCVP userParam[userNum];
+    void* pUsers[userNum];
+    std::vector<uint8_t> userOutput[userNum];
+    std::vector<uint8_t> userSEI[userNum];
+    for (int32_t u = 0; u < userNum; u++)
+    {
+        userOutput[u].resize(bufferlen);
+        userSEI[u].resize(2000);
+        userParam[u] = param;
+        userParam[u].paramViewPort.viewPortYaw = yaws[u];
+        userParam[u].pOutputBitstream = &userOutput[u][0];
+        userParam[u].pOutputSEI = &userSEI[u][0];
+        pUsers[u] = I360SCVP_Init(&userParam[u]);
+        ASSERT_TRUE(pUsers[u] != NULL);
+    }
+    EXPECT_TRUE(I360SCVP_SharedFrameInit(NULL) == NULL);
+    void* pShared = I360SCVP_SharedFrameInit(&param);
+    ASSERT_TRUE(pShared != NULL);
+    EXPECT_EQ(0, I360SCVP_SharedFrameParse(&param, pShared));
+    EXPECT_NE(0, I360SCVP_processShared(&userParam[0], pUsers[0], NULL, NULL, NULL));
+
+    // the handles read the shared frame at the same time
+    int32_t ret[userNum];
+    std::vector<std::thread> workers;
+    for (int32_t u = 0; u < userNum; u++)
+    {
+        workers.push_back(std::thread([&, u]() {
+            ret[u] = I360SCVP_processShared(&userParam[u], pUsers[u], pShared, NULL, NULL);
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+    for (int32_t u = 0; u < userNum; u++)
+    {
+        EXPECT_EQ(0, ret[u]);
+        EXPECT_EQ(expected[u].size(), (size_t)userParam[u].outputBitstreamLen);
+        EXPECT_EQ(0, memcmp(&expected[u][0], &userOutput[u][0], expected[u].size()));
+    }
+
+    // and give the same stream as segments
+    BitstreamSegment* pSegments = NULL;
+    int32_t segmentNum = 0;
+    EXPECT_EQ(0, I360SCVP_processShared(&userParam[1], pUsers[1], pShared, &pSegments, &segmentNum));
+    std::vector<uint8_t> gathered;
+    for (int32_t i = 0; i < segmentNum; i++)
+        gathered.insert(gathered.end(), pSegments[i].pData, pSegments[i].pData + pSegments[i].dataLen);
+    EXPECT_TRUE(gathered == expected[1]);
+
+    for (int32_t u = 0; u < userNum; u++)
+        I360SCVP_unInit(pUsers[u]);
+    EXPECT_EQ(0, I360SCVP_SharedFrameUnInit(pShared));
+    EXPECT_FALSE(expected[0] == expected[2]);
+}
+
+TEST_F(I360SCVPTest, ThreeTierMerge)
+{
+    param.paramViewPort.faceWidth = 3840;
+    param.paramViewPort.faceHeight = 2048;
+    param.paramViewPort.geoTypeInput = EGeometryType(E_SVIDEO_EQUIRECT);
+    param.paramViewPort.viewportHeight = 960;
+    param.paramViewPort.viewportWidth = 960;
+    param.paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    param.paramViewPort.viewPortYaw = 0;
+    param.paramViewPort.viewPortPitch = 0;
+    param.paramViewPort.viewPortFOVH = 80;
+    param.paramViewPort.viewPortFOVV = 80;
+    param.usedType = E_MERGE_AND_VIEWPORT;
+
+    // the mid tier is a window of 5x2 tiles of the high resolution stream, the merged frame has 5 tiles in a column
+    std::vector<uint8_t> input(pInputBuffer, pInputBuffer + bufferlen);
+    std::vector<uint8_t> inputLow(pInputBufferlow, pInputBufferlow + bufferlenlow);
+    std::vector<uint8_t> inputMid(bufferlen * 2);
+    memcpy(&inputMid[0], pInputBuffer, bufferlen);
+    param_midTier midTier;
+    memset(&midTier, 0, sizeof(param_midTier));
+    midTier.pInputBitstream = &inputMid[0];
+    midTier.inputBitstreamLen = bufferlen;
+    midTier.frameWidth = frameWidth;
+    midTier.frameHeight = frameHeight;
+    midTier.tileWidthNumSel = 5;
+    midTier.tileHeightNumSel = 2;
+    param.midTierNum = MAX_MID_TIER_NUM + 1;
+    param.pMidTiers = &midTier;
+    EXPECT_TRUE(I360SCVP_Init(&param) == NULL);
+    param.midTierNum = 1;
+    param.pMidTiers = NULL;
+    EXPECT_TRUE(I360SCVP_Init(&param) == NULL);
+    // the rwpk SEI counts the regions of all the tiers on 8 bits
+    param_midTier wholeTiers[MAX_MID_TIER_NUM];
+    for (int32_t k = 0; k < MAX_MID_TIER_NUM; k++)
+    {
+        wholeTiers[k] = midTier;
+        wholeTiers[k].tileWidthNumSel = 10;
+        wholeTiers[k].tileHeightNumSel = 8;
+    }
+    param.midTierNum = MAX_MID_TIER_NUM;
+    param.pMidTiers = wholeTiers;
+    EXPECT_TRUE(I360SCVP_Init(&param) == NULL);
+    memcpy(pInputBuffer, &input[0], input.size());
+    memcpy(pInputBufferlow, &inputLow[0], inputLow.size());
+    memcpy(&inputMid[0], &input[0], input.size());
+    param.midTierNum = 1;
+    param.pMidTiers = &midTier;
+
+    void* pI360SCVP = I360SCVP_Init(&param);
+    ASSERT_TRUE(pI360SCVP != NULL);
+    EXPECT_EQ(0, I360SCVP_process(&param, pI360SCVP));
+    ASSERT_GT(param.outputBitstreamLen, 0u);
+    std::vector<uint8_t> output(pOutputBuffer, pOutputBuffer + param.outputBitstreamLen);
+
+    // the segments of the next frame are the same frame
+    memcpy(pInputBuffer, &input[0], input.size());
+    memcpy(pInputBufferlow, &inputLow[0], inputLow.size());
+    memcpy(&inputMid[0], &input[0], input.size());
+    BitstreamSegment* pSegments = NULL;
+    int32_t segmentNum = 0;
+    EXPECT_EQ(0, I360SCVP_processSegments(&param, pI360SCVP, &pSegments, &segmentNum));
+    std::vector<uint8_t> segmentsOutput;
+    for (int32_t i = 0; i < segmentNum; i++)
+        segmentsOutput.insert(segmentsOutput.end(), pSegments[i].pData, pSegments[i].pData + pSegments[i].dataLen);
+    EXPECT_TRUE(segmentsOutput == output);
+
+    // the tiles of all the tiers are merged the same on several threads
+    int32_t threadNum = 3;
+    EXPECT_EQ(0, I360SCVP_SetParameter(pI360SCVP, ID_SCVP_PARAM_MERGE_THREADS, &threadNum));
+    memcpy(pInputBuffer, &input[0], input.size());
+    memcpy(pInputBufferlow, &inputLow[0], inputLow.size());
+    memcpy(&inputMid[0], &input[0], input.size());
+    EXPECT_EQ(0, I360SCVP_process(&param, pI360SCVP));
+    EXPECT_TRUE(std::vector<uint8_t>(pOutputBuffer, pOutputBuffer + param.outputBitstreamLen) == output);
+
+    // the high, the mid and the low tier tiles are in 4, 2 and 3 columns of 5 tiles
+    param_360SCVP parserParam;
+    memset(&parserParam, 0, sizeof(param_360SCVP));
+    parserParam.usedType = E_PARSER_ONENAL;
+    void* pParser = I360SCVP_Init(&parserParam);
+    ASSERT_TRUE(pParser != NULL);
+    std::vector<Nalu> nalus(100);
+    int32_t naluNum = I360SCVP_ParseAccessUnit(pParser, &output[0], (int32_t)output.size(), &nalus[0], (int32_t)nalus.size());
+    int32_t slices = 0;
+    for (int32_t i = 0; i < naluNum; i++)
+    {
+        if (nalus[i].naluType < 32 && nalus[i].sliceHeaderLen)
+            slices++;
+    }
+    EXPECT_EQ(20 + 10 + 15, slices);
+    Param_PicInfo picInfo;
+    Param_PicInfo* pPicInfo = &picInfo;
+    EXPECT_EQ(0, I360SCVP_GetParameter(pParser, ID_SCVP_PARAM_PICINFO, (void**)&pPicInfo));
+    EXPECT_EQ(4 * 384 + 2 * 384 + 3 * 256, pPicInfo->picWidth);
+    EXPECT_EQ(5 * 256, pPicInfo->picHeight);
+    EXPECT_EQ(4 + 2 + 3, pPicInfo->tileWidthNum);
+
+    // the regions of all the tiers are packed without overlapping
+    RegionWisePacking RWPK;
+    RWPK.rectRegionPacking = new RectangularRegionWisePacking[DEFAULT_REGION_NUM];
+    EXPECT_EQ(0, I360SCVP_ParseRWPK(pI360SCVP, &RWPK, param.pOutputSEI, param.outputSEILen));
+    EXPECT_EQ(20 + 10 + 15, RWPK.numRegions);
+    EXPECT_EQ(pPicInfo->picWidth, (int32_t)RWPK.packedPicWidth);
+    std::vector<uint8_t> covered(pPicInfo->picWidth / 128 * pPicInfo->picHeight / 128, 0);
+    for (int32_t i = 0; i < RWPK.numRegions; i++)
+    {
+        RectangularRegionWisePacking* pRegion = &RWPK.rectRegionPacking[i];
+        ASSERT_LE(pRegion->packedRegLeft + pRegion->packedRegWidth, (uint32_t)pPicInfo->picWidth);
+        ASSERT_LE(pRegion->packedRegTop + pRegion->packedRegHeight, (uint32_t)pPicInfo->picHeight);
+        for (uint32_t y = pRegion->packedRegTop / 128; y < (pRegion->packedRegTop + pRegion->packedRegHeight) / 128; y++)
+        {
+            for (uint32_t x = pRegion->packedRegLeft / 128; x < (pRegion->packedRegLeft + pRegion->packedRegWidth) / 128; x++)
+                covered[y * (pPicInfo->picWidth / 128) + x]++;
+        }
+    }
+    for (size_t i = 0; i < covered.size(); i++)
+        EXPECT_EQ(1, covered[i]);
+
+    delete [] RWPK.rectRegionPacking;
+    I360SCVP_unInit(pParser);
+    I360SCVP_unInit(pI360SCVP);
+}
+
+struct PipelineFrames
+{
+    void*                              pPipeline;
+    std::vector<param_360SCVP>        *pParams;
+    std::vector<std::vector<uint8_t> > output;
+    std::vector<int32_t>               ret;
+    int32_t                            viewportFrame;  //the viewport is changed when this frame is done
+    int32_t                            submitNum;      //the callback queues the next frame up to this number, 0 if not
+};
+
+static void onPipelineFrameDone(void* pUserData, param_360SCVP* pParam360SCVP, int32_t ret)
+{
+    PipelineFrames* pFrames = (PipelineFrames*)pUserData;
+    int32_t f = (int32_t)(pParam360SCVP - &(*pFrames->pParams)[0]);
+    pFrames->output.push_back(std::vector<uint8_t>(pParam360SCVP->pOutputBitstream, pParam360SCVP->pOutputBitstream + pParam360SCVP->outputBitstreamLen));
+    pFrames->ret.push_back(ret);
+    EXPECT_EQ((int32_t)pFrames->output.size() - 1, f);
+    // the callback can't wait for its own frame, nor free the pipeline it is called by
+    EXPECT_NE(0, I360SCVP_PipelineFlush(pFrames->pPipeline));
+    EXPECT_NE(0, I360SCVP_PipelineUnInit(pFrames->pPipeline));
+    if (f == pFrames->viewportFrame)
+    {
+        EXPECT_EQ(0, I360SCVP_PipelineSetViewPort(pFrames->pPipeline, 120, 0));
+    }
+    if (f + 1 < pFrames->submitNum)
+    {
+        EXPECT_EQ(0, I360SCVP_processAsync(pFrames->pPipeline, &(*pFrames->pParams)[f + 1]));
+    }
+}
+
+TEST_F(I360SCVPTest, PipelineMerge)
+{
+    param.paramViewPort.faceWidth = 3840;
+    param.paramViewPort.faceHeight = 2048;
+    param.paramViewPort.geoTypeInput = EGeometryType(E_SVIDEO_EQUIRECT);
+    param.paramViewPort.viewportHeight = 960;
+    param.paramViewPort.viewportWidth = 960;
+    param.paramViewPort.geoTypeOutput = E_SVIDEO_VIEWPORT;
+    param.paramViewPort.viewPortYaw = 0;
+    param.paramViewPort.viewPortPitch = 0;
+    param.paramViewPort.viewPortFOVH = 80;
+    param.paramViewPort.viewPortFOVV = 80;
+    param.usedType = E_MERGE_AND_VIEWPORT;
+
+    // each frame is parsed from its own copy of the input, the parsing puts the headers before it
+    static const int32_t frameNum = 5;
+    static const int32_t viewportFrame = 1;
+    std::vector<uint8_t> input(pInputBuffer, pInputBuffer + bufferlen);
+    std::vector<uint8_t> inputLow(pInputBufferlow, pInputBufferlow + bufferlenlow);
+    std::vector<std::vector<uint8_t> > frameInput(frameNum), frameInputLow(frameNum), frameOutput(frameNum), frameSEI(frameNum);
+    std::vector<param_360SCVP> frameParam(frameNum);
+    for (int32_t f = 0; f < frameNum; f++)
+    {
+        frameOutput[f].resize(bufferlen);
+        frameSEI[f].resize(2000);
+        frameParam[f] = param;
+        frameParam[f].pOutputBitstream = &frameOutput[f][0];
+        frameParam[f].pOutputSEI = &frameSEI[f][0];
+    }
+    auto resetInput = [](std::vector<uint8_t>& dst, const std::vector<uint8_t>& src) {
+        dst.assign(src.begin(), src.end());
+        dst.resize(src.size() + 4096);
+    };
+
+    // the frames processed one by one, the viewport is changed after viewportFrame
+    std::vector<std::vector<uint8_t> > expected(frameNum);
+    void* pI360SCVP = I360SCVP_Init(&param);
+    ASSERT_TRUE(pI360SCVP != NULL);
+    for (int32_t f = 0; f < frameNum; f++)
+    {
+        resetInput(frameInput[f], input);
+        resetInput(frameInputLow[f], inputLow);
+        frameParam[f].pInputBitstream = &frameInput[f][0];
+        frameParam[f].pInputLowBitstream = &frameInputLow[f][0];
+        EXPECT_EQ(0, I360SCVP_process(&frameParam[f], pI360SCVP));
+        expected[f].assign(frameOutput[f].begin(), frameOutput[f].begin() + frameParam[f].outputBitstreamLen);
+        if (f == viewportFrame)
+        {
+            EXPECT_EQ(0, I360SCVP_setViewPort(pI360SCVP, 120, 0));
+        }
+    }
+    I360SCVP_unInit(pI360SCVP);
+    EXPECT_FALSE(expected[0] == expected[frameNum - 1]);
+
+    memcpy(pInputBuffer, &input[0], input.size());
+    memcpy(pInputBufferlow, &inputLow[0], inputLow.size());
+    pI360SCVP = I360SCVP_Init(&param);
+    ASSERT_TRUE(pI360SCVP != NULL);
+    PipelineFrames frames;
+    frames.pParams = &frameParam;
+    frames.viewportFrame = viewportFrame;
+    frames.submitNum = 0;
+    EXPECT_TRUE(I360SCVP_PipelineInit(NULL, &param, 2, onPipelineFrameDone, &frames) == NULL);
+    EXPECT_TRUE(I360SCVP_PipelineInit(pI360SCVP, &param, 0, onPipelineFrameDone, &frames) == NULL);
+    EXPECT_TRUE(I360SCVP_PipelineInit(pI360SCVP, &param, 2, NULL, &frames) == NULL);
+    EXPECT_NE(0, I360SCVP_processAsync(NULL, &frameParam[0]));
+    frames.pPipeline = I360SCVP_PipelineInit(pI360SCVP, &param, 3, onPipelineFrameDone, &frames);
+    ASSERT_TRUE(frames.pPipeline != NULL);
+    EXPECT_NE(0, I360SCVP_processAsync(frames.pPipeline, NULL));
+
+    // the frames after the one whose callback changes the viewport are merged with the new viewport
+    for (int32_t f = 0; f < frameNum; f++)
+    {
+        resetInput(frameInput[f], input);
+        resetInput(frameInputLow[f], inputLow);
+        frameParam[f].pInputBitstream = &frameInput[f][0];
+        frameParam[f].pInputLowBitstream = &frameInputLow[f][0];
+        frameParam[f].outputBitstreamLen = 0;
+    }
+    for (int32_t f = 0; f < frameNum; f++)
+        EXPECT_EQ(0, I360SCVP_processAsync(frames.pPipeline, &frameParam[f]));
+    EXPECT_EQ(0, I360SCVP_PipelineFlush(frames.pPipeline));
+    ASSERT_EQ((size_t)frameNum, frames.output.size());
+    for (int32_t f = 0; f < frameNum; f++)
+    {
+        EXPECT_EQ(0, frames.ret[f]);
+        EXPECT_TRUE(frames.output[f] == expected[f]);
+    }
+
+    // the handle can be used again once the pipeline is freed
+    EXPECT_EQ(0, I360SCVP_PipelineUnInit(frames.pPipeline));
+    resetInput(frameInput[0], input);
+    resetInput(frameInputLow[0], inputLow);
+    frameParam[0].pInputBitstream = &frameInput[0][0];
+    frameParam[0].pInputLowBitstream = &frameInputLow[0][0];
+    EXPECT_EQ(0, I360SCVP_process(&frameParam[0], pI360SCVP));
+    EXPECT_EQ(expected[frameNum - 1].size(), (size_t)frameParam[0].outputBitstreamLen);
+    EXPECT_EQ(0, memcmp(&expected[frameNum - 1][0], &frameOutput[0][0], expected[frameNum - 1].size()));
+    I360SCVP_unInit(pI360SCVP);
+
+    // the callback of a frame can queue the next one while the queue is full
+    memcpy(pInputBuffer, &input[0], input.size());
+    memcpy(pInputBufferlow, &inputLow[0], inputLow.size());
+    pI360SCVP = I360SCVP_Init(&param);
+    ASSERT_TRUE(pI360SCVP != NULL);
+    PipelineFrames chained;
+    chained.pParams = &frameParam;
+    chained.viewportFrame = viewportFrame;
+    chained.submitNum = frameNum;
+    chained.pPipeline = I360SCVP_PipelineInit(pI360SCVP, &param, 1, onPipelineFrameDone, &chained);
+    ASSERT_TRUE(chained.pPipeline != NULL);
+    for (int32_t f = 0; f < frameNum; f++)
+    {
+        resetInput(frameInput[f], input);
+        resetInput(frameInputLow[f], inputLow);
+        frameParam[f].pInputBitstream = &frameInput[f][0];
+        frameParam[f].pInputLowBitstream = &frameInputLow[f][0];
+        frameParam[f].outputBitstreamLen = 0;
+    }
+    EXPECT_EQ(0, I360SCVP_processAsync(chained.pPipeline, &frameParam[0]));
+    EXPECT_EQ(0, I360SCVP_PipelineFlush(chained.pPipeline));
+    ASSERT_EQ((size_t)frameNum, chained.output.size());
+    for (int32_t f = 0; f < frameNum; f++)
+    {
+        EXPECT_EQ(0, chained.ret[f]);
+        EXPECT_TRUE(chained.output[f] == expected[f]);
+    }
+    EXPECT_EQ(0, I360SCVP_PipelineUnInit(chained.pPipeline));
+    I360SCVP_unInit(pI360SCVP);
+}
+
 }
@@ -164,6 +164,10 @@ int OmafExtractorSelector::SetInitialViewport( std::vector<Viewport*>& pView, He
     mParamViewport->m_tileNumCol = pStream->GetColSize();
     mParamViewport->m_pUpLeft = new point[6];
     mParamViewport->m_pDownRight = new point[6];
+    mParamViewport->m_lutYawStep = 0;
+    mParamViewport->m_lutPitchStep = 0;
+    mParamViewport->m_mappingMode = E_VIEWPORT_MAPPING_FULL;
+    mParamViewport->m_precision = E_VIEWPORT_PRECISION_DOUBLE;
 
     m360ViewPortHandle = genViewport_Init(mParamViewport);
     if(!m360ViewPortHandle)
@@ -232,17 +236,17 @@ OmafExtractor* OmafExtractorSelector::SelectExtractor(OmafMediaStream* pStream,
 {
     // to select extractor;
     int ret = genViewport_setViewPort(m360ViewPortHandle, pose->yaw, pose->pitch);
-    if(ret != 0)
-        return NULL;
-    ret = genViewport_process(mParamViewport, m360ViewPortHandle);
     if(ret != 0)
         return NULL;
 
-    // get Content Coverage from 360SCVP library
+    // get Content Coverage from 360SCVP library, together with the viewport range
     CCDef* outCC = new CCDef;
-    ret = genViewport_getContentCoverage(m360ViewPortHandle, outCC);
-    if(ret != 0)
+    ret = genViewport_processSelection(mParamViewport, m360ViewPortHandle, NULL, outCC);
+    if(ret < 0)
+    {
+        delete outCC;
         return NULL;
+    }
 
     // get the extractor with largest intersection
     OmafExtractor *selectedExtractor = GetNearestExtractor(pStream, outCC);
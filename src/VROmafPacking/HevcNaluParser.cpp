@@ -279,63 +279,47 @@ int32_t HevcNaluParser::ParseSliceNalu(
     if (!frameData || !frameDataSize || !tilesNum || !tilesInfo)
         return OMAF_ERROR_BAD_PARAM;
 
-    m_360scvpParam->pInputBitstream = frameData;
-    m_360scvpParam->inputBitstreamLen = frameDataSize;
-    uint32_t restBSBytes = m_360scvpParam->inputBitstreamLen;
+    // index all nalus of the frame in one pass, the array is kept for
+    // the next frames and only grows when the frame has more nalus
+    if (m_frameNalus.size() < (size_t)tilesNum + 8)
+        m_frameNalus.resize(tilesNum + 8);
 
-    while (restBSBytes > 0)
+    int32_t naluNum = I360SCVP_ParseAccessUnit(m_360scvpHandle, frameData, frameDataSize, m_frameNalus.data(), (int32_t)m_frameNalus.size());
+    if (naluNum > (int32_t)m_frameNalus.size())
     {
-        Nalu *tempNalu = new Nalu;
-        tempNalu->data = m_360scvpParam->pInputBitstream;
-        tempNalu->dataSize = restBSBytes;
-        I360SCVP_ParseNAL(tempNalu, m_360scvpHandle);
-        if (tempNalu->naluType == 32 || tempNalu->naluType == 33
-        || tempNalu->naluType == 34 || tempNalu->naluType == 39
-        || tempNalu->naluType == 40) // skip VPS/SPS/PPS/SEI
-        {
-            m_360scvpParam->pInputBitstream = m_360scvpParam->pInputBitstream + tempNalu->dataSize;
-            restBSBytes -= tempNalu->dataSize;
-            delete tempNalu;
-            tempNalu = NULL;
-        }
+        m_frameNalus.resize(naluNum);
+        naluNum = I360SCVP_ParseAccessUnit(m_360scvpHandle, frameData, frameDataSize, m_frameNalus.data(), naluNum);
+    }
+    if (naluNum <= 0 || m_frameNalus[0].data != frameData)
+        return OMAF_ERROR_INVALID_FRAME_BITSTREAM;
+
+    int32_t naluIdx = 0;
+    while (naluIdx < naluNum)
+    {
+        uint16_t naluType = m_frameNalus[naluIdx].naluType;
+        if (naluType == 32 || naluType == 33
+        || naluType == 34 || naluType == 39
+        || naluType == 40) // skip VPS/SPS/PPS/SEI
+            naluIdx++;
         else
-        {
-            delete tempNalu;
-            tempNalu = NULL;
             break;
-        }
     }
 
-    uint32_t restBitstreamLen = restBSBytes;
+    if (naluNum - naluIdx < tilesNum)
+        return OMAF_ERROR_INVALID_FRAME_BITSTREAM;
+
+    m_360scvpParam->pInputBitstream = m_frameNalus[naluIdx].data;
+    m_360scvpParam->inputBitstreamLen = frameDataSize;
+
     for (uint16_t tileIdx = 0; tileIdx < tilesNum; tileIdx++)
     {
         TileInfo *tileInfo = &(tilesInfo[tileIdx]);
         Nalu *nalu         = tileInfo->tileNalu;
 
-        if (tileIdx == 0)
-        {
-            nalu->data       = m_360scvpParam->pInputBitstream;
-            nalu->dataSize   = restBitstreamLen;
-        }
-        else
-        {
-            TileInfo *tileInfoPrev = &(tilesInfo[tileIdx - 1]);
-            Nalu *naluPrev         = tileInfoPrev->tileNalu;
-            nalu->data             = naluPrev->data + naluPrev->dataSize;
-            nalu->dataSize         = restBitstreamLen;
-        }
-
-        uint8_t *startPos = nalu->data;
-
-        I360SCVP_ParseNAL(nalu, m_360scvpHandle);
-
-        if (nalu->data != startPos)
-            return OMAF_ERROR_INVALID_FRAME_BITSTREAM;
+        *nalu = m_frameNalus[naluIdx + tileIdx];
 
         nalu->sliceHeaderLen = nalu->sliceHeaderLen - HEVC_NALUHEADER_LEN;
 
-        restBitstreamLen = restBitstreamLen - nalu->dataSize;
-
         uint64_t actualSize = nalu->dataSize - HEVC_STARTCODES_LEN;
         nalu->data[0] = (uint8_t)((0xff000000 & actualSize) >> 24);
         nalu->data[1] = (uint8_t)((0x00ff0000 & actualSize) >> 16);
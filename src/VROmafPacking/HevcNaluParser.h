@@ -37,6 +37,7 @@
 #ifndef _HEVCNALUPARSER_H_
 #define _HEVCNALUPARSER_H_
 
+#include <vector>
 #include "NaluParser.h"
 
 VCD_NS_BEGIN
@@ -173,6 +174,7 @@ private:
     virtual int16_t ParseProjectionTypeSei();
 
 private:
+    std::vector<Nalu> m_frameNalus;   //!< the nalus of the current frame, indexed in one pass
 };
 
 VCD_NS_END;
@@ -283,7 +283,7 @@ int32_t OneVideoExtractorTrackGenerator::Initialize()
     if (!m_tilesInViewport)
         return OMAF_ERROR_NULL_PTR;
 
-    m_viewInfo = new Param_ViewPortInfo;
+    m_viewInfo = new Param_ViewPortInfo();
     if (!m_viewInfo)
         return OMAF_ERROR_NULL_PTR;
 
@@ -299,6 +299,8 @@ int32_t OneVideoExtractorTrackGenerator::Initialize()
     m_viewInfo->faceHeight     = (m_initInfo->viewportInfo)->inHeight;
     m_viewInfo->tileNumRow     = (m_initInfo->viewportInfo)->tileInCol;
     m_viewInfo->tileNumCol     = (m_initInfo->viewportInfo)->tileInRow;
+    m_viewInfo->mappingMode    = E_VIEWPORT_MAPPING_FULL;
+    m_viewInfo->precision      = E_VIEWPORT_PRECISION_DOUBLE;
 
     ret = I360SCVP_SetParameter(m_360scvpHandle, ID_SCVP_PARAM_VIEWPORT, (void*)m_viewInfo);
     if (ret)
@@ -316,6 +318,8 @@ int32_t OneVideoExtractorTrackGenerator::Initialize()
     m_360scvpParam->paramViewPort.faceHeight     = (m_initInfo->viewportInfo)->inHeight;
     m_360scvpParam->paramViewPort.tileNumRow     = (m_initInfo->viewportInfo)->tileInCol;
     m_360scvpParam->paramViewPort.tileNumCol     = (m_initInfo->viewportInfo)->tileInRow;
+    m_360scvpParam->paramViewPort.mappingMode    = E_VIEWPORT_MAPPING_FULL;
+    m_360scvpParam->paramViewPort.precision      = E_VIEWPORT_PRECISION_DOUBLE;
 
     ret = I360SCVP_process(m_360scvpParam, m_360scvpHandle);
     if (ret)